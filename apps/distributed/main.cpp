@@ -0,0 +1,517 @@
+#include <mpi.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bodies.hpp"
+#include "domain.hpp"
+#include "initial_conditions.hpp"
+#include "integrator.hpp"
+#include "octree.hpp"
+#include "parallel.hpp"
+#include "scheduler.hpp"
+#include "simd.hpp"
+#include "snapshot.hpp"
+#include "solver.hpp"
+
+// Runs one simulation over several MPI processes, each owning the bodies of one domain along the Morton curve.
+// Before every force computation each rank sends every other rank the locally essential tree for that rank's
+// domain, and computes the forces between its own bodies while the exchange is in flight. The forces of the
+// imported sources on the local bodies are added once they arrived. Domains are recut from the measured force
+// time whenever the ranks drift out of balance. MPI calls abort the job on error, the default error handler.
+
+class DistributedOptions {
+   public:
+    nbody::SolverKind solver     = nbody::SolverKind::BARNES_HUT;
+    nbody::Isa        isa        = nbody::detect_isa();
+    uint64_t          body_count = 256 * 1024;  // Over all ranks
+    uint64_t          steps      = 1000;
+    float             timestep   = 1.0e-3f;
+    float             softening  = 1.0e-2f;
+    float             theta      = 0.5f;
+
+    // Domains are recut when, checked every `rebalance_interval` steps, the slowest rank spent more than
+    // `imbalance_tolerance` times the mean force time since the last cut.
+    uint32_t rebalance_interval  = 10;
+    double   imbalance_tolerance = 1.05;
+
+    // A snapshot of the rank's bodies every `snapshot_interval`-th step, to `snapshot_path` suffixed with the
+    // rank when there are several.
+    std::string snapshot_path;
+    uint32_t    snapshot_interval = 100;
+};
+
+class DistributedApplication {
+   private:
+    static constexpr float GRAVITATIONAL_CONSTANT = 1.0f;
+
+    // Samples per rank for cutting the domains. More give domains of more even work at the cost of a larger
+    // all-gather.
+    static constexpr std::size_t SAMPLES_PER_RANK = 256;
+
+    // Floats per body moved between ranks: position, velocity, mass.
+    static constexpr std::size_t BODY_FLOATS = 7;
+
+    // Floats per essential source: position, mass.
+    static constexpr std::size_t SOURCE_FLOATS = 4;
+
+    DistributedOptions m_options;
+    int                m_rank       = 0;
+    int                m_rank_count = 1;
+
+    nbody::Bodies         m_bodies;
+    std::vector<uint64_t> m_keys;
+    std::vector<uint64_t> m_splitters;
+
+    // The local solver sees the rank's own bodies. The remote one sees them again, massless and all active,
+    // together with the imported sources, which leaves it only the pull of the other domains to compute.
+    std::unique_ptr<nbody::Solver> m_local_solver;
+    std::unique_ptr<nbody::Solver> m_remote_solver;
+    nbody::Bodies                  m_remote;
+    std::vector<uint32_t>          m_local_indices;
+
+    // Tree of the local bodies the essential trees for the other ranks are cut from.
+    nbody::Octree                    m_tree;
+    uint32_t                         m_leaf_size    = 0;
+    float                            m_export_theta = 0.0f;
+    std::vector<nbody::DomainBounds> m_domain_bounds;
+    std::vector<std::vector<float>>  m_exports;
+    std::vector<std::vector<float>>  m_imports;
+    std::vector<MPI_Request>         m_requests;
+
+    // Force time of this rank since the last cut, the weight of its bodies for the next one.
+    double   m_work          = 0.0;
+    uint64_t m_rebalances    = 0;
+    uint64_t m_imported      = 0;
+    double   m_max_imbalance = 1.0;
+
+    std::unique_ptr<nbody::SnapshotWriter> m_snapshot_writer;
+
+   public:
+    explicit DistributedApplication(const DistributedOptions& options) : m_options(options) {
+        MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &m_rank_count);
+
+        m_options.snapshot_interval  = std::max(options.snapshot_interval, 1u);
+        m_options.rebalance_interval = std::max(options.rebalance_interval, 1u);
+
+        nbody::SolverConfig config{};
+        config.kind                   = options.solver;
+        config.softening              = options.softening;
+        config.gravitational_constant = GRAVITATIONAL_CONSTANT;
+        config.isa                    = options.isa;
+        config.theta                  = options.theta;
+        m_local_solver                = nbody::make_solver(config);
+        m_remote_solver               = nbody::make_solver(config);
+
+        // Exact solvers get every remote body. The multipole solver gets the monopoles a tree code with the same
+        // opening angle would use.
+        m_leaf_size    = config.leaf_size;
+        m_export_theta = options.solver == nbody::SolverKind::DIRECT_SUM ? 0.0f : options.theta;
+
+        m_domain_bounds.resize(static_cast<std::size_t>(m_rank_count));
+        m_exports.resize(static_cast<std::size_t>(m_rank_count));
+        m_imports.resize(static_cast<std::size_t>(m_rank_count));
+
+        if (!options.snapshot_path.empty()) {
+            std::string path = options.snapshot_path;
+            if (m_rank_count > 1) {
+                path += "." + std::to_string(m_rank);
+            }
+
+            // Masses never change and compress to almost nothing, the other columns stay mappable in place.
+            nbody::SnapshotWriterConfig snapshot_config{};
+            snapshot_config.encodings[static_cast<std::size_t>(nbody::SnapshotColumn::MASS)] =
+                nbody::ColumnEncoding::SHUFFLED_RLE;
+            m_snapshot_writer = std::make_unique<nbody::SnapshotWriter>(path, snapshot_config);
+        }
+    }
+
+    void run() {
+        generate_initial_bodies();
+
+        // Every body costs the same until there are measurements.
+        rebalance(static_cast<double>(m_bodies.size()));
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        auto start = std::chrono::steady_clock::now();
+
+        // Symplectic Euler like the single node engines.
+        for (uint64_t step = 1; step <= m_options.steps; ++step) {
+            compute_accelerations();
+            nbody::kick(m_bodies, m_options.timestep);
+            nbody::drift(m_bodies, m_options.timestep);
+
+            if (step % m_options.rebalance_interval == 0 && is_imbalanced()) {
+                rebalance(m_work);
+                m_work = 0.0;
+            }
+
+            if (m_snapshot_writer && step % m_options.snapshot_interval == 0) {
+                m_snapshot_writer->write(m_bodies, step, static_cast<double>(step) * m_options.timestep);
+            }
+        }
+
+        if (m_snapshot_writer) {
+            m_snapshot_writer->close();
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t imported = 0;
+        MPI_Reduce(&m_imported, &imported, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+        if (m_rank == 0) {
+            double steps = static_cast<double>(std::max<uint64_t>(m_options.steps, 1));
+            std::cout << m_options.steps << " steps of " << m_options.body_count << " bodies on " << m_rank_count
+                      << " ranks in " << seconds << " s (" << static_cast<double>(m_options.steps) / seconds
+                      << " steps/s), " << static_cast<double>(imported) / steps / m_rank_count
+                      << " imported sources per rank and step, " << m_rebalances << " rebalances, peak imbalance "
+                      << m_max_imbalance << "\n";
+        }
+    }
+
+   private:
+    /* ---- Initial conditions ---- */
+
+    // The disk of the other apps, every rank drawing its share with its own seed, so no rank ever holds all bodies.
+    void generate_initial_bodies() {
+        uint64_t ranks = static_cast<uint64_t>(m_rank_count);
+        uint64_t rank  = static_cast<uint64_t>(m_rank);
+        uint64_t count = m_options.body_count / ranks + (rank < m_options.body_count % ranks ? 1 : 0);
+
+        // Every share orbits like the whole disk, only its bodies weigh their fraction of it.
+        m_bodies = nbody::generate_initial_conditions(nbody::InitialConditions::DISK, count, 1 + rank);
+        std::fill(m_bodies.mass.begin(), m_bodies.mass.end(), 1.0f / static_cast<float>(m_options.body_count));
+    }
+
+    /* ---- Domain decomposition ---- */
+
+    nbody::DomainBounds global_bounds() const {
+        nbody::DomainBounds local = nbody::DomainBounds::of(m_bodies);
+
+        // Negated maxima turn the whole reduction into one minimum.
+        std::array<float, 6> bounds = {local.min_x, local.min_y, local.min_z, -local.max_x, -local.max_y, -local.max_z};
+        MPI_Allreduce(MPI_IN_PLACE, bounds.data(), 6, MPI_FLOAT, MPI_MIN, MPI_COMM_WORLD);
+
+        return {bounds[0], bounds[1], bounds[2], -bounds[3], -bounds[4], -bounds[5]};
+    }
+
+    bool is_imbalanced() {
+        std::array<double, 2> work = {m_work, m_work};
+        MPI_Allreduce(MPI_IN_PLACE, &work[0], 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, &work[1], 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+        double mean      = work[1] / m_rank_count;
+        double imbalance = mean > 0.0 ? work[0] / mean : 1.0;
+        m_max_imbalance  = std::max(m_max_imbalance, imbalance);
+        return imbalance > m_options.imbalance_tolerance;
+    }
+
+    // Recuts the domains so that each gets the same share of `work`, the cost of this rank's bodies, and moves
+    // every body to the rank owning its key. Bodies leave sorted by key, so each rank's share is contiguous.
+    void rebalance(double work) {
+        ++m_rebalances;
+
+        std::size_t count = m_bodies.size();
+        m_keys.resize(count);
+        nbody::compute_domain_keys(m_bodies, global_bounds(), m_keys);
+
+        std::vector<uint32_t> order(count);
+        std::iota(order.begin(), order.end(), 0u);
+        nbody::parallel_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return m_keys[a] < m_keys[b] || (m_keys[a] == m_keys[b] && a < b);
+        });
+
+        std::vector<uint64_t> sorted_keys(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            sorted_keys[i] = m_keys[order[i]];
+        }
+
+        std::vector<nbody::DomainSample> samples = nbody::sample_domain(sorted_keys, work, SAMPLES_PER_RANK);
+        m_splitters = nbody::choose_splitters(all_gather_samples(samples), static_cast<std::size_t>(m_rank_count));
+
+        std::size_t        ranks = static_cast<std::size_t>(m_rank_count);
+        std::vector<int>   send_counts(ranks);
+        std::vector<int>   send_offsets(ranks);
+        std::vector<float> outgoing(count * BODY_FLOATS);
+        for (std::size_t rank = 0; rank < ranks; ++rank) {
+            auto begin = std::lower_bound(sorted_keys.begin(), sorted_keys.end(), m_splitters[rank]);
+            auto end   = rank + 1 < ranks ? std::lower_bound(begin, sorted_keys.end(), m_splitters[rank + 1])
+                                          : sorted_keys.end();
+
+            send_offsets[rank] = static_cast<int>((begin - sorted_keys.begin()) * BODY_FLOATS);
+            send_counts[rank]  = static_cast<int>((end - begin) * BODY_FLOATS);
+        }
+
+        for (std::size_t i = 0; i < count; ++i) {
+            uint32_t index = order[i];
+            float*   body  = outgoing.data() + i * BODY_FLOATS;
+            body[0]        = m_bodies.x[index];
+            body[1]        = m_bodies.y[index];
+            body[2]        = m_bodies.z[index];
+            body[3]        = m_bodies.vx[index];
+            body[4]        = m_bodies.vy[index];
+            body[5]        = m_bodies.vz[index];
+            body[6]        = m_bodies.mass[index];
+        }
+
+        std::vector<int> receive_counts(ranks);
+        MPI_Alltoall(send_counts.data(), 1, MPI_INT, receive_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+
+        std::vector<int> receive_offsets(ranks);
+        std::exclusive_scan(receive_counts.begin(), receive_counts.end(), receive_offsets.begin(), 0);
+
+        std::vector<float> incoming(static_cast<std::size_t>(receive_offsets.back() + receive_counts.back()));
+        MPI_Alltoallv(outgoing.data(), send_counts.data(), send_offsets.data(), MPI_FLOAT, incoming.data(),
+                      receive_counts.data(), receive_offsets.data(), MPI_FLOAT, MPI_COMM_WORLD);
+
+        m_bodies.resize(incoming.size() / BODY_FLOATS);
+        for (std::size_t i = 0; i < m_bodies.size(); ++i) {
+            const float* body = incoming.data() + i * BODY_FLOATS;
+            m_bodies.x[i]     = body[0];
+            m_bodies.y[i]     = body[1];
+            m_bodies.z[i]     = body[2];
+            m_bodies.vx[i]    = body[3];
+            m_bodies.vy[i]    = body[4];
+            m_bodies.vz[i]    = body[5];
+            m_bodies.mass[i]  = body[6];
+        }
+
+        m_local_indices.resize(m_bodies.size());
+        std::iota(m_local_indices.begin(), m_local_indices.end(), 0u);
+    }
+
+    std::vector<nbody::DomainSample> all_gather_samples(const std::vector<nbody::DomainSample>& samples) {
+        std::size_t ranks = static_cast<std::size_t>(m_rank_count);
+        int         bytes = static_cast<int>(samples.size() * sizeof(nbody::DomainSample));
+
+        std::vector<int> counts(ranks);
+        MPI_Allgather(&bytes, 1, MPI_INT, counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+
+        std::vector<int> offsets(ranks);
+        std::exclusive_scan(counts.begin(), counts.end(), offsets.begin(), 0);
+
+        std::vector<nbody::DomainSample> all(static_cast<std::size_t>(offsets.back() + counts.back()) /
+                                             sizeof(nbody::DomainSample));
+        MPI_Allgatherv(samples.data(), bytes, MPI_BYTE, all.data(), counts.data(), offsets.data(), MPI_BYTE,
+                       MPI_COMM_WORLD);
+        return all;
+    }
+
+    /* ---- Forces ---- */
+
+    void compute_accelerations() {
+        post_essential_tree_exchange();
+
+        // The scheduler's workers compute the local forces while this thread drives the exchange. MPI is only
+        // ever called from this thread. Without workers the task runs inside `wait` and the exchange completes
+        // afterwards.
+        nbody::Scheduler& scheduler = nbody::Scheduler::global();
+        nbody::TaskGroup  group;
+        double            local_seconds = 0.0;
+
+        scheduler.spawn(group, [&] {
+            auto start = std::chrono::steady_clock::now();
+            m_local_solver->compute_accelerations(m_bodies);
+            local_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        });
+
+        bool exchanged = false;
+        while (scheduler.worker_count() > 0 && !group.done() && !exchanged) {
+            int flag = 0;
+            MPI_Testall(static_cast<int>(m_requests.size()), m_requests.data(), &flag, MPI_STATUSES_IGNORE);
+            exchanged = flag != 0;
+            std::this_thread::yield();
+        }
+        scheduler.wait(group);
+        MPI_Waitall(static_cast<int>(m_requests.size()), m_requests.data(), MPI_STATUSES_IGNORE);
+
+        auto start = std::chrono::steady_clock::now();
+        add_remote_accelerations();
+        m_work += local_seconds + std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Cuts the essential tree of every other rank from the local tree and starts sending them. Sizes go first in
+    // one all-to-all, so the payloads can be received straight into buffers of the right size.
+    void post_essential_tree_exchange() {
+        std::size_t ranks = static_cast<std::size_t>(m_rank_count);
+
+        nbody::DomainBounds local = nbody::DomainBounds::of(m_bodies);
+        MPI_Allgather(&local, sizeof(local), MPI_BYTE, m_domain_bounds.data(), sizeof(local), MPI_BYTE,
+                      MPI_COMM_WORLD);
+
+        m_tree.build(m_bodies, m_leaf_size);
+        nbody::parallel_for(ranks, 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t rank = begin; rank < end; ++rank) {
+                m_exports[rank].clear();
+                if (rank != static_cast<std::size_t>(m_rank)) {
+                    nbody::append_essential_sources(m_tree, m_domain_bounds[rank], m_export_theta, m_exports[rank]);
+                }
+            }
+        });
+
+        std::vector<int> send_counts(ranks);
+        for (std::size_t rank = 0; rank < ranks; ++rank) {
+            send_counts[rank] = static_cast<int>(m_exports[rank].size());
+        }
+
+        std::vector<int> receive_counts(ranks);
+        MPI_Alltoall(send_counts.data(), 1, MPI_INT, receive_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+
+        m_requests.clear();
+        for (std::size_t rank = 0; rank < ranks; ++rank) {
+            m_imports[rank].resize(static_cast<std::size_t>(receive_counts[rank]));
+            if (receive_counts[rank] > 0) {
+                MPI_Request request;
+                MPI_Irecv(m_imports[rank].data(), receive_counts[rank], MPI_FLOAT, static_cast<int>(rank), 0,
+                          MPI_COMM_WORLD, &request);
+                m_requests.push_back(request);
+            }
+        }
+        for (std::size_t rank = 0; rank < ranks; ++rank) {
+            if (send_counts[rank] > 0) {
+                MPI_Request request;
+                MPI_Isend(m_exports[rank].data(), send_counts[rank], MPI_FLOAT, static_cast<int>(rank), 0,
+                          MPI_COMM_WORLD, &request);
+                m_requests.push_back(request);
+            }
+        }
+    }
+
+    void add_remote_accelerations() {
+        std::size_t local_count  = m_bodies.size();
+        std::size_t import_count = 0;
+        for (const auto& sources : m_imports) {
+            import_count += sources.size() / SOURCE_FLOATS;
+        }
+        m_imported += import_count;
+
+        if (import_count == 0 || local_count == 0) {
+            return;
+        }
+
+        m_remote.resize(local_count + import_count);
+        std::copy(m_bodies.x.begin(), m_bodies.x.end(), m_remote.x.begin());
+        std::copy(m_bodies.y.begin(), m_bodies.y.end(), m_remote.y.begin());
+        std::copy(m_bodies.z.begin(), m_bodies.z.end(), m_remote.z.begin());
+        std::fill_n(m_remote.mass.begin(), local_count, 0.0f);
+
+        std::size_t next = local_count;
+        for (const auto& sources : m_imports) {
+            for (std::size_t i = 0; i < sources.size(); i += SOURCE_FLOATS, ++next) {
+                m_remote.x[next]    = sources[i];
+                m_remote.y[next]    = sources[i + 1];
+                m_remote.z[next]    = sources[i + 2];
+                m_remote.mass[next] = sources[i + 3];
+            }
+        }
+
+        m_remote_solver->compute_active_accelerations(m_remote, m_local_indices);
+
+        for (std::size_t i = 0; i < local_count; ++i) {
+            m_bodies.ax[i] += m_remote.ax[i];
+            m_bodies.ay[i] += m_remote.ay[i];
+            m_bodies.az[i] += m_remote.az[i];
+        }
+    }
+};
+
+int main(int argc, char** argv) {
+    // Only the main thread talks to MPI, the scheduler's workers only compute.
+    int provided = 0;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    DistributedOptions options{};
+
+    auto fail = [&] {
+        if (rank == 0) {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--solver direct|barnes-hut|fmm] [--isa auto|scalar|neon|avx2|avx512] [--bodies N]"
+                         " [--steps N] [--timestep DT] [--softening EPS] [--theta THETA] [--rebalance-interval N]"
+                         " [--imbalance-tolerance RATIO] [--snapshot PATH] [--snapshot-interval N]\n";
+        }
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    };
+
+    if (provided < MPI_THREAD_FUNNELED) {
+        if (rank == 0) {
+            std::cerr << "main => the MPI library does not support MPI_THREAD_FUNNELED.\n";
+        }
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+
+        if (argument == "--solver" && i + 1 < argc) {
+            std::optional<nbody::SolverKind> solver = nbody::parse_solver_kind(argv[++i]);
+            if (!solver) {
+                return fail();
+            }
+            options.solver = *solver;
+        } else if (argument == "--isa" && i + 1 < argc) {
+            std::optional<nbody::Isa> isa = nbody::parse_isa(argv[++i]);
+            if (!isa) {
+                return fail();
+            }
+            options.isa = *isa;
+        } else if (argument == "--bodies" && i + 1 < argc) {
+            options.body_count = std::strtoull(argv[++i], nullptr, 10);
+        } else if (argument == "--steps" && i + 1 < argc) {
+            options.steps = std::strtoull(argv[++i], nullptr, 10);
+        } else if (argument == "--timestep" && i + 1 < argc) {
+            options.timestep = std::strtof(argv[++i], nullptr);
+        } else if (argument == "--softening" && i + 1 < argc) {
+            options.softening = std::strtof(argv[++i], nullptr);
+        } else if (argument == "--theta" && i + 1 < argc) {
+            options.theta = std::strtof(argv[++i], nullptr);
+        } else if (argument == "--rebalance-interval" && i + 1 < argc) {
+            options.rebalance_interval = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--imbalance-tolerance" && i + 1 < argc) {
+            options.imbalance_tolerance = std::strtod(argv[++i], nullptr);
+        } else if (argument == "--snapshot" && i + 1 < argc) {
+            options.snapshot_path = argv[++i];
+        } else if (argument == "--snapshot-interval" && i + 1 < argc) {
+            options.snapshot_interval = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            return fail();
+        }
+    }
+
+    if (options.body_count == 0 || !(options.timestep > 0.0f)) {
+        return fail();
+    }
+
+    try {
+        DistributedApplication application(options);
+        application.run();
+    } catch (const std::exception& e) {
+        // The other ranks would wait for this one forever.
+        std::cerr << "rank " << rank << ": " << e.what() << "\n";
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    MPI_Finalize();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1042 @@
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bodies.hpp"
+#include "gpu_memory.hpp"
+#include "gpu_tree.hpp"
+#include "initial_conditions.hpp"
+#include "integrator.hpp"
+#include "parallel.hpp"
+#include "pipeline_cache.hpp"
+#include "precision.hpp"
+#include "scheduler.hpp"
+#include "shader_library.hpp"
+#include "simd.hpp"
+#include "snapshot.hpp"
+#include "solver.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+
+// Runs the simulation without a window, surface or swapchain, for machines without a display. The CPU engine
+// steps the bodies with a solver on the task scheduler, the GPU engine runs shaders/nbody.comp, or with
+// `--gpu-tree` the Barnes-Hut passes of `nbody::GpuBarnesHut`, on a compute queue and records many steps per
+// submission. Both stream snapshots to a file and, with `--telemetry`, live frames to remote viewers.
+
+enum class SimulationEngine {
+    GPU,
+    CPU,
+};
+
+class HeadlessOptions {
+   public:
+    SimulationEngine  engine          = SimulationEngine::CPU;
+    nbody::SolverKind solver          = nbody::SolverKind::BARNES_HUT;
+    nbody::Isa        isa             = nbody::detect_isa();
+    nbody::Precision  precision       = nbody::Precision::FP32;
+    bool              block_timesteps = false;
+    bool              gpu_tree        = false;
+    uint32_t          body_count      = 32 * 1024;
+    uint64_t          steps           = 1000;
+    float             timestep        = 1.0e-3f;
+    float             softening       = 1.0e-2f;
+
+    // Barnes-Hut on the CPU engine only, see `nbody::BarnesHutConfig::rebuild_threshold`.
+    float rebuild_threshold = 0.0f;
+
+    // A snapshot of every `snapshot_interval`-th step is streamed to `snapshot_path`.
+    std::string snapshot_path;
+    uint32_t    snapshot_interval = 100;
+
+    // Every `telemetry_interval`-th step is streamed to the viewers connected to `telemetry_port`, if set.
+    std::optional<uint16_t> telemetry_port;
+    uint32_t                telemetry_interval = 10;
+
+    // When set, tracing is on and the events still in the trace rings are written there as a Chrome trace.
+    std::string trace_path;
+};
+
+// Must match the `Parameters` push constant block in shaders/nbody.comp.
+class SimulationPushConstants {
+   public:
+    uint32_t body_count;
+    uint32_t first_target;
+    uint32_t target_count;
+    float    timestep;
+    float    softening_squared;
+    float    gravitational_constant;
+};
+
+// Steps recorded into one submission. Readbacks for snapshots and telemetry end a batch early.
+class ComputeBatch {
+   public:
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    VkFence         done           = VK_NULL_HANDLE;
+
+    // Host visible copy of the positions and velocities at the end of the batch, when it reads them back.
+    VkBuffer             readback_buffer            = VK_NULL_HANDLE;
+    nbody::GpuAllocation readback_buffer_allocation = {};
+
+    std::optional<uint64_t> readback_step;
+};
+
+class HeadlessApplication {
+   private:
+    // Must match `local_size_x` in shaders/nbody.comp.
+    static constexpr uint32_t COMPUTE_WORKGROUP_SIZE = 256;
+
+    static constexpr float GRAVITATIONAL_CONSTANT = 1.0f;
+
+    // Enough steps per submission that the submit and fence wait are negligible against the dispatches.
+    static constexpr uint64_t MAX_BATCH_STEPS = 64;
+
+    static constexpr std::size_t UNPACK_GRAIN = 16 * 1024;
+
+    static constexpr const char* PIPELINE_CACHE_FILE = "headless_pipeline_cache.bin";
+
+#ifdef NDEBUG
+    static constexpr bool ENABLE_VALIDATION_LAYERS = false;
+#else
+    static constexpr bool ENABLE_VALIDATION_LAYERS = true;
+#endif
+
+    HeadlessOptions m_options;
+    nbody::Bodies   m_bodies;
+
+    std::unique_ptr<nbody::SnapshotWriter> m_snapshot_writer;
+
+    // Step timing for the telemetry, measured between the frames it publishes.
+    std::unique_ptr<nbody::TelemetryServer> m_telemetry;
+    uint64_t                                m_telemetry_step = 0;
+    std::chrono::steady_clock::time_point   m_telemetry_time;
+
+    // CPU engine.
+    std::unique_ptr<nbody::Solver>                m_cpu_solver;
+    std::optional<nbody::BlockTimestepIntegrator> m_block_integrator;
+
+    // GPU engine. The state ping-pongs between two slots of storage buffers, descriptor set `i` reads slot `i`
+    // and writes the other one. Two batches alternate, so one batch is recorded and submitted while the GPU
+    // still runs the other and the queue never drains.
+    VkInstance                     m_instance                      = VK_NULL_HANDLE;
+    VkPhysicalDevice               m_physical_device               = VK_NULL_HANDLE;
+    VkDevice                       m_logical_device                = VK_NULL_HANDLE;
+    uint32_t                       m_compute_family                = 0;
+    VkQueue                        m_compute_queue                 = VK_NULL_HANDLE;
+    VkCommandPool                  m_command_pool                  = VK_NULL_HANDLE;
+    VkDescriptorSetLayout          m_compute_descriptor_set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout               m_compute_pipeline_layout       = VK_NULL_HANDLE;
+    VkPipeline                     m_compute_pipeline              = VK_NULL_HANDLE;
+    VkDescriptorPool               m_descriptor_pool               = VK_NULL_HANDLE;
+    std::array<VkDescriptorSet, 2> m_compute_descriptor_sets       = {};
+    std::array<VkBuffer, 2>             m_position_buffers              = {};
+    std::array<nbody::GpuAllocation, 2> m_position_buffer_allocations   = {};
+    std::array<VkBuffer, 2>             m_velocity_buffers              = {};
+    std::array<nbody::GpuAllocation, 2> m_velocity_buffer_allocations   = {};
+    std::array<ComputeBatch, 2>         m_batches                       = {};
+    uint32_t                            m_simulation_read_index         = 0;
+    bool                                m_validation_layers_enabled     = false;
+
+    // Every buffer is suballocated from here.
+    nbody::GpuAllocator m_allocator;
+
+    nbody::PipelineCache m_pipeline_cache;
+    nbody::GpuBarnesHut  m_gpu_tree;
+
+    // `generate_initial_bodies` while `init_vulkan` runs.
+    nbody::TaskGroup m_initial_bodies;
+
+    const std::vector<const char*> m_validation_layers = {"VK_LAYER_KHRONOS_validation"};
+
+   public:
+    explicit HeadlessApplication(const HeadlessOptions& options) : m_options(options) {
+        m_options.snapshot_interval  = std::max(options.snapshot_interval, 1u);
+        m_options.telemetry_interval = std::max(options.telemetry_interval, 1u);
+
+        if (!options.snapshot_path.empty()) {
+            // Masses never change and compress to almost nothing, the other columns stay mappable in place.
+            nbody::SnapshotWriterConfig config{};
+            config.encodings[static_cast<std::size_t>(nbody::SnapshotColumn::MASS)] =
+                nbody::ColumnEncoding::SHUFFLED_RLE;
+            m_snapshot_writer = std::make_unique<nbody::SnapshotWriter>(options.snapshot_path, config);
+        }
+
+        if (options.telemetry_port) {
+            nbody::TelemetryConfig config{};
+            config.port   = *options.telemetry_port;
+            config.solver = solver_config();
+            m_telemetry = std::make_unique<nbody::TelemetryServer>(config);
+            std::cout << "Streaming telemetry on port " << m_telemetry->port() << "\n";
+        }
+    }
+
+    void run() {
+        if (!m_options.trace_path.empty()) {
+            nbody::Tracer::set_enabled(true);
+            nbody::Tracer::global().set_thread_name("main");
+        }
+
+        auto start       = std::chrono::steady_clock::now();
+        m_telemetry_time = start;
+        if (m_options.engine == SimulationEngine::CPU) {
+            generate_initial_bodies();
+            run_cpu();
+        } else {
+            // The disk is generated on a worker while the driver starts up, it is only needed for the upload.
+            nbody::Scheduler::global().spawn(m_initial_bodies, [this] { generate_initial_bodies(); });
+            try {
+                init_vulkan();
+                run_gpu();
+            } catch (...) {
+                // Also after a failed `init_vulkan`, whose objects not created yet are still null.
+                if (m_logical_device != VK_NULL_HANDLE) {
+                    vkDeviceWaitIdle(m_logical_device);
+                }
+                cleanup_vulkan();
+                throw;
+            }
+            cleanup_vulkan();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (m_snapshot_writer) {
+            m_snapshot_writer->close();
+        }
+        if (!m_options.trace_path.empty()) {
+            nbody::Tracer::global().write_chrome_trace(m_options.trace_path);
+        }
+
+        std::cout << m_options.steps << " steps of " << m_options.body_count << " bodies in " << seconds << " s ("
+                  << static_cast<double>(m_options.steps) / seconds << " steps/s)\n";
+    }
+
+   private:
+    /* ---- Initial conditions, snapshots and telemetry ---- */
+
+    void generate_initial_bodies() {
+        m_bodies = nbody::generate_initial_conditions(nbody::InitialConditions::DISK, m_options.body_count);
+    }
+
+    bool is_snapshot_step(uint64_t step) const noexcept {
+        return m_snapshot_writer && step % m_options.snapshot_interval == 0;
+    }
+
+    // Only the copy happens here, the writer thread encodes and writes while the next steps run.
+    void write_snapshot(uint64_t step) {
+        m_snapshot_writer->write(m_bodies, step, static_cast<double>(step) * m_options.timestep);
+    }
+
+    bool is_telemetry_step(uint64_t step) const noexcept {
+        return m_telemetry && step % m_options.telemetry_interval == 0;
+    }
+
+    // Steps whose state the engines have to hand to the host.
+    bool is_readback_step(uint64_t step) const noexcept { return is_snapshot_step(step) || is_telemetry_step(step); }
+
+    // A copy like `write_snapshot`, or nothing at all when no viewer is connected or the last frame is still
+    // being sent.
+    void publish_telemetry(uint64_t step) {
+        auto now = std::chrono::steady_clock::now();
+
+        nbody::TelemetryStats stats{};
+        stats.step         = step;
+        stats.time         = static_cast<double>(step) * m_options.timestep;
+        stats.step_seconds = std::chrono::duration<double>(now - m_telemetry_time).count() /
+                             static_cast<double>(std::max<uint64_t>(step - m_telemetry_step, 1));
+        m_telemetry->publish(m_bodies, stats);
+
+        m_telemetry_step = step;
+        m_telemetry_time = now;
+    }
+
+    /* ---- CPU engine ---- */
+
+    // What the engine steps with, the GPU one only honors the kind, the softening and the constant.
+    nbody::SolverConfig solver_config() const {
+        nbody::SolverConfig config{};
+        config.kind                   = m_options.solver;
+        config.softening              = m_options.softening;
+        config.gravitational_constant = GRAVITATIONAL_CONSTANT;
+        config.isa                    = m_options.isa;
+        config.precision              = m_options.precision;
+        config.rebuild_threshold      = m_options.rebuild_threshold;
+        if (m_options.engine == SimulationEngine::GPU) {
+            config.kind = m_options.gpu_tree ? nbody::SolverKind::BARNES_HUT : nbody::SolverKind::DIRECT_SUM;
+        }
+        return config;
+    }
+
+    void run_cpu() {
+        m_cpu_solver = nbody::make_solver(solver_config());
+
+        if (m_options.block_timesteps) {
+            nbody::BlockTimestepConfig block_config{};
+            block_config.max_timestep = m_options.timestep;
+            block_config.softening    = m_options.softening;
+            block_config.precision    = m_options.precision;
+            m_block_integrator.emplace(block_config);
+        }
+
+        // Symplectic Euler like shaders/nbody.comp, so both engines follow the same trajectories up to round off.
+        for (uint64_t step = 1; step <= m_options.steps; ++step) {
+            NBODY_TRACE_ZONE("cpu.step");
+
+            if (m_block_integrator) {
+                m_block_integrator->step(m_bodies, *m_cpu_solver);
+            } else {
+                m_cpu_solver->compute_accelerations(m_bodies);
+                nbody::kick(m_bodies, m_options.timestep);
+                nbody::drift(m_bodies, m_options.timestep, m_options.precision);
+            }
+
+            if (is_snapshot_step(step)) {
+                write_snapshot(step);
+            }
+            if (is_telemetry_step(step)) {
+                publish_telemetry(step);
+            }
+        }
+    }
+
+    /* ---- GPU engine ---- */
+
+    void init_vulkan() {
+        try {
+            create_instance();
+            pick_physical_device();
+            create_logical_device();
+            m_allocator.create(m_logical_device, m_physical_device);
+            create_compute_descriptor_set_layout();
+
+            m_pipeline_cache.create(m_logical_device, m_physical_device,
+                                    nbody::default_cache_path(PIPELINE_CACHE_FILE));
+            create_compute_pipeline();
+            if (m_options.gpu_tree) {
+                create_gpu_tree();
+            }
+
+            // A failed save only costs the next run its warm start.
+            if (!m_pipeline_cache.save()) {
+                std::cerr << "HeadlessApplication::init_vulkan => failed to write pipeline cache to "
+                          << m_pipeline_cache.path() << "\n";
+            }
+
+            create_command_pool();
+        } catch (...) {
+            // The generation writes to this application, so it has to finish before the exception unwinds it.
+            nbody::Scheduler::global().wait(m_initial_bodies);
+            throw;
+        }
+
+        nbody::Scheduler::global().wait(m_initial_bodies);
+        create_simulation_buffers();
+        create_descriptor_sets();
+        create_batches();
+
+        // Nothing allocates after this, so the block that held the staging buffer can go.
+        m_allocator.trim();
+    }
+
+    // Also undoes a partial `init_vulkan`. Objects not created yet are null, which the destroy calls ignore as
+    // long as there is a device, and without one nothing but the instance can exist.
+    void cleanup_vulkan() {
+        if (m_logical_device != VK_NULL_HANDLE) {
+            for (auto& batch : m_batches) {
+                vkDestroyFence(m_logical_device, batch.done, nullptr);
+                m_allocator.destroy_buffer(batch.readback_buffer, batch.readback_buffer_allocation);
+            }
+
+            vkDestroyDescriptorPool(m_logical_device, m_descriptor_pool, nullptr);
+
+            for (std::size_t i = 0; i < m_position_buffers.size(); ++i) {
+                m_allocator.destroy_buffer(m_position_buffers[i], m_position_buffer_allocations[i]);
+                m_allocator.destroy_buffer(m_velocity_buffers[i], m_velocity_buffer_allocations[i]);
+            }
+
+            vkDestroyCommandPool(m_logical_device, m_command_pool, nullptr);
+            m_gpu_tree.destroy();
+            vkDestroyPipeline(m_logical_device, m_compute_pipeline, nullptr);
+            vkDestroyPipelineLayout(m_logical_device, m_compute_pipeline_layout, nullptr);
+            vkDestroyDescriptorSetLayout(m_logical_device, m_compute_descriptor_set_layout, nullptr);
+            m_pipeline_cache.destroy();
+            m_allocator.destroy();
+
+            vkDestroyDevice(m_logical_device, nullptr);
+            m_logical_device = VK_NULL_HANDLE;
+        }
+
+        vkDestroyInstance(m_instance, nullptr);
+        m_instance = VK_NULL_HANDLE;
+    }
+
+    // No surface extensions are needed. Validation layers are enabled in debug builds when they are installed,
+    // compute nodes often only have the driver.
+    void create_instance() {
+        m_validation_layers_enabled = ENABLE_VALIDATION_LAYERS && check_validation_layer_support();
+
+        VkApplicationInfo application_info{};
+        application_info.sType              = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        application_info.pApplicationName   = "headless";
+        application_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+        application_info.pEngineName        = "no_engine";
+        application_info.engineVersion      = VK_MAKE_VERSION(1, 0, 0);
+        application_info.apiVersion         = VK_API_VERSION_1_1;
+
+        VkInstanceCreateInfo create_info{};
+        create_info.sType            = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        create_info.pApplicationInfo = &application_info;
+        if (m_validation_layers_enabled) {
+            create_info.enabledLayerCount   = static_cast<uint32_t>(m_validation_layers.size());
+            create_info.ppEnabledLayerNames = m_validation_layers.data();
+        }
+
+        if (vkCreateInstance(&create_info, nullptr, &m_instance) != VK_SUCCESS) {
+            throw std::runtime_error("HeadlessApplication::create_instance => failed to create a Vulkan instance.");
+        }
+    }
+
+    bool check_validation_layer_support() {
+        uint32_t layer_count = 0;
+        vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+
+        std::vector<VkLayerProperties> available_layers(layer_count);
+        vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
+
+        return std::all_of(m_validation_layers.begin(), m_validation_layers.end(), [&](const char* name) {
+            return std::any_of(available_layers.begin(), available_layers.end(),
+                               [&](const VkLayerProperties& layer) { return std::strcmp(name, layer.layerName) == 0; });
+        });
+    }
+
+    // Prefers discrete GPUs, then a compute family without graphics support on the chosen device.
+    void pick_physical_device() {
+        uint32_t count = 0;
+        vkEnumeratePhysicalDevices(m_instance, &count, nullptr);
+
+        std::vector<VkPhysicalDevice> devices(count);
+        vkEnumeratePhysicalDevices(m_instance, &count, devices.data());
+
+        int best_score = -1;
+        for (VkPhysicalDevice device : devices) {
+            std::optional<uint32_t> family = find_compute_family(device);
+            if (!family) {
+                continue;
+            }
+
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(device, &properties);
+
+            int score = properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU     ? 2
+                        : properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ? 1
+                                                                                          : 0;
+            if (score > best_score) {
+                best_score        = score;
+                m_physical_device = device;
+                m_compute_family  = *family;
+            }
+        }
+
+        if (m_physical_device == VK_NULL_HANDLE) {
+            throw std::runtime_error(
+                "HeadlessApplication::pick_physical_device => failed to find a GPU with a compute queue.");
+        }
+    }
+
+    static std::optional<uint32_t> find_compute_family(VkPhysicalDevice device) {
+        uint32_t count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &count, nullptr);
+
+        std::vector<VkQueueFamilyProperties> families(count);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &count, families.data());
+
+        std::optional<uint32_t> result;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!(families[i].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+                continue;
+            }
+            if (!(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+                return i;
+            }
+            if (!result) {
+                result = i;
+            }
+        }
+        return result;
+    }
+
+    void create_logical_device() {
+        float queue_priority = 1.0f;
+
+        VkDeviceQueueCreateInfo queue_create_info{};
+        queue_create_info.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queue_create_info.queueFamilyIndex = m_compute_family;
+        queue_create_info.queueCount       = 1;
+        queue_create_info.pQueuePriorities = &queue_priority;
+
+        VkPhysicalDeviceFeatures physical_device_features{};
+
+        VkDeviceCreateInfo create_info{};
+        create_info.sType                = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        create_info.queueCreateInfoCount = 1;
+        create_info.pQueueCreateInfos    = &queue_create_info;
+        create_info.pEnabledFeatures     = &physical_device_features;
+        if (m_validation_layers_enabled) {
+            create_info.enabledLayerCount   = static_cast<uint32_t>(m_validation_layers.size());
+            create_info.ppEnabledLayerNames = m_validation_layers.data();
+        }
+
+        if (vkCreateDevice(m_physical_device, &create_info, nullptr, &m_logical_device) != VK_SUCCESS) {
+            throw std::runtime_error("HeadlessApplication::create_logical_device => failed to create logical device!");
+        }
+
+        vkGetDeviceQueue(m_logical_device, m_compute_family, 0, &m_compute_queue);
+    }
+
+    void create_compute_descriptor_set_layout() {
+        // 0: positions in, 1: velocities in, 2: positions out, 3: velocities out
+        std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); ++i) {
+            bindings[i].binding            = i;
+            bindings[i].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount    = 1;
+            bindings[i].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
+            bindings[i].pImmutableSamplers = nullptr;
+        }
+
+        VkDescriptorSetLayoutCreateInfo create_info{};
+        create_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        create_info.bindingCount = static_cast<uint32_t>(bindings.size());
+        create_info.pBindings    = bindings.data();
+
+        if (vkCreateDescriptorSetLayout(m_logical_device, &create_info, nullptr, &m_compute_descriptor_set_layout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                "HeadlessApplication::create_compute_descriptor_set_layout => failed to create descriptor set "
+                "layout!");
+        }
+    }
+
+    void create_compute_pipeline() {
+        std::vector<uint32_t>     storage;
+        std::span<const uint32_t> code = nbody::load_shader("shaders/nbody.comp.spv", storage);
+
+        VkShaderModuleCreateInfo module_create_info{};
+        module_create_info.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        module_create_info.codeSize = code.size_bytes();
+        module_create_info.pCode    = code.data();
+
+        VkShaderModule shader_module;
+        if (vkCreateShaderModule(m_logical_device, &module_create_info, nullptr, &shader_module) != VK_SUCCESS) {
+            throw std::runtime_error("HeadlessApplication::create_compute_pipeline => failed to create shader module!");
+        }
+
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constant_range.offset     = 0;
+        push_constant_range.size       = sizeof(SimulationPushConstants);
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.setLayoutCount         = 1;
+        pipeline_layout_info.pSetLayouts            = &m_compute_descriptor_set_layout;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges    = &push_constant_range;
+
+        if (vkCreatePipelineLayout(m_logical_device, &pipeline_layout_info, nullptr, &m_compute_pipeline_layout) !=
+            VK_SUCCESS) {
+            vkDestroyShaderModule(m_logical_device, shader_module, nullptr);
+            throw std::runtime_error(
+                "HeadlessApplication::create_compute_pipeline => failed to create pipeline layout!");
+        }
+
+        // The `PRECISION` specialization constant of the shader.
+        uint32_t                 precision = static_cast<uint32_t>(m_options.precision);
+        VkSpecializationMapEntry precision_entry{0, 0, sizeof(precision)};
+
+        VkSpecializationInfo specialization_info{};
+        specialization_info.mapEntryCount = 1;
+        specialization_info.pMapEntries   = &precision_entry;
+        specialization_info.dataSize      = sizeof(precision);
+        specialization_info.pData         = &precision;
+
+        VkComputePipelineCreateInfo pipeline_create_info{};
+        pipeline_create_info.sType                     = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_create_info.stage.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipeline_create_info.stage.stage               = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipeline_create_info.stage.module              = shader_module;
+        pipeline_create_info.stage.pName               = "main";
+        pipeline_create_info.stage.pSpecializationInfo = &specialization_info;
+        pipeline_create_info.layout                    = m_compute_pipeline_layout;
+        pipeline_create_info.basePipelineHandle        = VK_NULL_HANDLE;
+        pipeline_create_info.basePipelineIndex         = -1;
+
+        VkResult result = vkCreateComputePipelines(m_logical_device, m_pipeline_cache.handle(), 1,
+                                                   &pipeline_create_info, nullptr, &m_compute_pipeline);
+        vkDestroyShaderModule(m_logical_device, shader_module, nullptr);
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error(
+                "HeadlessApplication::create_compute_pipeline => failed to create compute pipeline!");
+        }
+    }
+
+    // Shares the body sets of the direct sum, so switching solvers changes nothing but the recorded passes.
+    void create_gpu_tree() {
+        nbody::GpuBarnesHutConfig config{};
+        config.timestep               = m_options.timestep;
+        config.softening              = m_options.softening;
+        config.gravitational_constant = GRAVITATIONAL_CONSTANT;
+        config.theta                  = nbody::SolverConfig{}.theta;
+
+        m_gpu_tree.create(m_allocator, m_physical_device, m_pipeline_cache.handle(), m_compute_descriptor_set_layout,
+                          m_options.body_count, config);
+    }
+
+    void create_command_pool() {
+        VkCommandPoolCreateInfo create_info{};
+        create_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        create_info.queueFamilyIndex = m_compute_family;
+        create_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+        if (vkCreateCommandPool(m_logical_device, &create_info, nullptr, &m_command_pool) != VK_SUCCESS) {
+            throw std::runtime_error("HeadlessApplication::create_command_pool => failed to create command pool!");
+        }
+    }
+
+    VkDeviceSize state_buffer_size() const noexcept { return sizeof(float) * 4 * m_options.body_count; }
+
+    // Both slots start from the initial state, uploaded through a staging buffer in one submission.
+    void create_simulation_buffers() {
+        VkDeviceSize size = state_buffer_size();
+
+        for (std::size_t i = 0; i < m_position_buffers.size(); ++i) {
+            VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                       VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            m_position_buffers[i] = m_allocator.create_buffer(size, usage, nbody::MemoryUsage::DEVICE_LOCAL,
+                                                              m_position_buffer_allocations[i]);
+            m_velocity_buffers[i] = m_allocator.create_buffer(size, usage, nbody::MemoryUsage::DEVICE_LOCAL,
+                                                              m_velocity_buffer_allocations[i]);
+        }
+
+        nbody::GpuAllocation staging_allocation{};
+        VkBuffer             staging_buffer = m_allocator.create_buffer(
+            2 * size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, nbody::MemoryUsage::HOST_UPLOAD, staging_allocation);
+
+        auto* positions  = static_cast<std::array<float, 4>*>(staging_allocation.mapped);
+        auto* velocities = positions + m_options.body_count;
+        for (std::size_t i = 0; i < m_bodies.size(); ++i) {
+            positions[i]  = {m_bodies.x[i], m_bodies.y[i], m_bodies.z[i], m_bodies.mass[i]};
+            velocities[i] = {m_bodies.vx[i], m_bodies.vy[i], m_bodies.vz[i], 0.0f};
+        }
+
+        VkCommandBuffer command_buffer = allocate_command_buffer();
+
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(command_buffer, &begin_info);
+
+        for (std::size_t i = 0; i < m_position_buffers.size(); ++i) {
+            VkBufferCopy position_region{0, 0, size};
+            VkBufferCopy velocity_region{size, 0, size};
+            vkCmdCopyBuffer(command_buffer, staging_buffer, m_position_buffers[i], 1, &position_region);
+            vkCmdCopyBuffer(command_buffer, staging_buffer, m_velocity_buffers[i], 1, &velocity_region);
+        }
+
+        vkEndCommandBuffer(command_buffer);
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers    = &command_buffer;
+
+        VkResult result = vkQueueSubmit(m_compute_queue, 1, &submit_info, VK_NULL_HANDLE);
+        vkQueueWaitIdle(m_compute_queue);
+
+        vkFreeCommandBuffers(m_logical_device, m_command_pool, 1, &command_buffer);
+        m_allocator.destroy_buffer(staging_buffer, staging_allocation);
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error(
+                "HeadlessApplication::create_simulation_buffers => failed to submit the upload!");
+        }
+    }
+
+    VkCommandBuffer allocate_command_buffer() {
+        VkCommandBufferAllocateInfo allocate_info{};
+        allocate_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocate_info.commandPool        = m_command_pool;
+        allocate_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocate_info.commandBufferCount = 1;
+
+        VkCommandBuffer command_buffer;
+        if (vkAllocateCommandBuffers(m_logical_device, &allocate_info, &command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "HeadlessApplication::allocate_command_buffer => failed to allocate command buffer!");
+        }
+        return command_buffer;
+    }
+
+    void create_descriptor_sets() {
+        VkDescriptorPoolSize pool_size{};
+        pool_size.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        pool_size.descriptorCount = 4 * static_cast<uint32_t>(m_compute_descriptor_sets.size());
+
+        VkDescriptorPoolCreateInfo pool_create_info{};
+        pool_create_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_create_info.poolSizeCount = 1;
+        pool_create_info.pPoolSizes    = &pool_size;
+        pool_create_info.maxSets       = static_cast<uint32_t>(m_compute_descriptor_sets.size());
+
+        if (vkCreateDescriptorPool(m_logical_device, &pool_create_info, nullptr, &m_descriptor_pool) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "HeadlessApplication::create_descriptor_sets => failed to create descriptor pool!");
+        }
+
+        std::array<VkDescriptorSetLayout, 2> layouts = {m_compute_descriptor_set_layout,
+                                                        m_compute_descriptor_set_layout};
+
+        VkDescriptorSetAllocateInfo allocate_info{};
+        allocate_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocate_info.descriptorPool     = m_descriptor_pool;
+        allocate_info.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+        allocate_info.pSetLayouts        = layouts.data();
+
+        if (vkAllocateDescriptorSets(m_logical_device, &allocate_info, m_compute_descriptor_sets.data()) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                "HeadlessApplication::create_descriptor_sets => failed to allocate descriptor sets!");
+        }
+
+        VkDeviceSize size = state_buffer_size();
+        for (std::size_t i = 0; i < m_compute_descriptor_sets.size(); ++i) {
+            std::size_t next = 1 - i;
+
+            std::array<VkDescriptorBufferInfo, 4> buffer_infos = {
+                VkDescriptorBufferInfo{m_position_buffers[i], 0, size},
+                VkDescriptorBufferInfo{m_velocity_buffers[i], 0, size},
+                VkDescriptorBufferInfo{m_position_buffers[next], 0, size},
+                VkDescriptorBufferInfo{m_velocity_buffers[next], 0, size},
+            };
+
+            std::array<VkWriteDescriptorSet, 4> writes{};
+            for (uint32_t binding = 0; binding < writes.size(); ++binding) {
+                writes[binding].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writes[binding].dstSet          = m_compute_descriptor_sets[i];
+                writes[binding].dstBinding      = binding;
+                writes[binding].dstArrayElement = 0;
+                writes[binding].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writes[binding].descriptorCount = 1;
+                writes[binding].pBufferInfo     = &buffer_infos[binding];
+            }
+
+            vkUpdateDescriptorSets(m_logical_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        }
+    }
+
+    void create_batches() {
+        for (auto& batch : m_batches) {
+            batch.command_buffer = allocate_command_buffer();
+
+            // Signaled, so the first wait on a batch that never ran returns at once.
+            VkFenceCreateInfo fence_info{};
+            fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+            if (vkCreateFence(m_logical_device, &fence_info, nullptr, &batch.done) != VK_SUCCESS) {
+                throw std::runtime_error("HeadlessApplication::create_batches => failed to create fence!");
+            }
+
+            if (m_snapshot_writer || m_telemetry) {
+                batch.readback_buffer =
+                    m_allocator.create_buffer(2 * state_buffer_size(), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                              nbody::MemoryUsage::HOST_READBACK, batch.readback_buffer_allocation);
+            }
+        }
+    }
+
+    // Submits batches of steps until `steps` ran. Batch `n` reuses the buffers of batch `n - 2`, so its fence wait
+    // returns at once unless the host got two batches ahead, and its snapshot is unpacked while batch `n - 1` runs.
+    void run_gpu() {
+        uint64_t step  = 0;
+        uint64_t index = 0;
+
+        while (step < m_options.steps) {
+            ComputeBatch& batch = m_batches[index++ % m_batches.size()];
+            finish_batch(batch);
+
+            uint64_t count = std::min(MAX_BATCH_STEPS, m_options.steps - step);
+            if (m_snapshot_writer) {
+                uint64_t next_snapshot = (step / m_options.snapshot_interval + 1) * m_options.snapshot_interval;
+                count                  = std::min(count, next_snapshot - step);
+            }
+            if (m_telemetry) {
+                uint64_t next_frame = (step / m_options.telemetry_interval + 1) * m_options.telemetry_interval;
+                count               = std::min(count, next_frame - step);
+            }
+            step += count;
+
+            batch.readback_step.reset();
+            if (is_readback_step(step)) {
+                batch.readback_step = step;
+            }
+            submit_batch(batch, static_cast<uint32_t>(count));
+        }
+
+        // In submission order, so snapshots and frames go out in step order.
+        for (std::size_t i = 0; i < m_batches.size(); ++i) {
+            finish_batch(m_batches[index++ % m_batches.size()]);
+        }
+    }
+
+    void finish_batch(ComputeBatch& batch) {
+        vkWaitForFences(m_logical_device, 1, &batch.done, VK_TRUE, UINT64_MAX);
+        if (!batch.readback_step) {
+            return;
+        }
+
+        // Without a viewer, a frame that takes no snapshot has nobody to go to.
+        uint64_t step = *batch.readback_step;
+        batch.readback_step.reset();
+        if (!is_snapshot_step(step) && m_telemetry->client_count() == 0) {
+            return;
+        }
+
+        const auto* positions  = static_cast<const std::array<float, 4>*>(batch.readback_buffer_allocation.mapped);
+        const auto* velocities = positions + m_options.body_count;
+
+        nbody::parallel_for(m_bodies.size(), UNPACK_GRAIN, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                m_bodies.x[i]  = positions[i][0];
+                m_bodies.y[i]  = positions[i][1];
+                m_bodies.z[i]  = positions[i][2];
+                m_bodies.vx[i] = velocities[i][0];
+                m_bodies.vy[i] = velocities[i][1];
+                m_bodies.vz[i] = velocities[i][2];
+            }
+        });
+
+        if (is_snapshot_step(step)) {
+            write_snapshot(step);
+        }
+        if (is_telemetry_step(step)) {
+            publish_telemetry(step);
+        }
+    }
+
+    void submit_batch(ComputeBatch& batch, uint32_t count) {
+        vkResetFences(m_logical_device, 1, &batch.done);
+        vkResetCommandBuffer(batch.command_buffer, 0);
+        record_batch(batch, count);
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers    = &batch.command_buffer;
+
+        if (vkQueueSubmit(m_compute_queue, 1, &submit_info, batch.done) != VK_SUCCESS) {
+            throw std::runtime_error("HeadlessApplication::submit_batch => failed to submit compute command buffer!");
+        }
+    }
+
+    void record_batch(ComputeBatch& batch, uint32_t count) {
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(batch.command_buffer, &begin_info) != VK_SUCCESS) {
+            throw std::runtime_error("HeadlessApplication::record_batch => failed to begin recording command buffer!");
+        }
+
+        SimulationPushConstants push_constants{};
+        push_constants.body_count             = m_options.body_count;
+        push_constants.first_target           = 0;
+        push_constants.target_count           = m_options.body_count;
+        push_constants.timestep               = m_options.timestep;
+        push_constants.softening_squared      = m_options.softening * m_options.softening;
+        push_constants.gravitational_constant = GRAVITATIONAL_CONSTANT;
+
+        if (!m_options.gpu_tree) {
+            vkCmdBindPipeline(batch.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_compute_pipeline);
+            vkCmdPushConstants(batch.command_buffer, m_compute_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(push_constants), &push_constants);
+        }
+
+        uint32_t group_count = (m_options.body_count + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE;
+
+        for (uint32_t i = 0; i < count; ++i) {
+            if (m_options.gpu_tree) {
+                m_gpu_tree.record_step(batch.command_buffer, m_compute_descriptor_sets[m_simulation_read_index]);
+                m_simulation_read_index = 1 - m_simulation_read_index;
+                continue;
+            }
+
+            // Make the previous step's writes, or the upload, visible before this step reads them as its input.
+            VkMemoryBarrier barrier{};
+            barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(batch.command_buffer,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+            vkCmdBindDescriptorSets(batch.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_compute_pipeline_layout, 0,
+                                    1, &m_compute_descriptor_sets[m_simulation_read_index], 0, nullptr);
+            vkCmdDispatch(batch.command_buffer, group_count, 1, 1);
+
+            m_simulation_read_index = 1 - m_simulation_read_index;
+        }
+
+        if (batch.readback_step) {
+            record_readback(batch);
+        }
+
+        if (vkEndCommandBuffer(batch.command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("HeadlessApplication::record_batch => failed to record command buffer!");
+        }
+    }
+
+    // Copies the slot the last step wrote into the batch's readback buffer, visible to the host after the fence.
+    void record_readback(ComputeBatch& batch) {
+        VkDeviceSize size = state_buffer_size();
+
+        VkMemoryBarrier to_transfer{};
+        to_transfer.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        to_transfer.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        to_transfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(batch.command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 1, &to_transfer, 0, nullptr, 0, nullptr);
+
+        VkBufferCopy position_region{0, 0, size};
+        VkBufferCopy velocity_region{0, size, size};
+        vkCmdCopyBuffer(batch.command_buffer, m_position_buffers[m_simulation_read_index], batch.readback_buffer, 1,
+                        &position_region);
+        vkCmdCopyBuffer(batch.command_buffer, m_velocity_buffers[m_simulation_read_index], batch.readback_buffer, 1,
+                        &velocity_region);
+
+        VkMemoryBarrier to_host{};
+        to_host.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        to_host.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        to_host.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(batch.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                             &to_host, 0, nullptr, 0, nullptr);
+    }
+};
+
+int main(int argc, char** argv) {
+    HeadlessOptions options{};
+
+    auto print_usage = [&] {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--engine cpu|gpu] [--solver direct|barnes-hut|fmm] [--isa auto|scalar|neon|avx2|avx512]"
+                     " [--precision fp32|compensated|fp64|relative] [--block-timesteps] [--gpu-tree] [--bodies N]"
+                     " [--steps N] [--timestep DT] [--softening EPS] [--rebuild-threshold GROWTH]"
+                     " [--snapshot PATH] [--snapshot-interval N] [--telemetry PORT] [--telemetry-interval N]"
+                     " [--trace PATH]\n";
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+
+        if (argument == "--engine" && i + 1 < argc) {
+            std::string engine = argv[++i];
+            if (engine == "gpu") {
+                options.engine = SimulationEngine::GPU;
+            } else if (engine == "cpu") {
+                options.engine = SimulationEngine::CPU;
+            } else {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        } else if (argument == "--solver" && i + 1 < argc) {
+            std::optional<nbody::SolverKind> solver = nbody::parse_solver_kind(argv[++i]);
+            if (!solver) {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+            options.solver = *solver;
+        } else if (argument == "--isa" && i + 1 < argc) {
+            std::optional<nbody::Isa> isa = nbody::parse_isa(argv[++i]);
+            if (!isa) {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+            options.isa = *isa;
+        } else if (argument == "--precision" && i + 1 < argc) {
+            std::optional<nbody::Precision> precision = nbody::parse_precision(argv[++i]);
+            if (!precision) {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+            options.precision = *precision;
+        } else if (argument == "--block-timesteps") {
+            options.block_timesteps = true;
+        } else if (argument == "--gpu-tree") {
+            options.gpu_tree = true;
+        } else if (argument == "--bodies" && i + 1 < argc) {
+            options.body_count = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--steps" && i + 1 < argc) {
+            options.steps = std::strtoull(argv[++i], nullptr, 10);
+        } else if (argument == "--timestep" && i + 1 < argc) {
+            options.timestep = std::strtof(argv[++i], nullptr);
+        } else if (argument == "--softening" && i + 1 < argc) {
+            options.softening = std::strtof(argv[++i], nullptr);
+        } else if (argument == "--rebuild-threshold" && i + 1 < argc) {
+            options.rebuild_threshold = std::strtof(argv[++i], nullptr);
+        } else if (argument == "--snapshot" && i + 1 < argc) {
+            options.snapshot_path = argv[++i];
+        } else if (argument == "--snapshot-interval" && i + 1 < argc) {
+            options.snapshot_interval = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--telemetry" && i + 1 < argc) {
+            options.telemetry_port = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--telemetry-interval" && i + 1 < argc) {
+            options.telemetry_interval = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--trace" && i + 1 < argc) {
+            options.trace_path = argv[++i];
+        } else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options.body_count == 0 || !(options.timestep > 0.0f)) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    // shaders/nbody.comp is only specialized for single precision, plain or compensated.
+    if (options.engine == SimulationEngine::GPU && options.precision != nbody::Precision::FP32 &&
+        options.precision != nbody::Precision::COMPENSATED) {
+        std::cerr << "The GPU engine supports --precision fp32 and compensated only.\n";
+        return EXIT_FAILURE;
+    }
+
+    // The tree passes only have the plain single precision sums.
+    if (options.gpu_tree && (options.engine != SimulationEngine::GPU || options.precision != nbody::Precision::FP32)) {
+        std::cerr << "--gpu-tree needs --engine gpu and --precision fp32.\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        HeadlessApplication application(options);
+        application.run();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
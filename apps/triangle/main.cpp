@@ -1,11 +1,19 @@
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstddef>
-#include <fstream>
+#include <iomanip>
 #include <ios>
 #include <limits>
+#include <numbers>
 #include <set>
+#include <span>
+#include <sstream>
+#include <stop_token>
 #include <string>
+#include <thread>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <vulkan/vk_platform.h>
@@ -18,17 +26,40 @@
 #include <exception>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <optional>
 #include <stdexcept>
 #include <utility>
 #include <vector>
 
+#include "bodies.hpp"
+#include "gpu_lod.hpp"
+#include "gpu_memory.hpp"
+#include "gpu_tree.hpp"
+#include "initial_conditions.hpp"
+#include "integrator.hpp"
+#include "parallel.hpp"
+#include "pipeline_cache.hpp"
+#include "scheduler.hpp"
+#include "shader_library.hpp"
+#include "simd.hpp"
+#include "snapshot.hpp"
+#include "solver.hpp"
+#include "trace.hpp"
+#include "triple_buffer.hpp"
+
 class QueueFamilyIndices {
    public:
     std::optional<uint32_t> graphics_family;
     std::optional<uint32_t> present_family;
+    std::optional<uint32_t> compute_family;
+
+    bool is_complete() {
+        return graphics_family.has_value() && present_family.has_value() && compute_family.has_value();
+    }
 
-    bool is_complete() { return graphics_family.has_value() && present_family.has_value(); }
+    // True if the compute family has no graphics support, i.e. the simulation runs on an async queue.
+    bool has_dedicated_compute = false;
 };
 
 class SwapChainSupportDetails {
@@ -38,11 +69,235 @@ class SwapChainSupportDetails {
     std::vector<VkPresentModeKHR>   present_modes;
 };
 
+// Everything a single frame touches while it is in flight. A slot is reused once its `in_flight` fence signals,
+// so the CPU can record frame `n + 1` while the GPU still works on frame `n`.
+class FrameResources {
+   public:
+    VkCommandBuffer command_buffer         = VK_NULL_HANDLE;
+    VkCommandBuffer compute_command_buffer = VK_NULL_HANDLE;
+    VkSemaphore     image_available        = VK_NULL_HANDLE;
+    VkSemaphore     simulation_finished    = VK_NULL_HANDLE;
+    VkFence         in_flight              = VK_NULL_HANDLE;
+
+    // Of the frame's camera uniforms in the upload ring, the dynamic offset of the camera set.
+    uint32_t camera_offset = 0;
+
+    // GPU engine on several GPUs only: completes the step's slot with the slices the helpers stepped.
+    VkCommandBuffer exchange_command_buffer = VK_NULL_HANDLE;
+
+    // CPU engine only: host visible copy of the body positions this frame renders.
+    VkBuffer             body_buffer            = VK_NULL_HANDLE;
+    nbody::GpuAllocation body_buffer_allocation = {};
+
+    // Set when the last submits of the slot wrote timestamp queries, which are read once `in_flight` signals.
+    bool compute_timestamps_written = false;
+    bool render_timestamps_written  = false;
+};
+
+// Where the simulation steps run. The GPU engine keeps the bodies in device memory and sums forces directly, or
+// with a tree it rebuilds every step on the GPU, the CPU engine steps them with the chosen solver on the task
+// scheduler and uploads positions every frame.
+enum class SimulationEngine {
+    GPU,
+    CPU,
+};
+
+// How frames reach the screen. `IMMEDIATE` presents as fast as frames are rendered and may tear, for measuring.
+// `MAILBOX` replaces a queued frame with a newer one, the lowest latency without tearing. `FIFO` waits for
+// vertical blank, and the GPU engine keeps stepping the simulation while every image is queued rather than
+// waiting with it. A policy the surface does not support falls back towards `FIFO`, which every surface has.
+enum class PresentPolicy {
+    IMMEDIATE,
+    MAILBOX,
+    FIFO,
+};
+
+std::string_view present_policy_name(PresentPolicy policy) noexcept {
+    switch (policy) {
+        case PresentPolicy::IMMEDIATE:
+            return "immediate";
+        case PresentPolicy::MAILBOX:
+            return "mailbox";
+        case PresentPolicy::FIFO:
+            return "fifo";
+    }
+    return "unknown";
+}
+
+std::optional<PresentPolicy> parse_present_policy(std::string_view name) noexcept {
+    for (PresentPolicy policy : {PresentPolicy::IMMEDIATE, PresentPolicy::MAILBOX, PresentPolicy::FIFO}) {
+        if (present_policy_name(policy) == name) {
+            return policy;
+        }
+    }
+    return std::nullopt;
+}
+
+// A swapchain replaced after a resize, with everything created for its images. Kept until no frame that used
+// it can still be in flight.
+class RetiredSwapchain {
+   public:
+    VkSwapchainKHR             swapchain = VK_NULL_HANDLE;
+    std::vector<VkImageView>   image_views;
+    std::vector<VkFramebuffer> framebuffers;
+    std::vector<VkSemaphore>   render_finished;
+    uint64_t                   retired_at = 0;  // The first frame number that used its successor
+};
+
+class ApplicationOptions {
+   public:
+    uint32_t          frames_in_flight = 2;
+    SimulationEngine  engine           = SimulationEngine::GPU;
+    PresentPolicy     present_policy   = PresentPolicy::MAILBOX;
+    nbody::SolverKind solver           = nbody::SolverKind::BARNES_HUT;
+    nbody::Isa        isa              = nbody::detect_isa();
+    bool              block_timesteps  = false;
+
+    // GPU engine only: the bodies are split over up to `gpu_count` GPUs, the best of which renders.
+    uint32_t gpu_count = 1;
+
+    // GPU engine on one GPU only: Barnes-Hut with `nbody::GpuBarnesHut` instead of the direct sum.
+    bool gpu_tree = false;
+
+    // GPU tree only: nodes of the tree that span fewer pixels are drawn as a single impostor by `nbody::GpuLod`,
+    // and what is outside the view is not drawn at all. 0 draws every body.
+    float lod_pixels = 0.0f;
+
+    // Bodies to simulate, 0 for the default of the engine.
+    uint32_t body_count = 0;
+
+    // CPU engine only: steps per second of simulated time, 0 to step as fast as the solver allows.
+    uint32_t simulation_rate = 0;
+
+    // CPU engine only: a snapshot of every `snapshot_interval`-th step is streamed to `snapshot_path`.
+    std::string snapshot_path;
+    uint32_t    snapshot_interval = 100;
+
+    // The events still in the trace rings on exit are written to `trace_path` as a Chrome trace.
+    std::string trace_path;
+};
+
+// Must match the `Camera` uniform block in shaders/shader.vert and shaders/impostor.vert (std140).
+class CameraUniforms {
+   public:
+    std::array<float, 16> view_projection;   // Column major
+    std::array<float, 2>  sprite_size;       // Half extent of a body sprite in normalized device coordinates
+    std::array<float, 2>  projection_scale;  // Clip space extent of a unit length in x and y, whatever its depth
+};
+
+// Positions with the mass in `w` before and after one step of the CPU engine, and the `nbody::trace_now` times at
+// which a frame shows each of them.
+class SimulationState {
+   public:
+    std::vector<std::array<float, 4>> previous;
+    std::vector<std::array<float, 4>> current;
+    uint64_t                          previous_ns = 0;
+    uint64_t                          current_ns  = 0;
+};
+
+// Must match the `Parameters` push constant block in shaders/nbody.comp.
+class SimulationPushConstants {
+   public:
+    uint32_t body_count;
+    uint32_t first_target;
+    uint32_t target_count;
+    float    timestep;
+    float    softening_squared;
+    float    gravitational_constant;
+};
+
+// Bodies `[first, first + count)`, the share of one GPU.
+class BodySlice {
+   public:
+    uint32_t first = 0;
+    uint32_t count = 0;
+};
+
+// What recording and submitting compute work on one logical device needs.
+class DeviceContext {
+   public:
+    VkPhysicalDevice     physical_device = VK_NULL_HANDLE;
+    VkDevice             device          = VK_NULL_HANDLE;
+    uint32_t             queue_family    = 0;
+    VkQueue              queue           = VK_NULL_HANDLE;
+    VkCommandPool        command_pool    = VK_NULL_HANDLE;
+    nbody::GpuAllocator* allocator       = nullptr;
+};
+
+// Host visible copies of all positions through which GPUs swap their slices after a step. Each GPU copies its
+// new slice into `download`, and the host copies the slices of all other GPUs into its `upload`. Both are
+// indexed like the position buffers.
+class ExchangeBuffers {
+   public:
+    VkBuffer             download            = VK_NULL_HANDLE;
+    nbody::GpuAllocation download_allocation = {};
+    VkBuffer             upload              = VK_NULL_HANDLE;
+    nbody::GpuAllocation upload_allocation   = {};
+};
+
+// A further GPU stepping a slice of the bodies for the GPU engine, on its own logical device. It keeps all
+// positions, since the whole system pulls on its slice, and only velocities of its own slice are current.
+class HelperDevice {
+   public:
+    DeviceContext         context;
+    nbody::GpuAllocator   allocator;
+    VkCommandBuffer       command_buffer        = VK_NULL_HANDLE;
+    VkFence               step_finished         = VK_NULL_HANDLE;
+    VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout      pipeline_layout       = VK_NULL_HANDLE;
+    VkPipeline            pipeline              = VK_NULL_HANDLE;
+    VkDescriptorPool      descriptor_pool       = VK_NULL_HANDLE;
+    nbody::PipelineCache  pipeline_cache;
+
+    // Nothing renders from these, so two slots do: set `i` reads slot `i` and writes the other one.
+    std::array<VkDescriptorSet, 2>      descriptor_sets             = {};
+    std::array<VkBuffer, 2>             position_buffers            = {};
+    std::array<nbody::GpuAllocation, 2> position_buffer_allocations = {};
+    std::array<VkBuffer, 2>             velocity_buffers            = {};
+    std::array<nbody::GpuAllocation, 2> velocity_buffer_allocations = {};
+    uint32_t                            read_index                  = 0;
+
+    // The other slices of the previous step are in `exchange.upload` and not yet in the read slot.
+    ExchangeBuffers exchange;
+    bool            upload_pending = false;
+};
+
 class TriangleApplication {
    private:
     static constexpr uint32_t WINDOW_WIDTH  = 800;
     static constexpr uint32_t WINDOW_HEIGHT = 600;
 
+    // Must match `local_size_x` in shaders/nbody.comp.
+    static constexpr uint32_t COMPUTE_WORKGROUP_SIZE = 256;
+
+    static constexpr uint32_t BODY_COUNT             = 128 * 1024;
+    static constexpr uint32_t CPU_BODY_COUNT         = 32 * 1024;
+    static constexpr float    SIMULATION_TIMESTEP    = 1.0e-3f;
+    static constexpr float    SIMULATION_SOFTENING   = 1.0e-2f;
+    static constexpr float    GRAVITATIONAL_CONSTANT = 1.0f;
+
+    static constexpr float SPRITE_SIZE_PIXELS = 2.0f;
+
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 8;
+
+    static constexpr std::size_t PACK_GRAIN = 16 * 1024;
+
+    // Steps a paced simulation thread may fall behind its clock before it slows down instead of catching up.
+    static constexpr uint64_t MAX_SIMULATION_LAG = 4;
+
+    static constexpr const char* PIPELINE_CACHE_FILE = "triangle_pipeline_cache.bin";
+    static constexpr const char* DEVICE_PROBE_FILE   = "triangle_device_probe.bin";
+
+    // Changes whenever `rate_physical_device` or `find_queue_familiy_indices` look for something else, which
+    // retires the records of older builds.
+    static constexpr uint32_t DEVICE_PROBE_KEY = 1;
+
+    // Queries `4 i` and `4 i + 1` of frame slot `i` surround its compute step, `4 i + 2` and `4 i + 3` its render
+    // pass.
+    static constexpr uint32_t TIMESTAMPS_PER_FRAME = 4;
+
+    static constexpr uint64_t STATS_INTERVAL_NS = 500'000'000;
+
 #ifdef NDEBUG
     static constexpr bool ENABLE_VALIDATION_LAYERS = false;
 #else
@@ -54,9 +309,11 @@ class TriangleApplication {
     VkDebugUtilsMessengerEXT   m_debug_messenger        = VK_NULL_HANDLE;
     VkSurfaceKHR               m_surface                = VK_NULL_HANDLE;
     VkPhysicalDevice           m_physical_device        = VK_NULL_HANDLE;
+    QueueFamilyIndices         m_queue_families         = {};  // Of `m_physical_device`, found once when picked
     VkDevice                   m_logical_device         = VK_NULL_HANDLE;
     VkQueue                    m_graphics_queue         = VK_NULL_HANDLE;
     VkQueue                    m_present_queue          = VK_NULL_HANDLE;
+    VkQueue                    m_compute_queue          = VK_NULL_HANDLE;
     VkSwapchainKHR             m_swapchain              = VK_NULL_HANDLE;
     std::vector<VkImage>       m_swapchain_images       = {};
     VkFormat                   m_swapchain_format       = VK_FORMAT_UNDEFINED;
@@ -67,16 +324,147 @@ class TriangleApplication {
     VkPipeline                 m_graphics_pipeline      = VK_NULL_HANDLE;
     std::vector<VkFramebuffer> m_swapchain_framebuffers = {};
     VkCommandPool              m_command_pool           = VK_NULL_HANDLE;
-    VkCommandBuffer            m_command_buffer         = VK_NULL_HANDLE;
 
-    VkSemaphore m_semaphore_image_available = VK_NULL_HANDLE;
-    VkSemaphore m_semaphore_render_finished = VK_NULL_HANDLE;
-    VkFence     m_fence_in_flight           = VK_NULL_HANDLE;
+    uint32_t                    m_frames_in_flight = 0;
+    uint32_t                    m_current_frame    = 0;
+    uint64_t                    m_frame_number     = 0;  // Frames submitted so far, rendered or not
+    std::vector<FrameResources> m_frames           = {};
+
+    // `m_present_mode` is what `m_present_policy` got on this surface. A stale swapchain, after a resize or a
+    // suboptimal present, is recreated by the next acquire.
+    PresentPolicy                 m_present_policy;
+    VkPresentModeKHR              m_present_mode       = VK_PRESENT_MODE_FIFO_KHR;
+    bool                          m_swapchain_stale    = false;
+    std::vector<RetiredSwapchain> m_retired_swapchains = {};
+
+    // Signaled by the render submit and waited on by present. Indexed by swapchain image rather than frame,
+    // because presentation offers no way to know when the semaphore of a frame slot may be reused.
+    std::vector<VkSemaphore> m_semaphores_render_finished = {};
+
+    // GPU timestamps of every frame slot, laid out as `TIMESTAMPS_PER_FRAME` says. A queue whose mask is 0 writes
+    // none. Ticks turn into trace time with the offset measured for their queue at startup.
+    VkQueryPool       m_timestamp_pool          = VK_NULL_HANDLE;
+    double            m_timestamp_period        = 1.0;
+    uint64_t          m_graphics_timestamp_mask = 0;
+    uint64_t          m_compute_timestamp_mask  = 0;
+    int64_t           m_graphics_clock_offset   = 0;
+    int64_t           m_compute_clock_offset    = 0;
+    nbody::TraceRing* m_render_track            = nullptr;
+    nbody::TraceRing* m_compute_track           = nullptr;
+
+    // Per frame averages of the trace zones since `m_stats_begin` go into the window title.
+    uint64_t    m_stats_begin = 0;
+    std::string m_trace_path;
+
+    // Simulation state lives in a ring of storage buffers, one more than there are frames in flight. Each step
+    // reads slot `m_simulation_read_index` and writes the next one, which no in-flight frame still renders from.
+    // Descriptor set `i` of either kind refers to slot `i`.
+    VkDescriptorSetLayout        m_compute_descriptor_set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout             m_compute_pipeline_layout       = VK_NULL_HANDLE;
+    VkPipeline                   m_compute_pipeline              = VK_NULL_HANDLE;
+    VkDescriptorPool             m_descriptor_pool               = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> m_compute_descriptor_sets       = {};
+    std::vector<VkBuffer>        m_position_buffers              = {};
+    std::vector<nbody::GpuAllocation> m_position_buffer_allocations = {};
+    std::vector<VkBuffer>        m_velocity_buffers              = {};
+    std::vector<nbody::GpuAllocation> m_velocity_buffer_allocations = {};
+    VkCommandPool                m_compute_command_pool          = VK_NULL_HANDLE;
+    uint32_t                     m_simulation_read_index         = 0;
+
+    // With helpers the render device steps `m_slices[0]` and helper `k` steps `m_slices[k + 1]`. After every step
+    // each GPU copies its new slice to the host, which passes it on to all other GPUs before they read it.
+    uint32_t                                   m_gpu_count;
+    std::vector<BodySlice>                     m_slices         = {};
+    std::vector<std::unique_ptr<HelperDevice>> m_helpers        = {};
+    ExchangeBuffers                            m_exchange       = {};
+    VkFence                                    m_exchange_fence = VK_NULL_HANDLE;
+
+    // Every buffer of the render device is suballocated from `m_allocator`. Data rewritten every frame goes
+    // through `m_upload_ring`, which has a region per frame slot.
+    nbody::GpuAllocator m_allocator;
+    nbody::GpuRing      m_upload_ring;
+
+    // The vertex stage reads body positions straight from the simulation buffers through set 0, and the frame's
+    // camera uniforms through set 1, which points into the upload ring at the frame's dynamic offset.
+    VkDescriptorSetLayout        m_body_descriptor_set_layout  = VK_NULL_HANDLE;
+    VkDescriptorSetLayout        m_frame_descriptor_set_layout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> m_body_descriptor_sets        = {};
+    VkDescriptorSet              m_frame_descriptor_set        = VK_NULL_HANDLE;
+
+    // The CPU engine steps `m_bodies` on `m_simulation_thread`, every `m_simulation_interval_ns` or as fast as it
+    // can when that is 0, and publishes the positions before and after each step to `m_simulation_states`. Every
+    // frame interpolates the latest pair into its body buffer, so a slow frame never holds up the simulation and a
+    // slow step never holds up a frame. Body descriptor set `i` then refers to the body buffer of frame slot `i`.
+    SimulationEngine                     m_engine;
+    uint32_t                             m_body_count;
+    nbody::Bodies                        m_bodies;
+    std::unique_ptr<nbody::Solver>       m_cpu_solver;
+    uint64_t                             m_simulation_interval_ns;
+    nbody::TripleBuffer<SimulationState> m_simulation_states;
+    std::exception_ptr                   m_simulation_error;
+    std::atomic<bool>                    m_simulation_failed{false};
+
+    // Set when the CPU engine gives every body its own timestep, with a frame's step as the longest one.
+    std::optional<nbody::BlockTimestepIntegrator> m_block_integrator;
+
+    std::unique_ptr<nbody::SnapshotWriter> m_snapshot_writer;
+    uint32_t                               m_snapshot_interval;
+    uint64_t                               m_cpu_step = 0;
+
+    // Last, so that it stops before the state it steps is destroyed.
+    std::jthread m_simulation_thread;
+
+    // Pipelines are created with `m_pipeline_cache`, which is loaded from and written back to disk, and are
+    // built as tasks of `m_pipeline_builds` during initialization.
+    nbody::PipelineCache m_pipeline_cache;
+    nbody::TaskGroup     m_pipeline_builds;
+
+    // Steps the bodies in place of `m_compute_pipeline` when enabled.
+    nbody::GpuBarnesHut m_gpu_tree;
+    bool                m_gpu_tree_enabled;
+
+    // With level of detail the compute submit of a rendered frame picks what it draws from the tree it just
+    // built, into the instance and draw buffers of the frame slot, and the render pass draws them indirectly
+    // through `m_lod_descriptor_sets[slot]` in place of the body sets. Both sides see `m_frame_camera`, which is
+    // set before the step.
+    nbody::GpuLod                m_lod;
+    float                        m_lod_pixels;
+    std::vector<VkDescriptorSet> m_lod_descriptor_sets = {};
+    CameraUniforms               m_frame_camera{};
 
     const std::vector<const char*> m_validation_layers = {"VK_LAYER_KHRONOS_validation"};
     const std::vector<const char*> m_device_extensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
    public:
+    explicit TriangleApplication(const ApplicationOptions& options)
+        : m_frames_in_flight(std::clamp(options.frames_in_flight, 1u, MAX_FRAMES_IN_FLIGHT)),
+          m_present_policy(options.present_policy),
+          m_gpu_count(options.engine == SimulationEngine::GPU ? std::max(options.gpu_count, 1u) : 1u),
+          m_engine(options.engine),
+          m_body_count(options.body_count != 0                  ? options.body_count
+                       : options.engine == SimulationEngine::GPU ? BODY_COUNT
+                                                                 : CPU_BODY_COUNT),
+          m_cpu_solver(nbody::make_solver(make_solver_config(options))),
+          m_simulation_interval_ns(options.simulation_rate != 0 ? 1'000'000'000 / options.simulation_rate : 0),
+          m_snapshot_interval(std::max(options.snapshot_interval, 1u)),
+          m_gpu_tree_enabled(options.engine == SimulationEngine::GPU && options.gpu_tree),
+          m_lod_pixels(m_gpu_tree_enabled ? options.lod_pixels : 0.0f) {
+        m_trace_path = options.trace_path;
+        if (options.engine == SimulationEngine::CPU && !options.snapshot_path.empty()) {
+            // Masses never change and compress to almost nothing, the other columns stay mappable in place.
+            nbody::SnapshotWriterConfig config{};
+            config.encodings[static_cast<std::size_t>(nbody::SnapshotColumn::MASS)] =
+                nbody::ColumnEncoding::SHUFFLED_RLE;
+            m_snapshot_writer = std::make_unique<nbody::SnapshotWriter>(options.snapshot_path, config);
+        }
+        if (options.block_timesteps) {
+            nbody::BlockTimestepConfig config{};
+            config.max_timestep = SIMULATION_TIMESTEP;
+            config.softening    = SIMULATION_SOFTENING;
+            m_block_integrator.emplace(config);
+        }
+    }
+
     void run() {
         init();
         main_loop();
@@ -87,8 +475,25 @@ class TriangleApplication {
     /* ---- Initialization and lifecycle ---- */
 
     void init() {
+        // Zones cost little enough to stay on, the stats in the window title come from them.
+        nbody::Tracer::set_enabled(true);
+        nbody::Tracer::global().set_thread_name("main");
+
         init_glfw();
-        init_window();
+
+        // Loading the drivers takes about as long as opening the window, which GLFW only allows on this thread, so
+        // the instance is created on a worker meanwhile. The surface needs both.
+        nbody::TaskGroup instance_creation;
+        nbody::Scheduler::global().spawn(instance_creation, [this] { create_instance(); });
+        try {
+            init_window();
+        } catch (...) {
+            nbody::Scheduler::global().wait(instance_creation);
+            glfwTerminate();
+            throw;
+        }
+        nbody::Scheduler::global().wait(instance_creation);
+
         init_vulcan();
     }
 
@@ -100,22 +505,42 @@ class TriangleApplication {
 
     void init_window() {
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
         m_window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "triangle", nullptr, nullptr);
         if (!m_window) {
-            glfwTerminate();
             throw std::runtime_error("TriangleApplication::init_window => Failed to create GLFW window");
         }
+
+        // Not every platform reports a resize through the acquire and present results.
+        glfwSetWindowUserPointer(m_window, this);
+        glfwSetFramebufferSizeCallback(m_window, [](GLFWwindow* window, int, int) {
+            static_cast<TriangleApplication*>(glfwGetWindowUserPointer(window))->m_swapchain_stale = true;
+        });
     }
 
+    // Expects the instance of `init`.
     void init_vulcan() {
-        create_instance();
         check_extension_support();
         setup_debug_messenger();
         create_surface();
         pick_physical_device();
-        create_logical_device();
+        pick_helper_devices();
+
+        // Devices start up independently, so the helpers come up on a worker while this thread creates the render
+        // device.
+        nbody::TaskGroup helper_creation;
+        if (!m_helpers.empty()) {
+            nbody::Scheduler::global().spawn(helper_creation, [this] { create_helper_devices(); });
+        }
+        try {
+            create_logical_device();
+            m_allocator.create(m_logical_device, m_physical_device);
+        } catch (...) {
+            nbody::Scheduler::global().wait(helper_creation);
+            throw;
+        }
+        nbody::Scheduler::global().wait(helper_creation);
 
         // Create the swapchain and image views before creating the render pass and graphics
         // pipeline so that `m_swapchain_format` and `m_swapchain_extent` are defined.
@@ -123,26 +548,144 @@ class TriangleApplication {
         create_image_views();
 
         create_render_pass();
-        create_graphics_pipleline();
-        create_framebuffers();
-        create_command_pool();
-        create_command_buffer();
+        create_graphics_descriptor_set_layouts();
+        create_compute_descriptor_set_layout();
+
+        // Everything the pipelines depend on exists now, so they compile on the workers while this thread creates
+        // the remaining resources.
+        m_pipeline_cache.create(m_logical_device, m_physical_device, nbody::default_cache_path(PIPELINE_CACHE_FILE));
+        build_pipelines_async();
+
+        try {
+            create_framebuffers();
+            create_command_pool();
+            create_compute_command_pool();
+            create_command_buffers();
+            if (m_engine == SimulationEngine::GPU) {
+                create_simulation_buffers();
+            } else {
+                create_cpu_simulation();
+            }
+            create_upload_ring();
+            create_descriptor_pool();
+            create_compute_descriptor_sets();
+            create_graphics_descriptor_sets();
+
+            // Create synchronization objects last so they are available when drawing frames.
+            create_synchonization_objects();
+            create_timestamp_queries();
+        } catch (...) {
+            // The builds refer to this application, so they have to finish before the exception unwinds it.
+            nbody::Scheduler::global().wait(m_pipeline_builds);
+            throw;
+        }
+
+        nbody::Scheduler::global().wait(m_pipeline_builds);
+
+        // Picks from the buffers of the tree, which its build task created.
+        if (m_lod_pixels > 0.0f) {
+            create_lod();
+        }
+
+        // A failed save only costs the next run its warm start.
+        std::vector<const nbody::PipelineCache*> caches{&m_pipeline_cache};
+        for (const auto& helper : m_helpers) {
+            caches.push_back(&helper->pipeline_cache);
+        }
+        for (const nbody::PipelineCache* cache : caches) {
+            if (!cache->save()) {
+                std::cerr << "TriangleApplication::init_vulcan => failed to write pipeline cache to " << cache->path()
+                          << "\n";
+            }
+        }
+    }
+
+    void build_pipelines_async() {
+        nbody::Scheduler& scheduler = nbody::Scheduler::global();
+        scheduler.spawn(m_pipeline_builds, [this] { create_graphics_pipleline(); });
+        scheduler.spawn(m_pipeline_builds, [this] { create_compute_pipeline(); });
+        if (m_gpu_tree_enabled) {
+            scheduler.spawn(m_pipeline_builds, [this] { create_gpu_tree(); });
+        }
 
-        // Create synchronization objects last so they are available when drawing frames.
-        create_synchonization_objects();
+        for (auto& helper : m_helpers) {
+            scheduler.spawn(m_pipeline_builds, [&helper = *helper] {
+                create_compute_pipeline(helper.context.device, helper.pipeline_cache.handle(),
+                                        helper.descriptor_set_layout, helper.pipeline_layout, helper.pipeline);
+            });
+        }
     }
 
     void main_loop() {
+        if (m_engine == SimulationEngine::CPU) {
+            m_simulation_thread = std::jthread([this](std::stop_token stop) { run_cpu_simulation(stop); });
+        }
+
         while (!glfwWindowShouldClose(m_window)) {
             glfwPollEvents();
             draw_frame();
         }
+
+        // Wait for in-flight work to finish before `cleanup` starts destroying the objects it uses.
+        if (m_simulation_thread.joinable()) {
+            m_simulation_thread.request_stop();
+            m_simulation_thread.join();
+        }
+        vkDeviceWaitIdle(m_logical_device);
+        for (const auto& helper : m_helpers) {
+            vkDeviceWaitIdle(helper->context.device);
+        }
+
+        // Surfaces write errors, which the destructor would drop.
+        if (m_snapshot_writer) {
+            m_snapshot_writer->close();
+        }
+
+        if (!m_trace_path.empty()) {
+            try {
+                nbody::Tracer::global().write_chrome_trace(m_trace_path);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << "\n";
+            }
+        }
     }
 
     void cleanup() {
-        vkDestroySemaphore(m_logical_device, m_semaphore_image_available, nullptr);
-        vkDestroySemaphore(m_logical_device, m_semaphore_render_finished, nullptr);
-        vkDestroyFence(m_logical_device, m_fence_in_flight, nullptr);
+        for (auto& frame : m_frames) {
+            vkDestroySemaphore(m_logical_device, frame.image_available, nullptr);
+            vkDestroySemaphore(m_logical_device, frame.simulation_finished, nullptr);
+            vkDestroyFence(m_logical_device, frame.in_flight, nullptr);
+            m_allocator.destroy_buffer(frame.body_buffer, frame.body_buffer_allocation);
+        }
+        m_upload_ring.destroy();
+
+        for (auto semaphore : m_semaphores_render_finished) {
+            vkDestroySemaphore(m_logical_device, semaphore, nullptr);
+        }
+        for (auto& retired : m_retired_swapchains) {
+            destroy_retired_swapchain(retired);
+        }
+        vkDestroyQueryPool(m_logical_device, m_timestamp_pool, nullptr);
+
+        vkDestroyDescriptorPool(m_logical_device, m_descriptor_pool, nullptr);
+
+        for (size_t i = 0; i < m_position_buffers.size(); ++i) {
+            m_allocator.destroy_buffer(m_position_buffers[i], m_position_buffer_allocations[i]);
+            m_allocator.destroy_buffer(m_velocity_buffers[i], m_velocity_buffer_allocations[i]);
+        }
+
+        for (const auto& helper : m_helpers) {
+            destroy_helper_device(*helper);
+        }
+        destroy_exchange_buffers(m_allocator, m_exchange);
+        vkDestroyFence(m_logical_device, m_exchange_fence, nullptr);
+
+        m_lod.destroy();
+        m_gpu_tree.destroy();
+        vkDestroyPipeline(m_logical_device, m_compute_pipeline, nullptr);
+        vkDestroyPipelineLayout(m_logical_device, m_compute_pipeline_layout, nullptr);
+        vkDestroyDescriptorSetLayout(m_logical_device, m_compute_descriptor_set_layout, nullptr);
+        vkDestroyCommandPool(m_logical_device, m_compute_command_pool, nullptr);
 
         vkDestroyCommandPool(m_logical_device, m_command_pool, nullptr);
 
@@ -152,6 +695,9 @@ class TriangleApplication {
 
         vkDestroyPipeline(m_logical_device, m_graphics_pipeline, nullptr);
         vkDestroyPipelineLayout(m_logical_device, m_pipeline_layout, nullptr);
+        m_pipeline_cache.destroy();
+        vkDestroyDescriptorSetLayout(m_logical_device, m_body_descriptor_set_layout, nullptr);
+        vkDestroyDescriptorSetLayout(m_logical_device, m_frame_descriptor_set_layout, nullptr);
         vkDestroyRenderPass(m_logical_device, m_render_pass, nullptr);
 
         for (auto image_view : m_swapchain_image_views) {
@@ -160,6 +706,7 @@ class TriangleApplication {
 
         vkDestroySwapchainKHR(m_logical_device, m_swapchain, nullptr);
         vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+        m_allocator.destroy();
         vkDestroyDevice(m_logical_device, nullptr);
 
         if (ENABLE_VALIDATION_LAYERS) {
@@ -190,7 +737,7 @@ class TriangleApplication {
         application_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         application_info.pEngineName        = "no_engine";
         application_info.engineVersion      = VK_MAKE_VERSION(1, 0, 0);
-        application_info.apiVersion         = VK_API_VERSION_1_0;
+        application_info.apiVersion         = VK_API_VERSION_1_1;
 
         VkInstanceCreateInfo application_create_info{};
         application_create_info.sType            = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -228,7 +775,8 @@ class TriangleApplication {
         }
     }
 
-    void create_swapchain() {
+    // Passing the swapchain being replaced lets the presentation engine hand its resources over.
+    void create_swapchain(VkSwapchainKHR old_swapchain = VK_NULL_HANDLE) {
         SwapChainSupportDetails support_details = query_swapchain_support_details(m_physical_device);
 
         VkSurfaceFormatKHR surface_format = choose_swapchain_surface_format(support_details.formats);
@@ -252,7 +800,7 @@ class TriangleApplication {
         create_info.imageArrayLayers         = 1;
         create_info.imageUsage               = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-        QueueFamilyIndices queue_family_indices         = find_queue_familiy_indices(m_physical_device);
+        QueueFamilyIndices queue_family_indices         = m_queue_families;
         uint32_t           queue_family_indices_array[] = {queue_family_indices.graphics_family.value(),
                                                            queue_family_indices.present_family.value()};
 
@@ -270,7 +818,7 @@ class TriangleApplication {
         create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
         create_info.presentMode    = present_mode;
         create_info.clipped        = VK_TRUE;
-        create_info.oldSwapchain   = VK_NULL_HANDLE;
+        create_info.oldSwapchain   = old_swapchain;
 
         if (vkCreateSwapchainKHR(m_logical_device, &create_info, nullptr, &m_swapchain) != VK_SUCCESS) {
             throw std::runtime_error("TriangleApplication::create_swap_chain => failed to create swap chain!");
@@ -282,9 +830,79 @@ class TriangleApplication {
 
         m_swapchain_format = surface_format.format;
         m_swapchain_extent = extent;
+        m_present_mode     = present_mode;
+    }
+
+    // Replaces the swapchain without waiting for the device: the new one is created from the old one, which
+    // keeps presenting what is already queued, and the old objects wait in `m_retired_swapchains` for the frames
+    // that still use them.
+    void recreate_swapchain() {
+        NBODY_TRACE_ZONE("frame.recreate_swapchain");
+
+        // A minimized window has no extent to create a swapchain for.
+        int width  = 0;
+        int height = 0;
+        glfwGetFramebufferSize(m_window, &width, &height);
+        while ((width == 0 || height == 0) && !glfwWindowShouldClose(m_window)) {
+            glfwWaitEvents();
+            glfwGetFramebufferSize(m_window, &width, &height);
+        }
+        if (width == 0 || height == 0) {
+            return;
+        }
+        m_swapchain_stale = false;
+
+        RetiredSwapchain retired;
+        retired.swapchain       = m_swapchain;
+        retired.image_views     = std::exchange(m_swapchain_image_views, {});
+        retired.framebuffers    = std::exchange(m_swapchain_framebuffers, {});
+        retired.render_finished = std::exchange(m_semaphores_render_finished, {});
+        retired.retired_at      = m_frame_number;
+        m_swapchain             = VK_NULL_HANDLE;
+        m_retired_swapchains.push_back(std::move(retired));
+
+        // The render pass and graphics pipeline were made for the format, the extent is dynamic state.
+        VkFormat format = m_swapchain_format;
+        create_swapchain(m_retired_swapchains.back().swapchain);
+        if (m_swapchain_format != format) {
+            throw std::runtime_error("TriangleApplication::recreate_swapchain => the surface format changed!");
+        }
+        create_image_views();
+        create_framebuffers();
+        create_render_finished_semaphores();
+    }
+
+    // Frame `n` starts once frame `n - m_frames_in_flight` finished, so after `m_frames_in_flight` frames on the
+    // new swapchain no frame that rendered to an old image is left in flight.
+    void destroy_retired_swapchains() {
+        std::erase_if(m_retired_swapchains, [&](RetiredSwapchain& retired) {
+            if (m_frame_number < retired.retired_at + m_frames_in_flight) {
+                return false;
+            }
+            destroy_retired_swapchain(retired);
+            return true;
+        });
+    }
+
+    void destroy_retired_swapchain(RetiredSwapchain& retired) {
+        for (auto framebuffer : retired.framebuffers) {
+            vkDestroyFramebuffer(m_logical_device, framebuffer, nullptr);
+        }
+        for (auto image_view : retired.image_views) {
+            vkDestroyImageView(m_logical_device, image_view, nullptr);
+        }
+        for (auto semaphore : retired.render_finished) {
+            vkDestroySemaphore(m_logical_device, semaphore, nullptr);
+        }
+        vkDestroySwapchainKHR(m_logical_device, retired.swapchain, nullptr);
     }
 
+    // Only debug builds list the extensions, release builds skip the enumeration.
     void check_extension_support() {
+        if (!ENABLE_VALIDATION_LAYERS) {
+            return;
+        }
+
         uint32_t count = 0;
         vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
 
@@ -402,6 +1020,10 @@ class TriangleApplication {
         }
     }
 
+    // Scoring queries the features, extensions and surface support of every device, so the pick is recorded and a
+    // later run takes the recorded device as it is, once the window can still present from its recorded family.
+    // That is the only answer of the probe that depends on the surface, the others only change with the device or
+    // its driver, which the record names.
     void pick_physical_device() {
         uint32_t count = 0;
         vkEnumeratePhysicalDevices(m_instance, &count, nullptr);
@@ -415,6 +1037,14 @@ class TriangleApplication {
         std::vector<VkPhysicalDevice> devices(count);
         vkEnumeratePhysicalDevices(m_instance, &count, devices.data());
 
+        nbody::DeviceProbeCache probe_cache(nbody::default_cache_path(DEVICE_PROBE_FILE));
+        std::vector<uint32_t>   recorded;
+        if (std::optional<VkPhysicalDevice> device = probe_cache.load(devices, DEVICE_PROBE_KEY, recorded);
+            device && restore_queue_families(*device, recorded)) {
+            m_physical_device = *device;
+            return;
+        }
+
         std::multimap<uint32_t, VkPhysicalDevice> candidates;
 
         for (const auto& device : devices) {
@@ -435,6 +1065,43 @@ class TriangleApplication {
         if (m_physical_device == VK_NULL_HANDLE) {
             throw std::runtime_error("TriangleApplication::pick_physical_device => Failed to find a suitable GPU.");
         }
+
+        m_queue_families = find_queue_familiy_indices(m_physical_device);
+
+        // A failed save only costs the next run the probe.
+        std::array<uint32_t, 4> families = {
+            m_queue_families.graphics_family.value(), m_queue_families.present_family.value(),
+            m_queue_families.compute_family.value(), m_queue_families.has_dedicated_compute ? 1u : 0u};
+        if (!probe_cache.save(m_physical_device, DEVICE_PROBE_KEY, families)) {
+            std::cerr << "TriangleApplication::pick_physical_device => failed to write device probe to "
+                      << probe_cache.path() << "\n";
+        }
+    }
+
+    // Takes the families `pick_physical_device` recorded for `device`, unless they no longer fit it.
+    bool restore_queue_families(VkPhysicalDevice device, const std::vector<uint32_t>& families) {
+        if (families.size() != 4) {
+            return false;
+        }
+
+        uint32_t family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &family_count, nullptr);
+        if (std::any_of(families.begin(), families.begin() + 3,
+                        [&](uint32_t family) { return family >= family_count; })) {
+            return false;
+        }
+
+        VkBool32 has_presentation_support = false;
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, families[1], m_surface, &has_presentation_support);
+        if (!has_presentation_support) {
+            return false;
+        }
+
+        m_queue_families.graphics_family       = families[0];
+        m_queue_families.present_family        = families[1];
+        m_queue_families.compute_family        = families[2];
+        m_queue_families.has_dedicated_compute = families[3] != 0;
+        return true;
     }
 
     uint32_t rate_physical_device(VkPhysicalDevice device) {
@@ -514,7 +1181,19 @@ class TriangleApplication {
                 queue_family_indices.present_family = i;
             }
 
-            if (queue_family_indices.is_complete()) {
+            // Prefer a compute family without graphics support, it lets the driver overlap the simulation
+            // step with rendering. Any compute capable family is an acceptable fallback.
+            if (queue_family.queueFlags & VK_QUEUE_COMPUTE_BIT) {
+                bool is_dedicated = !(queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+
+                if (!queue_family_indices.compute_family.has_value() ||
+                    (is_dedicated && !queue_family_indices.has_dedicated_compute)) {
+                    queue_family_indices.compute_family        = i;
+                    queue_family_indices.has_dedicated_compute = is_dedicated;
+                }
+            }
+
+            if (queue_family_indices.is_complete() && queue_family_indices.has_dedicated_compute) {
                 break;
             }
 
@@ -524,12 +1203,84 @@ class TriangleApplication {
         return queue_family_indices;
     }
 
+    // Further GPUs for the GPU engine, best first. They only step bodies, so they need neither a swapchain nor
+    // graphics, just a compute queue. Slices are equal, so a helper much slower than the render device holds back
+    // every step, and software rasterizers are never picked.
+    void pick_helper_devices() {
+        if (m_gpu_count < 2) {
+            return;
+        }
+
+        uint32_t count = 0;
+        vkEnumeratePhysicalDevices(m_instance, &count, nullptr);
+
+        std::vector<VkPhysicalDevice> devices(count);
+        vkEnumeratePhysicalDevices(m_instance, &count, devices.data());
+
+        std::multimap<uint32_t, VkPhysicalDevice> candidates;
+
+        for (const auto& device : devices) {
+            uint32_t score = rate_helper_device(device);
+            if (device != m_physical_device && score > 0) {
+                candidates.insert(std::make_pair(score, device));
+            }
+        }
+
+        for (auto it = candidates.rbegin(); it != candidates.rend() && m_helpers.size() + 1 < m_gpu_count; ++it) {
+            auto helper                     = std::make_unique<HelperDevice>();
+            helper->context.physical_device = it->second;
+            helper->context.queue_family    = find_helper_queue_family(it->second).value();
+            m_helpers.push_back(std::move(helper));
+        }
+
+        if (m_helpers.size() + 1 < m_gpu_count) {
+            std::cerr << "TriangleApplication::pick_helper_devices => found " << m_helpers.size() + 1 << " of "
+                      << m_gpu_count << " GPUs, stepping on those.\n";
+        }
+    }
+
+    static uint32_t rate_helper_device(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+
+        if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU || !find_helper_queue_family(device)) {
+            return 0;
+        }
+
+        return properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ? 2 : 1;
+    }
+
+    // Prefers a compute family without graphics support like `find_queue_familiy_indices`.
+    static std::optional<uint32_t> find_helper_queue_family(VkPhysicalDevice physical_device) {
+        uint32_t queue_family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+
+        std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
+
+        std::optional<uint32_t> compute_family;
+        for (uint32_t i = 0; i < queue_family_count; ++i) {
+            if (!(queue_families[i].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+                continue;
+            }
+            if (!(queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+                return i;
+            }
+            if (!compute_family.has_value()) {
+                compute_family = i;
+            }
+        }
+
+        return compute_family;
+    }
+
     void create_logical_device() {
-        QueueFamilyIndices queue_family_indices = find_queue_familiy_indices(m_physical_device);
+        QueueFamilyIndices queue_family_indices = m_queue_families;
 
         std::vector<VkDeviceQueueCreateInfo> queue_create_infos{};
         std::set<uint32_t>                   unique_queue_families = {queue_family_indices.graphics_family.value(),
-                                                                      queue_family_indices.present_family.value()};
+                                                                      queue_family_indices.present_family.value(),
+                                                                      queue_family_indices.compute_family.value()};
 
         float queue_priority = 1.0f;
 
@@ -568,6 +1319,83 @@ class TriangleApplication {
 
         vkGetDeviceQueue(m_logical_device, queue_family_indices.graphics_family.value(), 0, &m_graphics_queue);
         vkGetDeviceQueue(m_logical_device, queue_family_indices.present_family.value(), 0, &m_present_queue);
+        vkGetDeviceQueue(m_logical_device, queue_family_indices.compute_family.value(), 0, &m_compute_queue);
+    }
+
+    // A logical device with a single compute queue per helper, plus everything its pipeline depends on.
+    void create_helper_devices() {
+        for (size_t i = 0; i < m_helpers.size(); ++i) {
+            DeviceContext& context = m_helpers[i]->context;
+
+            float queue_priority = 1.0f;
+
+            VkDeviceQueueCreateInfo queue_create_info = {};
+            queue_create_info.sType                   = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queue_create_info.queueFamilyIndex        = context.queue_family;
+            queue_create_info.queueCount              = 1;
+            queue_create_info.pQueuePriorities        = &queue_priority;
+
+            VkPhysicalDeviceFeatures physical_device_features = {};
+
+            VkDeviceCreateInfo device_create_info   = {};
+            device_create_info.sType                = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+            device_create_info.queueCreateInfoCount = 1;
+            device_create_info.pQueueCreateInfos    = &queue_create_info;
+            device_create_info.pEnabledFeatures     = &physical_device_features;
+
+            if (ENABLE_VALIDATION_LAYERS) {
+                device_create_info.enabledLayerCount   = static_cast<uint32_t>(m_validation_layers.size());
+                device_create_info.ppEnabledLayerNames = m_validation_layers.data();
+            }
+
+            if (vkCreateDevice(context.physical_device, &device_create_info, nullptr, &context.device) !=
+                VK_SUCCESS) {
+                throw std::runtime_error(
+                    "TriangleApplication::create_helper_devices => failed to create logical device!");
+            }
+
+            vkGetDeviceQueue(context.device, context.queue_family, 0, &context.queue);
+
+            m_helpers[i]->allocator.create(context.device, context.physical_device);
+            context.allocator = &m_helpers[i]->allocator;
+
+            VkCommandPoolCreateInfo command_pool_create_info{};
+            command_pool_create_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            command_pool_create_info.queueFamilyIndex = context.queue_family;
+            command_pool_create_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+            if (vkCreateCommandPool(context.device, &command_pool_create_info, nullptr, &context.command_pool) !=
+                VK_SUCCESS) {
+                throw std::runtime_error(
+                    "TriangleApplication::create_helper_devices => failed to create command pool!");
+            }
+
+            // One file per helper, since a cache only ever holds the data of one device.
+            std::string cache_file = "triangle_pipeline_cache_gpu" + std::to_string(i + 1) + ".bin";
+            m_helpers[i]->descriptor_set_layout = create_compute_descriptor_set_layout(context.device);
+            m_helpers[i]->pipeline_cache.create(context.device, context.physical_device,
+                                                nbody::default_cache_path(cache_file.c_str()));
+        }
+    }
+
+    static void destroy_helper_device(HelperDevice& helper) {
+        VkDevice device = helper.context.device;
+
+        for (size_t i = 0; i < helper.position_buffers.size(); ++i) {
+            helper.allocator.destroy_buffer(helper.position_buffers[i], helper.position_buffer_allocations[i]);
+            helper.allocator.destroy_buffer(helper.velocity_buffers[i], helper.velocity_buffer_allocations[i]);
+        }
+        destroy_exchange_buffers(helper.allocator, helper.exchange);
+
+        vkDestroyFence(device, helper.step_finished, nullptr);
+        vkDestroyDescriptorPool(device, helper.descriptor_pool, nullptr);
+        vkDestroyPipeline(device, helper.pipeline, nullptr);
+        vkDestroyPipelineLayout(device, helper.pipeline_layout, nullptr);
+        helper.pipeline_cache.destroy();
+        vkDestroyDescriptorSetLayout(device, helper.descriptor_set_layout, nullptr);
+        vkDestroyCommandPool(device, helper.context.command_pool, nullptr);
+        helper.allocator.destroy();
+        vkDestroyDevice(device, nullptr);
     }
 
     SwapChainSupportDetails query_swapchain_support_details(VkPhysicalDevice physical_device) {
@@ -612,13 +1440,27 @@ class TriangleApplication {
     }
 
     VkPresentModeKHR choose_swapchain_present_mode(const std::vector<VkPresentModeKHR>& present_modes) {
-        for (const auto& present_mode : present_modes) {
-            if (present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                return present_mode;
-            }
+        auto supported = [&](VkPresentModeKHR mode) {
+            return std::find(present_modes.begin(), present_modes.end(), mode) != present_modes.end();
+        };
+
+        VkPresentModeKHR wanted = m_present_policy == PresentPolicy::IMMEDIATE ? VK_PRESENT_MODE_IMMEDIATE_KHR
+                                  : m_present_policy == PresentPolicy::MAILBOX ? VK_PRESENT_MODE_MAILBOX_KHR
+                                                                               : VK_PRESENT_MODE_FIFO_KHR;
+        if (supported(wanted)) {
+            return wanted;
         }
 
-        return VK_PRESENT_MODE_FIFO_KHR;
+        // Without tearing is the closest to uncapped, otherwise vertical blank is all there is.
+        PresentPolicy fallback = m_present_policy == PresentPolicy::IMMEDIATE && supported(VK_PRESENT_MODE_MAILBOX_KHR)
+                                     ? PresentPolicy::MAILBOX
+                                     : PresentPolicy::FIFO;
+        if (m_retired_swapchains.empty()) {
+            std::cerr << "TriangleApplication::choose_swapchain_present_mode => the surface has no "
+                      << present_policy_name(m_present_policy) << " present mode, using "
+                      << present_policy_name(fallback) << "\n";
+        }
+        return fallback == PresentPolicy::MAILBOX ? VK_PRESENT_MODE_MAILBOX_KHR : VK_PRESENT_MODE_FIFO_KHR;
     }
 
     VkExtent2D choose_swapchain_extent(const VkSurfaceCapabilitiesKHR& capabilities) {
@@ -660,12 +1502,24 @@ class TriangleApplication {
         subpass.colorAttachmentCount = 1;
         subpass.pColorAttachments    = &color_attachment_reference;
 
+        // The image layout transition at the start of the render pass must wait until the image acquire
+        // semaphore, waited on at the color attachment output stage, has been signaled.
+        VkSubpassDependency subpass_dependency = {};
+        subpass_dependency.srcSubpass          = VK_SUBPASS_EXTERNAL;
+        subpass_dependency.dstSubpass          = 0;
+        subpass_dependency.srcStageMask        = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        subpass_dependency.srcAccessMask       = 0;
+        subpass_dependency.dstStageMask        = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        subpass_dependency.dstAccessMask       = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
         VkRenderPassCreateInfo render_pass_create_info = {};
         render_pass_create_info.sType                  = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
         render_pass_create_info.attachmentCount        = 1;
         render_pass_create_info.pAttachments           = &color_attachment_description;
         render_pass_create_info.subpassCount           = 1;
         render_pass_create_info.pSubpasses             = &subpass;
+        render_pass_create_info.dependencyCount        = 1;
+        render_pass_create_info.pDependencies          = &subpass_dependency;
 
         if (vkCreateRenderPass(m_logical_device, &render_pass_create_info, nullptr, &m_render_pass) != VK_SUCCESS) {
             throw std::runtime_error("TriangleApplication::create_render_pass => Failed to create render pass!");
@@ -698,11 +1552,15 @@ class TriangleApplication {
     }
 
     void create_graphics_pipleline() {
-        std::vector<char> vert_shader_code = read_file("shaders/vert.spv");
-        std::vector<char> frag_shader_code = read_file("shaders/frag.spv");
+        // Level of detail draws the instances `m_lod` picked, through the same layout.
+        bool                  lod = m_lod_pixels > 0.0f;
+        std::vector<uint32_t> vert_storage;
+        std::vector<uint32_t> frag_storage;
 
-        VkShaderModule vert_shader_module = create_shader_module(vert_shader_code);
-        VkShaderModule frag_shader_module = create_shader_module(frag_shader_code);
+        VkShaderModule vert_shader_module = create_shader_module(
+            nbody::load_shader(lod ? "shaders/impostor.vert.spv" : "shaders/shader.vert.spv", vert_storage));
+        VkShaderModule frag_shader_module = create_shader_module(
+            nbody::load_shader(lod ? "shaders/impostor.frag.spv" : "shaders/shader.frag.spv", frag_storage));
 
         VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
         vert_shader_stage_info.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -718,6 +1576,8 @@ class TriangleApplication {
 
         std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages = {vert_shader_stage_info, frag_shader_stage_info};
 
+        // No vertex buffers: the vertex shader fetches positions from the simulation storage buffer by
+        // `gl_InstanceIndex` and expands every body into a screen aligned quad from `gl_VertexIndex`.
         VkPipelineVertexInputStateCreateInfo vertex_input_info{};
         vertex_input_info.sType                           = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
         vertex_input_info.vertexBindingDescriptionCount   = 0;
@@ -727,7 +1587,7 @@ class TriangleApplication {
 
         VkPipelineInputAssemblyStateCreateInfo input_assembly_info{};
         input_assembly_info.sType                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        input_assembly_info.topology               = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        input_assembly_info.topology               = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
         input_assembly_info.primitiveRestartEnable = VK_FALSE;
 
         VkViewport viewport{};
@@ -765,7 +1625,7 @@ class TriangleApplication {
         rasterization_state_info.rasterizerDiscardEnable = VK_FALSE;
         rasterization_state_info.polygonMode             = VK_POLYGON_MODE_FILL;
         rasterization_state_info.lineWidth               = 1.0f;
-        rasterization_state_info.cullMode                = VK_CULL_MODE_BACK_BIT;
+        rasterization_state_info.cullMode                = VK_CULL_MODE_NONE;
         rasterization_state_info.frontFace               = VK_FRONT_FACE_CLOCKWISE;
         rasterization_state_info.depthBiasEnable         = VK_FALSE;
         rasterization_state_info.depthBiasEnable         = VK_FALSE;
@@ -788,12 +1648,11 @@ class TriangleApplication {
         color_blend_attachment_state.colorWriteMask =
             VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 
-        // Color blending disabled for this example
-        color_blend_attachment_state.blendEnable = VK_FALSE;
+        // Additive blending so that dense regions of overlapping sprites glow instead of hiding each other
+        color_blend_attachment_state.blendEnable = VK_TRUE;
 
-        // Optional blend factors and operations
         color_blend_attachment_state.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-        color_blend_attachment_state.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+        color_blend_attachment_state.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
         color_blend_attachment_state.colorBlendOp        = VK_BLEND_OP_ADD;
         color_blend_attachment_state.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
         color_blend_attachment_state.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
@@ -815,9 +1674,13 @@ class TriangleApplication {
         VkPipelineLayoutCreateInfo pipeline_layout_info{};
         pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 
+        std::array<VkDescriptorSetLayout, 2> set_layouts = {m_body_descriptor_set_layout,
+                                                            m_frame_descriptor_set_layout};
+
+        pipeline_layout_info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
+        pipeline_layout_info.pSetLayouts    = set_layouts.data();
+
         // Optional push constants
-        pipeline_layout_info.setLayoutCount         = 0;
-        pipeline_layout_info.pSetLayouts            = nullptr;
         pipeline_layout_info.pushConstantRangeCount = 0;
         pipeline_layout_info.pPushConstantRanges    = nullptr;
 
@@ -849,7 +1712,7 @@ class TriangleApplication {
         pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
         pipeline_create_info.basePipelineIndex  = -1;
 
-        if (vkCreateGraphicsPipelines(m_logical_device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr,
+        if (vkCreateGraphicsPipelines(m_logical_device, m_pipeline_cache.handle(), 1, &pipeline_create_info, nullptr,
                                       &m_graphics_pipeline) != VK_SUCCESS) {
             throw std::runtime_error(
                 "TriangleApplication::create_graphics_pipeline => failed to create graphics "
@@ -860,31 +1723,18 @@ class TriangleApplication {
         vkDestroyShaderModule(m_logical_device, frag_shader_module, nullptr);
     }
 
-    static std::vector<char> read_file(const std::string& filename) {
-        std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-        if (!file.is_open()) {
-            throw std::runtime_error("TriangleApplication::read_file => failed to open file!");
-        }
-
-        size_t            file_size = static_cast<size_t>(file.tellg());
-        std::vector<char> buffer(file_size);
-
-        file.seekg(0);
-        file.read(buffer.data(), file_size);
-        file.close();
-
-        return buffer;
+    VkShaderModule create_shader_module(std::span<const uint32_t> code) {
+        return create_shader_module(m_logical_device, code);
     }
 
-    VkShaderModule create_shader_module(const std::vector<char>& code) {
+    static VkShaderModule create_shader_module(VkDevice device, std::span<const uint32_t> code) {
         VkShaderModuleCreateInfo create_info{};
         create_info.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        create_info.codeSize = code.size();
-        create_info.pCode    = reinterpret_cast<const uint32_t*>(code.data());
+        create_info.codeSize = code.size_bytes();
+        create_info.pCode    = code.data();
 
         VkShaderModule shader_module;
-        if (vkCreateShaderModule(m_logical_device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
+        if (vkCreateShaderModule(device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
             throw std::runtime_error("TriangleApplication::create_shader_module => failed to create shader module!");
         }
 
@@ -914,7 +1764,7 @@ class TriangleApplication {
     }
 
     void create_command_pool() {
-        QueueFamilyIndices queue_family_indices = find_queue_familiy_indices(m_physical_device);
+        QueueFamilyIndices queue_family_indices = m_queue_families;
 
         VkCommandPoolCreateInfo command_pool_create_info{};
         command_pool_create_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -926,21 +1776,41 @@ class TriangleApplication {
         }
     }
 
-    void create_command_buffer() {
+    // Every frame slot records its own graphics and compute command buffers.
+    void create_command_buffers() {
+        m_frames.resize(m_frames_in_flight);
+
+        std::vector<VkCommandBuffer> command_buffers(m_frames_in_flight);
+        std::vector<VkCommandBuffer> compute_command_buffers(m_frames_in_flight);
+        std::vector<VkCommandBuffer> exchange_command_buffers(m_frames_in_flight);
+
         VkCommandBufferAllocateInfo command_buffer_allocate_info{};
         command_buffer_allocate_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
         command_buffer_allocate_info.commandPool        = m_command_pool;
         command_buffer_allocate_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        command_buffer_allocate_info.commandBufferCount = 1;
+        command_buffer_allocate_info.commandBufferCount = m_frames_in_flight;
 
-        if (vkAllocateCommandBuffers(m_logical_device, &command_buffer_allocate_info, &m_command_buffer) !=
-            VK_SUCCESS) {
+        VkCommandBufferAllocateInfo compute_command_buffer_allocate_info = command_buffer_allocate_info;
+        compute_command_buffer_allocate_info.commandPool                 = m_compute_command_pool;
+
+        if (vkAllocateCommandBuffers(m_logical_device, &command_buffer_allocate_info, command_buffers.data()) !=
+                VK_SUCCESS ||
+            vkAllocateCommandBuffers(m_logical_device, &compute_command_buffer_allocate_info,
+                                     compute_command_buffers.data()) != VK_SUCCESS ||
+            vkAllocateCommandBuffers(m_logical_device, &compute_command_buffer_allocate_info,
+                                     exchange_command_buffers.data()) != VK_SUCCESS) {
             throw std::runtime_error(
-                "TriangleApplication::create_command_buffer => failed to allocate command buffer!");
+                "TriangleApplication::create_command_buffers => failed to allocate command buffers!");
+        }
+
+        for (uint32_t i = 0; i < m_frames_in_flight; ++i) {
+            m_frames[i].command_buffer          = command_buffers[i];
+            m_frames[i].compute_command_buffer  = compute_command_buffers[i];
+            m_frames[i].exchange_command_buffer = exchange_command_buffers[i];
         }
     }
 
-    void record_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index) {
+    void record_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index, const FrameResources& frame) {
         VkCommandBufferBeginInfo command_buffer_begin_info{};
         command_buffer_begin_info.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         command_buffer_begin_info.flags            = 0;        // Optional
@@ -963,8 +1833,23 @@ class TriangleApplication {
         render_pass_begin_info.clearValueCount = 1;
         render_pass_begin_info.pClearValues    = &clear_color;
 
+        uint32_t first_query = m_current_frame * TIMESTAMPS_PER_FRAME + 2;
+        if (m_graphics_timestamp_mask != 0) {
+            vkCmdResetQueryPool(command_buffer, m_timestamp_pool, first_query, 2);
+            vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestamp_pool, first_query);
+        }
+
         vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(m_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphics_pipeline);
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphics_pipeline);
+
+        uint32_t        body_slot = m_engine == SimulationEngine::GPU ? m_simulation_read_index : m_current_frame;
+        VkDescriptorSet body_set  = m_lod_pixels > 0.0f ? m_lod_descriptor_sets[m_current_frame]
+                                                        : m_body_descriptor_sets[body_slot];
+
+        std::array<VkDescriptorSet, 2> descriptor_sets = {body_set, m_frame_descriptor_set};
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0,
+                                static_cast<uint32_t>(descriptor_sets.size()), descriptor_sets.data(), 1,
+                                &frame.camera_offset);
 
         VkViewport viewport{};
         viewport.x        = 0.0f;
@@ -980,58 +1865,144 @@ class TriangleApplication {
         scissor.extent = m_swapchain_extent;
         vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
-        vkCmdDraw(command_buffer, 3, 1, 0, 0);
+        // One four vertex triangle strip per body, or per instance the compute queue picked and counted.
+        if (m_lod_pixels > 0.0f) {
+            vkCmdDrawIndirect(command_buffer, m_lod.draw_buffer(m_current_frame), 0, 1, sizeof(VkDrawIndirectCommand));
+        } else {
+            vkCmdDraw(command_buffer, 4, m_body_count, 0, 0);
+        }
 
         vkCmdEndRenderPass(command_buffer);
 
+        if (m_graphics_timestamp_mask != 0) {
+            vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestamp_pool,
+                                first_query + 1);
+        }
+
         if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
             throw std::runtime_error("TriangleApplication::record_command_buffer => failed to record command buffer!");
         }
     }
 
+    // The time spent in the waits shows what bounds a frame: the in flight fence the GPU, the simulation wait the
+    // CPU step, acquire and present the swapchain.
     void draw_frame() {
-        vkWaitForFences(m_logical_device, 1, &m_fence_in_flight, VK_TRUE, UINT64_MAX);
-        vkResetFences(m_logical_device, 1, &m_fence_in_flight);
+        NBODY_TRACE_ZONE("frame");
 
-        uint32_t image_index{};
-        vkAcquireNextImageKHR(m_logical_device, m_swapchain, UINT64_MAX, m_semaphore_image_available, VK_NULL_HANDLE,
-                              &image_index);
+        FrameResources& frame = m_frames[m_current_frame];
 
-        vkResetCommandBuffer(m_command_buffer, 0);
-        record_command_buffer(m_command_buffer, image_index);
+        // Only the slot about to be reused has to be finished, the other frames keep running.
+        {
+            NBODY_TRACE_ZONE("frame.fence_wait");
+            vkWaitForFences(m_logical_device, 1, &frame.in_flight, VK_TRUE, UINT64_MAX);
+        }
+        read_gpu_timestamps(frame);
+        destroy_retired_swapchains();
+
+        // Under FIFO the GPU engine does not wait for vertical blank. While every image is queued for
+        // presentation it takes a step without rendering, so vsync caps the frame rate but not the simulation.
+        bool     decoupled   = m_engine == SimulationEngine::GPU && m_present_mode == VK_PRESENT_MODE_FIFO_KHR;
+        uint32_t image_index = 0;
+        bool     render      = false;
+        {
+            NBODY_TRACE_ZONE("frame.acquire");
+            render = acquire_next_image(frame, decoupled ? 0 : UINT64_MAX, image_index);
+        }
+        if (!render && !decoupled) {
+            // The swapchain was recreated. The fence is still signaled, so the slot is simply tried again.
+            return;
+        }
 
-        VkSubmitInfo submit_info{};
-        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        vkResetFences(m_logical_device, 1, &frame.in_flight);
 
-        std::array<VkSemaphore, 1>          signal_semaphores = {m_semaphore_render_finished};
-        std::array<VkSemaphore, 1>          wait_semaphores   = {m_semaphore_image_available};
-        std::array<VkPipelineStageFlags, 1> wait_stages       = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+        if (render) {
+            m_frame_camera = camera_uniforms();
+        }
+
+        if (m_engine == SimulationEngine::GPU) {
+            NBODY_TRACE_ZONE("frame.simulation");
+            step_simulation(frame, render);
+            frame.compute_timestamps_written = m_compute_timestamp_mask != 0;
+        } else {
+            interpolate_bodies(frame);
+        }
+
+        if (render) {
+            render_frame(frame, image_index);
+        }
+
+        m_current_frame = (m_current_frame + 1) % m_frames_in_flight;
+        ++m_frame_number;
+        update_stats_title();
+    }
+
+    // Whether an image was acquired into `image_index`, which then signals `frame.image_available`. A stale or
+    // out of date swapchain is recreated first, and a suboptimal one is still rendered to and presented before
+    // the next acquire recreates it.
+    bool acquire_next_image(FrameResources& frame, uint64_t timeout, uint32_t& image_index) {
+        if (m_swapchain_stale) {
+            recreate_swapchain();
+            if (m_swapchain_stale) {
+                return false;
+            }
+        }
+
+        VkResult result = vkAcquireNextImageKHR(m_logical_device, m_swapchain, timeout, frame.image_available,
+                                                VK_NULL_HANDLE, &image_index);
+        switch (result) {
+            case VK_SUCCESS:
+                return true;
+            case VK_SUBOPTIMAL_KHR:
+                m_swapchain_stale = true;
+                return true;
+            case VK_NOT_READY:
+            case VK_TIMEOUT:
+                return false;
+            case VK_ERROR_OUT_OF_DATE_KHR:
+                recreate_swapchain();
+                return false;
+            default:
+                throw std::runtime_error("TriangleApplication::acquire_next_image => failed to acquire an image!");
+        }
+    }
+
+    void render_frame(FrameResources& frame, uint32_t image_index) {
+        // The slot's fence signaled, so the device is done with everything its previous use uploaded.
+        m_upload_ring.begin_frame(m_current_frame);
+        update_camera_uniforms(frame);
+
+        {
+            NBODY_TRACE_ZONE("frame.record");
+            vkResetCommandBuffer(frame.command_buffer, 0);
+            record_command_buffer(frame.command_buffer, image_index, frame);
+            frame.render_timestamps_written = m_graphics_timestamp_mask != 0;
+        }
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-        submit_info.waitSemaphoreCount   = static_cast<uint32_t>(wait_semaphores.size());
+        // Waiting on the simulation semaphore at the vertex shader stage hands the freshly written positions
+        // over from the compute queue: the wait makes the compute writes available and visible to the vertex
+        // shader reads, without copying them anywhere. The draw indirect stage reads the instance count that
+        // level of detail writes. Host writes of the CPU engine are visible to the submit without any semaphore.
+        std::array<VkSemaphore, 1>          signal_semaphores = {m_semaphores_render_finished[image_index]};
+        std::array<VkSemaphore, 2>          wait_semaphores   = {frame.image_available, frame.simulation_finished};
+        std::array<VkPipelineStageFlags, 2> wait_stages       = {
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT};
+
+        submit_info.waitSemaphoreCount   = m_engine == SimulationEngine::GPU ? 2 : 1;
         submit_info.pWaitSemaphores      = wait_semaphores.data();
         submit_info.pWaitDstStageMask    = wait_stages.data();
         submit_info.commandBufferCount   = 1;
-        submit_info.pCommandBuffers      = &m_command_buffer;
+        submit_info.pCommandBuffers      = &frame.command_buffer;
         submit_info.signalSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size());
         submit_info.pSignalSemaphores    = signal_semaphores.data();
 
-        if (vkQueueSubmit(m_graphics_queue, 1, &submit_info, m_fence_in_flight) != VK_SUCCESS) {
+        if (vkQueueSubmit(m_graphics_queue, 1, &submit_info, frame.in_flight) != VK_SUCCESS) {
             throw std::runtime_error("TriangleApplication::draw_frame => failed to submit draw command buffer!");
         }
 
-        VkSubpassDependency subpass_dependency{};
-        subpass_dependency.srcSubpass    = VK_SUBPASS_EXTERNAL;
-        subpass_dependency.dstSubpass    = 0;
-        subpass_dependency.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        subpass_dependency.srcAccessMask = 0;
-        subpass_dependency.dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        subpass_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-        VkRenderPassCreateInfo render_pass_create_info{};
-        render_pass_create_info.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        render_pass_create_info.dependencyCount = 1;
-        render_pass_create_info.pDependencies   = &subpass_dependency;
-
         std::array<VkSwapchainKHR, 1> swapchains = {m_swapchain};
 
         VkPresentInfoKHR present_info{};
@@ -1043,7 +2014,213 @@ class TriangleApplication {
         present_info.pImageIndices      = &image_index;
         present_info.pResults           = nullptr;  // Optional
 
-        vkQueuePresentKHR(m_present_queue, &present_info);
+        VkResult result;
+        {
+            NBODY_TRACE_ZONE("frame.present");
+            result = vkQueuePresentKHR(m_present_queue, &present_info);
+        }
+
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+            m_swapchain_stale = true;
+        } else if (result != VK_SUCCESS) {
+            throw std::runtime_error("TriangleApplication::render_frame => failed to present!");
+        }
+    }
+
+    // Frame times and the zones that explain them, averaged per frame over `STATS_INTERVAL_NS` and shown in the
+    // window title, which needs no text rendering.
+    void update_stats_title() {
+        uint64_t now = nbody::trace_now();
+        if (m_stats_begin == 0) {
+            m_stats_begin = now;
+        }
+        if (now - m_stats_begin < STATS_INTERVAL_NS) {
+            return;
+        }
+
+        std::vector<nbody::TraceSummary> summaries = nbody::Tracer::global().summarize(m_stats_begin, now);
+        m_stats_begin                              = now;
+
+        // Per rendered frame, which under decoupled FIFO covers several iterations of the loop.
+        uint64_t frames = 0;
+        uint64_t steps  = 0;
+        for (const auto& summary : summaries) {
+            if (summary.name == "frame.record") {
+                frames = summary.count;
+            } else if (summary.name == "frame.simulation") {
+                steps = summary.count;
+            }
+        }
+        if (frames == 0) {
+            return;
+        }
+
+        auto milliseconds = [&](std::string_view name, uint64_t count) {
+            for (const auto& summary : summaries) {
+                if (summary.name == name) {
+                    return static_cast<double>(summary.total_ns) / static_cast<double>(count) * 1.0e-6;
+                }
+            }
+            return 0.0;
+        };
+
+        VkPresentModeKHR mode   = m_present_mode;
+        PresentPolicy    policy = mode == VK_PRESENT_MODE_IMMEDIATE_KHR ? PresentPolicy::IMMEDIATE
+                                  : mode == VK_PRESENT_MODE_MAILBOX_KHR ? PresentPolicy::MAILBOX
+                                                                        : PresentPolicy::FIFO;
+
+        std::ostringstream title;
+        title << std::fixed << std::setprecision(2) << "triangle (" << present_policy_name(policy) << ") | frame "
+              << milliseconds("frame", frames) << " ms | fence " << milliseconds("frame.fence_wait", frames)
+              << " | acquire " << milliseconds("frame.acquire", frames) << " | present "
+              << milliseconds("frame.present", frames);
+        if (m_engine == SimulationEngine::GPU && steps > 0) {
+            title << " | " << static_cast<double>(steps) / static_cast<double>(frames) << " steps of gpu "
+                  << milliseconds("gpu.compute", steps);
+        } else if (m_engine == SimulationEngine::CPU) {
+            uint64_t cpu_steps = 0;
+            for (const auto& summary : summaries) {
+                if (summary.name == "cpu.step") {
+                    cpu_steps = summary.count;
+                }
+            }
+            title << " | " << static_cast<double>(cpu_steps) / static_cast<double>(frames) << " steps";
+            if (cpu_steps > 0) {
+                title << " of " << milliseconds("cpu.step", cpu_steps) << " (tree "
+                      << milliseconds("octree.build", cpu_steps) << ")";
+            }
+            title << " | interpolate " << milliseconds("frame.interpolate", frames);
+        }
+        title << " | gpu render " << milliseconds("gpu.render", frames);
+        glfwSetWindowTitle(m_window, title.str().c_str());
+    }
+
+    /* ---- GPU timestamps ---- */
+
+    void create_timestamp_queries() {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(m_physical_device, &properties);
+        m_timestamp_period = properties.limits.timestampPeriod;
+
+        uint32_t queue_family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(m_physical_device, &queue_family_count, nullptr);
+        std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(m_physical_device, &queue_family_count, queue_families.data());
+
+        // Families that count no valid bits write no timestamps.
+        auto valid_mask = [&](uint32_t family) -> uint64_t {
+            uint32_t bits = queue_families[family].timestampValidBits;
+            return bits >= 64 ? UINT64_MAX : (uint64_t{1} << bits) - 1;
+        };
+
+        QueueFamilyIndices queue_family_indices = m_queue_families;
+        m_graphics_timestamp_mask               = valid_mask(queue_family_indices.graphics_family.value());
+        if (m_engine == SimulationEngine::GPU) {
+            m_compute_timestamp_mask = valid_mask(queue_family_indices.compute_family.value());
+        }
+        if (m_graphics_timestamp_mask == 0 && m_compute_timestamp_mask == 0) {
+            return;
+        }
+
+        VkQueryPoolCreateInfo query_pool_create_info{};
+        query_pool_create_info.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_pool_create_info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+        query_pool_create_info.queryCount = m_frames_in_flight * TIMESTAMPS_PER_FRAME;
+
+        if (vkCreateQueryPool(m_logical_device, &query_pool_create_info, nullptr, &m_timestamp_pool) != VK_SUCCESS) {
+            throw std::runtime_error("TriangleApplication::create_timestamp_queries => failed to create query pool!");
+        }
+
+        if (m_graphics_timestamp_mask != 0) {
+            m_graphics_clock_offset = measure_clock_offset(m_graphics_queue, m_command_pool, m_graphics_timestamp_mask);
+            m_render_track          = &nbody::Tracer::global().track("GPU graphics queue");
+        }
+        if (m_compute_timestamp_mask != 0) {
+            m_compute_clock_offset =
+                measure_clock_offset(m_compute_queue, m_compute_command_pool, m_compute_timestamp_mask);
+            m_compute_track = &nbody::Tracer::global().track("GPU compute queue");
+        }
+    }
+
+    // Trace time minus GPU time on `queue`, from one timestamp written while the queue is otherwise idle. GPU events
+    // come out early by the time this thread takes to notice the wait ended, which is small against a frame.
+    int64_t measure_clock_offset(VkQueue queue, VkCommandPool command_pool, uint64_t mask) {
+        VkCommandBufferAllocateInfo command_buffer_allocate_info{};
+        command_buffer_allocate_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        command_buffer_allocate_info.commandPool        = command_pool;
+        command_buffer_allocate_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        command_buffer_allocate_info.commandBufferCount = 1;
+
+        VkCommandBuffer command_buffer;
+        if (vkAllocateCommandBuffers(m_logical_device, &command_buffer_allocate_info, &command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::measure_clock_offset => failed to allocate command buffer!");
+        }
+
+        VkCommandBufferBeginInfo command_buffer_begin_info{};
+        command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+        vkCmdResetQueryPool(command_buffer, m_timestamp_pool, 0, 1);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestamp_pool, 0);
+        vkEndCommandBuffer(command_buffer);
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers    = &command_buffer;
+
+        if (vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("TriangleApplication::measure_clock_offset => failed to submit command buffer!");
+        }
+        vkQueueWaitIdle(queue);
+        uint64_t now = nbody::trace_now();
+
+        uint64_t ticks = 0;
+        vkGetQueryPoolResults(m_logical_device, m_timestamp_pool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks),
+                              VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        vkFreeCommandBuffers(m_logical_device, command_pool, 1, &command_buffer);
+
+        return static_cast<int64_t>(now) - static_cast<int64_t>(gpu_nanoseconds(ticks & mask));
+    }
+
+    uint64_t gpu_nanoseconds(uint64_t ticks) const {
+        return static_cast<uint64_t>(static_cast<double>(ticks) * m_timestamp_period);
+    }
+
+    // Called once the fence of `frame` signaled, which the render submit signals after the compute step it
+    // waited on, so every query the slot wrote is available.
+    void read_gpu_timestamps(FrameResources& frame) {
+        uint32_t first_query = m_current_frame * TIMESTAMPS_PER_FRAME;
+        if (frame.compute_timestamps_written) {
+            read_timestamp_pair(first_query, m_compute_timestamp_mask, m_compute_clock_offset, "gpu.compute",
+                                *m_compute_track);
+        }
+        if (frame.render_timestamps_written) {
+            read_timestamp_pair(first_query + 2, m_graphics_timestamp_mask, m_graphics_clock_offset, "gpu.render",
+                                *m_render_track);
+        }
+        frame.compute_timestamps_written = false;
+        frame.render_timestamps_written  = false;
+    }
+
+    void read_timestamp_pair(uint32_t query, uint64_t mask, int64_t clock_offset, const char* name,
+                             nbody::TraceRing& track) {
+        std::array<uint64_t, 2> ticks{};
+        if (vkGetQueryPoolResults(m_logical_device, m_timestamp_pool, query, 2, sizeof(ticks), ticks.data(),
+                                  sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+            return;
+        }
+
+        // A counter that wrapped between the two queries gives no duration.
+        uint64_t begin = ticks[0] & mask;
+        uint64_t end   = ticks[1] & mask;
+        if (end < begin || !nbody::Tracer::enabled()) {
+            return;
+        }
+        track.push(name, static_cast<uint64_t>(static_cast<int64_t>(gpu_nanoseconds(begin)) + clock_offset),
+                   static_cast<uint64_t>(static_cast<int64_t>(gpu_nanoseconds(end)) + clock_offset));
     }
 
     void create_synchonization_objects() {
@@ -1054,22 +2231,1177 @@ class TriangleApplication {
         fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
         fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-        if (vkCreateSemaphore(m_logical_device, &semaphore_create_info, nullptr, &m_semaphore_image_available) !=
+        for (auto& frame : m_frames) {
+            if (vkCreateSemaphore(m_logical_device, &semaphore_create_info, nullptr, &frame.image_available) !=
+                    VK_SUCCESS ||
+                vkCreateSemaphore(m_logical_device, &semaphore_create_info, nullptr, &frame.simulation_finished) !=
+                    VK_SUCCESS ||
+                vkCreateFence(m_logical_device, &fence_create_info, nullptr, &frame.in_flight) != VK_SUCCESS) {
+                throw std::runtime_error(
+                    "TriangleApplication::create_synchonization_objects => failed to create "
+                    "semaphores!");
+            }
+        }
+
+        create_render_finished_semaphores();
+    }
+
+    // One per swapchain image, see `m_semaphores_render_finished`.
+    void create_render_finished_semaphores() {
+        VkSemaphoreCreateInfo semaphore_create_info{};
+        semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        m_semaphores_render_finished.resize(m_swapchain_images.size());
+        for (auto& semaphore : m_semaphores_render_finished) {
+            if (vkCreateSemaphore(m_logical_device, &semaphore_create_info, nullptr, &semaphore) != VK_SUCCESS) {
+                throw std::runtime_error(
+                    "TriangleApplication::create_render_finished_semaphores => failed to create semaphores!");
+            }
+        }
+    }
+
+    /* ---- Simulation compute pipeline and storage buffers ---- */
+
+    void create_compute_descriptor_set_layout() {
+        m_compute_descriptor_set_layout = create_compute_descriptor_set_layout(m_logical_device);
+    }
+
+    static VkDescriptorSetLayout create_compute_descriptor_set_layout(VkDevice device) {
+        // 0: positions in, 1: velocities in, 2: positions out, 3: velocities out
+        std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); ++i) {
+            bindings[i].binding            = i;
+            bindings[i].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount    = 1;
+            bindings[i].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
+            bindings[i].pImmutableSamplers = nullptr;
+        }
+
+        VkDescriptorSetLayoutCreateInfo create_info{};
+        create_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        create_info.bindingCount = static_cast<uint32_t>(bindings.size());
+        create_info.pBindings    = bindings.data();
+
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+        if (vkCreateDescriptorSetLayout(device, &create_info, nullptr, &layout) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::create_compute_descriptor_set_layout => failed to create descriptor set "
+                "layout!");
+        }
+        return layout;
+    }
+
+    void create_compute_pipeline() {
+        create_compute_pipeline(m_logical_device, m_pipeline_cache.handle(), m_compute_descriptor_set_layout,
+                                m_compute_pipeline_layout, m_compute_pipeline);
+    }
+
+    // Steps the same descriptor sets as the direct sum.
+    void create_gpu_tree() {
+        nbody::GpuBarnesHutConfig config{};
+        config.timestep               = SIMULATION_TIMESTEP;
+        config.softening              = SIMULATION_SOFTENING;
+        config.gravitational_constant = GRAVITATIONAL_CONSTANT;
+        config.theta                  = nbody::SolverConfig{}.theta;
+
+        m_gpu_tree.create(m_allocator, m_physical_device, m_pipeline_cache.handle(), m_compute_descriptor_set_layout,
+                          m_body_count, config);
+    }
+
+    // The instance buffers of the frame slots are drawn from through body sets of their own.
+    void create_lod() {
+        nbody::GpuLodConfig config{};
+        config.detail_pixels = m_lod_pixels;
+        m_lod.create(m_allocator, m_pipeline_cache.handle(), m_gpu_tree, m_frames_in_flight, config,
+                     render_queue_families());
+
+        std::vector<VkDescriptorSetLayout> layouts(m_frames_in_flight, m_body_descriptor_set_layout);
+        m_lod_descriptor_sets.resize(layouts.size());
+
+        VkDescriptorSetAllocateInfo allocate_info{};
+        allocate_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocate_info.descriptorPool     = m_descriptor_pool;
+        allocate_info.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+        allocate_info.pSetLayouts        = layouts.data();
+
+        if (vkAllocateDescriptorSets(m_logical_device, &allocate_info, m_lod_descriptor_sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("TriangleApplication::create_lod => failed to allocate descriptor sets!");
+        }
+
+        for (uint32_t i = 0; i < m_frames_in_flight; ++i) {
+            VkDescriptorBufferInfo instance_buffer_info{m_lod.instance_buffer(i), 0, m_lod.instance_buffer_size()};
+
+            VkWriteDescriptorSet write{};
+            write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet          = m_lod_descriptor_sets[i];
+            write.dstBinding      = 0;
+            write.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write.descriptorCount = 1;
+            write.pBufferInfo     = &instance_buffer_info;
+
+            vkUpdateDescriptorSets(m_logical_device, 1, &write, 0, nullptr);
+        }
+    }
+
+    // The families of the compute queue, which writes what the graphics queue draws, and of the graphics queue.
+    std::vector<uint32_t> render_queue_families() {
+        QueueFamilyIndices    queue_family_indices = m_queue_families;
+        std::vector<uint32_t> queue_families{queue_family_indices.compute_family.value()};
+        if (queue_family_indices.graphics_family.value() != queue_family_indices.compute_family.value()) {
+            queue_families.push_back(queue_family_indices.graphics_family.value());
+        }
+        return queue_families;
+    }
+
+    static void create_compute_pipeline(VkDevice device, VkPipelineCache cache, VkDescriptorSetLayout set_layout,
+                                        VkPipelineLayout& pipeline_layout, VkPipeline& pipeline) {
+        std::vector<uint32_t> comp_storage;
+        VkShaderModule        comp_shader_module =
+            create_shader_module(device, nbody::load_shader("shaders/nbody.comp.spv", comp_storage));
+
+        VkPipelineShaderStageCreateInfo comp_shader_stage_info{};
+        comp_shader_stage_info.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        comp_shader_stage_info.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+        comp_shader_stage_info.module = comp_shader_module;
+        comp_shader_stage_info.pName  = "main";
+
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constant_range.offset     = 0;
+        push_constant_range.size       = sizeof(SimulationPushConstants);
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.setLayoutCount         = 1;
+        pipeline_layout_info.pSetLayouts            = &set_layout;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges    = &push_constant_range;
+
+        if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pipeline_layout) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::create_compute_pipeline => failed to create pipeline layout!");
+        }
+
+        VkComputePipelineCreateInfo pipeline_create_info{};
+        pipeline_create_info.sType              = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_create_info.stage              = comp_shader_stage_info;
+        pipeline_create_info.layout             = pipeline_layout;
+        pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+        pipeline_create_info.basePipelineIndex  = -1;
+
+        if (vkCreateComputePipelines(device, cache, 1, &pipeline_create_info, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::create_compute_pipeline => failed to create compute pipeline!");
+        }
+
+        vkDestroyShaderModule(device, comp_shader_module, nullptr);
+    }
+
+    void create_compute_command_pool() {
+        QueueFamilyIndices queue_family_indices = m_queue_families;
+
+        VkCommandPoolCreateInfo command_pool_create_info{};
+        command_pool_create_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        command_pool_create_info.queueFamilyIndex = queue_family_indices.compute_family.value();
+        command_pool_create_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+        if (vkCreateCommandPool(m_logical_device, &command_pool_create_info, nullptr, &m_compute_command_pool) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::create_compute_command_pool => failed to create command pool!");
+        }
+    }
+
+    // The compute queue of the render device, which owns the simulation buffers.
+    DeviceContext render_context() {
+        uint32_t compute_family = m_queue_families.compute_family.value();
+        return {m_physical_device, m_logical_device, compute_family, m_compute_queue, m_compute_command_pool,
+                &m_allocator};
+    }
+
+    // Copies through a one-shot command buffer on the compute queue of `context`, which owns the simulation
+    // buffers of its device.
+    static void copy_buffer(const DeviceContext& context, VkBuffer source, VkBuffer destination, VkDeviceSize size) {
+        VkCommandBufferAllocateInfo command_buffer_allocate_info{};
+        command_buffer_allocate_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        command_buffer_allocate_info.commandPool        = context.command_pool;
+        command_buffer_allocate_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        command_buffer_allocate_info.commandBufferCount = 1;
+
+        VkCommandBuffer command_buffer;
+        if (vkAllocateCommandBuffers(context.device, &command_buffer_allocate_info, &command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("TriangleApplication::copy_buffer => failed to allocate command buffer!");
+        }
+
+        VkCommandBufferBeginInfo command_buffer_begin_info{};
+        command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+
+        VkBufferCopy copy_region{};
+        copy_region.srcOffset = 0;
+        copy_region.dstOffset = 0;
+        copy_region.size      = size;
+        vkCmdCopyBuffer(command_buffer, source, destination, 1, &copy_region);
+
+        vkEndCommandBuffer(command_buffer);
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers    = &command_buffer;
+
+        if (vkQueueSubmit(context.queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("TriangleApplication::copy_buffer => failed to submit copy command buffer!");
+        }
+        vkQueueWaitIdle(context.queue);
+
+        vkFreeCommandBuffers(context.device, context.command_pool, 1, &command_buffer);
+    }
+
+    // Uploads `data` into a new device local storage buffer through a temporary host visible staging buffer.
+    static void create_storage_buffer(const DeviceContext& context, const std::vector<std::array<float, 4>>& data,
+                                      VkBuffer& buffer, nbody::GpuAllocation& allocation,
+                                      const std::vector<uint32_t>& queue_families = {}) {
+        VkDeviceSize size = sizeof(data[0]) * data.size();
+
+        nbody::GpuAllocator& allocator = *context.allocator;
+
+        nbody::GpuAllocation staging_allocation{};
+        VkBuffer             staging_buffer = allocator.create_buffer(
+            size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, nbody::MemoryUsage::HOST_UPLOAD, staging_allocation);
+        std::memcpy(staging_allocation.mapped, data.data(), static_cast<size_t>(size));
+
+        buffer = allocator.create_buffer(size,
+                                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                             VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                         nbody::MemoryUsage::DEVICE_LOCAL, allocation, queue_families);
+        copy_buffer(context, staging_buffer, buffer, size);
+
+        allocator.destroy_buffer(staging_buffer, staging_allocation);
+    }
+
+    // Downloads are read by the host, which is slow from uncached memory, uploads are only written by it.
+    static void create_exchange_buffers(const DeviceContext& context, VkDeviceSize size, ExchangeBuffers& exchange) {
+        nbody::GpuAllocator& allocator = *context.allocator;
+
+        exchange.download = allocator.create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                    nbody::MemoryUsage::HOST_READBACK, exchange.download_allocation);
+        exchange.upload   = allocator.create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                    nbody::MemoryUsage::HOST_UPLOAD, exchange.upload_allocation);
+    }
+
+    static void destroy_exchange_buffers(nbody::GpuAllocator& allocator, ExchangeBuffers& exchange) {
+        allocator.destroy_buffer(exchange.download, exchange.download_allocation);
+        allocator.destroy_buffer(exchange.upload, exchange.upload_allocation);
+    }
+
+    void create_simulation_buffers() {
+        // One buffer per frame in flight that may still be rendering from it, plus the one being written.
+        size_t slot_count = m_frames_in_flight + 1;
+        m_position_buffers.resize(slot_count);
+        m_position_buffer_allocations.resize(slot_count);
+        m_velocity_buffers.resize(slot_count);
+        m_velocity_buffer_allocations.resize(slot_count);
+
+        std::vector<std::array<float, 4>> positions(m_body_count);
+        std::vector<std::array<float, 4>> velocities(m_body_count);
+        generate_initial_bodies(positions, velocities);
+
+        // Positions are written by the compute queue and read by the graphics queue.
+        std::vector<uint32_t> position_queue_families = render_queue_families();
+
+        // All slots start from the same state, every step overwrites the slot after the one it reads.
+        DeviceContext context = render_context();
+        for (size_t i = 0; i < m_position_buffers.size(); ++i) {
+            create_storage_buffer(context, positions, m_position_buffers[i], m_position_buffer_allocations[i],
+                                  position_queue_families);
+            create_storage_buffer(context, velocities, m_velocity_buffers[i], m_velocity_buffer_allocations[i]);
+        }
+
+        partition_bodies();
+        if (!m_helpers.empty()) {
+            create_helper_simulations(positions, velocities);
+        }
+    }
+
+    // Equal slices in whole workgroups, so that no workgroup straddles two GPUs.
+    void partition_bodies() {
+        uint32_t gpu_count   = static_cast<uint32_t>(m_helpers.size()) + 1;
+        uint32_t group_count = (m_body_count + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE;
+
+        m_slices.clear();
+        for (uint32_t i = 0; i < gpu_count; ++i) {
+            uint32_t first = std::min(group_count * i / gpu_count * COMPUTE_WORKGROUP_SIZE, m_body_count);
+            uint32_t end   = std::min(group_count * (i + 1) / gpu_count * COMPUTE_WORKGROUP_SIZE, m_body_count);
+            m_slices.push_back({first, end - first});
+        }
+    }
+
+    // Every helper starts from the full initial state like the slots of the render device, and gets its own
+    // pool, sets, command buffer and fence, which belong to its device.
+    void create_helper_simulations(const std::vector<std::array<float, 4>>& positions,
+                                   const std::vector<std::array<float, 4>>& velocities) {
+        VkDeviceSize buffer_size = sizeof(positions[0]) * positions.size();
+
+        VkFenceCreateInfo fence_create_info{};
+        fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        create_exchange_buffers(render_context(), buffer_size, m_exchange);
+        if (vkCreateFence(m_logical_device, &fence_create_info, nullptr, &m_exchange_fence) != VK_SUCCESS) {
+            throw std::runtime_error("TriangleApplication::create_helper_simulations => failed to create fence!");
+        }
+
+        for (auto& helper_pointer : m_helpers) {
+            HelperDevice&        helper  = *helper_pointer;
+            const DeviceContext& context = helper.context;
+
+            for (size_t i = 0; i < helper.position_buffers.size(); ++i) {
+                create_storage_buffer(context, positions, helper.position_buffers[i],
+                                      helper.position_buffer_allocations[i]);
+                create_storage_buffer(context, velocities, helper.velocity_buffers[i],
+                                      helper.velocity_buffer_allocations[i]);
+            }
+            create_exchange_buffers(context, buffer_size, helper.exchange);
+
+            VkDescriptorPoolSize pool_size{};
+            pool_size.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            pool_size.descriptorCount = static_cast<uint32_t>(4 * helper.descriptor_sets.size());
+
+            VkDescriptorPoolCreateInfo pool_create_info{};
+            pool_create_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+            pool_create_info.poolSizeCount = 1;
+            pool_create_info.pPoolSizes    = &pool_size;
+            pool_create_info.maxSets       = static_cast<uint32_t>(helper.descriptor_sets.size());
+
+            if (vkCreateDescriptorPool(context.device, &pool_create_info, nullptr, &helper.descriptor_pool) !=
+                VK_SUCCESS) {
+                throw std::runtime_error(
+                    "TriangleApplication::create_helper_simulations => failed to create descriptor pool!");
+            }
+
+            std::array<VkDescriptorSetLayout, 2> layouts = {helper.descriptor_set_layout,
+                                                            helper.descriptor_set_layout};
+
+            VkDescriptorSetAllocateInfo set_allocate_info{};
+            set_allocate_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            set_allocate_info.descriptorPool     = helper.descriptor_pool;
+            set_allocate_info.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+            set_allocate_info.pSetLayouts        = layouts.data();
+
+            VkCommandBufferAllocateInfo command_buffer_allocate_info{};
+            command_buffer_allocate_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            command_buffer_allocate_info.commandPool        = context.command_pool;
+            command_buffer_allocate_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            command_buffer_allocate_info.commandBufferCount = 1;
+
+            if (vkAllocateDescriptorSets(context.device, &set_allocate_info, helper.descriptor_sets.data()) !=
+                    VK_SUCCESS ||
+                vkAllocateCommandBuffers(context.device, &command_buffer_allocate_info, &helper.command_buffer) !=
+                    VK_SUCCESS ||
+                vkCreateFence(context.device, &fence_create_info, nullptr, &helper.step_finished) != VK_SUCCESS) {
+                throw std::runtime_error(
+                    "TriangleApplication::create_helper_simulations => failed to create step resources!");
+            }
+
+            for (size_t i = 0; i < helper.descriptor_sets.size(); ++i) {
+                size_t next = 1 - i;
+                write_compute_descriptor_set(context.device, helper.descriptor_sets[i],
+                                             {helper.position_buffers[i], helper.velocity_buffers[i],
+                                              helper.position_buffers[next], helper.velocity_buffers[next]},
+                                             buffer_size);
+            }
+        }
+    }
+
+    // The disk of `InitialConditions::DISK`. Positions carry the mass in `w`.
+    static void generate_initial_bodies(std::vector<std::array<float, 4>>& positions,
+                                        std::vector<std::array<float, 4>>& velocities) {
+        nbody::Bodies bodies = nbody::generate_initial_conditions(nbody::InitialConditions::DISK, positions.size());
+
+        for (size_t i = 0; i < positions.size(); ++i) {
+            positions[i]  = {bodies.x[i], bodies.y[i], bodies.z[i], bodies.mass[i]};
+            velocities[i] = {bodies.vx[i], bodies.vy[i], bodies.vz[i], 0.0f};
+        }
+    }
+
+    void create_descriptor_pool() {
+        // A compute and a body set per simulation slot and the camera set. The CPU engine has no compute sets and
+        // one body set per frame slot. Level of detail adds a body set per frame slot.
+        uint32_t compute_set_count = static_cast<uint32_t>(m_position_buffers.size());
+        uint32_t body_set_count    = static_cast<uint32_t>(body_buffers().size());
+        if (m_lod_pixels > 0.0f) {
+            body_set_count += m_frames_in_flight;
+        }
+
+        std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+        pool_sizes[0].type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        pool_sizes[0].descriptorCount = 4 * compute_set_count + body_set_count;
+        pool_sizes[1].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        pool_sizes[1].descriptorCount = 1;
+
+        VkDescriptorPoolCreateInfo create_info{};
+        create_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+        create_info.pPoolSizes    = pool_sizes.data();
+        create_info.maxSets       = compute_set_count + body_set_count + 1;
+
+        if (vkCreateDescriptorPool(m_logical_device, &create_info, nullptr, &m_descriptor_pool) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::create_descriptor_pool => failed to create descriptor pool!");
+        }
+    }
+
+    void create_compute_descriptor_sets() {
+        if (m_position_buffers.empty()) {
+            return;
+        }
+
+        std::vector<VkDescriptorSetLayout> layouts(m_position_buffers.size(), m_compute_descriptor_set_layout);
+        m_compute_descriptor_sets.resize(layouts.size());
+
+        VkDescriptorSetAllocateInfo allocate_info{};
+        allocate_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocate_info.descriptorPool     = m_descriptor_pool;
+        allocate_info.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+        allocate_info.pSetLayouts        = layouts.data();
+
+        if (vkAllocateDescriptorSets(m_logical_device, &allocate_info, m_compute_descriptor_sets.data()) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::create_compute_descriptor_sets => failed to allocate descriptor sets!");
+        }
+
+        VkDeviceSize buffer_size = sizeof(float) * 4 * m_body_count;
+
+        // Set `i` reads the state from slot `i` and writes the next state into the following slot.
+        for (size_t i = 0; i < m_compute_descriptor_sets.size(); ++i) {
+            size_t next = (i + 1) % m_compute_descriptor_sets.size();
+            write_compute_descriptor_set(m_logical_device, m_compute_descriptor_sets[i],
+                                         {m_position_buffers[i], m_velocity_buffers[i], m_position_buffers[next],
+                                          m_velocity_buffers[next]},
+                                         buffer_size);
+        }
+    }
+
+    // Binds `buffers` in the order of the bindings of `create_compute_descriptor_set_layout`.
+    static void write_compute_descriptor_set(VkDevice device, VkDescriptorSet set,
+                                             const std::array<VkBuffer, 4>& buffers, VkDeviceSize buffer_size) {
+        std::array<VkDescriptorBufferInfo, 4> buffer_infos{};
+        std::array<VkWriteDescriptorSet, 4>   writes{};
+        for (uint32_t binding = 0; binding < writes.size(); ++binding) {
+            buffer_infos[binding] = VkDescriptorBufferInfo{buffers[binding], 0, buffer_size};
+
+            writes[binding].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet          = set;
+            writes[binding].dstBinding      = binding;
+            writes[binding].dstArrayElement = 0;
+            writes[binding].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[binding].descriptorCount = 1;
+            writes[binding].pBufferInfo     = &buffer_infos[binding];
+        }
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    // Only a rendered frame picks what it draws.
+    void record_compute_command_buffer(VkCommandBuffer command_buffer, bool render) {
+        VkCommandBufferBeginInfo command_buffer_begin_info{};
+        command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::record_compute_command_buffer => failed to begin recording command buffer!");
+        }
+
+        uint32_t first_query = m_current_frame * TIMESTAMPS_PER_FRAME;
+        if (m_compute_timestamp_mask != 0) {
+            vkCmdResetQueryPool(command_buffer, m_timestamp_pool, first_query, 2);
+            vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestamp_pool, first_query);
+        }
+
+        if (m_gpu_tree_enabled) {
+            m_gpu_tree.record_step(command_buffer, m_compute_descriptor_sets[m_simulation_read_index]);
+            if (render && m_lod_pixels > 0.0f) {
+                m_lod.record_cull(command_buffer, m_current_frame, lod_view());
+            }
+        } else {
+            record_step_dispatch(command_buffer, m_compute_pipeline, m_compute_pipeline_layout,
+                                 m_compute_descriptor_sets[m_simulation_read_index], m_slices[0]);
+        }
+
+        if (!m_helpers.empty()) {
+            uint32_t next = (m_simulation_read_index + 1) % static_cast<uint32_t>(m_position_buffers.size());
+            record_slice_download(command_buffer, m_position_buffers[next], m_slices[0], m_exchange);
+        }
+
+        if (m_compute_timestamp_mask != 0) {
+            vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestamp_pool,
+                                first_query + 1);
+        }
+
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::record_compute_command_buffer => failed to record command buffer!");
+        }
+    }
+
+    // Steps the bodies of `slice` from the state `set` reads into the state it writes.
+    void record_step_dispatch(VkCommandBuffer command_buffer, VkPipeline pipeline, VkPipelineLayout pipeline_layout,
+                              VkDescriptorSet set, const BodySlice& slice) const {
+        // Make the previous step's writes, and the slices copied in from other GPUs, visible before this step
+        // reads them as its input.
+        VkMemoryBarrier memory_barrier{};
+        memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+        SimulationPushConstants push_constants{};
+        push_constants.body_count             = m_body_count;
+        push_constants.first_target           = slice.first;
+        push_constants.target_count           = slice.count;
+        push_constants.timestep               = SIMULATION_TIMESTEP;
+        push_constants.softening_squared      = SIMULATION_SOFTENING * SIMULATION_SOFTENING;
+        push_constants.gravitational_constant = GRAVITATIONAL_CONSTANT;
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &set, 0,
+                                nullptr);
+        vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants),
+                           &push_constants);
+
+        uint32_t group_count = (slice.count + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE;
+        vkCmdDispatch(command_buffer, group_count, 1, 1);
+    }
+
+    // Copies the slice a step just wrote into the download buffer, where the host can read it once the
+    // submission's fence signaled.
+    static void record_slice_download(VkCommandBuffer command_buffer, VkBuffer positions, const BodySlice& slice,
+                                      const ExchangeBuffers& exchange) {
+        VkMemoryBarrier memory_barrier{};
+        memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1,
+                             &memory_barrier, 0, nullptr, 0, nullptr);
+
+        VkBufferCopy copy_region = slice_region(slice);
+        vkCmdCopyBuffer(command_buffer, positions, exchange.download, 1, &copy_region);
+
+        memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                             &memory_barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // Copies every slice but `m_slices[local]` from the upload buffer into `positions`. Host writes before the
+    // submit are visible to it without a barrier.
+    void record_slice_upload(VkCommandBuffer command_buffer, const ExchangeBuffers& exchange, VkBuffer positions,
+                             size_t local) const {
+        std::vector<VkBufferCopy> copy_regions;
+        for (size_t i = 0; i < m_slices.size(); ++i) {
+            if (i != local && m_slices[i].count > 0) {
+                copy_regions.push_back(slice_region(m_slices[i]));
+            }
+        }
+
+        if (!copy_regions.empty()) {
+            vkCmdCopyBuffer(command_buffer, exchange.upload, positions, static_cast<uint32_t>(copy_regions.size()),
+                            copy_regions.data());
+        }
+    }
+
+    // Exchange buffers are laid out like the position buffers, so a slice is at the same offset in both.
+    static VkBufferCopy slice_region(const BodySlice& slice) {
+        VkDeviceSize body_size = sizeof(float) * 4;
+        return {body_size * slice.first, body_size * slice.first, body_size * slice.count};
+    }
+
+    // Called once the frame's fence signaled: the frame that last rendered from the slot this step writes is
+    // `m_frames_in_flight` frames old, so it has finished as well.
+    // A frame that renders waits on `frame.simulation_finished`, one that does not has the step signal its fence.
+    void step_simulation(FrameResources& frame, bool render) {
+        if (!m_helpers.empty()) {
+            step_simulation_on_all_gpus(frame, render);
+            return;
+        }
+
+        vkResetCommandBuffer(frame.compute_command_buffer, 0);
+        record_compute_command_buffer(frame.compute_command_buffer, render);
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount   = 1;
+        submit_info.pCommandBuffers      = &frame.compute_command_buffer;
+        submit_info.signalSemaphoreCount = render ? 1 : 0;
+        submit_info.pSignalSemaphores    = &frame.simulation_finished;
+
+        if (vkQueueSubmit(m_compute_queue, 1, &submit_info, render ? VK_NULL_HANDLE : frame.in_flight) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::step_simulation => failed to submit compute command buffer!");
+        }
+
+        m_simulation_read_index = (m_simulation_read_index + 1) % static_cast<uint32_t>(m_position_buffers.size());
+    }
+
+    // Every GPU steps its slice and copies it to the host, which hands each slice on to all other GPUs. Separate
+    // logical devices share no memory or semaphores, so this thread waits for the slowest GPU every step, and only
+    // rendering still overlaps with the next frame. The render device copies the other slices into the new slot
+    // right away, helpers only at the start of their next step.
+    void step_simulation_on_all_gpus(FrameResources& frame, bool render) {
+        std::vector<VkFence> helper_fences;
+        for (size_t i = 0; i < m_helpers.size(); ++i) {
+            submit_helper_step(*m_helpers[i], i + 1);
+            helper_fences.push_back(m_helpers[i]->step_finished);
+        }
+
+        vkResetCommandBuffer(frame.compute_command_buffer, 0);
+        record_compute_command_buffer(frame.compute_command_buffer, render);
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers    = &frame.compute_command_buffer;
+
+        vkResetFences(m_logical_device, 1, &m_exchange_fence);
+        if (vkQueueSubmit(m_compute_queue, 1, &submit_info, m_exchange_fence) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::step_simulation_on_all_gpus => failed to submit compute command buffer!");
+        }
+
+        vkWaitForFences(m_logical_device, 1, &m_exchange_fence, VK_TRUE, UINT64_MAX);
+        for (size_t i = 0; i < m_helpers.size(); ++i) {
+            vkWaitForFences(m_helpers[i]->context.device, 1, &helper_fences[i], VK_TRUE, UINT64_MAX);
+        }
+
+        gather_slices();
+
+        uint32_t next = (m_simulation_read_index + 1) % static_cast<uint32_t>(m_position_buffers.size());
+
+        VkCommandBufferBeginInfo command_buffer_begin_info{};
+        command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkResetCommandBuffer(frame.exchange_command_buffer, 0);
+        vkBeginCommandBuffer(frame.exchange_command_buffer, &command_buffer_begin_info);
+        record_slice_upload(frame.exchange_command_buffer, m_exchange, m_position_buffers[next], 0);
+        if (vkEndCommandBuffer(frame.exchange_command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::step_simulation_on_all_gpus => failed to record command buffer!");
+        }
+
+        // The render submit waits on this one, which follows the step on the same queue.
+        submit_info.pCommandBuffers      = &frame.exchange_command_buffer;
+        submit_info.signalSemaphoreCount = render ? 1 : 0;
+        submit_info.pSignalSemaphores    = &frame.simulation_finished;
+
+        if (vkQueueSubmit(m_compute_queue, 1, &submit_info, render ? VK_NULL_HANDLE : frame.in_flight) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::step_simulation_on_all_gpus => failed to submit exchange command buffer!");
+        }
+
+        m_simulation_read_index = next;
+        for (const auto& helper : m_helpers) {
+            helper->upload_pending = true;
+        }
+    }
+
+    // The previous step of the helper finished, since `step_simulation_on_all_gpus` waited on its fence.
+    void submit_helper_step(HelperDevice& helper, size_t slice_index) {
+        const BodySlice& slice = m_slices[slice_index];
+
+        VkCommandBufferBeginInfo command_buffer_begin_info{};
+        command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        uint32_t next = 1 - helper.read_index;
+
+        vkResetCommandBuffer(helper.command_buffer, 0);
+        vkBeginCommandBuffer(helper.command_buffer, &command_buffer_begin_info);
+        if (helper.upload_pending) {
+            record_slice_upload(helper.command_buffer, helper.exchange, helper.position_buffers[helper.read_index],
+                                slice_index);
+        }
+        record_step_dispatch(helper.command_buffer, helper.pipeline, helper.pipeline_layout,
+                             helper.descriptor_sets[helper.read_index], slice);
+        record_slice_download(helper.command_buffer, helper.position_buffers[next], slice, helper.exchange);
+        if (vkEndCommandBuffer(helper.command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("TriangleApplication::submit_helper_step => failed to record command buffer!");
+        }
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers    = &helper.command_buffer;
+
+        vkResetFences(helper.context.device, 1, &helper.step_finished);
+        if (vkQueueSubmit(helper.context.queue, 1, &submit_info, helper.step_finished) != VK_SUCCESS) {
+            throw std::runtime_error("TriangleApplication::submit_helper_step => failed to submit command buffer!");
+        }
+
+        helper.read_index     = next;
+        helper.upload_pending = false;
+    }
+
+    // Copies the slice of every GPU from its download buffer into the upload buffers of all other GPUs.
+    void gather_slices() {
+        std::vector<ExchangeBuffers*> exchanges{&m_exchange};
+        for (const auto& helper : m_helpers) {
+            exchanges.push_back(&helper->exchange);
+        }
+
+        for (size_t source = 0; source < exchanges.size(); ++source) {
+            VkBufferCopy region = slice_region(m_slices[source]);
+            const auto*  slice = static_cast<const std::byte*>(exchanges[source]->download_allocation.mapped);
+
+            for (size_t target = 0; target < exchanges.size(); ++target) {
+                if (target != source) {
+                    auto* upload = static_cast<std::byte*>(exchanges[target]->upload_allocation.mapped);
+                    std::memcpy(upload + region.dstOffset, slice + region.srcOffset,
+                                static_cast<size_t>(region.size));
+                }
+            }
+        }
+    }
+
+    /* ---- CPU simulation engine ---- */
+
+    static nbody::SolverConfig make_solver_config(const ApplicationOptions& options) {
+        nbody::SolverConfig config{};
+        config.kind                   = options.solver;
+        config.softening              = SIMULATION_SOFTENING;
+        config.gravitational_constant = GRAVITATIONAL_CONSTANT;
+        config.isa                    = options.isa;
+        return config;
+    }
+
+    void create_cpu_simulation() {
+        std::vector<std::array<float, 4>> positions(m_body_count);
+        std::vector<std::array<float, 4>> velocities(m_body_count);
+        generate_initial_bodies(positions, velocities);
+
+        SimulationState initial{};
+        initial.previous = positions;
+        initial.current  = positions;
+        m_simulation_states.fill(initial);
+
+        m_bodies.resize(m_body_count);
+        for (size_t i = 0; i < positions.size(); ++i) {
+            m_bodies.x[i]    = positions[i][0];
+            m_bodies.y[i]    = positions[i][1];
+            m_bodies.z[i]    = positions[i][2];
+            m_bodies.mass[i] = positions[i][3];
+            m_bodies.vx[i]   = velocities[i][0];
+            m_bodies.vy[i]   = velocities[i][1];
+            m_bodies.vz[i]   = velocities[i][2];
+        }
+
+        VkDeviceSize size = sizeof(positions[0]) * positions.size();
+        for (auto& frame : m_frames) {
+            frame.body_buffer = m_allocator.create_buffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                          nbody::MemoryUsage::HOST_UPLOAD,
+                                                          frame.body_buffer_allocation);
+        }
+    }
+
+    // Symplectic Euler like shaders/nbody.comp, so both engines follow the same trajectories up to round off.
+    // Block timesteps trade that for far fewer force evaluations on clustered systems.
+    void step_cpu_simulation() {
+        NBODY_TRACE_ZONE("cpu.step");
+
+        if (m_block_integrator) {
+            m_block_integrator->step(m_bodies, *m_cpu_solver);
+        } else {
+            m_cpu_solver->compute_accelerations(m_bodies);
+            nbody::kick(m_bodies, SIMULATION_TIMESTEP);
+            nbody::drift(m_bodies, SIMULATION_TIMESTEP);
+        }
+
+        // Only the copy happens here, the writer thread encodes and writes while the next steps run.
+        ++m_cpu_step;
+        if (m_snapshot_writer && m_cpu_step % m_snapshot_interval == 0) {
+            m_snapshot_writer->write(m_bodies, m_cpu_step, static_cast<double>(m_cpu_step) * SIMULATION_TIMESTEP);
+        }
+    }
+
+    // Body of `m_simulation_thread`. A paced simulation publishes each step once its time has come, and when it
+    // falls more than `MAX_SIMULATION_LAG` steps behind it drops the missed time rather than catching up in a
+    // burst. An exception ends the thread and is rethrown by the next frame.
+    void run_cpu_simulation(std::stop_token stop) {
+        nbody::Tracer::global().set_thread_name("simulation");
+
+        try {
+            uint64_t published_ns = nbody::trace_now();
+            uint64_t next_ns      = published_ns + m_simulation_interval_ns;
+            while (!stop.stop_requested()) {
+                SimulationState& state = m_simulation_states.back();
+                pack_positions(state.previous);
+                step_cpu_simulation();
+                pack_positions(state.current);
+
+                uint64_t now_ns = nbody::trace_now();
+                if (m_simulation_interval_ns != 0) {
+                    if (now_ns < next_ns) {
+                        std::this_thread::sleep_for(std::chrono::nanoseconds(next_ns - now_ns));
+                        now_ns = nbody::trace_now();
+                    }
+                    uint64_t lag = MAX_SIMULATION_LAG * m_simulation_interval_ns;
+                    next_ns      = std::max(next_ns, now_ns > lag ? now_ns - lag : 0) + m_simulation_interval_ns;
+                }
+
+                state.previous_ns = published_ns;
+                state.current_ns  = now_ns;
+                published_ns      = now_ns;
+                m_simulation_states.publish();
+            }
+        } catch (...) {
+            m_simulation_error = std::current_exception();
+            m_simulation_failed.store(true, std::memory_order_release);
+        }
+    }
+
+    // Positions of `m_bodies` in the layout of the `Positions` block in shaders/shader.vert. Simulation thread
+    // only.
+    void pack_positions(std::vector<std::array<float, 4>>& positions) {
+        positions.resize(m_bodies.size());
+        nbody::parallel_for(m_bodies.size(), PACK_GRAIN, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                positions[i] = {m_bodies.x[i], m_bodies.y[i], m_bodies.z[i], m_bodies.mass[i]};
+            }
+        });
+    }
+
+    // Writes the latest published state into the frame's body buffer, interpolated to the time of the frame. A
+    // pair of states is shown over the interval after it was published, so frames lag the simulation by a step.
+    void interpolate_bodies(FrameResources& frame) {
+        NBODY_TRACE_ZONE("frame.interpolate");
+
+        if (m_simulation_failed.load(std::memory_order_acquire)) {
+            std::rethrow_exception(m_simulation_error);
+        }
+
+        m_simulation_states.update();
+        const SimulationState& state = m_simulation_states.front();
+
+        float alpha = 1.0f;
+        if (state.current_ns > state.previous_ns) {
+            uint64_t now_ns   = nbody::trace_now();
+            double   elapsed  = now_ns > state.current_ns ? static_cast<double>(now_ns - state.current_ns) : 0.0;
+            double   interval = static_cast<double>(state.current_ns - state.previous_ns);
+            alpha             = static_cast<float>(std::min(elapsed / interval, 1.0));
+        }
+
+        auto* packed = static_cast<std::array<float, 4>*>(frame.body_buffer_allocation.mapped);
+
+        nbody::parallel_for(state.current.size(), PACK_GRAIN, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                const std::array<float, 4>& from = state.previous[i];
+                const std::array<float, 4>& to   = state.current[i];
+                packed[i] = {from[0] + alpha * (to[0] - from[0]), from[1] + alpha * (to[1] - from[1]),
+                             from[2] + alpha * (to[2] - from[2]), to[3]};
+            }
+        });
+    }
+
+    // Buffers the vertex stage reads positions from, one per body descriptor set.
+    std::vector<VkBuffer> body_buffers() const {
+        if (m_engine == SimulationEngine::GPU) {
+            return m_position_buffers;
+        }
+
+        std::vector<VkBuffer> buffers;
+        for (const auto& frame : m_frames) {
+            buffers.push_back(frame.body_buffer);
+        }
+        return buffers;
+    }
+
+    /* ---- Body rendering resources ---- */
+
+    void create_graphics_descriptor_set_layouts() {
+        // Set 0, binding 0: body positions written by the simulation
+        VkDescriptorSetLayoutBinding body_binding{};
+        body_binding.binding         = 0;
+        body_binding.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        body_binding.descriptorCount = 1;
+        body_binding.stageFlags      = VK_SHADER_STAGE_VERTEX_BIT;
+
+        // Set 1, binding 0: per frame camera uniforms, at the frame's offset into the upload ring
+        VkDescriptorSetLayoutBinding frame_binding{};
+        frame_binding.binding         = 0;
+        frame_binding.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        frame_binding.descriptorCount = 1;
+        frame_binding.stageFlags      = VK_SHADER_STAGE_VERTEX_BIT;
+
+        VkDescriptorSetLayoutCreateInfo body_create_info{};
+        body_create_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        body_create_info.bindingCount = 1;
+        body_create_info.pBindings    = &body_binding;
+
+        VkDescriptorSetLayoutCreateInfo frame_create_info = body_create_info;
+        frame_create_info.pBindings                       = &frame_binding;
+
+        if (vkCreateDescriptorSetLayout(m_logical_device, &body_create_info, nullptr, &m_body_descriptor_set_layout) !=
                 VK_SUCCESS ||
-            vkCreateSemaphore(m_logical_device, &semaphore_create_info, nullptr, &m_semaphore_render_finished) !=
+            vkCreateDescriptorSetLayout(m_logical_device, &frame_create_info, nullptr,
+                                        &m_frame_descriptor_set_layout) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "TriangleApplication::create_graphics_descriptor_set_layouts => failed to create descriptor set "
+                "layouts!");
+        }
+    }
+
+    // Stays mapped for the lifetime of the ring, a frame's region is rewritten every time its slot is reused.
+    void create_upload_ring() {
+        m_upload_ring.create(m_allocator, sizeof(CameraUniforms), m_frames_in_flight,
+                             VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+    }
+
+    void create_graphics_descriptor_sets() {
+        std::vector<VkBuffer>              buffers = body_buffers();
+        std::vector<VkDescriptorSetLayout> body_layouts(buffers.size(), m_body_descriptor_set_layout);
+        m_body_descriptor_sets.resize(body_layouts.size());
+
+        VkDescriptorSetAllocateInfo body_allocate_info{};
+        body_allocate_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        body_allocate_info.descriptorPool     = m_descriptor_pool;
+        body_allocate_info.descriptorSetCount = static_cast<uint32_t>(body_layouts.size());
+        body_allocate_info.pSetLayouts        = body_layouts.data();
+
+        VkDescriptorSetAllocateInfo frame_allocate_info = body_allocate_info;
+        frame_allocate_info.descriptorSetCount          = 1;
+        frame_allocate_info.pSetLayouts                 = &m_frame_descriptor_set_layout;
+
+        if (vkAllocateDescriptorSets(m_logical_device, &body_allocate_info, m_body_descriptor_sets.data()) !=
                 VK_SUCCESS ||
-            vkCreateFence(m_logical_device, &fence_create_info, nullptr, &m_fence_in_flight) != VK_SUCCESS) {
+            vkAllocateDescriptorSets(m_logical_device, &frame_allocate_info, &m_frame_descriptor_set) != VK_SUCCESS) {
             throw std::runtime_error(
-                "TriangleApplication::create_synchonization_objects => failed to create "
-                "semaphores!");
+                "TriangleApplication::create_graphics_descriptor_sets => failed to allocate descriptor sets!");
+        }
+
+        for (size_t i = 0; i < m_body_descriptor_sets.size(); ++i) {
+            VkDescriptorBufferInfo position_buffer_info{buffers[i], 0, sizeof(float) * 4 * m_body_count};
+
+            VkWriteDescriptorSet write{};
+            write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet          = m_body_descriptor_sets[i];
+            write.dstBinding      = 0;
+            write.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write.descriptorCount = 1;
+            write.pBufferInfo     = &position_buffer_info;
+
+            vkUpdateDescriptorSets(m_logical_device, 1, &write, 0, nullptr);
+        }
+
+        VkDescriptorBufferInfo camera_buffer_info{m_upload_ring.buffer(), 0, sizeof(CameraUniforms)};
+
+        VkWriteDescriptorSet write{};
+        write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet          = m_frame_descriptor_set;
+        write.dstBinding      = 0;
+        write.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        write.descriptorCount = 1;
+        write.pBufferInfo     = &camera_buffer_info;
+
+        vkUpdateDescriptorSets(m_logical_device, 1, &write, 0, nullptr);
+    }
+
+    // Orbits the camera slowly around the disk, looking down at it from above the plane.
+    CameraUniforms camera_uniforms() const {
+        float time     = static_cast<float>(glfwGetTime());
+        float aspect   = static_cast<float>(m_swapchain_extent.width) / static_cast<float>(m_swapchain_extent.height);
+        float azimuth  = 0.05f * time;
+        float distance = 3.0f;
+
+        std::array<float, 3> eye    = {distance * std::cos(azimuth), distance * std::sin(azimuth), 0.6f * distance};
+        std::array<float, 3> target = {0.0f, 0.0f, 0.0f};
+        std::array<float, 3> up     = {0.0f, 0.0f, 1.0f};
+
+        std::array<float, 16> projection = perspective_matrix(std::numbers::pi_v<float> / 4.0f, aspect);
+
+        CameraUniforms uniforms{};
+        uniforms.view_projection  = multiply_matrices(projection, look_at_matrix(eye, target, up));
+        uniforms.sprite_size      = {SPRITE_SIZE_PIXELS / static_cast<float>(m_swapchain_extent.width),
+                                     SPRITE_SIZE_PIXELS / static_cast<float>(m_swapchain_extent.height)};
+        uniforms.projection_scale = {projection[0], -projection[5]};
+        return uniforms;
+    }
+
+    void update_camera_uniforms(FrameResources& frame) {
+        nbody::GpuRingAllocation allocation = m_upload_ring.allocate(sizeof(m_frame_camera));
+        std::memcpy(allocation.mapped, &m_frame_camera, sizeof(m_frame_camera));
+        frame.camera_offset = static_cast<uint32_t>(allocation.offset);
+    }
+
+    // The frame's camera as `m_lod` needs it, with the focal length in pixels of the swapchain's height.
+    nbody::GpuLodView lod_view() const {
+        float half_height = 0.5f * static_cast<float>(m_swapchain_extent.height);
+
+        nbody::GpuLodView view{};
+        view.view_projection = m_frame_camera.view_projection;
+        view.focal_pixels    = m_frame_camera.projection_scale[1] * half_height;
+        view.sprite_size     = m_frame_camera.sprite_size;
+        return view;
+    }
+
+    // Matrices are column major, clip space follows Vulkan conventions (y down, depth in [0, 1]).
+    static std::array<float, 16> perspective_matrix(float vertical_fov, float aspect) {
+        constexpr float near = 0.01f;
+        constexpr float far  = 100.0f;
+
+        float focal = 1.0f / std::tan(vertical_fov / 2.0f);
+
+        std::array<float, 16> matrix{};
+        matrix[0]  = focal / aspect;
+        matrix[5]  = -focal;
+        matrix[10] = far / (near - far);
+        matrix[11] = -1.0f;
+        matrix[14] = far * near / (near - far);
+        return matrix;
+    }
+
+    static std::array<float, 16> look_at_matrix(const std::array<float, 3>& eye, const std::array<float, 3>& target,
+                                                const std::array<float, 3>& up) {
+        auto normalize = [](std::array<float, 3> v) {
+            float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            return std::array<float, 3>{v[0] / length, v[1] / length, v[2] / length};
+        };
+        auto cross = [](const std::array<float, 3>& a, const std::array<float, 3>& b) {
+            return std::array<float, 3>{a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+                                        a[0] * b[1] - a[1] * b[0]};
+        };
+        auto dot = [](const std::array<float, 3>& a, const std::array<float, 3>& b) {
+            return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        };
+
+        std::array<float, 3> forward   = normalize({target[0] - eye[0], target[1] - eye[1], target[2] - eye[2]});
+        std::array<float, 3> right     = normalize(cross(forward, up));
+        std::array<float, 3> camera_up = cross(right, forward);
+
+        std::array<float, 16> matrix{};
+        matrix[0]  = right[0];
+        matrix[4]  = right[1];
+        matrix[8]  = right[2];
+        matrix[1]  = camera_up[0];
+        matrix[5]  = camera_up[1];
+        matrix[9]  = camera_up[2];
+        matrix[2]  = -forward[0];
+        matrix[6]  = -forward[1];
+        matrix[10] = -forward[2];
+        matrix[12] = -dot(right, eye);
+        matrix[13] = -dot(camera_up, eye);
+        matrix[14] = dot(forward, eye);
+        matrix[15] = 1.0f;
+        return matrix;
+    }
+
+    static std::array<float, 16> multiply_matrices(const std::array<float, 16>& a, const std::array<float, 16>& b) {
+        std::array<float, 16> result{};
+        for (size_t column = 0; column < 4; ++column) {
+            for (size_t row = 0; row < 4; ++row) {
+                for (size_t k = 0; k < 4; ++k) {
+                    result[column * 4 + row] += a[k * 4 + row] * b[column * 4 + k];
+                }
+            }
         }
+        return result;
     }
 };
 
-int main() {
-    TriangleApplication application;
+int main(int argc, char** argv) {
+    ApplicationOptions options{};
+
+    auto print_usage = [&] {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--frames-in-flight N] [--present immediate|mailbox|fifo] [--engine gpu|cpu]"
+                     " [--solver direct|barnes-hut|fmm]"
+                     " [--isa auto|scalar|neon|avx2|avx512] [--block-timesteps] [--gpus N] [--gpu-tree]"
+                     " [--lod PIXELS] [--bodies N] [--simulation-rate HZ] [--snapshot PATH] [--snapshot-interval N]"
+                     " [--trace PATH]\n";
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+
+        if (argument == "--frames-in-flight" && i + 1 < argc) {
+            options.frames_in_flight = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--present" && i + 1 < argc) {
+            std::optional<PresentPolicy> policy = parse_present_policy(argv[++i]);
+            if (!policy) {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+            options.present_policy = *policy;
+        } else if (argument == "--engine" && i + 1 < argc) {
+            std::string engine = argv[++i];
+            if (engine == "gpu") {
+                options.engine = SimulationEngine::GPU;
+            } else if (engine == "cpu") {
+                options.engine = SimulationEngine::CPU;
+            } else {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        } else if (argument == "--solver" && i + 1 < argc) {
+            std::optional<nbody::SolverKind> solver = nbody::parse_solver_kind(argv[++i]);
+            if (!solver) {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+            options.solver = *solver;
+        } else if (argument == "--isa" && i + 1 < argc) {
+            std::optional<nbody::Isa> isa = nbody::parse_isa(argv[++i]);
+            if (!isa) {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+            options.isa = *isa;
+        } else if (argument == "--block-timesteps") {
+            options.block_timesteps = true;
+        } else if (argument == "--gpus" && i + 1 < argc) {
+            options.gpu_count = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--gpu-tree") {
+            options.gpu_tree = true;
+        } else if (argument == "--lod" && i + 1 < argc) {
+            options.lod_pixels = std::strtof(argv[++i], nullptr);
+            if (!(options.lod_pixels > 0.0f)) {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        } else if (argument == "--bodies" && i + 1 < argc) {
+            options.body_count = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--simulation-rate" && i + 1 < argc) {
+            options.simulation_rate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--snapshot" && i + 1 < argc) {
+            options.snapshot_path = argv[++i];
+        } else if (argument == "--snapshot-interval" && i + 1 < argc) {
+            options.snapshot_interval = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--trace" && i + 1 < argc) {
+            options.trace_path = argv[++i];
+        } else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The tree needs every body on the GPU that builds it.
+    if (options.gpu_tree && (options.engine != SimulationEngine::GPU || options.gpu_count > 1)) {
+        std::cerr << "--gpu-tree needs --engine gpu on a single GPU.\n";
+        return EXIT_FAILURE;
+    }
+
+    // Level of detail picks from the tree.
+    if (options.lod_pixels > 0.0f && !options.gpu_tree) {
+        std::cerr << "--lod needs --gpu-tree.\n";
+        return EXIT_FAILURE;
+    }
 
     try {
+        TriangleApplication application(options);
         application.run();
     } catch (const std::exception& e) {
         std::cerr << e.what() << "\n";
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <span>
+
+#include "bench.hpp"
+#include "diagnostics.hpp"
+
+// Energy and momentum drift over simulated time, for every solver on every workload, swept over the opening
+// angle of the tree codes, the timestep and the precision mode. One line per combination. The energies are
+// summed directly in double precision, so they measure the solvers and the integrator rather than themselves.
+// Wall time is reported next to the drift, so that accuracy can be weighed against cost.
+
+namespace {
+    constexpr float THETAS[] = {0.3f, 0.5f, 0.7f};
+
+    // Every timestep integrates the same simulated time, so the drifts compare at equal times.
+    constexpr double TIMESTEPS[] = {4.0e-3, 2.0e-3, 1.0e-3};
+
+    constexpr nbody::Precision PRECISIONS[] = {
+        nbody::Precision::FP32,
+        nbody::Precision::COMPENSATED,
+        nbody::Precision::FP64,
+        nbody::Precision::RELATIVE,
+    };
+
+    // Energies are sampled this many times per run for the largest error, they cost a direct sum each.
+    constexpr uint64_t ENERGY_SAMPLES = 10;
+
+    double total_energy(const nbody::Bodies& bodies, const nbody::SolverConfig& config) {
+        return nbody::kinetic_energy(bodies) +
+               nbody::potential_energy(bodies, config.gravitational_constant, config.softening);
+    }
+
+    // `sum_i m_i |v_i|`, which the momentum drift is relative to, since the total momentum starts near zero.
+    double momentum_scale(const nbody::Bodies& bodies) {
+        double scale = 0.0;
+        for (std::size_t i = 0; i < bodies.size(); ++i) {
+            double vx = bodies.vx[i];
+            double vy = bodies.vy[i];
+            double vz = bodies.vz[i];
+            scale += bodies.mass[i] * std::sqrt(vx * vx + vy * vy + vz * vz);
+        }
+        return scale;
+    }
+
+    void run(const bench::BenchOptions& options, nbody::InitialConditions workload, const nbody::SolverConfig& config,
+             std::size_t count, double timestep, double duration) {
+        nbody::Bodies                  bodies   = nbody::generate_initial_conditions(workload, count, options.seed);
+        std::unique_ptr<nbody::Solver> solver   = nbody::make_solver(config);
+        double                         initial  = total_energy(bodies, config);
+        std::array<double, 3>          momentum = nbody::momentum(bodies);
+        double                         scale    = momentum_scale(bodies);
+
+        uint64_t steps    = static_cast<uint64_t>(std::llround(duration / timestep));
+        uint64_t interval = std::max<uint64_t>(steps / ENERGY_SAMPLES, 1);
+
+        // Only the steps are timed, not the energies.
+        double wall      = 0.0;
+        double max_error = 0.0;
+        double error     = 0.0;
+        for (uint64_t step = 1; step <= steps; ++step) {
+            bench::Stopwatch stopwatch;
+            bench::step(bodies, *solver, static_cast<float>(timestep), config.precision);
+            wall += stopwatch.seconds();
+
+            if (step % interval == 0 || step == steps) {
+                error     = std::abs((total_energy(bodies, config) - initial) / initial);
+                max_error = std::max(max_error, error);
+            }
+        }
+
+        std::array<double, 3> moved = nbody::momentum(bodies);
+        for (std::size_t axis = 0; axis < 3; ++axis) {
+            moved[axis] -= momentum[axis];
+        }
+        double drift = std::hypot(moved[0], moved[1], moved[2]) / scale;
+
+        // Direct sums have no opening angle.
+        double theta = config.kind == nbody::SolverKind::DIRECT_SUM ? std::numeric_limits<double>::quiet_NaN()
+                                                                     : static_cast<double>(config.theta);
+        bench::JsonLine()
+            .field("bench", "accuracy")
+            .field("workload", nbody::initial_conditions_name(workload))
+            .field("solver", nbody::solver_kind_name(config.kind))
+            .field("precision", nbody::precision_name(config.precision))
+            .field("theta", theta)
+            .field("timestep", timestep)
+            .field("bodies", static_cast<uint64_t>(count))
+            .field("steps", steps)
+            .field("time", static_cast<double>(steps) * timestep)
+            .field("relative_energy_error", error)
+            .field("max_relative_energy_error", max_error)
+            .field("relative_momentum_drift", drift)
+            .field("wall_seconds", wall)
+            .print();
+    }
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::BenchOptions options = bench::parse_bench_options(argc, argv);
+
+    std::size_t count    = std::min<std::size_t>(options.max_bodies, options.quick ? 1024 : 4096);
+    double      duration = options.quick ? 0.1 : 1.0;
+
+    try {
+        for (nbody::InitialConditions workload : bench::WORKLOADS) {
+            for (nbody::SolverKind kind : bench::SOLVERS) {
+                // The direct sum runs once per timestep and precision, the theta sweep would repeat it.
+                std::span<const float> thetas(THETAS);
+                if (kind == nbody::SolverKind::DIRECT_SUM) {
+                    thetas = thetas.first(1);
+                }
+                for (float theta : thetas) {
+                    for (double timestep : TIMESTEPS) {
+                        for (nbody::Precision precision : PRECISIONS) {
+                            nbody::SolverConfig config{};
+                            config.kind      = kind;
+                            config.theta     = theta;
+                            config.precision = precision;
+                            run(options, workload, config, count, timestep, duration);
+                        }
+                    }
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
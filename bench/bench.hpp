@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bodies.hpp"
+#include "initial_conditions.hpp"
+#include "integrator.hpp"
+#include "solver.hpp"
+
+// Shared by the benchmark binaries in bench/. Every binary prints one JSON object per line on stdout, so that
+// results can be collected with `make run-bench` and compared between commits by any JSON Lines reader.
+
+namespace bench {
+
+class BenchOptions {
+   public:
+    // Fewer and smaller runs, for checking that the benchmarks work rather than for measuring.
+    bool        quick      = false;
+    std::size_t max_bodies = 16 * 1024;
+    uint64_t    seed       = 1;
+};
+
+inline BenchOptions parse_bench_options(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view argument = argv[i];
+        if (argument == "--quick") {
+            options.quick      = true;
+            options.max_bodies = std::min<std::size_t>(options.max_bodies, 2 * 1024);
+        } else if (argument == "--max-bodies" && i + 1 < argc) {
+            options.max_bodies = std::strtoull(argv[++i], nullptr, 10);
+        } else if (argument == "--seed" && i + 1 < argc) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--quick] [--max-bodies <count>] [--seed <seed>]\n";
+            std::exit(argument == "--help" ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    return options;
+}
+
+// Body counts from 1024 up to `max_bodies`, doubling.
+inline std::vector<std::size_t> body_count_sweep(const BenchOptions& options) {
+    std::vector<std::size_t> counts;
+    for (std::size_t count = 1024; count <= options.max_bodies; count *= 2) {
+        counts.push_back(count);
+    }
+    return counts;
+}
+
+inline constexpr nbody::InitialConditions WORKLOADS[] = {
+    nbody::InitialConditions::PLUMMER,
+    nbody::InitialConditions::COLD_COLLAPSE,
+    nbody::InitialConditions::DISK_MERGER,
+    nbody::InitialConditions::UNIFORM_CUBE,
+};
+
+inline constexpr nbody::SolverKind SOLVERS[] = {
+    nbody::SolverKind::DIRECT_SUM,
+    nbody::SolverKind::BARNES_HUT,
+    nbody::SolverKind::FAST_MULTIPOLE,
+};
+
+// One JSON object, written out as a single line when `print` is called.
+class JsonLine {
+   public:
+    JsonLine& field(std::string_view name, std::string_view value) {
+        key(name);
+        m_line += '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                m_line += '\\';
+            }
+            m_line += c;
+        }
+        m_line += '"';
+        return *this;
+    }
+
+    JsonLine& field(std::string_view name, const char* value) { return field(name, std::string_view(value)); }
+
+    JsonLine& field(std::string_view name, double value) {
+        key(name);
+        // JSON has no infinities or NaNs.
+        if (!std::isfinite(value)) {
+            m_line += "null";
+            return *this;
+        }
+        // Shortest form that reads back to the same double.
+        char buffer[32];
+        m_line.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+        return *this;
+    }
+
+    JsonLine& field(std::string_view name, uint64_t value) {
+        key(name);
+        m_line += std::to_string(value);
+        return *this;
+    }
+
+    JsonLine& field(std::string_view name, uint32_t value) { return field(name, static_cast<uint64_t>(value)); }
+
+    void print() const { std::cout << m_line << "}" << std::endl; }
+
+   private:
+    void key(std::string_view name) {
+        m_line += m_line.empty() ? "{" : ",";
+        m_line += '"';
+        m_line += name;
+        m_line += "\":";
+    }
+
+    std::string m_line;
+};
+
+// Seconds since construction.
+class Stopwatch {
+   public:
+    double seconds() const { return std::chrono::duration<double>(Clock::now() - m_start).count(); }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point m_start = Clock::now();
+};
+
+// Symplectic Euler like the headless app, so that the benchmarks time the same step the apps run.
+inline void step(nbody::Bodies& bodies, nbody::Solver& solver, float timestep, nbody::Precision precision) {
+    solver.compute_accelerations(bodies);
+    nbody::kick(bodies, timestep);
+    nbody::drift(bodies, timestep, precision);
+}
+
+}  // namespace bench
@@ -0,0 +1,154 @@
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <numbers>
+#include <random>
+#include <vector>
+
+#include "bench.hpp"
+#include "ensemble.hpp"
+#include "scheduler.hpp"
+
+// Steps per second of many small planetary systems over a sweep of system sizes: packed into one
+// `nbody::Ensemble` one system per SIMD lane, batched into one with packing off so that each system runs the
+// direct sum over its own range, and with every system in an ensemble of its own, stepped one after the other,
+// as one simulation per process would. The monitored mode packs at the default limit with encounters and adaptive
+// steps on, which is how an ensemble runs in practice. Every sweep point holds `max_bodies` bodies in total, in as
+// many systems as fit.
+
+namespace {
+    constexpr std::size_t SYSTEM_SIZES[] = {3, 10, 100, 1000};
+    constexpr float       TIMESTEP       = 1.0e-3f;
+
+    // Close enough that no system stops within a run, and loose enough that `TIMESTEP` bounds nearly every step.
+    constexpr float ENCOUNTER_DISTANCE = 1.0e-4f;
+    constexpr float ACCURACY           = 1.0e-2f;
+
+    enum class Mode { PACKED, MONITORED, BATCHED, SEQUENTIAL };
+
+    const char* mode_name(Mode mode) {
+        switch (mode) {
+            case Mode::PACKED:
+                return "packed";
+            case Mode::MONITORED:
+                return "monitored";
+            case Mode::BATCHED:
+                return "batched";
+            case Mode::SEQUENTIAL:
+                return "sequential";
+        }
+        return "unknown";
+    }
+
+    // A star of unit mass with planets of a millionth of its mass on circular orbits of radius 1 to 5, inclined
+    // by up to a hundredth of a radian, one stability problem of a sweep.
+    nbody::Bodies planetary_system(std::size_t count, std::mt19937_64& generator) {
+        std::uniform_real_distribution<float> radius(1.0f, 5.0f);
+        std::uniform_real_distribution<float> angle(0.0f, 2.0f * std::numbers::pi_v<float>);
+        std::uniform_real_distribution<float> inclination(-0.01f, 0.01f);
+
+        nbody::Bodies bodies;
+        bodies.push_back(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+        for (std::size_t i = 1; i < count; ++i) {
+            float r     = radius(generator);
+            float phase = angle(generator);
+            float tilt  = inclination(generator);
+            float speed = 1.0f / std::sqrt(r);
+            bodies.push_back(r * std::cos(phase), r * std::sin(phase) * std::cos(tilt), r * std::sin(phase) * tilt,
+                             -speed * std::sin(phase), speed * std::cos(phase) * std::cos(tilt),
+                             speed * std::cos(phase) * tilt, 1.0e-6f);
+        }
+        return bodies;
+    }
+
+    // Seconds per step of every system in `ensembles`, which are stepped one after the other.
+    double time_steps(const bench::BenchOptions& options, std::vector<nbody::Ensemble>& ensembles, uint64_t& steps) {
+        for (nbody::Ensemble& ensemble : ensembles) {
+            ensemble.step();
+        }
+
+        constexpr uint64_t MIN_STEPS = 3;
+        constexpr uint64_t MAX_STEPS = 200;
+        double             budget    = options.quick ? 0.05 : 1.0;
+
+        bench::Stopwatch stopwatch;
+        steps = 0;
+        while (steps < MIN_STEPS || (steps < MAX_STEPS && stopwatch.seconds() < budget)) {
+            for (nbody::Ensemble& ensemble : ensembles) {
+                ensemble.step();
+            }
+            ++steps;
+        }
+        return stopwatch.seconds();
+    }
+
+    void run(const bench::BenchOptions& options, std::size_t size, Mode mode) {
+        std::size_t system_count = std::max<std::size_t>(1, options.max_bodies / size);
+
+        // Never stop within the run, the end time lies far past it.
+        nbody::EnsembleSystemConfig system_config{};
+        system_config.end_time     = 1.0e9;
+        system_config.max_timestep = TIMESTEP;
+
+        // Packing takes every size of the sweep, so that it compares against the direct sum at each. Monitoring
+        // keeps the default limit, past which the closest pair needs the single lane scalar kernel.
+        nbody::EnsembleConfig config{};
+        if (mode == Mode::PACKED) {
+            config.max_packed_bodies = SYSTEM_SIZES[std::size(SYSTEM_SIZES) - 1];
+        } else if (mode == Mode::MONITORED) {
+            config.accuracy                  = ACCURACY;
+            system_config.encounter_distance = ENCOUNTER_DISTANCE;
+        } else {
+            config.max_packed_bodies = 0;
+        }
+
+        bool                         batched = mode != Mode::SEQUENTIAL;
+        std::mt19937_64              generator(options.seed);
+        std::vector<nbody::Ensemble> ensembles(batched ? 1 : system_count, nbody::Ensemble(config));
+        for (std::size_t i = 0; i < system_count; ++i) {
+            ensembles[batched ? 0 : i].add_system(planetary_system(size, generator), system_config);
+        }
+
+        uint64_t steps   = 0;
+        double   seconds = time_steps(options, ensembles, steps);
+
+        double system_steps = static_cast<double>(system_count) * static_cast<double>(steps);
+        double body_steps   = system_steps * static_cast<double>(size);
+
+        bench::JsonLine()
+            .field("bench", "ensemble")
+            .field("mode", mode_name(mode))
+            .field("isa", nbody::isa_name(config.isa))
+            .field("threads", static_cast<uint64_t>(nbody::Scheduler::global().worker_count() + 1))
+            .field("system_bodies", static_cast<uint64_t>(size))
+            .field("systems", static_cast<uint64_t>(system_count))
+            .field("steps", steps)
+            .field("seconds", seconds)
+            .field("system_steps_per_second", system_steps / seconds)
+            .field("ns_per_body_step", 1.0e9 * seconds / body_steps)
+            .print();
+    }
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::BenchOptions options = bench::parse_bench_options(argc, argv);
+
+    try {
+        for (std::size_t size : SYSTEM_SIZES) {
+            if (size > options.max_bodies) {
+                continue;
+            }
+            for (Mode mode : {Mode::PACKED, Mode::MONITORED, Mode::BATCHED, Mode::SEQUENTIAL}) {
+                run(options, size, mode);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
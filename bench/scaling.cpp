@@ -0,0 +1,82 @@
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <vector>
+
+#include "bench.hpp"
+#include "scheduler.hpp"
+
+// Strong scaling of every solver on the Plummer sphere: the same bodies stepped with 1, 2, 4, ... threads up to
+// every worker of the global scheduler plus the calling thread. Speedup and efficiency are against one thread.
+
+namespace {
+    constexpr float TIMESTEP = 1.0e-3f;
+
+    std::vector<std::size_t> thread_count_sweep() {
+        std::size_t              threads = nbody::Scheduler::global().worker_count() + 1;
+        std::vector<std::size_t> counts;
+        for (std::size_t count = 1; count < threads; count *= 2) {
+            counts.push_back(count);
+        }
+        counts.push_back(threads);
+        return counts;
+    }
+
+    // Seconds per step with `threads` threads.
+    double time_step(const bench::BenchOptions& options, const nbody::SolverConfig& config, std::size_t count,
+                     std::size_t threads, uint64_t steps) {
+        nbody::Scheduler::global().set_active_worker_count(threads - 1);
+
+        nbody::Bodies bodies = nbody::generate_initial_conditions(nbody::InitialConditions::PLUMMER, count,
+                                                                  options.seed);
+        std::unique_ptr<nbody::Solver> solver = nbody::make_solver(config);
+        bench::step(bodies, *solver, TIMESTEP, config.precision);
+
+        bench::Stopwatch stopwatch;
+        for (uint64_t step = 0; step < steps; ++step) {
+            bench::step(bodies, *solver, TIMESTEP, config.precision);
+        }
+        return stopwatch.seconds() / static_cast<double>(steps);
+    }
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::BenchOptions options = bench::parse_bench_options(argc, argv);
+
+    std::size_t count = options.max_bodies;
+    uint64_t    steps = options.quick ? 2 : 10;
+
+    try {
+        for (nbody::SolverKind kind : bench::SOLVERS) {
+            nbody::SolverConfig config{};
+            config.kind = kind;
+
+            double serial = 0.0;
+            for (std::size_t threads : thread_count_sweep()) {
+                double seconds = time_step(options, config, count, threads, steps);
+                if (threads == 1) {
+                    serial = seconds;
+                }
+
+                bench::JsonLine()
+                    .field("bench", "scaling")
+                    .field("workload", nbody::initial_conditions_name(nbody::InitialConditions::PLUMMER))
+                    .field("solver", nbody::solver_kind_name(kind))
+                    .field("isa", nbody::isa_name(config.isa))
+                    .field("bodies", static_cast<uint64_t>(count))
+                    .field("threads", static_cast<uint64_t>(threads))
+                    .field("seconds_per_step", seconds)
+                    .field("speedup", serial / seconds)
+                    .field("efficiency", serial / seconds / static_cast<double>(threads))
+                    .print();
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    nbody::Scheduler::global().set_active_worker_count(nbody::Scheduler::global().worker_count());
+    return EXIT_SUCCESS;
+}
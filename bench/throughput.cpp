@@ -0,0 +1,83 @@
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+
+#include "bench.hpp"
+#include "scheduler.hpp"
+
+// Time per step of every solver on every workload over a sweep of body counts, with all workers. Each run takes
+// one untimed step first, which builds the trees, sizes the scratch buffers and warms the caches.
+//
+// `interactions_per_second` counts the `N (N - 1)` pairs a direct sum evaluates per step, for every solver, so
+// that the tree codes read as the direct sum rate they stand in for rather than as their own, smaller, count.
+//
+// Barnes-Hut runs twice, rebuilding its tree every step and refitting it until it degrades by `REFIT_THRESHOLD`.
+
+namespace {
+    constexpr float TIMESTEP        = 1.0e-3f;
+    constexpr float REFIT_THRESHOLD = 1.25f;
+
+    void run(const bench::BenchOptions& options, nbody::InitialConditions workload, nbody::SolverKind kind,
+             std::size_t count, float rebuild_threshold = 0.0f) {
+        nbody::SolverConfig config{};
+        config.kind              = kind;
+        config.rebuild_threshold = rebuild_threshold;
+
+        nbody::Bodies                  bodies = nbody::generate_initial_conditions(workload, count, options.seed);
+        std::unique_ptr<nbody::Solver> solver = nbody::make_solver(config);
+        bench::step(bodies, *solver, TIMESTEP, config.precision);
+
+        // At least `MIN_STEPS` and then as many as fit the time budget.
+        constexpr uint64_t MIN_STEPS = 3;
+        constexpr uint64_t MAX_STEPS = 200;
+        double             budget    = options.quick ? 0.05 : 1.0;
+
+        bench::Stopwatch stopwatch;
+        uint64_t         steps = 0;
+        while (steps < MIN_STEPS || (steps < MAX_STEPS && stopwatch.seconds() < budget)) {
+            bench::step(bodies, *solver, TIMESTEP, config.precision);
+            ++steps;
+        }
+        double seconds = stopwatch.seconds();
+
+        double body_steps = static_cast<double>(count) * static_cast<double>(steps);
+        double pairs      = static_cast<double>(count) * static_cast<double>(count - 1) * static_cast<double>(steps);
+
+        bench::JsonLine()
+            .field("bench", "throughput")
+            .field("workload", nbody::initial_conditions_name(workload))
+            .field("solver", nbody::solver_kind_name(kind))
+            .field("rebuild_threshold", static_cast<double>(rebuild_threshold))
+            .field("isa", nbody::isa_name(config.isa))
+            .field("threads", static_cast<uint64_t>(nbody::Scheduler::global().worker_count() + 1))
+            .field("bodies", static_cast<uint64_t>(count))
+            .field("steps", steps)
+            .field("seconds", seconds)
+            .field("ns_per_body_step", 1.0e9 * seconds / body_steps)
+            .field("interactions_per_second", pairs / seconds)
+            .print();
+    }
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::BenchOptions options = bench::parse_bench_options(argc, argv);
+
+    try {
+        for (nbody::InitialConditions workload : bench::WORKLOADS) {
+            for (std::size_t count : bench::body_count_sweep(options)) {
+                for (nbody::SolverKind kind : bench::SOLVERS) {
+                    run(options, workload, kind, count);
+                    if (kind == nbody::SolverKind::BARNES_HUT) {
+                        run(options, workload, kind, count, REFIT_THRESHOLD);
+                    }
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
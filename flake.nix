@@ -46,6 +46,7 @@
               doctest
               nanobench
               glfw
+              mpi
               freetype
               vulkan-headers
               vulkan-loader
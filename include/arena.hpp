@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "scheduler.hpp"
+
+namespace nbody {
+
+// Frees memory from `::operator new` with `SIMD_ALIGNMENT`, for `std::unique_ptr`.
+class AlignedDelete {
+   public:
+    void operator()(std::byte* memory) const noexcept { ::operator delete(memory, std::align_val_t{SIMD_ALIGNMENT}); }
+};
+
+// Memory for data that lives for one step, such as interaction lists and scratch buffers. Allocation bumps an
+// offset into the current block and nothing is freed on its own: `reset` hands everything back at once. Blocks
+// are kept over resets, so after the first few steps a step allocates without calling the system allocator.
+class Arena {
+   public:
+    static constexpr std::size_t DEFAULT_BLOCK_BYTES = 64 * 1024;
+
+    // A position to `rewind` to, releasing everything allocated after it.
+    class Marker {
+       public:
+        std::size_t block;
+        std::size_t offset;
+    };
+
+    explicit Arena(std::size_t block_bytes = DEFAULT_BLOCK_BYTES) noexcept : m_block_bytes(block_bytes) {}
+
+    Arena(const Arena&)            = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // `alignment` must be a power of two no larger than `SIMD_ALIGNMENT`.
+    void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t)) {
+        std::size_t offset = (m_offset + alignment - 1) & ~(alignment - 1);
+        if (m_block < m_blocks.size() && offset + size <= m_blocks[m_block].size) {
+            m_offset = offset + size;
+            return m_blocks[m_block].memory.get() + offset;
+        }
+        return allocate_slow(size);
+    }
+
+    // Uninitialized storage for `count` objects of a trivial type.
+    template <typename T>
+    std::span<T> allocate_array(std::size_t count) {
+        static_assert(std::is_trivially_default_constructible_v<T> && std::is_trivially_destructible_v<T>,
+                      "Arena memory is released without running destructors");
+        return {static_cast<T*>(allocate(count * sizeof(T), alignof(T))), count};
+    }
+
+    template <typename T>
+    std::span<T> copy(std::span<const T> values) {
+        std::span<T> result = allocate_array<T>(values.size());
+        std::copy(values.begin(), values.end(), result.begin());
+        return result;
+    }
+
+    Marker mark() const noexcept { return {m_block, m_offset}; }
+    void   rewind(Marker marker) noexcept {
+        m_block  = marker.block;
+        m_offset = marker.offset;
+    }
+
+    // Releases every allocation. When the last cycle spilled over into several blocks, they are replaced by one
+    // block holding all of them, so the steady state runs from a single block.
+    void reset();
+
+    // Bytes handed out since the last reset, including alignment padding and the unused ends of full blocks.
+    std::size_t used() const noexcept;
+    std::size_t capacity() const noexcept;
+
+   private:
+    class Block {
+       public:
+        std::unique_ptr<std::byte, AlignedDelete> memory;
+        std::size_t                               size;
+    };
+
+    // Continues in the next block, which starts aligned for any `alignment`.
+    void* allocate_slow(std::size_t size);
+
+    static Block make_block(std::size_t size);
+
+    std::size_t        m_block_bytes;
+    std::vector<Block> m_blocks;
+    std::size_t        m_block  = 0;
+    std::size_t        m_offset = 0;
+};
+
+// Rewinds an arena to where it was when the scope was entered. Scratch memory of one loop iteration goes back
+// to the arena on every iteration instead of piling up until the reset.
+class ArenaScope {
+   public:
+    explicit ArenaScope(Arena& arena) noexcept : m_arena(arena), m_marker(arena.mark()) {}
+    ~ArenaScope() { m_arena.rewind(m_marker); }
+
+    ArenaScope(const ArenaScope&)            = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+   private:
+    Arena&        m_arena;
+    Arena::Marker m_marker;
+};
+
+// Fixed size blocks recycled through a free list, for objects that come and go one at a time. Blocks are carved
+// from slabs that are only returned to the system when the pool is destroyed. Not thread safe.
+class BlockPool {
+   public:
+    // `alignment` must be a power of two no larger than `SIMD_ALIGNMENT`.
+    BlockPool(std::size_t block_size, std::size_t alignment = alignof(std::max_align_t),
+              std::size_t blocks_per_slab = 64);
+
+    BlockPool(const BlockPool&)            = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+
+    void* allocate() {
+        if (m_free == nullptr) {
+            grow();
+        }
+        FreeBlock* block = m_free;
+        m_free           = block->next;
+        return block;
+    }
+
+    // `block` must come from this pool.
+    void deallocate(void* block) noexcept {
+        FreeBlock* free = static_cast<FreeBlock*>(block);
+        free->next      = m_free;
+        m_free          = free;
+    }
+
+    std::size_t block_size() const noexcept { return m_block_size; }
+
+   private:
+    class FreeBlock {
+       public:
+        FreeBlock* next;
+    };
+
+    void grow();
+
+    std::size_t                                            m_block_size;
+    std::size_t                                            m_blocks_per_slab;
+    FreeBlock*                                             m_free = nullptr;
+    std::vector<std::unique_ptr<std::byte, AlignedDelete>> m_slabs;
+};
+
+// `BlockPool` for objects of one type.
+template <typename T>
+class Pool {
+   public:
+    explicit Pool(std::size_t objects_per_slab = 64) : m_blocks(sizeof(T), alignof(T), objects_per_slab) {
+        static_assert(alignof(T) <= SIMD_ALIGNMENT, "Pool slabs are aligned to SIMD_ALIGNMENT");
+    }
+
+    template <typename... Args>
+    T* create(Args&&... args) {
+        void* block = m_blocks.allocate();
+        try {
+            return new (block) T(std::forward<Args>(args)...);
+        } catch (...) {
+            m_blocks.deallocate(block);
+            throw;
+        }
+    }
+
+    void destroy(T* object) noexcept {
+        object->~T();
+        m_blocks.deallocate(object);
+    }
+
+   private:
+    BlockPool m_blocks;
+};
+
+// One `T` per worker of a scheduler, for per-thread state such as arenas and scratch buffers that a task uses
+// without synchronization. Threads outside the scheduler, such as the one waiting for a parallel loop, get
+// their own `T` on first use. A worker only runs another task while it waits on a group, so state taken with
+// `local()` belongs to the current task until it spawns and waits.
+template <typename T>
+class WorkerLocal {
+   public:
+    explicit WorkerLocal(Scheduler& scheduler = Scheduler::global()) : m_scheduler(scheduler) {
+        m_workers.reserve(scheduler.worker_count());
+        for (std::size_t i = 0; i < scheduler.worker_count(); ++i) {
+            m_workers.push_back(std::make_unique<T>());
+        }
+    }
+
+    WorkerLocal(const WorkerLocal&)            = delete;
+    WorkerLocal& operator=(const WorkerLocal&) = delete;
+
+    T& local() {
+        std::size_t worker = m_scheduler.current_worker();
+        if (worker != Scheduler::NO_WORKER) {
+            return *m_workers[worker];
+        }
+
+        std::lock_guard lock(m_external_mutex);
+        std::thread::id thread = std::this_thread::get_id();
+        for (auto& [id, value] : m_external) {
+            if (id == thread) {
+                return *value;
+            }
+        }
+        return *m_external.emplace_back(thread, std::make_unique<T>()).second;
+    }
+
+    // Calls `function(T&)` for the state of every thread. No task may use the state meanwhile.
+    template <typename Function>
+    void for_each(const Function& function) {
+        for (auto& value : m_workers) {
+            function(*value);
+        }
+        std::lock_guard lock(m_external_mutex);
+        for (auto& entry : m_external) {
+            function(*entry.second);
+        }
+    }
+
+   private:
+    Scheduler&                                                  m_scheduler;
+    std::vector<std::unique_ptr<T>>                             m_workers;
+    std::mutex                                                  m_external_mutex;
+    std::vector<std::pair<std::thread::id, std::unique_ptr<T>>> m_external;
+};
+
+}  // namespace nbody
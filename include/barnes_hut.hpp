@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "arena.hpp"
+#include "bodies.hpp"
+#include "kernels.hpp"
+#include "octree.hpp"
+#include "precision.hpp"
+#include "scheduler.hpp"
+#include "simd.hpp"
+#include "solver.hpp"
+
+namespace nbody {
+
+class BarnesHutConfig {
+   public:
+    // Opening angle: a node of size `s` at distance `d` is used as a point mass when `s / d < theta`.
+    // 0 opens every node and degenerates to an exact direct sum.
+    float    theta                  = 0.5f;
+    float    softening              = 1.0e-2f;
+    float    gravitational_constant = 1.0f;
+    uint32_t leaf_size              = 16;
+
+    // Instruction set of the leaf interaction kernel.
+    Isa isa = detect_isa();
+
+    // `RELATIVE` rebases every interaction list on the center of mass of its group.
+    Precision precision = Precision::FP32;
+
+    // Steps refit the tree of an earlier build to the new positions until its `Octree::extent_growth` passes
+    // `rebuild_threshold`, then rebuild it in the background from that step's positions while the next step still
+    // uses the refitted one. 0 rebuilds the tree every step.
+    float rebuild_threshold = 0.0f;
+};
+
+// O(N log N) gravity: far away groups of bodies are approximated by the monopole of their octree node.
+class BarnesHut : public Solver {
+   public:
+    explicit BarnesHut(const BarnesHutConfig& config = {})
+        : m_config(config), m_kernel(select_direct_sum_kernel(config.isa, config.precision)) {}
+
+    // Waits for a background rebuild.
+    ~BarnesHut() override;
+
+    BarnesHut(const BarnesHut&)            = delete;
+    BarnesHut& operator=(const BarnesHut&) = delete;
+
+    // Rebuilds or refits the octree to the current positions and overwrites `ax`, `ay` and `az`.
+    void compute_accelerations(Bodies& bodies) override;
+
+    // Rebuilds or refits the octree over every body but only walks it for the leaves holding active bodies.
+    void compute_active_accelerations(Bodies& bodies, std::span<const uint32_t> active) override;
+
+    SolverKind kind() const noexcept override { return SolverKind::BARNES_HUT; }
+
+    const BarnesHutConfig& config() const noexcept { return m_config; }
+    void                   set_theta(float theta) noexcept { m_config.theta = theta; }
+
+    const Octree& tree() const noexcept { return m_tree; }
+
+   private:
+    // Buffers of one group walk. Every worker keeps its own over all steps, so walks stop allocating once
+    // the buffers have grown to the largest group.
+    class WalkScratch {
+       public:
+        InteractionList       list;
+        std::vector<uint32_t> targets;
+        aligned_vector<float> tx;
+        aligned_vector<float> ty;
+        aligned_vector<float> tz;
+        aligned_vector<float> tx_lo;
+        aligned_vector<float> ty_lo;
+        aligned_vector<float> tz_lo;
+        aligned_vector<float> ax;
+        aligned_vector<float> ay;
+        aligned_vector<float> az;
+    };
+
+    // Brings `m_tree` up to date with the positions of `bodies`, as `rebuild_threshold` says.
+    void update_tree(const Bodies& bodies);
+
+    // Walks the tree once per leaf in `m_groups`. With an `active` flag per body, only the flagged bodies of a
+    // leaf receive forces.
+    void evaluate(Bodies& bodies, const uint8_t* active);
+
+    BarnesHutConfig          m_config;
+    DirectSumKernel          m_kernel;
+    Octree                   m_tree;
+    std::vector<uint8_t>     m_active;
+    std::vector<uint32_t>    m_groups;
+    WorkerLocal<WalkScratch> m_scratch;
+
+    // A background rebuild writes `m_next_tree` from the positions copied to `m_snapshot`. The next step always
+    // waits for it and swaps it in, so the tree of every step is the same however the rebuild was scheduled.
+    Octree    m_next_tree;
+    Bodies    m_snapshot;
+    TaskGroup m_rebuild;
+    bool      m_rebuilding = false;
+};
+
+}  // namespace nbody
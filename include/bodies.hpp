@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+
+#include "aligned_allocator.hpp"
+
+namespace nbody {
+
+// Body state stored as one cache line aligned array per component (structure of arrays). Kernels stream
+// through a single component at a time and load full SIMD registers from it.
+class Bodies {
+   public:
+    aligned_vector<float> x;
+    aligned_vector<float> y;
+    aligned_vector<float> z;
+    aligned_vector<float> vx;
+    aligned_vector<float> vy;
+    aligned_vector<float> vz;
+    aligned_vector<float> mass;
+
+    // Rounding error of `x`, `y` and `z` under the precision modes that carry positions as pairs `x + x_lo`,
+    // zero otherwise. Columns missing after the others grew count as zero.
+    aligned_vector<float> x_lo;
+    aligned_vector<float> y_lo;
+    aligned_vector<float> z_lo;
+
+    // Written by the solvers.
+    aligned_vector<float> ax;
+    aligned_vector<float> ay;
+    aligned_vector<float> az;
+
+    std::size_t size() const noexcept { return x.size(); }
+    bool        empty() const noexcept { return x.empty(); }
+
+    // Zero fills the low parts of bodies added without them.
+    void resize_low_parts() {
+        x_lo.resize(size(), 0.0f);
+        y_lo.resize(size(), 0.0f);
+        z_lo.resize(size(), 0.0f);
+    }
+
+    void resize(std::size_t count) {
+        for (auto* column : {&x, &y, &z, &vx, &vy, &vz, &mass, &x_lo, &y_lo, &z_lo, &ax, &ay, &az}) {
+            column->resize(count, 0.0f);
+        }
+    }
+
+    void push_back(float px, float py, float pz, float pvx, float pvy, float pvz, float pmass) {
+        x.push_back(px);
+        y.push_back(py);
+        z.push_back(pz);
+        vx.push_back(pvx);
+        vy.push_back(pvy);
+        vz.push_back(pvz);
+        mass.push_back(pmass);
+        x_lo.push_back(0.0f);
+        y_lo.push_back(0.0f);
+        z_lo.push_back(0.0f);
+        ax.push_back(0.0f);
+        ay.push_back(0.0f);
+        az.push_back(0.0f);
+    }
+};
+
+}  // namespace nbody
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <array>
+
+#include "bodies.hpp"
+
+namespace nbody {
+
+// Conserved quantities for checking integrations, summed in double precision. Positions include their low
+// parts where the bodies carry them.
+
+double kinetic_energy(const Bodies& bodies);
+
+// Total linear momentum `sum_i m_i v_i`.
+std::array<double, 3> momentum(const Bodies& bodies);
+
+// `-G sum_(i < j) m_i m_j / sqrt(|r_i - r_j|^2 + softening^2)` by direct summation over the global scheduler,
+// so O(N^2) whatever solver produced the bodies.
+double potential_energy(const Bodies& bodies, float gravitational_constant, float softening);
+
+}  // namespace nbody
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include "aligned_allocator.hpp"
+#include "arena.hpp"
+#include "bodies.hpp"
+#include "kernels.hpp"
+#include "precision.hpp"
+#include "simd.hpp"
+#include "solver.hpp"
+
+namespace nbody {
+
+class DirectSumConfig {
+   public:
+    float softening              = 1.0e-2f;
+    float gravitational_constant = 1.0f;
+
+    // Falls back to a narrower instruction set when the CPU lacks this one.
+    Isa isa = detect_isa();
+
+    // Without cells, `RELATIVE` rebases every block of targets on its first target.
+    Precision precision = Precision::FP32;
+};
+
+// Exact O(N^2) gravity on the CPU, every body against every other one.
+class DirectSum : public Solver {
+   public:
+    explicit DirectSum(const DirectSumConfig& config = {})
+        : m_config(config), m_kernel(select_direct_sum_kernel(config.isa, config.precision)) {}
+
+    // Overwrites `ax`, `ay` and `az`.
+    void compute_accelerations(Bodies& bodies) override;
+
+    // Sums over every body for the active targets only.
+    void compute_active_accelerations(Bodies& bodies, std::span<const uint32_t> active) override;
+
+    SolverKind kind() const noexcept override { return SolverKind::DIRECT_SUM; }
+
+    const DirectSumConfig& config() const noexcept { return m_config; }
+
+   private:
+    // Coordinates rebased on the origin of the current block of targets under `RELATIVE`. Every worker keeps
+    // its own over all steps.
+    class RelativeScratch {
+       public:
+        aligned_vector<float> x;
+        aligned_vector<float> y;
+        aligned_vector<float> z;
+        aligned_vector<float> tx;
+        aligned_vector<float> ty;
+        aligned_vector<float> tz;
+    };
+
+    // Runs the kernel for one block of targets against every body. Under `RELATIVE` the targets and the
+    // sources are rebased on the first target of the block first.
+    void evaluate_block(const Bodies& bodies, const DirectSumTargets& targets, float softening_squared);
+
+    DirectSumConfig              m_config;
+    DirectSumKernel              m_kernel;
+    WorkerLocal<RelativeScratch> m_relative;
+};
+
+}  // namespace nbody
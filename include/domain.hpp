@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "bodies.hpp"
+#include "octree.hpp"
+
+namespace nbody {
+
+// Building blocks for spreading one simulation over several processes, independent of how they communicate.
+// Space is cut along the Morton curve over the global bounds into one contiguous key range per domain, weighted
+// by the measured cost of the bodies so that every domain gets the same amount of work. Every domain then
+// receives the locally essential tree of every other one: the nodes far enough away to act on all of the
+// domain as point masses, and the bodies of the leaves that are not.
+
+class DomainBounds {
+   public:
+    float min_x = std::numeric_limits<float>::max();
+    float min_y = std::numeric_limits<float>::max();
+    float min_z = std::numeric_limits<float>::max();
+    float max_x = std::numeric_limits<float>::lowest();
+    float max_y = std::numeric_limits<float>::lowest();
+    float max_z = std::numeric_limits<float>::lowest();
+
+    // Tight bounds of the positions, empty for no bodies.
+    static DomainBounds of(const Bodies& bodies);
+
+    bool empty() const noexcept { return min_x > max_x; }
+};
+
+// Morton keys of the positions quantized against the cube around `global`, which has to contain the bodies of
+// every domain so that keys compare across domains.
+void compute_domain_keys(const Bodies& bodies, const DomainBounds& global, std::span<uint64_t> keys);
+
+// A key and the work of the bodies from it up to the next sample of the same domain.
+class DomainSample {
+   public:
+    uint64_t key;
+    double   work;
+};
+
+// At most `count` samples at equal steps through `sorted_keys`, sharing `work` out evenly over the bodies.
+std::vector<DomainSample> sample_domain(std::span<const uint64_t> sorted_keys, double work, std::size_t count);
+
+// Key boundaries of `domain_count` domains of about equal work, from the samples of every domain in any order.
+// Domain `d` owns the keys `[splitters[d], splitters[d + 1])`, the last boundary is `UINT64_MAX`.
+std::vector<uint64_t> choose_splitters(std::vector<DomainSample> samples, std::size_t domain_count);
+
+// Domain owning `key` under `splitters` from `choose_splitters`.
+std::size_t domain_of(std::span<const uint64_t> splitters, uint64_t key) noexcept;
+
+// Appends what a domain with bounds `target` needs of the bodies in `tree` as `x, y, z, mass` quadruples to
+// `sources`: nodes that pass the Barnes-Hut criterion with `theta` for every point of `target`, as point
+// masses, and the bodies of the leaves that are opened. `theta = 0` sends every body.
+void append_essential_sources(const Octree& tree, const DomainBounds& target, float theta,
+                              std::vector<float>& sources);
+
+}  // namespace nbody
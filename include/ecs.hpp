@@ -0,0 +1,314 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "arena.hpp"
+#include "parallel.hpp"
+#include "typeindex.hpp"
+
+namespace nbody {
+
+// Entity component store. Entities with the same set of component types share an archetype, which keeps its
+// components in fixed size chunks holding one 64 byte aligned column per component type (structure of arrays).
+// Queries visit the chunks of every matching archetype in order, so a system streams through exactly the
+// columns it asks for, and chunks are independent units of parallel work.
+
+inline constexpr std::size_t MAX_COMPONENT_TYPES = 256;
+
+using ComponentId   = uint8_t;
+using ComponentMask = std::bitset<MAX_COMPONENT_TYPES>;
+
+// Component ids come from `internal::type_id_uint8`, so they are dense and at most `MAX_COMPONENT_TYPES`
+// distinct component types exist per process.
+template <typename T>
+ComponentId component_id() noexcept {
+    return static_cast<ComponentId>(internal::type_id_uint8<std::remove_cvref_t<T>>());
+}
+
+// How to move and destroy a component without knowing its type, for moving entities between archetypes.
+class ComponentInfo {
+   public:
+    ComponentId id;
+    std::size_t size;
+    std::size_t alignment;
+    bool        trivial;
+
+    void (*move_construct)(void* destination, void* source) noexcept;
+    void (*destroy)(void* component) noexcept;
+};
+
+template <typename T>
+const ComponentInfo& component_info() noexcept {
+    static_assert(std::is_nothrow_move_constructible_v<T>, "Components are moved between chunks");
+    static_assert(alignof(T) <= SIMD_ALIGNMENT, "Component columns are aligned to SIMD_ALIGNMENT");
+
+    static const ComponentInfo info{
+        component_id<T>(),
+        sizeof(T),
+        alignof(T),
+        std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>,
+        [](void* destination, void* source) noexcept {
+            new (destination) T(std::move(*static_cast<T*>(source)));
+        },
+        [](void* component) noexcept { static_cast<T*>(component)->~T(); },
+    };
+    return info;
+}
+
+// Handle of an entity. The generation tells a destroyed entity from a newer one reusing its slot.
+class Entity {
+   public:
+    uint32_t index      = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const Entity&) const = default;
+};
+
+class World {
+   public:
+    // Bytes per chunk, aiming for a chunk's columns to stay in L2 while a system works on it.
+    static constexpr std::size_t CHUNK_BYTES = 16 * 1024;
+
+    World() = default;
+    ~World();
+
+    World(const World&)            = delete;
+    World& operator=(const World&) = delete;
+
+    // Throws `std::invalid_argument` when a component type appears twice.
+    template <typename... Components>
+    Entity create(Components... components) {
+        std::array<const ComponentInfo*, sizeof...(Components)> infos{&component_info<Components>()...};
+
+        uint32_t archetype = archetype_for(infos);
+        Entity   entity    = create_entity();
+        Location location  = allocate(archetype, entity);
+        (new (component_pointer(location, component_id<Components>())) Components(std::move(components)), ...);
+        return entity;
+    }
+
+    // Destroys the components of `entity`. Throws `std::runtime_error` for an entity that is not alive.
+    void destroy(Entity entity);
+
+    bool alive(Entity entity) const noexcept {
+        return entity.index < m_records.size() && m_records[entity.index].generation == entity.generation &&
+               m_records[entity.index].archetype != NO_ARCHETYPE;
+    }
+
+    template <typename Component>
+    bool has(Entity entity) const {
+        return m_archetypes[record(entity).archetype]->mask.test(component_id<Component>());
+    }
+
+    // Throws `std::runtime_error` when `entity` lacks the component. The reference is invalidated by any
+    // change to the set of entities or their components.
+    template <typename Component>
+    Component& get(Entity entity) {
+        const Record& location = record(entity);
+        if (!m_archetypes[location.archetype]->mask.test(component_id<Component>())) {
+            throw std::runtime_error("World::get => entity has no such component.");
+        }
+        return *static_cast<Component*>(component_pointer(location.location(), component_id<Component>()));
+    }
+
+    // Adds the component, or replaces it if the entity already has one.
+    template <typename Component>
+    void add(Entity entity, Component component) {
+        ComponentId id = component_id<Component>();
+        if (has<Component>(entity)) {
+            get<Component>(entity) = std::move(component);
+            return;
+        }
+        Location location = migrate(entity, &component_info<Component>(), NO_COMPONENT);
+        new (component_pointer(location, id)) Component(std::move(component));
+    }
+
+    template <typename Component>
+    void remove(Entity entity) {
+        if (has<Component>(entity)) {
+            migrate(entity, nullptr, component_id<Component>());
+        }
+    }
+
+    // Calls `function(std::span<const Entity>, std::span<Components>...)` once per non-empty chunk of every
+    // archetype having all of `Components`. Entities must not be created, destroyed or change components
+    // during the query.
+    template <typename... Components, typename Function>
+    void each_chunk(Function&& function) {
+        const ComponentMask required = mask_of<Components...>();
+        for (auto& archetype : m_archetypes) {
+            if ((archetype->mask & required) != required) {
+                continue;
+            }
+            for (std::size_t chunk = 0; chunk < archetype->chunks.size(); ++chunk) {
+                visit_chunk<Components...>(*archetype, chunk, function);
+            }
+        }
+    }
+
+    // `each_chunk` with the chunks spread over the scheduler's workers. Chunks run concurrently, so
+    // `function` may only write to the columns it is given.
+    template <typename... Components, typename Function>
+    void parallel_each_chunk(const Function& function) {
+        const ComponentMask required = mask_of<Components...>();
+
+        std::vector<std::pair<Archetype*, std::size_t>> chunks;
+        for (auto& archetype : m_archetypes) {
+            if ((archetype->mask & required) == required) {
+                for (std::size_t chunk = 0; chunk < archetype->chunks.size(); ++chunk) {
+                    chunks.emplace_back(archetype.get(), chunk);
+                }
+            }
+        }
+
+        parallel_for(chunks.size(), 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                visit_chunk<Components...>(*chunks[i].first, chunks[i].second, function);
+            }
+        });
+    }
+
+    // Calls `function(Entity, Components&...)` for every entity having all of `Components`.
+    template <typename... Components, typename Function>
+    void each(Function&& function) {
+        each_chunk<Components...>([&](std::span<const Entity> entities, std::span<Components>... columns) {
+            for (std::size_t i = 0; i < entities.size(); ++i) {
+                function(entities[i], columns[i]...);
+            }
+        });
+    }
+
+    std::size_t size() const noexcept { return m_alive; }
+    std::size_t archetype_count() const noexcept { return m_archetypes.size(); }
+
+   private:
+    static constexpr uint32_t    NO_ARCHETYPE = UINT32_MAX;
+    static constexpr std::size_t NO_COMPONENT = MAX_COMPONENT_TYPES;
+    static constexpr uint8_t     NO_COLUMN    = UINT8_MAX;
+
+    class Location {
+       public:
+        uint32_t archetype;
+        uint32_t chunk;
+        uint32_t row;
+    };
+
+    class Record {
+       public:
+        uint32_t generation = 0;
+        uint32_t archetype  = NO_ARCHETYPE;
+        uint32_t chunk      = 0;
+        uint32_t row        = 0;
+
+        Location location() const noexcept { return {archetype, chunk, row}; }
+    };
+
+    // Chunks of at most `CHUNK_BYTES` go back to the world's pool, archetypes of huge components have larger
+    // chunks that go back to the system.
+    class ChunkDeleter {
+       public:
+        BlockPool* pool;  // Null for chunks from the system
+
+        void operator()(std::byte* memory) const noexcept {
+            if (pool != nullptr) {
+                pool->deallocate(memory);
+            } else {
+                ::operator delete(memory, std::align_val_t{SIMD_ALIGNMENT});
+            }
+        }
+    };
+
+    class Chunk {
+       public:
+        std::unique_ptr<std::byte, ChunkDeleter> memory;
+        uint32_t                                 count = 0;
+    };
+
+    class Archetype {
+       public:
+        ComponentMask                            mask;
+        std::vector<const ComponentInfo*>        components;  // Ordered by id
+        std::vector<std::size_t>                 column_offsets;
+        std::array<uint8_t, MAX_COMPONENT_TYPES> column_of;  // `NO_COLUMN` for components it lacks
+        std::size_t                              entity_offset  = 0;
+        std::size_t                              chunk_bytes    = 0;
+        uint32_t                                 chunk_capacity = 0;
+        std::vector<Chunk>                       chunks;  // All full but the last
+
+        // Archetypes one component away, filled in as entities migrate.
+        std::unordered_map<ComponentId, uint32_t> with;
+        std::unordered_map<ComponentId, uint32_t> without;
+
+        Entity* entities_of(std::size_t chunk) const noexcept {
+            return reinterpret_cast<Entity*>(chunks[chunk].memory.get() + entity_offset);
+        }
+
+        std::byte* column(std::size_t chunk, ComponentId id) const noexcept {
+            return chunks[chunk].memory.get() + column_offsets[column_of[id]];
+        }
+    };
+
+    template <typename... Components>
+    static ComponentMask mask_of() noexcept {
+        ComponentMask mask;
+        (mask.set(component_id<Components>()), ...);
+        return mask;
+    }
+
+    template <typename... Components, typename Function>
+    static void visit_chunk(const Archetype& archetype, std::size_t chunk, Function& function) {
+        uint32_t count = archetype.chunks[chunk].count;
+        if (count == 0) {
+            return;
+        }
+        function(std::span<const Entity>(archetype.entities_of(chunk), count),
+                 std::span<Components>(
+                     reinterpret_cast<Components*>(archetype.column(chunk, component_id<Components>())), count)...);
+    }
+
+    const Record& record(Entity entity) const;
+
+    uint32_t archetype_for(std::span<const ComponentInfo* const> infos);
+    uint32_t create_archetype(std::vector<const ComponentInfo*> components);
+    Entity   create_entity();
+    Location allocate(uint32_t archetype, Entity entity);
+
+    // Removes the row, moving the archetype's last row into the hole. Components still in the row are destroyed
+    // unless `destroy_components` is false, which leaves them to the caller having moved them out.
+    void release(Location location, bool destroy_components);
+
+    // Moves `entity` to the archetype with `added` or without `removed`. The added component is left
+    // unconstructed at the returned location.
+    Location migrate(Entity entity, const ComponentInfo* added, std::size_t removed);
+
+    void* component_pointer(Location location, ComponentId id) const noexcept {
+        const Archetype& archetype = *m_archetypes[location.archetype];
+        std::size_t      size      = archetype.components[archetype.column_of[id]]->size;
+        return archetype.column(location.chunk, id) + location.row * size;
+    }
+
+    // Chunks emptied by destroyed or migrated entities are kept for the next archetype that grows, so churning
+    // entities does not return to the system allocator. Declared first to outlive the chunks.
+    BlockPool m_chunk_pool{CHUNK_BYTES, SIMD_ALIGNMENT, 16};
+
+    std::vector<std::unique_ptr<Archetype>>     m_archetypes;
+    std::unordered_map<ComponentMask, uint32_t> m_archetype_of;
+    std::vector<Record>                         m_records;
+    std::vector<uint32_t>                       m_free_records;
+    std::size_t                                 m_alive = 0;
+};
+
+}  // namespace nbody
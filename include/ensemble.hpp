@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "bodies.hpp"
+#include "kernels.hpp"
+#include "simd.hpp"
+
+namespace nbody {
+
+enum class EnsembleStatus {
+    RUNNING,
+    // Reached its `end_time`.
+    FINISHED,
+    // A body got farther than `escape_radius` from the center of mass.
+    ESCAPE,
+    // Two bodies got closer than `encounter_distance`.
+    ENCOUNTER,
+};
+
+std::string_view ensemble_status_name(EnsembleStatus status) noexcept;
+
+// When a system of an `Ensemble` stops and how finely it steps. A distance of zero turns its condition off.
+class EnsembleSystemConfig {
+   public:
+    double end_time     = 1.0;
+    float  max_timestep = 1.0e-3f;
+
+    float escape_radius      = 0.0f;
+    float encounter_distance = 0.0f;
+};
+
+class EnsembleConfig {
+   public:
+    // Zero suits the few body systems ensembles are for, such as planetary systems, where close approaches are
+    // meant to be resolved or to stop the system rather than to be smoothed over.
+    float softening              = 0.0f;
+    float gravitational_constant = 1.0f;
+
+    // Falls back to a narrower instruction set when the CPU lacks this one.
+    Isa isa = detect_isa();
+
+    // Every step of a system takes `accuracy` times the shortest two body free fall time `sqrt(r^3 / G (m + m'))`
+    // of any of its pairs, at most its `max_timestep`. Zero steps every system by its `max_timestep`.
+    float accuracy = 0.0f;
+
+    // Systems of at most this many bodies step `PACKED_LANES` at a time through the packed kernel of `isa`, one
+    // system per SIMD lane, rather than each through the direct sum over its own range. Zero turns packing off.
+    std::size_t max_packed_bodies = 128;
+};
+
+// Where a system of an `Ensemble` lives in its bodies, and how far it got.
+class EnsembleSystem {
+   public:
+    std::size_t          offset = 0;
+    std::size_t          count  = 0;
+    EnsembleSystemConfig config{};
+
+    double         time   = 0.0;
+    uint64_t       steps  = 0;
+    EnsembleStatus status = EnsembleStatus::RUNNING;
+};
+
+// Many small independent systems stepped together, for parameter sweeps over thousands of systems of 3 to about
+// 1000 bodies each, which one simulation at a time leaves to a single thread and a few SIMD lanes. The bodies of
+// every system sit contiguously in one set of columns, and a step runs the running systems as tasks of the
+// global scheduler. Systems of similar small sizes are packed side by side, one per SIMD lane, so that every
+// vector evaluates the same pair of several systems. Larger ones go through the direct sum kernel of `isa` over
+// their own range. Either force pass also finds the closest pairs the stopping conditions and the timestep need.
+//
+// Every system integrates with kick-drift-kick leapfrog on its own timestep and clock. Its stopping conditions
+// are checked on the state at the start of each of its steps, and a stopped system keeps its bodies and time
+// as they were then, so that `time` is when it stopped.
+class Ensemble {
+   public:
+    explicit Ensemble(const EnsembleConfig& config = {});
+
+    // Appends a copy of the positions, velocities and masses of `bodies` as a new system and returns its index.
+    // Throws `std::invalid_argument` for an empty system.
+    std::size_t add_system(const Bodies& bodies, const EnsembleSystemConfig& config = {});
+
+    // Advances every running system by one of its steps and returns how many are still running.
+    std::size_t step();
+
+    // Steps until every system stopped or `max_steps` steps went by, and returns how many are still running.
+    std::size_t run(uint64_t max_steps = UINT64_MAX);
+
+    std::size_t           system_count() const noexcept { return m_systems.size(); }
+    const EnsembleSystem& system(std::size_t index) const noexcept { return m_systems[index]; }
+    std::size_t           running_count() const noexcept { return m_running.size(); }
+
+    // Every system, at its `offset`. Accelerations are those of the last step, in the units of the positions.
+    const Bodies& bodies() const noexcept { return m_bodies; }
+
+    const EnsembleConfig& config() const noexcept { return m_config; }
+
+   private:
+    // Of the pairs of a system at its current positions, as `PackedSystems` has them.
+    class ClosestPair {
+       public:
+        float distance2 = std::numeric_limits<float>::infinity();
+        float pull      = 0.0f;
+    };
+
+    // Up to `PACKED_LANES` running systems in ascending body count, with their bodies laid out for the packed
+    // kernel. Lanes past `lanes` are empty.
+    class PackedGroup {
+       public:
+        std::array<uint32_t, PACKED_LANES> systems{};
+        std::array<uint32_t, PACKED_LANES> counts{};
+        std::size_t                        lanes      = 0;
+        std::size_t                        body_count = 0;
+
+        // `x`, `y`, `z`, `mass`, `ax`, `ay` and `az`, `body_count * PACKED_LANES` each.
+        aligned_vector<float> columns;
+
+        std::array<float, PACKED_LANES> min_distance2{};
+        std::array<float, PACKED_LANES> max_pull{};
+    };
+
+    // Whether the stopping conditions or the timestep of `system` need its closest pairs.
+    bool needs_closest(const EnsembleSystem& system) const noexcept;
+
+    void compute_accelerations(std::size_t index);
+    void compute_accelerations(PackedGroup& group);
+
+    // Stops system `index` when one of its conditions holds, otherwise returns the length of its next step.
+    double check_system(std::size_t index);
+
+    void step_system(std::size_t index);
+    void step_group(PackedGroup& group);
+
+    // Splits the running systems into packed groups and the ones stepped one by one.
+    void build_groups();
+
+    EnsembleConfig      m_config;
+    DirectSumKernel     m_kernel;
+    PackedSystemsKernel m_packed_kernel;
+
+    Bodies                      m_bodies;
+    std::vector<EnsembleSystem> m_systems;
+    std::vector<ClosestPair>    m_closest;
+
+    // Indices of the running systems in ascending order.
+    std::vector<uint32_t> m_running;
+
+    // The running systems again, rebuilt from `m_running` whenever it changes.
+    std::vector<PackedGroup> m_groups;
+    std::vector<uint32_t>    m_unpacked;
+    std::size_t              m_unpacked_bodies = 0;
+    bool                     m_groups_dirty    = true;
+};
+
+}  // namespace nbody
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "arena.hpp"
+#include "bodies.hpp"
+#include "kernels.hpp"
+#include "octree.hpp"
+#include "precision.hpp"
+#include "simd.hpp"
+#include "solver.hpp"
+
+namespace nbody {
+
+// One term `target[t] += coefficient * source[s] * factor[f]` of a translation between expansions, indexing the
+// coefficients of multi-indices in degree order.
+class FastMultipoleTerm {
+   public:
+    uint32_t target;
+    uint32_t source;
+    uint32_t factor;
+    double   coefficient;
+};
+
+class FastMultipoleConfig {
+   public:
+    // Two nodes of radii `r_a` and `r_b` interact through their expansions when `r_a + r_b < theta * d`.
+    float theta = 0.5f;
+
+    // Highest total degree kept in the multipole and local expansions. The force converges one order lower.
+    uint32_t expansion_order = 4;
+
+    float    softening              = 1.0e-2f;
+    float    gravitational_constant = 1.0f;
+    uint32_t leaf_size              = 32;
+
+    // Instruction set of the near field kernel.
+    Isa isa = detect_isa();
+
+    // Precision of the near field. The expansions are double precision in every mode, only their center is
+    // rounded to single precision. `RELATIVE` rebases every near field on the center of mass of its leaf.
+    Precision precision = Precision::FP32;
+};
+
+// O(N) gravity through Cartesian Taylor expansions on the octree. Every node carries a multipole expansion of
+// the mass below it and a local expansion of the potential from well separated nodes. Node pairs are found by
+// a dual tree traversal that is one-sided per target node: a node only ever writes its own interaction lists,
+// so every level of the traversal runs in parallel. The far field is unsoftened, softening only applies to the
+// near field direct sums.
+class FastMultipole : public Solver {
+   public:
+    static constexpr uint32_t MAX_EXPANSION_ORDER = 10;
+
+    // Throws `std::invalid_argument` for an expansion order above `MAX_EXPANSION_ORDER`.
+    explicit FastMultipole(const FastMultipoleConfig& config = {});
+
+    void compute_accelerations(Bodies& bodies) override;
+
+    SolverKind kind() const noexcept override { return SolverKind::FAST_MULTIPOLE; }
+
+    const FastMultipoleConfig& config() const noexcept { return m_config; }
+
+    const Octree& tree() const noexcept { return m_tree; }
+
+   private:
+    // `T_n = (first_scale * sum_i r_i T_(n - e_i) + second_scale * sum_i T_(n - 2 e_i)) / |r|^2`. Missing
+    // lower indices refer to the row of zeros.
+    class Recurrence {
+       public:
+        std::array<uint32_t, 3> once;
+        std::array<uint32_t, 3> twice;
+        double                  first_scale;
+        double                  second_scale;
+    };
+
+    // Buffers whose size is only known once filled. Every worker keeps its own over all steps.
+    class Scratch {
+       public:
+        std::vector<uint32_t> stack;
+        std::vector<uint32_t> handed_down;
+        std::vector<uint32_t> far;
+        std::vector<uint32_t> near;
+        InteractionList       near_field;
+    };
+
+    void build_tables();
+
+    void upward_pass();
+    void build_interaction_lists();
+    void multipole_to_local();
+    void downward_pass();
+    void evaluate(Bodies& bodies);
+
+    // Stores the monomials `d^n` for every multi-index `n` in degree order.
+    void powers(double dx, double dy, double dz, double* result) const;
+
+    // Stores the Taylor coefficients `D^n (1 / |r|) / n!` at `count` points `r` as one row of `count` values per
+    // multi-index, in degree order, followed by a row of zeros and a scratch row.
+    void derivatives(std::size_t count, const double* rx, const double* ry, const double* rz, double* result) const;
+
+    double* multipole(uint32_t node) noexcept { return m_multipoles.data() + node * m_coefficient_count; }
+    double* local(uint32_t node) noexcept { return m_locals.data() + node * m_coefficient_count; }
+
+    FastMultipoleConfig m_config;
+    DirectSumKernel     m_kernel;
+    Octree              m_tree;
+
+    std::size_t                          m_coefficient_count = 0;
+    std::vector<std::array<uint32_t, 3>> m_indices;
+    std::vector<uint32_t>                m_index_of;  // (order + 1)^3 table from a multi-index to its position
+    std::vector<FastMultipoleTerm>       m_multipole_shift_terms;
+    std::vector<FastMultipoleTerm>       m_multipole_to_local_terms;
+    std::vector<FastMultipoleTerm>       m_local_shift_terms;
+
+    // Degree-lowering terms giving the gradient component of a local expansion along each axis.
+    std::array<std::vector<FastMultipoleTerm>, 3> m_gradient_terms;
+
+    std::vector<Recurrence> m_recurrence;
+
+    std::vector<double> m_multipoles;
+    std::vector<double> m_locals;
+    std::vector<float>  m_radii;
+
+    // Interaction lists of every node, in the arena of the worker that built them. The arenas are reset at the
+    // start of every step, so the lists of millions of nodes cost no allocations.
+    std::vector<std::span<const uint32_t>> m_candidates;
+    std::vector<std::span<const uint32_t>> m_far_lists;
+    std::vector<std::span<const uint32_t>> m_near_lists;
+    std::vector<uint32_t>                  m_leaves;
+
+    WorkerLocal<Arena>   m_arenas;
+    WorkerLocal<Scratch> m_scratch;
+};
+
+}  // namespace nbody
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory.hpp"
+#include "gpu_tree.hpp"
+
+namespace nbody {
+
+class GpuLodConfig {
+   public:
+    // Cells of the tree that span fewer pixels are drawn as one impostor.
+    float detail_pixels = 2.0f;
+
+    // Instances per frame. A frame that picks more drops the rest.
+    uint32_t max_instances = 1u << 20;
+};
+
+// What a frame sees of the bodies.
+class GpuLodView {
+   public:
+    std::array<float, 16> view_projection;  // Column major, Vulkan clip space
+    float                 focal_pixels;     // Pixels per unit of length at a depth of one
+    std::array<float, 2>  sprite_size;      // Half extent of a body sprite in normalized device coordinates
+};
+
+// Level of detail for drawing the bodies from the tree `GpuBarnesHut` built in its last step, so that the cost of
+// a frame follows what is on screen rather than the body count. A compute pass, shaders/lod_cull.comp, drops the
+// nodes outside the frustum and picks the largest nodes that span fewer than `detail_pixels`, or single bodies
+// where there are none, into an instance buffer, and counts them into the `VkDrawIndirectCommand` of a four
+// vertex quad per instance. Each node stands for all of its bodies, an impostor at its center of mass as bright
+// as they are together.
+//
+// Instances are laid out as `Instance` in shaders/lod_cull.comp and shaders/impostor.vert, which reads them. There
+// is one instance buffer and one draw buffer per frame slot, so a frame can pick while earlier ones still draw.
+class GpuLod {
+   public:
+    // Must match `Instance` in shaders/lod_cull.comp and shaders/impostor.vert.
+    static constexpr VkDeviceSize INSTANCE_SIZE = 32;
+
+    // Must match `WORKGROUP_SIZE` in shaders/lod_cull.comp.
+    static constexpr uint32_t WORKGROUP_SIZE = 256;
+
+    GpuLod() = default;
+
+    GpuLod(const GpuLod&)            = delete;
+    GpuLod& operator=(const GpuLod&) = delete;
+
+    // Picks from the nodes of `tree`, which must outlive this. The buffers come from `allocator` and are shared by
+    // `queue_families`, the queue that records the cull and the one that draws. Throws `std::runtime_error` when
+    // an object cannot be created.
+    void create(GpuAllocator& allocator, VkPipelineCache cache, const GpuBarnesHut& tree, uint32_t frame_count,
+                const GpuLodConfig& config, const std::vector<uint32_t>& queue_families);
+
+    void destroy() noexcept;
+
+    // Records the pick of frame slot `frame`, on the queue of the tree's step and after it. Starts with a barrier
+    // on earlier compute and transfer writes and leaves its own unsynchronized, the draw has to wait for them at
+    // the draw indirect and vertex shader stages. Binds its own pipeline and set.
+    void record_cull(VkCommandBuffer command_buffer, uint32_t frame, const GpuLodView& view) const;
+
+    // Read by `vkCmdDrawIndirect` with a draw count of 1.
+    VkBuffer draw_buffer(uint32_t frame) const noexcept { return m_frames[frame].draw_buffer; }
+
+    VkBuffer     instance_buffer(uint32_t frame) const noexcept { return m_frames[frame].instance_buffer; }
+    VkDeviceSize instance_buffer_size() const noexcept { return m_instance_buffer_size; }
+
+   private:
+    // Must match the `Parameters` push constant block in shaders/lod_cull.comp.
+    class PushConstants {
+       public:
+        std::array<float, 16> view_projection;
+        std::array<float, 2>  sprite_size;
+        float                 detail_scale;
+        uint32_t              body_count;
+    };
+
+    class Frame {
+       public:
+        VkBuffer        instance_buffer            = VK_NULL_HANDLE;
+        GpuAllocation   instance_buffer_allocation = {};
+        VkBuffer        draw_buffer                = VK_NULL_HANDLE;
+        GpuAllocation   draw_buffer_allocation     = {};
+        VkDescriptorSet set                        = VK_NULL_HANDLE;
+    };
+
+    void create_buffers(const std::vector<uint32_t>& queue_families);
+    void create_descriptor_sets(const GpuBarnesHut& tree);
+    void create_pipeline(VkPipelineCache cache);
+
+    GpuAllocator* m_allocator   = nullptr;
+    VkDevice      m_device      = VK_NULL_HANDLE;
+    uint32_t      m_body_count  = 0;
+    uint32_t      m_group_count = 0;
+    GpuLodConfig  m_config{};
+
+    VkDeviceSize       m_instance_buffer_size = 0;
+    std::vector<Frame> m_frames               = {};
+
+    VkDescriptorSetLayout m_set_layout      = VK_NULL_HANDLE;
+    VkDescriptorPool      m_descriptor_pool = VK_NULL_HANDLE;
+    VkPipelineLayout      m_pipeline_layout = VK_NULL_HANDLE;
+    VkPipeline            m_pipeline        = VK_NULL_HANDLE;
+};
+
+}  // namespace nbody
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace nbody {
+
+// Who touches an allocation, from which `GpuAllocator` picks the memory type.
+enum class MemoryUsage {
+    // Only the GPU.
+    DEVICE_LOCAL,
+    // Written by the host and read by the GPU. Host visible and coherent.
+    HOST_UPLOAD,
+    // Written by the GPU and read by the host. Host visible and coherent, and cached where there is such a type,
+    // since reading uncached memory is slow.
+    HOST_READBACK,
+};
+
+// A range of a block of `GpuAllocator`, to be bound at `offset` of `memory`.
+class GpuAllocation {
+   public:
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize   offset = 0;
+    VkDeviceSize   size   = 0;
+
+    // Into the mapping of the block for host visible usages, which lives as long as the block.
+    void* mapped = nullptr;
+
+   private:
+    friend class GpuAllocator;
+
+    uint32_t m_block = 0;
+};
+
+class GpuAllocatorStats {
+   public:
+    std::size_t  block_count      = 0;
+    std::size_t  allocation_count = 0;
+    VkDeviceSize reserved_bytes   = 0;
+    VkDeviceSize used_bytes       = 0;
+};
+
+// Suballocates buffer memory from a few large `VkDeviceMemory` blocks, which keeps far below the driver's limit on
+// allocations and spares a driver call for most buffers. Each memory type has its own blocks. Allocations that do
+// not fit half a block get a block of their own, and host visible blocks stay mapped while they live.
+//
+// A block fits an allocation into its smallest free range, and merges a freed range with the free ranges next to
+// it. An empty block stays until `trim`, so that freeing every buffer of one body count and allocating those of
+// the next reuses whole blocks without fragmenting them, and without going to the driver.
+//
+// Places buffers only, so `bufferImageGranularity` never applies. Thread safe, allocating and freeing take a lock,
+// which is cheap next to the driver calls it replaces.
+class GpuAllocator {
+   public:
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = VkDeviceSize{64} << 20;
+
+    GpuAllocator() = default;
+
+    GpuAllocator(const GpuAllocator&)            = delete;
+    GpuAllocator& operator=(const GpuAllocator&) = delete;
+
+    // Blocks are `block_size`, or an eighth of the heap of their memory type when that is smaller.
+    void create(VkDevice device, VkPhysicalDevice physical_device, VkDeviceSize block_size = DEFAULT_BLOCK_SIZE);
+
+    // Frees every block, which must no longer be in use by the device.
+    void destroy() noexcept;
+
+    // A type of `type_bits` for `usage`. Throws `std::runtime_error` when there is none.
+    uint32_t find_memory_type(uint32_t type_bits, MemoryUsage usage) const;
+
+    // Throws `std::runtime_error` when no memory type fits or the device is out of memory.
+    GpuAllocation allocate(const VkMemoryRequirements& requirements, MemoryUsage usage);
+
+    // Returns the range to its block and resets `allocation`. Does nothing for an empty allocation.
+    void free(GpuAllocation& allocation) noexcept;
+
+    // A buffer bound to a new allocation. Buffers shared by more than one queue family are created with
+    // concurrent sharing, which spares the ownership transfer barriers on every hand over.
+    VkBuffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memory_usage,
+                           GpuAllocation& allocation, const std::vector<uint32_t>& queue_families = {});
+
+    // Destroys `buffer` and frees `allocation`, and resets both.
+    void destroy_buffer(VkBuffer& buffer, GpuAllocation& allocation) noexcept;
+
+    // Frees the blocks without allocations.
+    void trim() noexcept;
+
+    GpuAllocatorStats stats() const noexcept;
+
+    VkDevice                                device() const noexcept { return m_device; }
+    const VkPhysicalDeviceLimits&           limits() const noexcept { return m_limits; }
+    const VkPhysicalDeviceMemoryProperties& memory_properties() const noexcept { return m_memory_properties; }
+
+   private:
+    class Block {
+       public:
+        VkDeviceMemory memory           = VK_NULL_HANDLE;
+        VkDeviceSize   size             = 0;
+        uint32_t       memory_type      = 0;
+        void*          mapped           = nullptr;
+        std::size_t    allocation_count = 0;
+        bool           dedicated        = false;
+
+        // Offset to size, with no two ranges adjacent.
+        std::map<VkDeviceSize, VkDeviceSize> free_ranges;
+    };
+
+    // The index of a new block in `m_blocks`.
+    uint32_t create_block(uint32_t memory_type, VkDeviceSize size, bool dedicated);
+    void     destroy_block(Block& block) noexcept;
+
+    // Carves `size` bytes at `alignment` out of the smallest free range of `block` they fit, if any.
+    static bool suballocate(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+
+    VkDevice                         m_device     = VK_NULL_HANDLE;
+    VkDeviceSize                     m_block_size = DEFAULT_BLOCK_SIZE;
+    VkPhysicalDeviceLimits           m_limits{};
+    VkPhysicalDeviceMemoryProperties m_memory_properties{};
+
+    // Destroyed blocks leave a slot with a null `memory`, which the next block takes.
+    mutable std::mutex m_mutex;
+    std::vector<Block> m_blocks;
+};
+
+class GpuRingAllocation {
+   public:
+    VkDeviceSize offset = 0;
+    void*        mapped = nullptr;
+};
+
+// Linear allocator over one persistently mapped upload buffer for data that changes every frame, with one region
+// per frame in flight. `begin_frame` discards everything the previous use of a frame slot allocated at once, by
+// which time the device must be done with it.
+class GpuRing {
+   public:
+    GpuRing() = default;
+
+    GpuRing(const GpuRing&)            = delete;
+    GpuRing& operator=(const GpuRing&) = delete;
+
+    // Allocations are aligned for every descriptor type `usage` allows binding them as.
+    void create(GpuAllocator& allocator, VkDeviceSize frame_size, uint32_t frame_count, VkBufferUsageFlags usage);
+
+    void destroy() noexcept;
+
+    void begin_frame(uint32_t frame) noexcept;
+
+    // Throws `std::runtime_error` when the region of the frame is full.
+    GpuRingAllocation allocate(VkDeviceSize size);
+
+    VkBuffer buffer() const noexcept { return m_buffer; }
+
+   private:
+    GpuAllocator* m_allocator  = nullptr;
+    VkBuffer      m_buffer     = VK_NULL_HANDLE;
+    GpuAllocation m_allocation = {};
+    VkDeviceSize  m_frame_size = 0;
+    VkDeviceSize  m_alignment  = 1;
+    VkDeviceSize  m_begin      = 0;
+    VkDeviceSize  m_head       = 0;
+};
+
+}  // namespace nbody
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory.hpp"
+
+namespace nbody {
+
+class GpuBarnesHutConfig {
+   public:
+    float theta                  = 0.5f;
+    float timestep               = 1.0e-3f;
+    float softening              = 1.0e-2f;
+    float gravitational_constant = 1.0f;
+};
+
+// Barnes-Hut on the GPU as a chain of compute passes, so the tree is rebuilt every step without the bodies ever
+// leaving device memory: bounds, 30 bit Morton codes, a radix sort of the codes, the linear BVH of Karras (2012)
+// over the sorted codes, bottom up moments, and a stackless traversal over escape pointers that kicks and drifts
+// every body like shaders/nbody.comp. The shaders are shaders/bvh_*.comp, which `load_shader` hands out from the
+// SPIR-V embedded in the library like the apps' own.
+//
+// Traversal needs subgroup vote operations in compute shaders, a Vulkan 1.1 feature.
+class GpuBarnesHut {
+   public:
+    // Must match `WORKGROUP_SIZE` and `SORT_BLOCK` in shaders/bvh_common.glsl.
+    static constexpr uint32_t WORKGROUP_SIZE = 256;
+    static constexpr uint32_t SORT_BLOCK     = WORKGROUP_SIZE * 8;
+
+    GpuBarnesHut() = default;
+
+    GpuBarnesHut(const GpuBarnesHut&)            = delete;
+    GpuBarnesHut& operator=(const GpuBarnesHut&) = delete;
+
+    // Whether `physical_device` can run the traversal.
+    static bool supported(VkPhysicalDevice physical_device);
+
+    // The buffers come from `allocator`, which must outlive them, on the device of `physical_device`.
+    // `body_set_layout` describes the sets `record_step` is given: positions in, velocities in, positions out and
+    // velocities out as storage buffers at bindings 0 to 3, positions with the mass in `w`, as for
+    // shaders/nbody.comp. Throws `std::runtime_error` when the device is not `supported` or an object cannot be
+    // created.
+    void create(GpuAllocator& allocator, VkPhysicalDevice physical_device, VkPipelineCache cache,
+                VkDescriptorSetLayout body_set_layout, uint32_t body_count, const GpuBarnesHutConfig& config);
+
+    void destroy() noexcept;
+
+    // Records one step from the state `body_set` reads into the one it writes. Starts with a barrier on earlier
+    // compute and transfer writes, like the direct sum's dispatches, and leaves the step's writes unsynchronized.
+    // Binds its own pipelines and sets.
+    void record_step(VkCommandBuffer command_buffer, VkDescriptorSet body_set) const;
+
+    uint32_t body_count() const noexcept { return m_body_count; }
+
+    // The nodes as `Node` in shaders/bvh_common.glsl lays them out, as of the last step recorded. For passes that
+    // read the tree after the step on the same queue, like `GpuLod`.
+    VkBuffer     node_buffer() const noexcept { return m_buffers[NODES_BUFFER]; }
+    VkDeviceSize node_buffer_size() const noexcept { return m_buffer_sizes[NODES_BUFFER]; }
+
+   private:
+    // Must match the `Parameters` push constant block in shaders/bvh_common.glsl.
+    class PushConstants {
+       public:
+        uint32_t body_count;
+        uint32_t block_count;
+        uint32_t shift;
+        float    theta_squared;
+        float    timestep;
+        float    softening_squared;
+        float    gravitational_constant;
+    };
+
+    enum Pass : uint32_t {
+        BOUNDS,
+        MORTON,
+        RADIX_HISTOGRAM,
+        RADIX_SCAN,
+        RADIX_SCATTER,
+        BUILD,
+        MOMENTS,
+        TRAVERSE,
+        PASS_COUNT,
+    };
+
+    // Bindings of set 1, in the order of shaders/bvh_common.glsl.
+    enum Buffer : uint32_t {
+        BOUNDS_BUFFER,
+        KEYS_BUFFER,
+        VALUES_BUFFER,
+        HISTOGRAMS_BUFFER,
+        NODES_BUFFER,
+        VISITS_BUFFER,
+        BUFFER_COUNT,
+    };
+
+    void create_buffers();
+    void create_descriptor_set();
+    void create_pipelines(VkPipelineCache cache, VkDescriptorSetLayout body_set_layout);
+
+    void record_dispatch(VkCommandBuffer command_buffer, Pass pass, uint32_t groups, uint32_t shift) const;
+
+    GpuAllocator* m_allocator  = nullptr;
+    VkDevice      m_device     = VK_NULL_HANDLE;
+    uint32_t      m_body_count = 0;
+
+    PushConstants m_push_constants{};
+
+    std::array<VkBuffer, BUFFER_COUNT>      m_buffers            = {};
+    std::array<GpuAllocation, BUFFER_COUNT> m_buffer_allocations = {};
+    std::array<VkDeviceSize, BUFFER_COUNT>  m_buffer_sizes       = {};
+
+    VkDescriptorSetLayout              m_tree_set_layout = VK_NULL_HANDLE;
+    VkDescriptorPool                   m_descriptor_pool = VK_NULL_HANDLE;
+    VkDescriptorSet                    m_tree_set        = VK_NULL_HANDLE;
+    VkPipelineLayout                   m_pipeline_layout = VK_NULL_HANDLE;
+    std::array<VkPipeline, PASS_COUNT> m_pipelines       = {};
+};
+
+}  // namespace nbody
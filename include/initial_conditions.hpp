@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "bodies.hpp"
+
+namespace nbody {
+
+// Standard test systems in N-body units (`G = 1`, total mass 1), drawn from a seeded generator so that the
+// same count and seed always give the same bodies. Every system is shifted to its center of mass frame.
+enum class InitialConditions {
+    // Plummer sphere in virial equilibrium, scaled to a total energy of -1/4. Radii are cut at 10 scale radii.
+    PLUMMER,
+    // Uniform sphere of unit radius at rest, which collapses within one free fall time of about 1.1.
+    COLD_COLLAPSE,
+    // Thin rotating disk of unit radius on circular orbits, what the apps start from.
+    DISK,
+    // Two thin rotating disks of unit radius on a parabolic orbit, inclined by 60 degrees against each other,
+    // with centers 6 apart along x and 2 along y.
+    DISK_MERGER,
+    // Uniform cube of side 2 at rest.
+    UNIFORM_CUBE,
+};
+
+Bodies generate_initial_conditions(InitialConditions kind, std::size_t count, uint64_t seed = 1);
+
+std::string_view                 initial_conditions_name(InitialConditions kind) noexcept;
+std::optional<InitialConditions> parse_initial_conditions(std::string_view name) noexcept;
+
+}  // namespace nbody
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bodies.hpp"
+#include "precision.hpp"
+#include "solver.hpp"
+
+namespace nbody {
+
+// Velocity update from the accelerations the last solver call wrote: `v += a * dt`.
+void kick(Bodies& bodies, float timestep);
+
+// Position update at constant velocity: `x += v * dt`. Outside of `FP32` the update is added to the position
+// pairs `x + x_lo`, exactly under `FP64` and with an error free two-sum otherwise, so that drifts far below the
+// resolution of `x` still accumulate.
+void drift(Bodies& bodies, float timestep, Precision precision = Precision::FP32);
+
+class BlockTimestepConfig {
+   public:
+    // Step of level 0. Level `l` steps by `max_timestep / 2^l`.
+    float max_timestep = 1.0e-3f;
+
+    // Deepest level, its step is the smallest one any body takes.
+    uint32_t max_level = 12;
+
+    // A body wants `dt = sqrt(2 * accuracy * softening / |a|)`, rounded down to the next level.
+    float accuracy  = 0.025f;
+    float softening = 1.0e-2f;
+
+    // Position accumulation of the drifts, normally that of the solver.
+    Precision precision = Precision::FP32;
+};
+
+// Kick-drift-kick leapfrog with individual power of two timesteps. Every body sits on a level, and a body on
+// level `l` is only kicked, and only has its force computed, at multiples of its own step. Drifts are cheap and
+// move every body to each substep, so the active bodies always feel current source positions. A body changes
+// level at the end of its step, to a longer step only at times that are a multiple of that step, which keeps
+// every level synchronized with the levels above it.
+class BlockTimestepIntegrator {
+   public:
+    static constexpr uint32_t MAX_LEVEL = 30;
+
+    // Throws `std::invalid_argument` for a `max_level` above `MAX_LEVEL`.
+    explicit BlockTimestepIntegrator(const BlockTimestepConfig& config = {});
+
+    // Advances every body by `max_timestep`. Positions and velocities are synchronized on return. The first
+    // call, and the first call after the body count changed, computes every acceleration up front.
+    void step(Bodies& bodies, Solver& solver);
+
+    const BlockTimestepConfig& config() const noexcept { return m_config; }
+
+    // Level of every body, set by the last `step`.
+    const std::vector<uint8_t>& levels() const noexcept { return m_levels; }
+
+    // Number of single-body force evaluations the last `step` did. A global timestep on the deepest occupied
+    // level would have done `bodies.size()` per substep.
+    std::size_t force_evaluations() const noexcept { return m_force_evaluations; }
+
+    // Substeps the last `step` took, one per distinct time some level ended its step.
+    std::size_t substeps() const noexcept { return m_substeps; }
+
+   private:
+    uint32_t level_for(float ax, float ay, float az) const noexcept;
+
+    // Finest level occupied by any body.
+    uint32_t deepest_level() const noexcept;
+
+    void start(Bodies& bodies, Solver& solver);
+
+    // `v += a * dt / 2` for every active body, with `dt` the step of its current level.
+    void half_kick_active(Bodies& bodies);
+
+    BlockTimestepConfig m_config;
+
+    std::vector<uint8_t>                   m_levels;
+    std::array<std::size_t, MAX_LEVEL + 1> m_level_counts{};
+    std::vector<uint32_t>                  m_active;
+    bool                                   m_started = false;
+
+    std::size_t m_force_evaluations = 0;
+    std::size_t m_substeps          = 0;
+};
+
+}  // namespace nbody
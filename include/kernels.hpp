@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "aligned_allocator.hpp"
+#include "precision.hpp"
+#include "simd.hpp"
+
+namespace nbody {
+
+// Bodies receiving forces. Accelerations are accumulated into `ax`, `ay` and `az`. The low parts of the
+// positions are only read by the `COMPENSATED` and `FP64` kernels, which need them.
+class DirectSumTargets {
+   public:
+    const float* x;
+    const float* y;
+    const float* z;
+    float*       ax;
+    float*       ay;
+    float*       az;
+    std::size_t  count;
+    const float* x_lo = nullptr;
+    const float* y_lo = nullptr;
+    const float* z_lo = nullptr;
+};
+
+// Point masses exerting forces, either bodies or the monopoles of tree nodes. Low parts as for the targets.
+class DirectSumSources {
+   public:
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* mass;
+    std::size_t  count;
+    const float* x_lo = nullptr;
+    const float* y_lo = nullptr;
+    const float* z_lo = nullptr;
+};
+
+// Point masses gathered from scattered places, such as accepted tree nodes and the bodies of opened leaves,
+// into contiguous columns for a single kernel call. A list is filled either without low parts or with them for
+// every entry.
+class InteractionList {
+   public:
+    aligned_vector<float> x;
+    aligned_vector<float> y;
+    aligned_vector<float> z;
+    aligned_vector<float> mass;
+    aligned_vector<float> x_lo;
+    aligned_vector<float> y_lo;
+    aligned_vector<float> z_lo;
+
+    void clear() noexcept {
+        x.clear();
+        y.clear();
+        z.clear();
+        mass.clear();
+        x_lo.clear();
+        y_lo.clear();
+        z_lo.clear();
+    }
+
+    void push_back(float px, float py, float pz, float pmass) {
+        x.push_back(px);
+        y.push_back(py);
+        z.push_back(pz);
+        mass.push_back(pmass);
+    }
+
+    void push_back(float px, float py, float pz, float pmass, float px_lo, float py_lo, float pz_lo) {
+        push_back(px, py, pz, pmass);
+        x_lo.push_back(px_lo);
+        y_lo.push_back(py_lo);
+        z_lo.push_back(pz_lo);
+    }
+
+    // Replaces the positions by their single precision offsets from the origin and drops the low parts.
+    void rebase(double origin_x, double origin_y, double origin_z) noexcept {
+        bool low = !x_lo.empty();
+        rebase_coordinates(x.data(), low ? x_lo.data() : nullptr, origin_x, x.size(), x.data());
+        rebase_coordinates(y.data(), low ? y_lo.data() : nullptr, origin_y, y.size(), y.data());
+        rebase_coordinates(z.data(), low ? z_lo.data() : nullptr, origin_z, z.size(), z.data());
+        x_lo.clear();
+        y_lo.clear();
+        z_lo.clear();
+    }
+
+    DirectSumSources sources() const noexcept {
+        if (x_lo.empty()) {
+            return {x.data(), y.data(), z.data(), mass.data(), x.size()};
+        }
+        return {x.data(), y.data(), z.data(), mass.data(), x.size(), x_lo.data(), y_lo.data(), z_lo.data()};
+    }
+};
+
+// Adds `sum_j m_j (r_j - r_i) / (|r_j - r_i|^2 + softening_squared)^(3/2)` to every target `i`. The
+// gravitational constant is left to the caller. Pairs at zero distance (a body and itself when the softening
+// is zero) contribute nothing.
+using DirectSumKernel = void (*)(const DirectSumTargets& targets, const DirectSumSources& sources,
+                                 float softening_squared);
+
+// Every kernel is instantiated for `FP32`, `COMPENSATED` and `FP64`. `RELATIVE` uses the `FP32` kernels on
+// rebased coordinates.
+template <Precision P>
+void direct_sum_scalar(const DirectSumTargets& targets, const DirectSumSources& sources, float softening_squared);
+
+#if defined(__x86_64__) || defined(_M_X64)
+template <Precision P>
+void direct_sum_avx2(const DirectSumTargets& targets, const DirectSumSources& sources, float softening_squared);
+template <Precision P>
+void direct_sum_avx512(const DirectSumTargets& targets, const DirectSumSources& sources, float softening_squared);
+#endif
+
+#if defined(__aarch64__)
+template <Precision P>
+void direct_sum_neon(const DirectSumTargets& targets, const DirectSumSources& sources, float softening_squared);
+#endif
+
+// Kernel for `isa` and `precision`, or for the widest supported instruction set below it.
+DirectSumKernel select_direct_sum_kernel(Isa isa, Precision precision = Precision::FP32) noexcept;
+
+// Small systems side by side, one per lane: element `i * lanes + l` of a column is body `i` of the system in
+// lane `l`, which has `counts[l]` bodies. Entries past the count of their lane are read but ignored, they only
+// need to be finite. Empty lanes have a count of zero.
+class PackedSystems {
+   public:
+    const float*    x;
+    const float*    y;
+    const float*    z;
+    const float*    mass;
+    float*          ax;
+    float*          ay;
+    float*          az;
+    const uint32_t* counts;
+    std::size_t     lanes;
+    // At least the largest of the counts.
+    std::size_t body_count;
+
+    // Per lane, over the pairs of its system: the smallest `|r_j - r_i|^2` and the largest
+    // `(m_i + m_j) / (|r_j - r_i|^2 + softening_squared)^(3/2)`. Infinity and zero for fewer than two bodies.
+    float* min_distance2;
+    float* max_pull;
+};
+
+// Overwrites the accelerations of every body with the sum `DirectSumKernel` adds over the other bodies of its
+// system, evaluating each pair once for both of its bodies, and fills the closest pair columns from the same
+// separations. In single precision, the gravitational constant is left to the caller.
+using PackedSystemsKernel = void (*)(const PackedSystems& systems, float softening_squared);
+
+// The scalar kernel takes any number of lanes, one included, which makes it a symmetric direct sum of a single
+// system in place. The others take a multiple of `PACKED_LANES`, the widest vector.
+inline constexpr std::size_t PACKED_LANES = 16;
+
+void packed_systems_scalar(const PackedSystems& systems, float softening_squared);
+
+#if defined(__x86_64__) || defined(_M_X64)
+void packed_systems_avx2(const PackedSystems& systems, float softening_squared);
+void packed_systems_avx512(const PackedSystems& systems, float softening_squared);
+#endif
+
+#if defined(__aarch64__)
+void packed_systems_neon(const PackedSystems& systems, float softening_squared);
+#endif
+
+// Kernel for `isa`, or for the widest supported instruction set below it.
+PackedSystemsKernel select_packed_systems_kernel(Isa isa) noexcept;
+
+}  // namespace nbody
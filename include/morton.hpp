@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+namespace nbody {
+
+// Bits per axis of a 63 bit Morton code.
+inline constexpr uint32_t MORTON_BITS_PER_AXIS = 21;
+inline constexpr uint32_t MORTON_AXIS_MAX      = (1u << MORTON_BITS_PER_AXIS) - 1;
+
+// Spreads the low 21 bits of `value` so that two zero bits separate consecutive bits.
+constexpr uint64_t morton_expand_bits(uint64_t value) noexcept {
+    value &= MORTON_AXIS_MAX;
+    value = (value | value << 32) & 0x001f00000000ffffull;
+    value = (value | value << 16) & 0x001f0000ff0000ffull;
+    value = (value | value << 8) & 0x100f00f00f00f00full;
+    value = (value | value << 4) & 0x10c30c30c30c30c3ull;
+    value = (value | value << 2) & 0x1249249249249249ull;
+    return value;
+}
+
+// Interleaves quantized coordinates as `...x1y1z1x0y0z0`.
+constexpr uint64_t morton_encode(uint32_t x, uint32_t y, uint32_t z) noexcept {
+    return morton_expand_bits(x) << 2 | morton_expand_bits(y) << 1 | morton_expand_bits(z);
+}
+
+// Octant (0..7) of the code at tree depth `depth`, where depth 0 splits the root cell.
+constexpr uint32_t morton_octant(uint64_t code, uint32_t depth) noexcept {
+    return static_cast<uint32_t>(code >> (3 * (MORTON_BITS_PER_AXIS - 1 - depth))) & 7u;
+}
+
+}  // namespace nbody
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "bodies.hpp"
+
+namespace nbody {
+
+// A cell of the octree. Children of a node are stored next to each other, so a node only needs the index of
+// its first child. Bodies of a node are the contiguous range `[body_begin, body_end)` of the Morton sorted order.
+class alignas(64) OctreeNode {
+   public:
+    // Monopole moment
+    float com_x;
+    float com_y;
+    float com_z;
+    float mass;
+
+    // Tight bounds of the bodies below the node, not the bounds of the Morton cell.
+    float min_x;
+    float min_y;
+    float min_z;
+    float max_x;
+    float max_y;
+    float max_z;
+
+    uint32_t first_child;
+    uint32_t child_count;  // 0 for leaves
+    uint32_t body_begin;
+    uint32_t body_end;
+    uint32_t parent;
+    uint32_t depth;
+
+    bool is_leaf() const noexcept { return child_count == 0; }
+};
+
+static_assert(sizeof(OctreeNode) == 64, "OctreeNode should fill exactly one cache line");
+
+// Linear octree built from Morton sorted bodies. Nodes live in one flat array ordered breadth first, level by
+// level, which keeps the top of the tree (visited by every walk) in a few cache lines.
+class Octree {
+   public:
+    static constexpr uint32_t ROOT    = 0;
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+    // Leaves hold at most `leaf_size` bodies, unless the Morton resolution is exhausted. With `low_parts` the
+    // low parts of the positions are sorted along, missing ones as zero.
+    void build(const Bodies& bodies, uint32_t leaf_size, bool low_parts = false);
+
+    // Keeps the nodes and the order of the last `build`, and only gathers the positions and masses of `bodies`
+    // again and recomputes the bounds and moments from them, which costs a small part of a build. Any body may
+    // move anywhere and the tree stays exact, since the bounds stay tight around the bodies of their node, but
+    // siblings grow and overlap as bodies wander off the cells they were sorted into, and walks open more nodes.
+    // `extent_growth` measures how far. Throws `std::runtime_error` when the body count changed.
+    void refit(const Bodies& bodies);
+
+    // Summed longest sides of all nodes over that sum right after the last `build`, 1 until the first `refit`.
+    double extent_growth() const noexcept { return m_built_extent > 0.0 ? m_extent / m_built_extent : 1.0; }
+
+    const std::vector<OctreeNode>& nodes() const noexcept { return m_nodes; }
+    bool                           empty() const noexcept { return m_nodes.empty(); }
+    std::size_t                    body_count() const noexcept { return m_order.size(); }
+
+    // Maps a position in the sorted order to the index of the body in the `Bodies` passed to `build`.
+    std::span<const uint32_t> order() const noexcept { return m_order; }
+
+    // Body positions and masses copied in sorted order, so leaves read contiguous memory.
+    std::span<const float> x() const noexcept { return m_x; }
+    std::span<const float> y() const noexcept { return m_y; }
+    std::span<const float> z() const noexcept { return m_z; }
+    std::span<const float> mass() const noexcept { return m_mass; }
+
+    // Low parts of the positions in sorted order, empty unless built with `low_parts`.
+    std::span<const float> x_lo() const noexcept { return m_x_lo; }
+    std::span<const float> y_lo() const noexcept { return m_y_lo; }
+    std::span<const float> z_lo() const noexcept { return m_z_lo; }
+
+    // Nodes of depth `d` are `[level_offsets()[d], level_offsets()[d + 1])`.
+    std::span<const uint32_t> level_offsets() const noexcept { return m_level_offsets; }
+
+   private:
+    class MortonKey {
+       public:
+        uint64_t code;
+        uint32_t index;
+    };
+
+    void   compute_morton_keys(const Bodies& bodies);
+    void   gather_bodies(const Bodies& bodies, bool low_parts);
+    void   build_levels(uint32_t leaf_size);
+    void   compute_moments();
+    double summed_extent() const;
+
+    std::vector<MortonKey>  m_keys;
+    std::vector<OctreeNode> m_nodes;
+    std::vector<uint32_t>   m_level_offsets;
+    std::vector<uint32_t>   m_child_counts;
+    std::vector<uint32_t>   m_order;
+    aligned_vector<float>   m_x;
+    aligned_vector<float>   m_y;
+    aligned_vector<float>   m_z;
+    aligned_vector<float>   m_mass;
+    aligned_vector<float>   m_x_lo;
+    aligned_vector<float>   m_y_lo;
+    aligned_vector<float>   m_z_lo;
+    double                  m_extent       = 0.0;
+    double                  m_built_extent = 0.0;
+};
+
+}  // namespace nbody
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+
+#include "scheduler.hpp"
+
+namespace nbody {
+
+// Calls `function(begin, end)` on disjoint chunks of at most `grain` items covering `[0, count)`, as tasks of the
+// global scheduler. Ranges no larger than `grain` run inline on the calling thread.
+template <typename Function>
+void parallel_for(std::size_t count, std::size_t grain, const Function& function) {
+    Scheduler::global().parallel_for(0, count, grain, function);
+}
+
+// Merge sort whose halves are sorted as separate tasks, down to runs small enough for `std::sort`.
+template <typename RandomIt, typename Compare>
+void parallel_sort(RandomIt first, RandomIt last, Compare compare) {
+    constexpr std::size_t GRAIN = 16 * 1024;
+
+    std::size_t count = static_cast<std::size_t>(std::distance(first, last));
+    if (count <= GRAIN) {
+        std::sort(first, last, compare);
+        return;
+    }
+
+    RandomIt   middle    = first + static_cast<std::ptrdiff_t>(count / 2);
+    Scheduler& scheduler = Scheduler::global();
+    TaskGroup  group;
+
+    scheduler.spawn(group, [=] { parallel_sort(first, middle, compare); });
+    try {
+        parallel_sort(middle, last, compare);
+    } catch (...) {
+        scheduler.wait(group);
+        throw;
+    }
+    scheduler.wait(group);
+
+    std::inplace_merge(first, middle, last, compare);
+}
+
+}  // namespace nbody
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace nbody {
+
+// `$XDG_CACHE_HOME/jennifers-body/<file_name>`, falling back to `~/.cache` and then the working directory.
+std::filesystem::path default_cache_path(const char* file_name);
+
+// A `VkPipelineCache` persisted across runs. The file leads with a header identifying the device and driver the
+// data was produced by, and a checksum of the data. A file from another device, another driver version or one
+// that is truncated or corrupt is ignored and the cache starts empty, since drivers are not required to reject
+// foreign cache data gracefully. The cache is internally synchronized, so workers may create pipelines with it
+// concurrently.
+class PipelineCache {
+   public:
+    PipelineCache() = default;
+
+    PipelineCache(const PipelineCache&)            = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    // Throws `std::runtime_error` when the cache object itself cannot be created. Problems with the file only
+    // cost the warm start.
+    void create(VkDevice device, VkPhysicalDevice physical_device, std::filesystem::path path);
+
+    // Writes the current data to a temporary file next to `path` and renames it over the old file, so a crash
+    // never leaves a torn cache behind. Returns false when the data could not be written.
+    bool save() const;
+
+    void destroy() noexcept;
+
+    VkPipelineCache handle() const noexcept { return m_cache; }
+
+    // Whether the data of a previous run was accepted.
+    bool loaded_from_disk() const noexcept { return m_loaded_from_disk; }
+
+    const std::filesystem::path& path() const noexcept { return m_path; }
+
+   private:
+    class Header {
+       public:
+        uint32_t                          magic;
+        uint32_t                          version;
+        uint32_t                          vendor_id;
+        uint32_t                          device_id;
+        uint32_t                          driver_version;
+        uint32_t                          reserved;
+        std::array<uint8_t, VK_UUID_SIZE> device_uuid;
+        std::array<uint8_t, VK_UUID_SIZE> pipeline_cache_uuid;
+        uint64_t                          data_size;
+        uint64_t                          checksum;
+    };
+
+    static constexpr uint32_t MAGIC   = 0x4a42'5043;  // "JBPC"
+    static constexpr uint32_t VERSION = 1;
+
+    VkDevice              m_device = VK_NULL_HANDLE;
+    VkPipelineCache       m_cache  = VK_NULL_HANDLE;
+    Header                m_identity{};
+    std::filesystem::path m_path;
+    bool                  m_loaded_from_disk = false;
+};
+
+// The physical device a previous run picked and what probing it found out, such as queue family indices, so that
+// later runs on the same machine skip scoring every device. A record names its device by IDs, driver version and
+// UUID like the header of `PipelineCache`, and only counts while one of the enumerated devices matches all of
+// them, which a driver update or a swapped card breaks.
+class DeviceProbeCache {
+   public:
+    explicit DeviceProbeCache(std::filesystem::path path) : m_path(std::move(path)) {}
+
+    // The recorded device among `devices`, with its values in `values`. Nothing when the file is missing, corrupt,
+    // of another `key` or of a device that is gone. Callers change `key` whenever what they probe for changes.
+    std::optional<VkPhysicalDevice> load(std::span<const VkPhysicalDevice> devices, uint32_t key,
+                                         std::vector<uint32_t>& values) const;
+
+    // Records `device` and `values` through a temporary file like `PipelineCache::save`. Returns false when the
+    // record could not be written.
+    bool save(VkPhysicalDevice device, uint32_t key, std::span<const uint32_t> values) const;
+
+    const std::filesystem::path& path() const noexcept { return m_path; }
+
+   private:
+    class Header {
+       public:
+        uint32_t                          magic;
+        uint32_t                          version;
+        uint32_t                          key;
+        uint32_t                          vendor_id;
+        uint32_t                          device_id;
+        uint32_t                          driver_version;
+        std::array<uint8_t, VK_UUID_SIZE> device_uuid;
+        uint64_t                          value_count;
+        uint64_t                          checksum;
+    };
+
+    static constexpr uint32_t MAGIC   = 0x4a42'4450;  // "JBDP"
+    static constexpr uint32_t VERSION = 1;
+
+    std::filesystem::path m_path;
+};
+
+}  // namespace nbody
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+namespace nbody {
+
+// How positions are accumulated and pair interactions evaluated. Every mode but `FP32` carries a position as the
+// pair `x + x_lo` of `Bodies`, which holds about twice the bits of a float, so that long integrations do not
+// lose small drifts against large coordinates.
+enum class Precision {
+    // Single precision throughout, `x_lo` is ignored.
+    FP32,
+    // Single precision forces on the differences of the position pairs, Kahan summed, and drifts added to the
+    // position pairs with error free transformations.
+    COMPENSATED,
+    // Double precision pair interactions and drifts. Half the SIMD lanes of single precision.
+    FP64,
+    // Single precision interactions on offsets from a double precision origin per cell or block of targets,
+    // which the solvers rebase once per interaction list. Drifts as `COMPENSATED`.
+    RELATIVE,
+};
+
+std::string_view         precision_name(Precision precision) noexcept;
+std::optional<Precision> parse_precision(std::string_view name) noexcept;
+
+// Stores `(hi[i] + lo[i]) - origin` rounded to single precision in `out[i]`, which may alias `hi`. A null `lo`
+// counts as zero.
+void rebase_coordinates(const float* hi, const float* lo, double origin, std::size_t count, float* out) noexcept;
+
+}  // namespace nbody
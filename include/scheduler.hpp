@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nbody {
+
+inline std::size_t hardware_thread_count() noexcept {
+    return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+class TaskGroup;
+
+class Task {
+   public:
+    std::function<void()> function;
+    TaskGroup*            group;
+};
+
+// Chase-Lev deque with the memory orderings of Le, Pop, Cohen and Zappa Nardelli (PPoPP 2013). The owning worker
+// pushes and pops at the bottom without contention, thieves take the oldest, usually largest, tasks from the top.
+class WorkStealingDeque {
+   public:
+    explicit WorkStealingDeque(std::size_t capacity = 1024);
+    ~WorkStealingDeque();
+
+    WorkStealingDeque(const WorkStealingDeque&)            = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only.
+    void  push(Task* task);
+    Task* pop();
+
+    // Any thread. Returns nullptr when empty or when another thread won the race for the top task.
+    Task* steal();
+
+   private:
+    class Ring {
+       public:
+        explicit Ring(int64_t capacity) : mask(capacity - 1), slots(new std::atomic<Task*>[capacity]) {}
+
+        int64_t capacity() const noexcept { return mask + 1; }
+
+        Task* get(int64_t index) const noexcept { return slots[index & mask].load(std::memory_order_acquire); }
+        void  put(int64_t index, Task* task) noexcept { slots[index & mask].store(task, std::memory_order_release); }
+
+        int64_t                              mask;
+        std::unique_ptr<std::atomic<Task*>[]> slots;
+    };
+
+    Ring* grow(Ring* ring, int64_t top, int64_t bottom);
+
+    alignas(64) std::atomic<int64_t> m_top{0};
+    alignas(64) std::atomic<int64_t> m_bottom{0};
+    std::atomic<Ring*> m_ring;
+
+    // Thieves may still read a ring that was replaced, so old rings live as long as the deque.
+    std::vector<std::unique_ptr<Ring>> m_rings;
+};
+
+// Counts the unfinished tasks spawned into it. `Scheduler::wait` returns once the count drops to zero.
+class TaskGroup {
+   public:
+    TaskGroup() = default;
+
+    TaskGroup(const TaskGroup&)            = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    bool done() const noexcept { return m_pending.load(std::memory_order_acquire) == 0; }
+
+   private:
+    friend class Scheduler;
+
+    std::atomic<std::size_t> m_pending{0};
+    std::atomic<bool>        m_failed{false};
+    std::exception_ptr       m_exception;
+};
+
+// Fixed pool of workers, each owning a work-stealing deque. Tasks spawned from a worker go to its own deque,
+// tasks spawned from any other thread go to a shared injection queue. Idle workers steal from random victims,
+// and threads blocked in `wait` run other tasks instead of sleeping, which makes nested parallelism safe.
+class Scheduler {
+   public:
+    explicit Scheduler(std::size_t worker_count);
+    ~Scheduler();
+
+    Scheduler(const Scheduler&)            = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Shared by the solvers and apps. One worker fewer than there are hardware threads, since the thread that
+    // waits on a group helps out.
+    static Scheduler& global();
+
+    std::size_t worker_count() const noexcept { return m_workers.size(); }
+
+    // Lets only the first `count` workers run tasks, the others park until the count is raised again. Threads
+    // waiting on a group still help, so `count + 1` threads share the work. For measuring how work scales with
+    // the thread count, tasks already queued on a parked worker's deque are stolen by the others.
+    void        set_active_worker_count(std::size_t count);
+    std::size_t active_worker_count() const noexcept { return m_active_workers.load(std::memory_order_relaxed); }
+
+    void spawn(TaskGroup& group, std::function<void()> function);
+
+    // Runs queued tasks until every task of `group` finished, then rethrows the first exception one of them
+    // threw.
+    void wait(TaskGroup& group);
+
+    // Calls `function(begin, end)` on disjoint chunks of at most `grain` items covering `[begin, end)`. The range
+    // is split in halves recursively, so a thief takes half of the remaining work in one steal.
+    template <typename Function>
+    void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, const Function& function) {
+        grain = std::max<std::size_t>(1, grain);
+        if (end - begin <= grain) {
+            if (begin < end) {
+                function(begin, end);
+            }
+            return;
+        }
+
+        // Spawned halves refer to `group`, so it has to outlive them even when this thread's share throws.
+        TaskGroup group;
+        try {
+            split(group, begin, end, grain, function);
+        } catch (...) {
+            wait(group);
+            throw;
+        }
+        wait(group);
+    }
+
+    static constexpr std::size_t NO_WORKER = SIZE_MAX;
+
+    // Index of the calling thread among this scheduler's workers, `NO_WORKER` for any other thread.
+    std::size_t current_worker() const noexcept;
+
+   private:
+    class Worker {
+       public:
+        WorkStealingDeque deque;
+        std::thread       thread;
+    };
+
+    template <typename Function>
+    void split(TaskGroup& group, std::size_t begin, std::size_t end, std::size_t grain, const Function& function) {
+        while (end - begin > grain) {
+            std::size_t middle = begin + (end - begin) / 2;
+            spawn(group, [this, &group, &function, middle, end, grain] { split(group, middle, end, grain, function); });
+            end = middle;
+        }
+        function(begin, end);
+    }
+
+    Task* find_task(std::size_t worker);
+    Task* steal_task(std::size_t worker);
+    void  run(Task* task);
+    void  worker_loop(std::size_t worker);
+    void  notify_task_queued();
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    std::mutex               m_injection_mutex;
+    std::deque<Task*>        m_injected;
+    std::atomic<std::size_t> m_injected_count{0};
+
+    // Workers sleep on `m_wake` once no task has been queued anywhere. `m_queued` only advises them, a task
+    // is always found through the deques or the injection queue.
+    std::mutex               m_sleep_mutex;
+    std::condition_variable  m_wake;
+    std::atomic<int64_t>     m_queued{0};
+    std::atomic<std::size_t> m_sleeping{0};
+    std::atomic<bool>        m_stopping{false};
+
+    // Workers past `m_active_workers` wait on `m_unpark` rather than `m_wake`, so that they never swallow the
+    // wake up meant for a sleeping active worker.
+    std::condition_variable  m_unpark;
+    std::atomic<std::size_t> m_active_workers{0};
+};
+
+}  // namespace nbody
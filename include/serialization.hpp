@@ -0,0 +1,36 @@
+#pragma once
+
+#include <tuple>
+
+#include "bodies.hpp"
+#include "solver.hpp"
+#include "sser_reflect.hpp"
+
+// `serr` layouts of the simulation types. Body state, the low parts of the positions included, is written as one
+// block copy per column. `TelemetryServer` sends the solver config with its keyframes.
+
+template <>
+struct serr::Reflect<nbody::Bodies> {
+    static constexpr auto fields = std::tuple{
+        serr::field("x", &nbody::Bodies::x),   serr::field("y", &nbody::Bodies::y),
+        serr::field("z", &nbody::Bodies::z),   serr::field("vx", &nbody::Bodies::vx),
+        serr::field("vy", &nbody::Bodies::vy), serr::field("vz", &nbody::Bodies::vz),
+        serr::field("mass", &nbody::Bodies::mass), serr::field("x_lo", &nbody::Bodies::x_lo),
+        serr::field("y_lo", &nbody::Bodies::y_lo), serr::field("z_lo", &nbody::Bodies::z_lo),
+    };
+};
+
+template <>
+struct serr::Reflect<nbody::SolverConfig> {
+    static constexpr auto fields = std::tuple{
+        serr::field("kind", &nbody::SolverConfig::kind),
+        serr::field("softening", &nbody::SolverConfig::softening),
+        serr::field("gravitational_constant", &nbody::SolverConfig::gravitational_constant),
+        serr::field("isa", &nbody::SolverConfig::isa),
+        serr::field("precision", &nbody::SolverConfig::precision),
+        serr::field("theta", &nbody::SolverConfig::theta),
+        serr::field("leaf_size", &nbody::SolverConfig::leaf_size),
+        serr::field("rebuild_threshold", &nbody::SolverConfig::rebuild_threshold),
+        serr::field("expansion_order", &nbody::SolverConfig::expansion_order),
+    };
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace nbody {
+
+// A SPIR-V module compiled into the program, named by the path of its file, such as `shaders/nbody.comp.spv`.
+class EmbeddedShader {
+   public:
+    std::string_view          path;
+    std::span<const uint32_t> code;
+};
+
+// Every module of shaders/ at the time of the build. Defined in the source the Makefile generates from the
+// compiled shaders, $(BIN)/gen/embedded_shaders.cpp.
+std::span<const EmbeddedShader> embedded_shaders() noexcept;
+
+// The SPIR-V of `path`, straight from the program when the build embedded it, so that startup reads no files and
+// the programs run from any directory. Any other path is read from disk into `storage`, which the result then
+// points into. Throws `std::runtime_error` when the file cannot be read or is no whole number of words.
+std::span<const uint32_t> load_shader(std::string_view path, std::vector<uint32_t>& storage);
+
+}  // namespace nbody
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+namespace nbody {
+
+// Instruction sets with a dedicated kernel, ordered from narrowest to widest.
+enum class Isa {
+    SCALAR,
+    NEON,
+    AVX2,
+    AVX512,
+};
+
+// Widest instruction set supported by both the build target and the CPU running it.
+Isa detect_isa() noexcept;
+
+// True if kernels for `isa` were built in and the CPU can run them.
+bool is_isa_supported(Isa isa) noexcept;
+
+std::string_view   isa_name(Isa isa) noexcept;
+std::optional<Isa> parse_isa(std::string_view name) noexcept;
+
+}  // namespace nbody
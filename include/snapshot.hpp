@@ -0,0 +1,182 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "bodies.hpp"
+
+namespace nbody {
+
+// A snapshot file is a sequence of frames, each one the state of every body at one time. A frame is a 64 byte
+// header, a table of column records and then one 64 byte aligned column per body component:
+//
+//     | header | column records | pad | x | pad | y | pad | ... | mass | pad |
+//
+// Frames are appended one after the other and their sizes are multiples of 64, so a memory mapping of the file
+// hands out SIMD aligned raw columns in place. A frame cut short by a crash is ignored on open.
+//
+// The low parts of the positions follow the mass only in frames where one of them is non-zero, which
+// `SnapshotFrame::column_count` tells. Frames without them load with zero low parts.
+
+enum class SnapshotColumn : uint32_t {
+    X,
+    Y,
+    Z,
+    VX,
+    VY,
+    VZ,
+    MASS,
+    X_LO,
+    Y_LO,
+    Z_LO,
+};
+
+// Columns of a frame with the low parts and without them.
+inline constexpr std::size_t SNAPSHOT_COLUMN_COUNT        = 10;
+inline constexpr std::size_t SNAPSHOT_COLUMN_COUNT_NO_LOW = 7;
+
+enum class ColumnEncoding : uint32_t {
+    // Little endian floats, readable in place.
+    RAW,
+
+    // The bytes of all values regrouped by significance, then run length encoded. Constant and slowly varying
+    // columns such as masses shrink to a fraction, noisy ones stay about the same size. Decoded on load.
+    SHUFFLED_RLE,
+};
+
+class SnapshotColumnRecord {
+   public:
+    uint32_t column;
+    uint32_t encoding;
+    uint64_t offset;       // From the start of the frame
+    uint64_t stored_size;  // Bytes in the file
+};
+
+// Where one frame lives inside a mapped file.
+class SnapshotFrame {
+   public:
+    uint64_t    step;
+    double      time;
+    uint64_t    body_count;
+    std::size_t offset;
+    std::size_t column_count;  // Records past it are zero
+
+    std::array<SnapshotColumnRecord, SNAPSHOT_COLUMN_COUNT> columns;
+
+    bool has(SnapshotColumn column) const noexcept { return static_cast<std::size_t>(column) < column_count; }
+};
+
+class SnapshotWriterConfig {
+   public:
+    std::array<ColumnEncoding, SNAPSHOT_COLUMN_COUNT> encodings{};  // All raw
+
+    // Snapshots copied but not written yet. `write` blocks once this many are queued, so a slow disk holds the
+    // step back instead of growing the queue without bounds.
+    std::size_t max_pending = 2;
+
+    // Appends to an existing file instead of replacing it.
+    bool append = false;
+};
+
+// Appends frames to a snapshot file from a background thread. `write` only copies the body state, encoding and
+// the write system calls happen on the writer's own thread, which stays off the task scheduler so that blocking
+// I/O never takes a worker away from the step.
+class SnapshotWriter {
+   public:
+    // Throws `std::runtime_error` when the file cannot be opened.
+    explicit SnapshotWriter(const std::filesystem::path& path, const SnapshotWriterConfig& config = {});
+
+    // Writes the queued frames, errors are dropped.
+    ~SnapshotWriter();
+
+    SnapshotWriter(const SnapshotWriter&)            = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // Queues the positions, velocities and masses of `bodies`, and the low parts of the positions. Rethrows the
+    // error of an earlier frame that failed to be written.
+    void write(const Bodies& bodies, uint64_t step, double time);
+
+    // Waits until every queued frame is in the file. Rethrows write errors.
+    void flush();
+
+    // Flushes and stops the writer thread. Further writes throw.
+    void close();
+
+   private:
+    class Pending {
+       public:
+        uint64_t                                                 step;
+        double                                                   time;
+        std::size_t                                              body_count;
+        std::array<aligned_vector<float>, SNAPSHOT_COLUMN_COUNT> columns;
+    };
+
+    void writer_loop();
+    void write_frame(const Pending& pending);
+    void rethrow_error();
+
+    SnapshotWriterConfig m_config;
+    int                  m_file = -1;
+
+    std::mutex                            m_mutex;
+    std::condition_variable               m_changed;
+    std::deque<std::unique_ptr<Pending>>  m_queue;
+    std::vector<std::unique_ptr<Pending>> m_free;  // Written frames whose buffers are reused
+    bool                                  m_writing  = false;
+    bool                                  m_stopping = false;
+    std::exception_ptr                    m_error;
+    std::thread                           m_thread;
+
+    // Writer thread only.
+    std::vector<uint8_t> m_encoded;
+    std::vector<uint8_t> m_shuffled;
+    std::vector<uint8_t> m_run_lengths;
+};
+
+// Read-only memory mapping of a snapshot file with an index of its frames.
+class SnapshotFile {
+   public:
+    // Throws `std::runtime_error` when the file cannot be mapped or does not start with a frame.
+    explicit SnapshotFile(const std::filesystem::path& path);
+    ~SnapshotFile();
+
+    SnapshotFile(const SnapshotFile&)            = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    std::size_t size() const noexcept { return m_frames.size(); }
+    bool        empty() const noexcept { return m_frames.empty(); }
+
+    const SnapshotFrame& frame(std::size_t index) const { return m_frames.at(index); }
+
+    // Index of the first frame at or after `time`, `size()` if there is none. Frames are assumed to be written
+    // in time order.
+    std::size_t find(double time) const noexcept;
+
+    // A raw column of a frame in place, without copying. Throws `std::runtime_error` for encoded columns and ones
+    // the frame does not have.
+    std::span<const float> column(std::size_t index, SnapshotColumn column) const;
+
+    // Copies or decodes a frame into `bodies`. Accelerations, and the low parts of frames without them, are
+    // zeroed.
+    void load(std::size_t index, Bodies& bodies) const;
+
+   private:
+    void build_index();
+
+    const uint8_t*             m_data = nullptr;
+    std::size_t                m_size = 0;
+    std::vector<SnapshotFrame> m_frames;
+};
+
+}  // namespace nbody
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include "bodies.hpp"
+#include "precision.hpp"
+#include "simd.hpp"
+
+namespace nbody {
+
+enum class SolverKind {
+    DIRECT_SUM,
+    BARNES_HUT,
+    FAST_MULTIPOLE,
+};
+
+// Settings of every solver in one place, so that apps can pick the solver at startup from the command line.
+// Fields a solver has no use for are ignored.
+class SolverConfig {
+   public:
+    SolverKind kind                   = SolverKind::BARNES_HUT;
+    float      softening              = 1.0e-2f;
+    float      gravitational_constant = 1.0f;
+    Isa        isa                    = detect_isa();
+    Precision  precision              = Precision::FP32;
+
+    // Tree codes
+    float    theta     = 0.5f;
+    uint32_t leaf_size = 16;
+
+    // Barnes-Hut only: refit the tree until it degrades this far, see `BarnesHutConfig::rebuild_threshold`.
+    float rebuild_threshold = 0.0f;
+
+    // Fast multipole method
+    uint32_t expansion_order = 4;
+};
+
+// Computes the gravitational acceleration of every body.
+class Solver {
+   public:
+    virtual ~Solver() = default;
+
+    // Overwrites `ax`, `ay` and `az` from the current positions and masses.
+    virtual void compute_accelerations(Bodies& bodies) = 0;
+
+    // Overwrites the accelerations of the bodies listed in `active`, still pulled by every body. The other
+    // accelerations are left unspecified. Solvers that cannot save work on a subset compute every body.
+    virtual void compute_active_accelerations(Bodies& bodies, [[maybe_unused]] std::span<const uint32_t> active) {
+        compute_accelerations(bodies);
+    }
+
+    virtual SolverKind kind() const noexcept = 0;
+};
+
+std::unique_ptr<Solver> make_solver(const SolverConfig& config);
+
+std::string_view          solver_kind_name(SolverKind kind) noexcept;
+std::optional<SolverKind> parse_solver_kind(std::string_view name) noexcept;
+
+}  // namespace nbody
@@ -1,4 +1,7 @@
+#pragma once
+
 #include <string>
+
 namespace serr {
 enum class Unit {
     UINT,
@@ -14,7 +17,7 @@ enum class Unit {
 
 class Object {
     public:
-        virtual Type type() const = 0;
+        virtual Unit type() const = 0;
         virtual std::string fmt() const = 0;
         virtual std::string fmt_pretty() const = 0;
         virtual std::string fmt_type() const = 0;
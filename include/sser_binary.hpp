@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "sser.hpp"
+
+namespace serr {
+
+// Compact binary encoding of the `Unit` value model, written and read in place without building `Object`s or
+// strings. Every value starts with its unit as one byte, followed by:
+//
+//     UINT, INT       LEB128 varint, zigzag encoded for INT
+//     FLOAT, DOUBLE   4 or 8 little endian bytes
+//     BOOL            one byte
+//     STRING          varint length, bytes
+//     ATOM            varint `id << 1 | defines`, then varint length and bytes when `defines` is set
+//     TABLE           varint count, then `count` pairs of an untagged atom key and a value
+//     ARRAY           element unit, element width, varint count, then either `count` values (element unit
+//                     `MIXED`) or, for scalars, padding up to the element width and the raw elements
+//
+// Atoms are interned per stream: the first use of a name defines the next id, later uses only send the id.
+// Scalar arrays are aligned to their element width relative to the start of the buffer, so a reader over an
+// aligned buffer views them in place.
+
+// Element unit of an array whose elements carry their own units.
+inline constexpr uint8_t MIXED = 0xff;
+
+template <typename T>
+concept ArrayScalar = std::same_as<T, bool> || std::same_as<T, float> || std::same_as<T, double> ||
+                      (std::integral<T> && !std::same_as<T, char> && sizeof(T) <= 8);
+
+template <ArrayScalar T>
+constexpr Unit array_unit() noexcept {
+    if constexpr (std::same_as<T, bool>) {
+        return Unit::BOOL;
+    } else if constexpr (std::same_as<T, float>) {
+        return Unit::FLOAT;
+    } else if constexpr (std::same_as<T, double>) {
+        return Unit::DOUBLE;
+    } else if constexpr (std::is_signed_v<T>) {
+        return Unit::INT;
+    } else {
+        return Unit::UINT;
+    }
+}
+
+// Elements of an array that `Writer::write_external_array` left in place, to be sent right after the first
+// `offset` bytes of the buffer that precede them.
+class ExternalArray {
+   public:
+    std::size_t      offset;
+    const std::byte* data;
+    std::size_t      size;
+};
+
+// Encodes into a caller-provided buffer, or appends to a growing byte vector. A fixed buffer that runs out
+// keeps counting, so `size()` reports how large it would have had to be.
+class Writer {
+   public:
+    explicit Writer(std::span<std::byte> buffer) noexcept;
+    explicit Writer(std::vector<std::byte>& buffer) noexcept;
+
+    void write_uint(uint64_t value);
+    void write_int(int64_t value);
+    void write_float(float value);
+    void write_double(double value);
+    void write_bool(bool value);
+    void write_string(std::string_view value);
+    void write_atom(std::string_view name);
+
+    // Follow with `count` pairs of `write_key` and a value.
+    void begin_table(std::size_t count);
+    void write_key(std::string_view name);
+
+    // Follow with `count` values of any unit.
+    void begin_array(std::size_t count);
+
+    // One contiguous block of elements.
+    template <ArrayScalar T>
+    void write_array(std::span<const T> values) {
+        write_array_bytes(array_unit<T>(), sizeof(T), values.size(), values.data(), false);
+    }
+
+    // Like `write_array`, but only the header and padding go into the buffer. The elements stay where they are
+    // and are listed in `external()`, for a gather write such as `sendmsg` that sends them from there between
+    // the buffer bytes around them, which reads back as the stream `write_array` would have written. `values`
+    // has to outlive the write.
+    template <ArrayScalar T>
+    void write_external_array(std::span<const T> values) {
+        write_array_bytes(array_unit<T>(), sizeof(T), values.size(), values.data(), true);
+    }
+
+    // Bytes written, or that would have been written into a fixed buffer that overflowed.
+    std::size_t size() const noexcept { return m_size; }
+    bool        overflowed() const noexcept { return m_size > m_capacity; }
+
+    std::span<const std::byte> data() const noexcept { return {m_data, std::min(m_size, m_capacity)}; }
+
+    std::span<const ExternalArray> external() const noexcept { return m_external; }
+
+    // Bytes of the stream, in the buffer and in external arrays.
+    std::size_t stream_size() const noexcept { return m_size - m_base + m_external_size; }
+
+    // Starts a new stream at the start of the buffer, forgetting all atoms and external arrays.
+    void reset() noexcept;
+
+   private:
+    class AtomHash {
+       public:
+        using is_transparent = void;
+
+        std::size_t operator()(std::string_view name) const noexcept { return std::hash<std::string_view>{}(name); }
+    };
+
+    void reserve(std::size_t count);
+    void put(const void* bytes, std::size_t count);
+    void put_byte(uint8_t byte);
+    void put_varint(uint64_t value);
+    void put_atom(std::string_view name);
+    void write_array_bytes(Unit unit, std::size_t width, std::size_t count, const void* elements, bool external);
+
+    std::byte*              m_data     = nullptr;
+    std::size_t             m_capacity = 0;
+    std::size_t             m_size     = 0;
+    std::size_t             m_base     = 0;  // Start of the stream in a growing buffer
+    std::vector<std::byte>* m_growable = nullptr;
+
+    std::unordered_map<std::string, uint32_t, AtomHash, std::equal_to<>> m_atoms;
+
+    std::vector<ExternalArray> m_external;
+    std::size_t                m_external_size = 0;
+};
+
+// The header of a scalar array. The elements are read with `Reader::read_array` or `Reader::view_array`.
+class ArrayHeader {
+   public:
+    Unit        element_unit;
+    uint8_t     element_width;
+    std::size_t count;
+};
+
+// Pull decoder over an encoded buffer. Strings and atoms are views into the buffer, which has to outlive them.
+// Malformed input and reads of the wrong unit throw `std::runtime_error`.
+class Reader {
+   public:
+    explicit Reader(std::span<const std::byte> buffer) noexcept : m_data(buffer.data()), m_size(buffer.size()) {}
+
+    bool        at_end() const noexcept { return m_position >= m_size; }
+    std::size_t position() const noexcept { return m_position; }
+
+    // Unit of the next value.
+    Unit peek() const;
+
+    uint64_t         read_uint();
+    int64_t          read_int();
+    float            read_float();
+    double           read_double();
+    bool             read_bool();
+    std::string_view read_string();
+    std::string_view read_atom();
+
+    // Returns the pair count.
+    std::size_t      begin_table();
+    std::string_view read_key();
+
+    // Returns the header of the next array. The elements of a `MIXED` array follow as values, those of a
+    // scalar array through `read_array` or `view_array`.
+    ArrayHeader begin_array();
+    bool        is_mixed(const ArrayHeader& header) const noexcept;
+
+    // Copies the elements of the scalar array just begun into `values`, which must hold `header.count` of them.
+    template <ArrayScalar T>
+    void read_array(const ArrayHeader& header, std::span<T> values) {
+        const std::byte* elements = array_elements(header, array_unit<T>(), sizeof(T));
+        if (values.size() < header.count) {
+            throw std::runtime_error("Reader::read_array => destination is too small.");
+        }
+        std::memcpy(values.data(), elements, header.count * sizeof(T));
+    }
+
+    // The elements of the scalar array just begun in place. Throws when the buffer is not aligned for `T`.
+    template <ArrayScalar T>
+    std::span<const T> view_array(const ArrayHeader& header) {
+        const std::byte* elements = array_elements(header, array_unit<T>(), sizeof(T));
+        if (reinterpret_cast<std::uintptr_t>(elements) % alignof(T) != 0) {
+            throw std::runtime_error("Reader::view_array => buffer is not aligned for the element type.");
+        }
+        return {reinterpret_cast<const T*>(elements), header.count};
+    }
+
+    // Skips the next value, including everything nested in it. Atoms it defines are still recorded.
+    void skip();
+
+   private:
+    void             expect(Unit unit, const char* where);
+    uint8_t          take_byte();
+    const std::byte* take(std::size_t count);
+    uint64_t         take_varint();
+    std::string_view take_atom();
+    const std::byte* array_elements(const ArrayHeader& header, Unit unit, std::size_t width);
+
+    const std::byte* m_data;
+    std::size_t      m_size;
+    std::size_t      m_position = 0;
+
+    std::vector<std::string_view> m_atoms;
+};
+
+}  // namespace serr
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "sser.hpp"
+#include "sser_binary.hpp"
+
+namespace serr {
+
+// Compile-time description of a C++ type as a `Unit` layout. A struct opts in by specializing `Reflect` with a
+// tuple of its fields:
+//
+//     template <>
+//     struct serr::Reflect<Telemetry> {
+//         static constexpr auto fields = std::tuple{serr::field("frame", &Telemetry::frame),
+//                                                   serr::field("step_ms", &Telemetry::step_ms)};
+//     };
+//
+// `encode` and `decode` then unroll over the fields at compile time. Every field is written by the typed
+// `Writer` call for its unit, contiguous ranges of scalars as one block copy, and nothing is allocated or
+// dispatched at runtime. Reflected structs are tables keyed by their field names, so readers can skip fields
+// they do not know and fill in fields they did not get.
+
+template <typename T, typename Member>
+class Field {
+   public:
+    using Type = Member;
+
+    std::string_view name;
+    Member T::*      member;
+};
+
+template <typename T, typename Member>
+constexpr Field<T, Member> field(std::string_view name, Member T::*member) noexcept {
+    return {name, member};
+}
+
+template <typename T>
+struct Reflect;
+
+template <typename T>
+concept Reflected = requires { Reflect<T>::fields; };
+
+template <typename T>
+concept StringLike = std::same_as<T, std::string> || std::same_as<T, std::string_view>;
+
+// Contiguous containers of scalars, such as `std::vector<float>`, `std::array<int, 3>` and `aligned_vector`.
+template <typename T>
+concept ScalarRange = std::ranges::contiguous_range<T> && std::ranges::sized_range<T> &&
+                      ArrayScalar<std::remove_cv_t<std::ranges::range_value_t<T>>>;
+
+// Resizable ranges are resized on decode, fixed ones must match the element count.
+template <typename T>
+concept ResizableRange = requires(T& range, std::size_t count) { range.resize(count); };
+
+template <typename T>
+concept EncodableRange = std::ranges::sized_range<T> && !StringLike<T> && !ScalarRange<T>;
+
+template <typename T>
+constexpr Unit unit_of() noexcept {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (std::same_as<U, bool>) {
+        return Unit::BOOL;
+    } else if constexpr (std::same_as<U, float>) {
+        return Unit::FLOAT;
+    } else if constexpr (std::same_as<U, double>) {
+        return Unit::DOUBLE;
+    } else if constexpr (std::is_enum_v<U>) {
+        return unit_of<std::underlying_type_t<U>>();
+    } else if constexpr (std::integral<U>) {
+        return std::is_signed_v<U> ? Unit::INT : Unit::UINT;
+    } else if constexpr (StringLike<U>) {
+        return Unit::STRING;
+    } else if constexpr (Reflected<U>) {
+        return Unit::TABLE;
+    } else {
+        static_assert(std::ranges::range<U>, "serr::unit_of => type has no serr layout");
+        return Unit::ARRAY;
+    }
+}
+
+template <typename T>
+constexpr std::size_t field_count() noexcept {
+    return std::tuple_size_v<std::remove_cvref_t<decltype(Reflect<T>::fields)>>;
+}
+
+class FieldLayout {
+   public:
+    std::string_view name;
+    Unit             unit;
+};
+
+// Field names and units of a reflected type, for checks such as `static_assert(layout<T>()[0].unit == ...)`.
+template <Reflected T>
+constexpr std::array<FieldLayout, field_count<T>()> layout() noexcept {
+    return std::apply(
+        [](const auto&... fields) {
+            return std::array<FieldLayout, sizeof...(fields)>{
+                FieldLayout{fields.name, unit_of<typename std::remove_cvref_t<decltype(fields)>::Type>()}...};
+        },
+        Reflect<T>::fields);
+}
+
+template <typename T>
+void encode(Writer& writer, const T& value) {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (std::same_as<U, bool>) {
+        writer.write_bool(value);
+    } else if constexpr (std::same_as<U, float>) {
+        writer.write_float(value);
+    } else if constexpr (std::same_as<U, double>) {
+        writer.write_double(value);
+    } else if constexpr (std::is_enum_v<U>) {
+        encode(writer, static_cast<std::underlying_type_t<U>>(value));
+    } else if constexpr (std::integral<U> && std::is_signed_v<U>) {
+        writer.write_int(value);
+    } else if constexpr (std::integral<U>) {
+        writer.write_uint(value);
+    } else if constexpr (StringLike<U>) {
+        writer.write_string(value);
+    } else if constexpr (Reflected<U>) {
+        writer.begin_table(field_count<U>());
+        std::apply(
+            [&](const auto&... fields) {
+                ((writer.write_key(fields.name), encode(writer, value.*(fields.member))), ...);
+            },
+            Reflect<U>::fields);
+    } else if constexpr (ScalarRange<U>) {
+        using Element = std::remove_cv_t<std::ranges::range_value_t<U>>;
+        writer.write_array(std::span<const Element>(std::ranges::data(value), std::ranges::size(value)));
+    } else {
+        static_assert(EncodableRange<U>, "serr::encode => type has no serr layout");
+        writer.begin_array(std::ranges::size(value));
+        for (const auto& element : value) {
+            encode(writer, element);
+        }
+    }
+}
+
+template <typename T>
+void decode(Reader& reader, T& value);
+
+namespace internal {
+    // Decodes the value of `key` into the matching field. Tries field `hint` first, which is the match whenever
+    // the writer emitted the fields in declaration order, before comparing against every name.
+    template <typename T, std::size_t... Indices>
+    void decode_field(Reader& reader, T& value, std::string_view key, std::size_t hint,
+                      std::index_sequence<Indices...>) {
+        const auto& fields = Reflect<T>::fields;
+
+        bool found = ((Indices == hint && std::get<Indices>(fields).name == key &&
+                       (decode(reader, value.*(std::get<Indices>(fields).member)), true)) ||
+                      ...);
+        if (!found) {
+            found = ((std::get<Indices>(fields).name == key &&
+                      (decode(reader, value.*(std::get<Indices>(fields).member)), true)) ||
+                     ...);
+        }
+        if (!found) {
+            reader.skip();
+        }
+    }
+}  // namespace internal
+
+// Decodes into `value`. Fields missing from the input keep their current values, unknown keys are skipped.
+// Throws `std::runtime_error` when the input has another layout.
+template <typename T>
+void decode(Reader& reader, T& value) {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (std::same_as<U, bool>) {
+        value = reader.read_bool();
+    } else if constexpr (std::same_as<U, float>) {
+        value = reader.read_float();
+    } else if constexpr (std::same_as<U, double>) {
+        value = reader.read_double();
+    } else if constexpr (std::is_enum_v<U>) {
+        std::underlying_type_t<U> underlying{};
+        decode(reader, underlying);
+        value = static_cast<U>(underlying);
+    } else if constexpr (std::integral<U> && std::is_signed_v<U>) {
+        value = static_cast<U>(reader.read_int());
+    } else if constexpr (std::integral<U>) {
+        value = static_cast<U>(reader.read_uint());
+    } else if constexpr (std::same_as<U, std::string>) {
+        value = reader.read_string();
+    } else if constexpr (Reflected<U>) {
+        std::size_t count = reader.begin_table();
+        for (std::size_t i = 0; i < count; ++i) {
+            std::string_view key = reader.read_key();
+            internal::decode_field(reader, value, key, i, std::make_index_sequence<field_count<U>()>{});
+        }
+    } else if constexpr (ScalarRange<U>) {
+        using Element      = std::remove_cv_t<std::ranges::range_value_t<U>>;
+        ArrayHeader header = reader.begin_array();
+        if constexpr (ResizableRange<U>) {
+            value.resize(header.count);
+        } else if (header.count != std::ranges::size(value)) {
+            throw std::runtime_error("serr::decode => array has another length.");
+        }
+        reader.read_array(header, std::span<Element>(std::ranges::data(value), header.count));
+    } else {
+        static_assert(EncodableRange<U> && ResizableRange<U>, "serr::decode => type has no serr layout");
+        ArrayHeader header = reader.begin_array();
+        if (!reader.is_mixed(header)) {
+            throw std::runtime_error("serr::decode => expected an array of values.");
+        }
+        value.resize(header.count);
+        for (auto& element : value) {
+            decode(reader, element);
+        }
+    }
+}
+
+}  // namespace serr
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "bodies.hpp"
+#include "solver.hpp"
+#include "sser_binary.hpp"
+
+namespace nbody {
+
+// Live telemetry for remote viewers over TCP. The server only sends, a viewer connects and reads a sequence of
+// messages, each a little endian `uint32` byte count followed by one `serr` stream holding one table:
+//
+//     kind              atom `keyframe` or `delta`
+//     step, time        uint, double
+//     step_seconds      double, wall time per step since the previous frame
+//     kinetic_energy    double
+//     potential_energy  double, NaN unless the simulation computed it
+//     momentum          array of 3 doubles
+//     dropped           uint, frames published while the server was still busy, over the whole run
+//     body_count        uint
+//     origin, quantum   keyframes only, array of 3 doubles and a double
+//     solver            keyframes only and only when configured, table in the layout of include/serialization.hpp
+//     x, y, z           array of int32 for keyframes, int16 for deltas
+//
+// Positions are quantized to the grid `origin + q * quantum`, set by each keyframe to `2^-position_bits` of the
+// longest side of the bounds of the bodies. A keyframe sends every `q`, a delta the change of every `q` since the
+// previous message, clamped to int16. The server advances its copy of `q` by the sent changes only, so a body
+// that moved further than a delta holds catches up over the next ones and viewers never drift from the server.
+// A viewer that connects starts at the next keyframe, which the server sends at once.
+class TelemetryConfig {
+   public:
+    // Zero picks a free port, see `TelemetryServer::port`.
+    uint16_t port = 7171;
+
+    // Every `keyframe_interval`-th message is a keyframe, which bounds how long clamped deltas lag behind.
+    uint32_t keyframe_interval = 64;
+    uint32_t position_bits     = 16;
+
+    std::size_t max_clients = 16;
+
+    // A viewer that cannot take a message within this many seconds is dropped, so that it never holds up the
+    // others for longer.
+    double send_timeout = 1.0;
+
+    // Sent with every keyframe, so that a viewer can tell how the bodies it shows are stepped.
+    std::optional<SolverConfig> solver;
+};
+
+// What the step loop knows about a frame. The server adds the kinetic energy and momentum itself.
+class TelemetryStats {
+   public:
+    uint64_t step             = 0;
+    double   time             = 0.0;
+    double   step_seconds     = 0.0;
+    double   potential_energy = std::numeric_limits<double>::quiet_NaN();
+};
+
+// Listens on all interfaces and streams frames to every connected viewer from a thread of its own, which stays
+// off the task scheduler like `SnapshotWriter`'s. `publish` only copies the bodies. Quantization, the diagnostics,
+// the encoding and the sends happen on the server thread, and the large position arrays go out through gather
+// writes straight from where they were quantized, without a copy into the message buffer.
+//
+// A frame published while the previous one is still waiting for the server thread is dropped rather than
+// queued, since a viewer wants the newest state and the step must never wait for the network.
+class TelemetryServer {
+   public:
+    // Throws `std::runtime_error` when the port cannot be bound.
+    explicit TelemetryServer(const TelemetryConfig& config = {});
+
+    // Stops the server thread and disconnects every viewer.
+    ~TelemetryServer();
+
+    TelemetryServer(const TelemetryServer&)            = delete;
+    TelemetryServer& operator=(const TelemetryServer&) = delete;
+
+    // Hands the state of `bodies` to the server thread, from one thread at a time. Returns false, without
+    // copying, when no viewer is connected or the previous frame was not picked up yet.
+    bool publish(const Bodies& bodies, const TelemetryStats& stats);
+
+    // The bound port, the chosen one when the config asked for 0.
+    uint16_t port() const noexcept { return m_port; }
+
+    std::size_t client_count() const noexcept { return m_client_count.load(std::memory_order_relaxed); }
+    uint64_t    dropped_frames() const noexcept { return m_dropped.load(std::memory_order_relaxed); }
+
+   private:
+    class Frame {
+       public:
+        Bodies         bodies;
+        TelemetryStats stats;
+    };
+
+    class Client {
+       public:
+        int  socket = -1;
+        bool synced = false;  // Got a keyframe, so it can follow deltas
+    };
+
+    void server_loop();
+    void accept_clients();
+    void quantize(const Bodies& bodies, bool keyframe);
+    void encode(const Frame& frame, bool keyframe);
+
+    // Returns false when the viewer went away or timed out, which may leave it with part of the message.
+    bool send_message(int socket) const;
+
+    TelemetryConfig m_config;
+    int             m_listener = -1;
+    uint16_t        m_port     = 0;
+
+    std::mutex              m_mutex;
+    std::condition_variable m_changed;
+    Frame                   m_pending;
+    bool                    m_has_pending = false;
+    bool                    m_stopping    = false;
+    std::thread             m_thread;
+
+    std::atomic<std::size_t> m_client_count{0};
+    std::atomic<uint64_t>    m_dropped{0};
+
+    // Server thread only. `m_q` is the grid position of every body as every synced viewer has it, per axis.
+    Frame                 m_frame;
+    std::vector<Client>   m_clients;
+    bool                  m_keyframe_due   = true;
+    uint32_t              m_since_keyframe = 0;
+    std::array<double, 3> m_origin         = {};
+    double                m_quantum        = 1.0;
+
+    std::array<aligned_vector<int32_t>, 3> m_q;
+    std::array<aligned_vector<int16_t>, 3> m_delta;
+
+    // The byte count and the buffered part of the stream, and the arrays sent from `m_q` or `m_delta`.
+    std::vector<std::byte>           m_message;
+    std::vector<serr::ExternalArray> m_external;
+};
+
+// What a viewer knows of the simulation after a message, apart from the positions.
+class TelemetryFrame {
+   public:
+    bool                  keyframe       = false;
+    TelemetryStats        stats          = {};
+    double                kinetic_energy = 0.0;
+    std::array<double, 3> momentum       = {};
+    uint64_t              dropped        = 0;
+
+    // From the last keyframe that had one.
+    std::optional<SolverConfig> solver;
+};
+
+// The viewer side of `TelemetryServer`, which rebuilds the positions from the messages in the order they came.
+class TelemetryDecoder {
+   public:
+    // Applies one message, without its byte count. Deltas before the first keyframe are skipped, which returns
+    // false. Throws `std::runtime_error` for a malformed message or a delta of another body count.
+    bool decode(std::span<const std::byte> message);
+
+    const TelemetryFrame& frame() const noexcept { return m_frame; }
+
+    // On the grid of the last keyframe.
+    const aligned_vector<float>& x() const noexcept { return m_x; }
+    const aligned_vector<float>& y() const noexcept { return m_y; }
+    const aligned_vector<float>& z() const noexcept { return m_z; }
+
+   private:
+    TelemetryFrame        m_frame;
+    bool                  m_synced  = false;
+    std::array<double, 3> m_origin  = {};
+    double                m_quantum = 1.0;
+
+    std::array<std::vector<int32_t>, 3> m_q;
+    std::array<std::vector<int16_t>, 3> m_delta;
+
+    aligned_vector<float> m_x;
+    aligned_vector<float> m_y;
+    aligned_vector<float> m_z;
+};
+
+}  // namespace nbody
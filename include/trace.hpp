@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nbody {
+
+// Monotonic nanoseconds, the time base of every trace event.
+uint64_t trace_now() noexcept;
+
+// A span of time with a name that has static storage duration, such as a string literal.
+class TraceEvent {
+   public:
+    const char* name;
+    uint64_t    begin;
+    uint64_t    end;
+};
+
+// Fixed size ring of events with a single writer, which overwrites its oldest events once full. Readers may copy
+// it while the writer runs and drop whatever the writer overwrote in the meantime.
+class TraceRing {
+   public:
+    TraceRing(std::size_t capacity, uint32_t id, std::string name);
+
+    TraceRing(const TraceRing&)            = delete;
+    TraceRing& operator=(const TraceRing&) = delete;
+
+    // Writer only.
+    void push(const char* name, uint64_t begin, uint64_t end) noexcept {
+        uint64_t head           = m_head.load(std::memory_order_relaxed);
+        m_events[head & m_mask] = {name, begin, end};
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    // The events still in the ring, oldest first.
+    std::vector<TraceEvent> copy() const;
+
+    uint32_t id() const noexcept { return m_id; }
+
+   private:
+    friend class Tracer;
+
+    std::vector<TraceEvent> m_events;
+    uint64_t                m_mask;
+    std::atomic<uint64_t>   m_head{0};
+    uint32_t                m_id;
+    std::string             m_name;  // Guarded by the mutex of the tracer
+};
+
+// Count and total time of the events with one name.
+class TraceSummary {
+   public:
+    std::string_view name;
+    uint64_t         count    = 0;
+    uint64_t         total_ns = 0;
+};
+
+// Collects scoped CPU zones into one ring per thread, and events that no thread owns, such as GPU timestamps,
+// into named tracks. Disabled by default, when a zone costs one relaxed load.
+class Tracer {
+   public:
+    // Events per ring, 768 KiB each.
+    static constexpr std::size_t RING_CAPACITY = 32 * 1024;
+
+    static Tracer& global();
+
+    static bool enabled() noexcept { return s_enabled.load(std::memory_order_relaxed); }
+    static void set_enabled(bool enabled) noexcept { s_enabled.store(enabled, std::memory_order_relaxed); }
+
+    // Appends to the ring of the calling thread, which is created on its first event. Drops the event when the
+    // ring cannot be allocated.
+    void record(const char* name, uint64_t begin, uint64_t end) noexcept;
+
+    // Names the ring of the calling thread in exported traces. Costs nothing until the thread records.
+    void set_thread_name(std::string name);
+
+    // The ring with `name`, created on first use. Events pushed to a track must come from one thread at a time.
+    TraceRing& track(std::string_view name);
+
+    // Totals of the events that ended in `[begin, end)`, over every thread and track, in order of first
+    // appearance.
+    std::vector<TraceSummary> summarize(uint64_t begin, uint64_t end) const;
+
+    // Every event still in the rings, in the Chrome trace event format that Perfetto and chrome://tracing open.
+    void write_chrome_trace(const std::filesystem::path& path) const;
+
+   private:
+    Tracer() = default;
+
+    TraceRing& local_ring();
+    TraceRing& add_ring(std::string name);
+
+    static inline std::atomic<bool> s_enabled{false};
+
+    mutable std::mutex                      m_mutex;
+    std::vector<std::unique_ptr<TraceRing>> m_rings;
+};
+
+// Records the time from construction to destruction as an event of the calling thread, when tracing is on.
+class TraceZone {
+   public:
+    explicit TraceZone(const char* name) noexcept
+        : m_name(name), m_active(Tracer::enabled()), m_begin(m_active ? trace_now() : 0) {}
+
+    ~TraceZone() {
+        if (m_active) {
+            Tracer::global().record(m_name, m_begin, trace_now());
+        }
+    }
+
+    TraceZone(const TraceZone&)            = delete;
+    TraceZone& operator=(const TraceZone&) = delete;
+
+   private:
+    const char* m_name;
+    bool        m_active;
+    uint64_t    m_begin;
+};
+
+#define NBODY_TRACE_CONCAT_IMPL(a, b) a##b
+#define NBODY_TRACE_CONCAT(a, b)      NBODY_TRACE_CONCAT_IMPL(a, b)
+
+// Traces the rest of the enclosing scope as `name`.
+#define NBODY_TRACE_ZONE(name) ::nbody::TraceZone NBODY_TRACE_CONCAT(nbody_trace_zone_, __LINE__)(name)
+
+}  // namespace nbody
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace nbody {
+
+// Lock-free hand over of the latest value from one producer thread to one consumer thread. The producer fills
+// `back` and publishes it, the consumer picks up the latest published value into `front`. Neither ever waits for
+// the other, and a value that is published again before the consumer picked it up is dropped.
+//
+// Each side owns one of three slots and the third sits in the middle. Publishing and picking up exchange the
+// caller's slot with the middle one, and a flag on the middle index says whether it holds a value the consumer
+// has not seen yet.
+template <typename T>
+class TripleBuffer {
+   public:
+    TripleBuffer() = default;
+
+    TripleBuffer(const TripleBuffer&)            = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Sets every slot to `value`. Only while neither side runs.
+    void fill(const T& value) {
+        m_slots.fill(value);
+        m_middle.store(MIDDLE, std::memory_order_relaxed);
+        m_back  = BACK;
+        m_front = FRONT;
+    }
+
+    // Producer only. Left as it was by the consumer's previous use, so it has to be written in full.
+    T& back() noexcept { return m_slots[m_back]; }
+
+    // Producer only. Makes `back` the latest value and hands the producer another slot.
+    void publish() noexcept { m_back = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+    // Consumer only. Whether a value was published since the last call, which `front` then holds.
+    bool update() noexcept {
+        if ((m_middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+            return false;
+        }
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    // Consumer only. The value the last successful `update` picked up, or the filled one before that.
+    const T& front() const noexcept { return m_slots[m_front]; }
+
+   private:
+    static constexpr uint32_t BACK   = 0;
+    static constexpr uint32_t MIDDLE = 1;
+    static constexpr uint32_t FRONT  = 2;
+    static constexpr uint32_t INDEX  = 3;
+    static constexpr uint32_t FRESH  = 4;
+
+    std::array<T, 3> m_slots{};
+
+    // On their own cache lines, since only the middle index is shared.
+    alignas(64) std::atomic<uint32_t> m_middle{MIDDLE};
+    alignas(64) uint32_t m_back = BACK;
+    alignas(64) uint32_t m_front = FRONT;
+};
+
+}  // namespace nbody
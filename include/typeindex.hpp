@@ -3,6 +3,9 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <limits>
 
 namespace nbody {
 namespace internal {
@@ -14,9 +17,17 @@ namespace internal {
         }
     }
 
+    // Counts on a wider type, so that the 257th type terminates instead of sharing index 0 with the first.
     template<typename T>
     std::size_t type_id_uint8() noexcept {
-        static const uint8_t index = typeindex_impl::next_type_index<uint8_t>();
+        static const uint8_t index = [] {
+            uint32_t next = typeindex_impl::next_type_index<uint32_t>();
+            if (next > std::numeric_limits<uint8_t>::max()) {
+                std::fputs("type_id_uint8 => more than 256 types!\n", stderr);
+                std::terminate();
+            }
+            return static_cast<uint8_t>(next);
+        }();
         return index;
     }
 }
@@ -0,0 +1,68 @@
+#include "arena.hpp"
+
+#include <algorithm>
+
+namespace nbody {
+
+Arena::Block Arena::make_block(std::size_t size) {
+    return {std::unique_ptr<std::byte, AlignedDelete>(
+                static_cast<std::byte*>(::operator new(size, std::align_val_t{SIMD_ALIGNMENT}))),
+            size};
+}
+
+void* Arena::allocate_slow(std::size_t size) {
+    // Blocks start SIMD aligned, so a fresh block needs no padding. Blocks past the current one are left over
+    // from before a rewind and are reused when large enough.
+    std::size_t next = m_blocks.empty() ? 0 : m_block + 1;
+    if (next >= m_blocks.size() || m_blocks[next].size < size) {
+        std::size_t grown = m_blocks.empty() ? m_block_bytes : std::max(m_block_bytes, m_blocks.back().size);
+        m_blocks.insert(m_blocks.begin() + static_cast<std::ptrdiff_t>(next), make_block(std::max(grown, size)));
+    }
+
+    m_block  = next;
+    m_offset = size;
+    return m_blocks[next].memory.get();
+}
+
+void Arena::reset() {
+    if (m_blocks.size() > 1) {
+        std::size_t total = capacity();
+        m_blocks.clear();
+        m_blocks.push_back(make_block(total));
+    }
+    m_block  = 0;
+    m_offset = 0;
+}
+
+std::size_t Arena::used() const noexcept {
+    std::size_t used = m_offset;
+    for (std::size_t block = 0; block < m_block && block < m_blocks.size(); ++block) {
+        used += m_blocks[block].size;
+    }
+    return used;
+}
+
+std::size_t Arena::capacity() const noexcept {
+    std::size_t capacity = 0;
+    for (const Block& block : m_blocks) {
+        capacity += block.size;
+    }
+    return capacity;
+}
+
+BlockPool::BlockPool(std::size_t block_size, std::size_t alignment, std::size_t blocks_per_slab)
+    : m_block_size((std::max(block_size, sizeof(FreeBlock)) + alignment - 1) & ~(alignment - 1)),
+      m_blocks_per_slab(std::max<std::size_t>(1, blocks_per_slab)) {}
+
+void BlockPool::grow() {
+    std::size_t bytes = m_block_size * m_blocks_per_slab;
+    m_slabs.emplace_back(static_cast<std::byte*>(::operator new(bytes, std::align_val_t{SIMD_ALIGNMENT})));
+
+    // Threaded back to front, so blocks are handed out in address order.
+    std::byte* slab = m_slabs.back().get();
+    for (std::size_t i = m_blocks_per_slab; i-- > 0;) {
+        deallocate(slab + i * m_block_size);
+    }
+}
+
+}  // namespace nbody
@@ -0,0 +1,278 @@
+#include "barnes_hut.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+namespace nbody {
+
+namespace {
+    constexpr std::size_t GROUP_GRAIN = 16;
+
+    // Deep enough for the 7 siblings pushed per level over the 21 Morton levels.
+    constexpr std::size_t STACK_SIZE = 8 * 22;
+
+    // Squared distance from a point to the closest point of a node's bounds, 0 inside them.
+    float distance_squared(const OctreeNode& box, float x, float y, float z) {
+        float dx = std::max({box.min_x - x, 0.0f, x - box.max_x});
+        float dy = std::max({box.min_y - y, 0.0f, y - box.max_y});
+        float dz = std::max({box.min_z - z, 0.0f, z - box.max_z});
+        return dx * dx + dy * dy + dz * dz;
+    }
+}  // namespace
+
+BarnesHut::~BarnesHut() {
+    if (m_rebuilding) {
+        try {
+            Scheduler::global().wait(m_rebuild);
+        } catch (...) {
+            // Nobody is left to see the tree it failed to build.
+        }
+    }
+}
+
+void BarnesHut::compute_accelerations(Bodies& bodies) {
+    bodies.ax.resize(bodies.size());
+    bodies.ay.resize(bodies.size());
+    bodies.az.resize(bodies.size());
+
+    update_tree(bodies);
+    if (m_tree.empty()) {
+        return;
+    }
+
+    const auto& nodes = m_tree.nodes();
+
+    m_groups.clear();
+    for (uint32_t index = 0; index < nodes.size(); ++index) {
+        if (nodes[index].is_leaf()) {
+            m_groups.push_back(index);
+        }
+    }
+
+    evaluate(bodies, nullptr);
+}
+
+void BarnesHut::compute_active_accelerations(Bodies& bodies, std::span<const uint32_t> active) {
+    bodies.ax.resize(bodies.size());
+    bodies.ay.resize(bodies.size());
+    bodies.az.resize(bodies.size());
+
+    // The inactive bodies still pull, so the tree always holds every body.
+    update_tree(bodies);
+    if (m_tree.empty()) {
+        return;
+    }
+
+    m_active.assign(bodies.size(), 0);
+    for (uint32_t index : active) {
+        m_active[index] = 1;
+    }
+
+    const auto& nodes = m_tree.nodes();
+    const auto  order = m_tree.order();
+
+    m_groups.clear();
+    for (uint32_t index = 0; index < nodes.size(); ++index) {
+        const OctreeNode& node = nodes[index];
+        if (node.is_leaf() && std::any_of(order.begin() + node.body_begin, order.begin() + node.body_end,
+                                          [&](uint32_t body) { return m_active[body] != 0; })) {
+            m_groups.push_back(index);
+        }
+    }
+
+    evaluate(bodies, m_active.data());
+}
+
+void BarnesHut::update_tree(const Bodies& bodies) {
+    bool     low_parts = m_config.precision != Precision::FP32;
+    uint32_t leaf_size = m_config.leaf_size;
+
+    if (m_config.rebuild_threshold <= 0.0f) {
+        m_tree.build(bodies, leaf_size, low_parts);
+        return;
+    }
+
+    if (m_rebuilding) {
+        m_rebuilding = false;
+        Scheduler::global().wait(m_rebuild);
+        std::swap(m_tree, m_next_tree);
+    }
+
+    // The first step, and any step after bodies were added or removed, has no tree to refit.
+    if (m_tree.empty() || m_tree.body_count() != bodies.size()) {
+        m_tree.build(bodies, leaf_size, low_parts);
+        return;
+    }
+
+    m_tree.refit(bodies);
+    if (m_tree.extent_growth() <= m_config.rebuild_threshold) {
+        return;
+    }
+
+    // The integrator moves the bodies while the rebuild runs, so it sorts a copy. The swap refits it to the
+    // positions of the next step, which moved little since.
+    m_snapshot.x.assign(bodies.x.begin(), bodies.x.end());
+    m_snapshot.y.assign(bodies.y.begin(), bodies.y.end());
+    m_snapshot.z.assign(bodies.z.begin(), bodies.z.end());
+    m_snapshot.mass.assign(bodies.mass.begin(), bodies.mass.end());
+
+    m_rebuilding = true;
+    Scheduler::global().spawn(m_rebuild, [this, leaf_size, low_parts] {
+        // Refitting gathers the low parts again, the sort only needs the positions.
+        m_next_tree.build(m_snapshot, leaf_size, low_parts);
+    });
+}
+
+void BarnesHut::evaluate(Bodies& bodies, const uint8_t* active) {
+    NBODY_TRACE_ZONE("barnes_hut.evaluate");
+
+    const auto& groups  = m_groups;
+    const auto& nodes   = m_tree.nodes();
+    const auto  order   = m_tree.order();
+    const auto  xs      = m_tree.x();
+    const auto  ys      = m_tree.y();
+    const auto  zs      = m_tree.z();
+    const auto  masses  = m_tree.mass();
+    const auto  xs_lo   = m_tree.x_lo();
+    const auto  ys_lo   = m_tree.y_lo();
+    const auto  zs_lo   = m_tree.z_lo();
+    bool        low     = !xs_lo.empty();
+    bool        rebase  = m_config.precision == Precision::RELATIVE;
+    float       theta2  = m_config.theta * m_config.theta;
+    float       eps2    = m_config.softening * m_config.softening;
+    float       g_const = m_config.gravitational_constant;
+
+    // Every leaf is a group of targets sharing one walk. Ordering them by their first body keeps the groups in
+    // Morton order, so neighbouring walks touch nearly the same nodes.
+    std::sort(m_groups.begin(), m_groups.end(),
+              [&](uint32_t a, uint32_t b) { return nodes[a].body_begin < nodes[b].body_begin; });
+
+    parallel_for(groups.size(), GROUP_GRAIN, [&](std::size_t begin, std::size_t end) {
+        std::array<uint32_t, STACK_SIZE> stack;
+        WalkScratch&                     scratch          = m_scratch.local();
+        InteractionList&                 list             = scratch.list;
+        std::vector<uint32_t>&           targets_of_group = scratch.targets;
+        aligned_vector<float>&           tx               = scratch.tx;
+        aligned_vector<float>&           ty               = scratch.ty;
+        aligned_vector<float>&           tz               = scratch.tz;
+        aligned_vector<float>&           tx_lo            = scratch.tx_lo;
+        aligned_vector<float>&           ty_lo            = scratch.ty_lo;
+        aligned_vector<float>&           tz_lo            = scratch.tz_lo;
+        aligned_vector<float>&           ax               = scratch.ax;
+        aligned_vector<float>&           ay               = scratch.ay;
+        aligned_vector<float>&           az               = scratch.az;
+
+        for (std::size_t group_index = begin; group_index < end; ++group_index) {
+            const OctreeNode& group = nodes[groups[group_index]];
+
+            list.clear();
+
+            std::size_t top = 0;
+            stack[top++]    = Octree::ROOT;
+
+            // A node is accepted only if its size is small against the distance to the nearest possible target
+            // in the group, which is at least as strict as the per-body criterion for every body of the group.
+            while (top > 0) {
+                const OctreeNode& node = nodes[stack[--top]];
+
+                float d2 = distance_squared(group, node.com_x, node.com_y, node.com_z);
+                float s  = std::max({node.max_x - node.min_x, node.max_y - node.min_y, node.max_z - node.min_z});
+
+                if (s * s < theta2 * d2) {
+                    if (low) {
+                        list.push_back(node.com_x, node.com_y, node.com_z, node.mass, 0.0f, 0.0f, 0.0f);
+                    } else {
+                        list.push_back(node.com_x, node.com_y, node.com_z, node.mass);
+                    }
+                } else if (node.is_leaf()) {
+                    // Includes the group itself, the kernel's zero distance rule drops the self interaction.
+                    for (uint32_t source = node.body_begin; source < node.body_end; ++source) {
+                        if (low) {
+                            list.push_back(xs[source], ys[source], zs[source], masses[source], xs_lo[source],
+                                           ys_lo[source], zs_lo[source]);
+                        } else {
+                            list.push_back(xs[source], ys[source], zs[source], masses[source]);
+                        }
+                    }
+                } else {
+                    for (uint32_t child = node.first_child; child < node.first_child + node.child_count; ++child) {
+                        stack[top++] = child;
+                    }
+                }
+            }
+
+            // Positions in the tree's sorted columns of the group's targets.
+            targets_of_group.clear();
+            for (uint32_t position = group.body_begin; position < group.body_end; ++position) {
+                if (active == nullptr || active[order[position]] != 0) {
+                    targets_of_group.push_back(position);
+                }
+            }
+
+            std::size_t count = targets_of_group.size();
+            ax.assign(count, 0.0f);
+            ay.assign(count, 0.0f);
+            az.assign(count, 0.0f);
+
+            DirectSumTargets targets{xs.data() + group.body_begin, ys.data() + group.body_begin,
+                                     zs.data() + group.body_begin, ax.data(), ay.data(), az.data(), count};
+            if (low) {
+                targets.x_lo = xs_lo.data() + group.body_begin;
+                targets.y_lo = ys_lo.data() + group.body_begin;
+                targets.z_lo = zs_lo.data() + group.body_begin;
+            }
+            if (count != group.body_end - group.body_begin || rebase) {
+                tx.resize(count);
+                ty.resize(count);
+                tz.resize(count);
+                for (std::size_t i = 0; i < count; ++i) {
+                    tx[i] = xs[targets_of_group[i]];
+                    ty[i] = ys[targets_of_group[i]];
+                    tz[i] = zs[targets_of_group[i]];
+                }
+                targets.x = tx.data();
+                targets.y = ty.data();
+                targets.z = tz.data();
+
+                if (low) {
+                    tx_lo.resize(count);
+                    ty_lo.resize(count);
+                    tz_lo.resize(count);
+                    for (std::size_t i = 0; i < count; ++i) {
+                        tx_lo[i] = xs_lo[targets_of_group[i]];
+                        ty_lo[i] = ys_lo[targets_of_group[i]];
+                        tz_lo[i] = zs_lo[targets_of_group[i]];
+                    }
+                    targets.x_lo = tx_lo.data();
+                    targets.y_lo = ty_lo.data();
+                    targets.z_lo = tz_lo.data();
+                }
+            }
+
+            // Offsets from the group's center of mass are small, so single precision resolves them finely.
+            if (rebase) {
+                list.rebase(group.com_x, group.com_y, group.com_z);
+                rebase_coordinates(tx.data(), tx_lo.data(), group.com_x, count, tx.data());
+                rebase_coordinates(ty.data(), ty_lo.data(), group.com_y, count, ty.data());
+                rebase_coordinates(tz.data(), tz_lo.data(), group.com_z, count, tz.data());
+            }
+            m_kernel(targets, list.sources(), eps2);
+
+            for (std::size_t i = 0; i < count; ++i) {
+                uint32_t index   = order[targets_of_group[i]];
+                bodies.ax[index] = g_const * ax[i];
+                bodies.ay[index] = g_const * ay[i];
+                bodies.az[index] = g_const * az[i];
+            }
+        }
+    });
+}
+
+}  // namespace nbody
@@ -0,0 +1,68 @@
+#include "diagnostics.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "parallel.hpp"
+
+namespace nbody {
+
+namespace {
+    constexpr std::size_t ROW_GRAIN = 64;
+
+    double position(const aligned_vector<float>& hi, const aligned_vector<float>& lo, std::size_t i) {
+        return static_cast<double>(hi[i]) + (i < lo.size() ? static_cast<double>(lo[i]) : 0.0);
+    }
+}  // namespace
+
+double kinetic_energy(const Bodies& bodies) {
+    double energy = 0.0;
+    for (std::size_t i = 0; i < bodies.size(); ++i) {
+        double vx = bodies.vx[i];
+        double vy = bodies.vy[i];
+        double vz = bodies.vz[i];
+        energy += 0.5 * bodies.mass[i] * (vx * vx + vy * vy + vz * vz);
+    }
+    return energy;
+}
+
+std::array<double, 3> momentum(const Bodies& bodies) {
+    std::array<double, 3> total{};
+    for (std::size_t i = 0; i < bodies.size(); ++i) {
+        total[0] += static_cast<double>(bodies.mass[i]) * bodies.vx[i];
+        total[1] += static_cast<double>(bodies.mass[i]) * bodies.vy[i];
+        total[2] += static_cast<double>(bodies.mass[i]) * bodies.vz[i];
+    }
+    return total;
+}
+
+double potential_energy(const Bodies& bodies, float gravitational_constant, float softening) {
+    double eps2 = static_cast<double>(softening) * softening;
+
+    // One partial sum per row keeps the result independent of how the rows were split over the workers.
+    std::vector<double> rows(bodies.size(), 0.0);
+    parallel_for(bodies.size(), ROW_GRAIN, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            double xi  = position(bodies.x, bodies.x_lo, i);
+            double yi  = position(bodies.y, bodies.y_lo, i);
+            double zi  = position(bodies.z, bodies.z_lo, i);
+            double sum = 0.0;
+            for (std::size_t j = i + 1; j < bodies.size(); ++j) {
+                double dx = position(bodies.x, bodies.x_lo, j) - xi;
+                double dy = position(bodies.y, bodies.y_lo, j) - yi;
+                double dz = position(bodies.z, bodies.z_lo, j) - zi;
+                sum += bodies.mass[j] / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
+            }
+            rows[i] = bodies.mass[i] * sum;
+        }
+    });
+
+    double energy = 0.0;
+    for (double row : rows) {
+        energy += row;
+    }
+    return -static_cast<double>(gravitational_constant) * energy;
+}
+
+}  // namespace nbody
@@ -0,0 +1,160 @@
+#include "direct_sum.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+#include "aligned_allocator.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+namespace nbody {
+
+namespace {
+    constexpr std::size_t TARGET_GRAIN = 64;
+
+    // Targets are swept against the sources in blocks that keep the block's accumulators in L1.
+    constexpr std::size_t TARGET_BLOCK = 256;
+}  // namespace
+
+void DirectSum::evaluate_block(const Bodies& bodies, const DirectSumTargets& targets, float softening_squared) {
+    if (m_config.precision != Precision::RELATIVE) {
+        DirectSumSources sources{bodies.x.data(), bodies.y.data(), bodies.z.data(), bodies.mass.data(),
+                                 bodies.size()};
+        if (m_config.precision != Precision::FP32) {
+            sources.x_lo = bodies.x_lo.data();
+            sources.y_lo = bodies.y_lo.data();
+            sources.z_lo = bodies.z_lo.data();
+        }
+        m_kernel(targets, sources, softening_squared);
+        return;
+    }
+
+    RelativeScratch& scratch = m_relative.local();
+    scratch.x.resize(bodies.size());
+    scratch.y.resize(bodies.size());
+    scratch.z.resize(bodies.size());
+    scratch.tx.resize(targets.count);
+    scratch.ty.resize(targets.count);
+    scratch.tz.resize(targets.count);
+
+    // Rebasing costs one pass over the sources per block, against `TARGET_BLOCK` passes of the kernel.
+    double origin_x = static_cast<double>(targets.x[0]) + targets.x_lo[0];
+    double origin_y = static_cast<double>(targets.y[0]) + targets.y_lo[0];
+    double origin_z = static_cast<double>(targets.z[0]) + targets.z_lo[0];
+    rebase_coordinates(bodies.x.data(), bodies.x_lo.data(), origin_x, bodies.size(), scratch.x.data());
+    rebase_coordinates(bodies.y.data(), bodies.y_lo.data(), origin_y, bodies.size(), scratch.y.data());
+    rebase_coordinates(bodies.z.data(), bodies.z_lo.data(), origin_z, bodies.size(), scratch.z.data());
+    rebase_coordinates(targets.x, targets.x_lo, origin_x, targets.count, scratch.tx.data());
+    rebase_coordinates(targets.y, targets.y_lo, origin_y, targets.count, scratch.ty.data());
+    rebase_coordinates(targets.z, targets.z_lo, origin_z, targets.count, scratch.tz.data());
+
+    DirectSumTargets rebased_targets{scratch.tx.data(), scratch.ty.data(), scratch.tz.data(), targets.ax,
+                                     targets.ay,        targets.az,        targets.count};
+    DirectSumSources rebased_sources{scratch.x.data(), scratch.y.data(), scratch.z.data(), bodies.mass.data(),
+                                     bodies.size()};
+    m_kernel(rebased_targets, rebased_sources, softening_squared);
+}
+
+void DirectSum::compute_accelerations(Bodies& bodies) {
+    NBODY_TRACE_ZONE("direct_sum.evaluate");
+
+    bodies.ax.resize(bodies.size());
+    bodies.ay.resize(bodies.size());
+    bodies.az.resize(bodies.size());
+
+    bool low_parts = m_config.precision != Precision::FP32;
+    if (low_parts) {
+        bodies.resize_low_parts();
+    }
+
+    float eps2    = m_config.softening * m_config.softening;
+    float g_const = m_config.gravitational_constant;
+
+    parallel_for(bodies.size(), TARGET_GRAIN, [&](std::size_t begin, std::size_t end) {
+        std::fill(bodies.ax.begin() + begin, bodies.ax.begin() + end, 0.0f);
+        std::fill(bodies.ay.begin() + begin, bodies.ay.begin() + end, 0.0f);
+        std::fill(bodies.az.begin() + begin, bodies.az.begin() + end, 0.0f);
+
+        for (std::size_t block = begin; block < end; block += TARGET_BLOCK) {
+            std::size_t      count = std::min(TARGET_BLOCK, end - block);
+            DirectSumTargets targets{bodies.x.data() + block,  bodies.y.data() + block,  bodies.z.data() + block,
+                                     bodies.ax.data() + block, bodies.ay.data() + block, bodies.az.data() + block,
+                                     count};
+            if (low_parts) {
+                targets.x_lo = bodies.x_lo.data() + block;
+                targets.y_lo = bodies.y_lo.data() + block;
+                targets.z_lo = bodies.z_lo.data() + block;
+            }
+            evaluate_block(bodies, targets, eps2);
+        }
+
+        for (std::size_t i = begin; i < end; ++i) {
+            bodies.ax[i] *= g_const;
+            bodies.ay[i] *= g_const;
+            bodies.az[i] *= g_const;
+        }
+    });
+}
+
+void DirectSum::compute_active_accelerations(Bodies& bodies, std::span<const uint32_t> active) {
+    NBODY_TRACE_ZONE("direct_sum.evaluate");
+
+    bodies.ax.resize(bodies.size());
+    bodies.ay.resize(bodies.size());
+    bodies.az.resize(bodies.size());
+
+    bool low_parts = m_config.precision != Precision::FP32;
+    if (low_parts) {
+        bodies.resize_low_parts();
+    }
+
+    float eps2    = m_config.softening * m_config.softening;
+    float g_const = m_config.gravitational_constant;
+
+    parallel_for(active.size(), TARGET_GRAIN, [&](std::size_t begin, std::size_t end) {
+        // Active bodies are scattered, so every block is gathered into contiguous columns for the kernel.
+        aligned_vector<float> x(TARGET_BLOCK);
+        aligned_vector<float> y(TARGET_BLOCK);
+        aligned_vector<float> z(TARGET_BLOCK);
+        aligned_vector<float> x_lo(low_parts ? TARGET_BLOCK : 0);
+        aligned_vector<float> y_lo(low_parts ? TARGET_BLOCK : 0);
+        aligned_vector<float> z_lo(low_parts ? TARGET_BLOCK : 0);
+        aligned_vector<float> ax(TARGET_BLOCK);
+        aligned_vector<float> ay(TARGET_BLOCK);
+        aligned_vector<float> az(TARGET_BLOCK);
+
+        for (std::size_t block = begin; block < end; block += TARGET_BLOCK) {
+            std::size_t count = std::min(TARGET_BLOCK, end - block);
+            for (std::size_t i = 0; i < count; ++i) {
+                uint32_t index = active[block + i];
+                x[i]           = bodies.x[index];
+                y[i]           = bodies.y[index];
+                z[i]           = bodies.z[index];
+            }
+            if (low_parts) {
+                for (std::size_t i = 0; i < count; ++i) {
+                    uint32_t index = active[block + i];
+                    x_lo[i]        = bodies.x_lo[index];
+                    y_lo[i]        = bodies.y_lo[index];
+                    z_lo[i]        = bodies.z_lo[index];
+                }
+            }
+            std::fill(ax.begin(), ax.end(), 0.0f);
+            std::fill(ay.begin(), ay.end(), 0.0f);
+            std::fill(az.begin(), az.end(), 0.0f);
+
+            DirectSumTargets targets{x.data(),    y.data(),    z.data(),    ax.data(), ay.data(), az.data(),
+                                     count,       x_lo.data(), y_lo.data(), z_lo.data()};
+            evaluate_block(bodies, targets, eps2);
+
+            for (std::size_t i = 0; i < count; ++i) {
+                uint32_t index   = active[block + i];
+                bodies.ax[index] = g_const * ax[i];
+                bodies.ay[index] = g_const * ay[i];
+                bodies.az[index] = g_const * az[i];
+            }
+        }
+    });
+}
+
+}  // namespace nbody
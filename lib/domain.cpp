@@ -0,0 +1,139 @@
+#include "domain.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "morton.hpp"
+
+namespace nbody {
+
+namespace {
+    // Deep enough for the 7 siblings pushed per level over the 21 Morton levels.
+    constexpr std::size_t STACK_SIZE = 8 * 22;
+
+    // Squared distance from a point to the closest point of `box`, 0 inside it.
+    float distance_squared(const DomainBounds& box, float x, float y, float z) {
+        float dx = std::max({box.min_x - x, 0.0f, x - box.max_x});
+        float dy = std::max({box.min_y - y, 0.0f, y - box.max_y});
+        float dz = std::max({box.min_z - z, 0.0f, z - box.max_z});
+        return dx * dx + dy * dy + dz * dz;
+    }
+}  // namespace
+
+DomainBounds DomainBounds::of(const Bodies& bodies) {
+    DomainBounds bounds;
+    for (std::size_t i = 0; i < bodies.size(); ++i) {
+        bounds.min_x = std::min(bounds.min_x, bodies.x[i]);
+        bounds.min_y = std::min(bounds.min_y, bodies.y[i]);
+        bounds.min_z = std::min(bounds.min_z, bodies.z[i]);
+        bounds.max_x = std::max(bounds.max_x, bodies.x[i]);
+        bounds.max_y = std::max(bounds.max_y, bodies.y[i]);
+        bounds.max_z = std::max(bounds.max_z, bodies.z[i]);
+    }
+    return bounds;
+}
+
+void compute_domain_keys(const Bodies& bodies, const DomainBounds& global, std::span<uint64_t> keys) {
+    // Quantize against a cube so that key ranges cut space like the octree does.
+    float extent = std::max({global.max_x - global.min_x, global.max_y - global.min_y, global.max_z - global.min_z});
+    float scale  = extent > 0.0f ? static_cast<float>(MORTON_AXIS_MAX) / extent : 0.0f;
+
+    auto quantize = [scale](float value, float origin) {
+        float cell = std::floor((value - origin) * scale);
+        return static_cast<uint32_t>(std::clamp(cell, 0.0f, static_cast<float>(MORTON_AXIS_MAX)));
+    };
+
+    for (std::size_t i = 0; i < bodies.size(); ++i) {
+        keys[i] = morton_encode(quantize(bodies.x[i], global.min_x), quantize(bodies.y[i], global.min_y),
+                                quantize(bodies.z[i], global.min_z));
+    }
+}
+
+std::vector<DomainSample> sample_domain(std::span<const uint64_t> sorted_keys, double work, std::size_t count) {
+    std::size_t body_count = sorted_keys.size();
+    count                  = std::min(count, body_count);
+
+    // Sample `i` stands for the bodies `[i * n / count, (i + 1) * n / count)`.
+    std::vector<DomainSample> samples;
+    samples.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        std::size_t begin = i * body_count / count;
+        std::size_t end   = (i + 1) * body_count / count;
+        double      share = static_cast<double>(end - begin) / static_cast<double>(body_count);
+        samples.push_back({sorted_keys[begin], work * share});
+    }
+    return samples;
+}
+
+std::vector<uint64_t> choose_splitters(std::vector<DomainSample> samples, std::size_t domain_count) {
+    std::sort(samples.begin(), samples.end(),
+              [](const DomainSample& a, const DomainSample& b) { return a.key < b.key; });
+
+    double total = 0.0;
+    for (const DomainSample& sample : samples) {
+        total += sample.work;
+    }
+
+    // A boundary goes at the first sample starting at or past its share of the work. Domains past the last
+    // sample stay empty rather than splitting a sample.
+    std::vector<uint64_t> splitters(domain_count + 1, UINT64_MAX);
+    splitters[0] = 0;
+
+    double      before = 0.0;
+    std::size_t next   = 0;
+    for (std::size_t domain = 1; domain < domain_count; ++domain) {
+        double target = total * static_cast<double>(domain) / static_cast<double>(domain_count);
+        while (next < samples.size() && before < target) {
+            before += samples[next++].work;
+        }
+        splitters[domain] = next < samples.size() ? std::max(samples[next].key, splitters[domain - 1]) : UINT64_MAX;
+    }
+    return splitters;
+}
+
+std::size_t domain_of(std::span<const uint64_t> splitters, uint64_t key) noexcept {
+    auto it = std::upper_bound(splitters.begin(), splitters.end() - 1, key);
+    return static_cast<std::size_t>(it - splitters.begin()) - 1;
+}
+
+void append_essential_sources(const Octree& tree, const DomainBounds& target, float theta,
+                              std::vector<float>& sources) {
+    if (tree.empty() || target.empty()) {
+        return;
+    }
+
+    const auto& nodes  = tree.nodes();
+    const auto  xs     = tree.x();
+    const auto  ys     = tree.y();
+    const auto  zs     = tree.z();
+    const auto  masses = tree.mass();
+    float       theta2 = theta * theta;
+
+    std::array<uint32_t, STACK_SIZE> stack;
+    std::size_t                      top = 0;
+    stack[top++]                         = Octree::ROOT;
+
+    // The criterion of `BarnesHut` against the closest point of the domain, so every leaf group of the
+    // receiving tree would have accepted the node as well.
+    while (top > 0) {
+        const OctreeNode& node = nodes[stack[--top]];
+
+        float d2 = distance_squared(target, node.com_x, node.com_y, node.com_z);
+        float s  = std::max({node.max_x - node.min_x, node.max_y - node.min_y, node.max_z - node.min_z});
+
+        if (s * s < theta2 * d2) {
+            sources.insert(sources.end(), {node.com_x, node.com_y, node.com_z, node.mass});
+        } else if (node.is_leaf()) {
+            for (uint32_t source = node.body_begin; source < node.body_end; ++source) {
+                sources.insert(sources.end(), {xs[source], ys[source], zs[source], masses[source]});
+            }
+        } else {
+            for (uint32_t child = node.first_child; child < node.first_child + node.child_count; ++child) {
+                stack[top++] = child;
+            }
+        }
+    }
+}
+
+}  // namespace nbody
@@ -0,0 +1,228 @@
+#include "ecs.hpp"
+
+#include <cstring>
+
+namespace nbody {
+
+namespace {
+    constexpr std::size_t align_up(std::size_t size) noexcept {
+        return (size + SIMD_ALIGNMENT - 1) & ~(SIMD_ALIGNMENT - 1);
+    }
+
+    void move_component(const ComponentInfo& info, void* destination, void* source) noexcept {
+        if (info.trivial) {
+            std::memcpy(destination, source, info.size);
+        } else {
+            info.move_construct(destination, source);
+            info.destroy(source);
+        }
+    }
+}  // namespace
+
+World::~World() {
+    for (auto& archetype : m_archetypes) {
+        for (std::size_t chunk = 0; chunk < archetype->chunks.size(); ++chunk) {
+            for (std::size_t c = 0; c < archetype->components.size(); ++c) {
+                const ComponentInfo& info = *archetype->components[c];
+                if (info.trivial) {
+                    continue;
+                }
+                std::byte* column = archetype->chunks[chunk].memory.get() + archetype->column_offsets[c];
+                for (uint32_t row = 0; row < archetype->chunks[chunk].count; ++row) {
+                    info.destroy(column + row * info.size);
+                }
+            }
+        }
+    }
+}
+
+const World::Record& World::record(Entity entity) const {
+    if (!alive(entity)) {
+        throw std::runtime_error("World::record => entity is not alive.");
+    }
+    return m_records[entity.index];
+}
+
+uint32_t World::archetype_for(std::span<const ComponentInfo* const> infos) {
+    ComponentMask mask;
+    for (const ComponentInfo* info : infos) {
+        if (mask.test(info->id)) {
+            throw std::invalid_argument("World::archetype_for => component type given twice.");
+        }
+        mask.set(info->id);
+    }
+
+    auto it = m_archetype_of.find(mask);
+    if (it != m_archetype_of.end()) {
+        return it->second;
+    }
+    return create_archetype({infos.begin(), infos.end()});
+}
+
+uint32_t World::create_archetype(std::vector<const ComponentInfo*> components) {
+    std::sort(components.begin(), components.end(),
+              [](const ComponentInfo* a, const ComponentInfo* b) { return a->id < b->id; });
+
+    auto archetype = std::make_unique<Archetype>();
+    archetype->column_of.fill(NO_COLUMN);
+    for (std::size_t c = 0; c < components.size(); ++c) {
+        archetype->mask.set(components[c]->id);
+        archetype->column_of[components[c]->id] = static_cast<uint8_t>(c);
+    }
+
+    // Every column starts on its own cache line. The capacity is a multiple of the widest SIMD register in
+    // floats, so full chunks have no remainder loops, unless single entities are too large for that.
+    std::size_t row_bytes = sizeof(Entity);
+    for (const ComponentInfo* info : components) {
+        row_bytes += info->size;
+    }
+    std::size_t padding  = SIMD_ALIGNMENT * (components.size() + 1);
+    std::size_t capacity = CHUNK_BYTES > padding ? (CHUNK_BYTES - padding) / row_bytes : 0;
+    capacity             = capacity >= 16 ? capacity & ~std::size_t{15} : std::max<std::size_t>(capacity, 1);
+
+    std::size_t offset = 0;
+    for (const ComponentInfo* info : components) {
+        archetype->column_offsets.push_back(offset);
+        offset = align_up(offset + info->size * capacity);
+    }
+    archetype->entity_offset  = offset;
+    archetype->chunk_bytes    = align_up(offset + sizeof(Entity) * capacity);
+    archetype->chunk_capacity = static_cast<uint32_t>(capacity);
+    archetype->components     = std::move(components);
+
+    uint32_t index = static_cast<uint32_t>(m_archetypes.size());
+    m_archetype_of.emplace(archetype->mask, index);
+    m_archetypes.push_back(std::move(archetype));
+    return index;
+}
+
+Entity World::create_entity() {
+    uint32_t index;
+    if (!m_free_records.empty()) {
+        index = m_free_records.back();
+        m_free_records.pop_back();
+    } else {
+        index = static_cast<uint32_t>(m_records.size());
+        m_records.emplace_back();
+    }
+    ++m_alive;
+    return {index, m_records[index].generation};
+}
+
+World::Location World::allocate(uint32_t archetype_index, Entity entity) {
+    Archetype& archetype = *m_archetypes[archetype_index];
+
+    if (archetype.chunks.empty() || archetype.chunks.back().count == archetype.chunk_capacity) {
+        Chunk chunk;
+        if (archetype.chunk_bytes <= CHUNK_BYTES) {
+            chunk.memory = {static_cast<std::byte*>(m_chunk_pool.allocate()), ChunkDeleter{&m_chunk_pool}};
+        } else {
+            chunk.memory.reset(
+                static_cast<std::byte*>(::operator new(archetype.chunk_bytes, std::align_val_t{SIMD_ALIGNMENT})));
+        }
+        archetype.chunks.push_back(std::move(chunk));
+    }
+
+    uint32_t chunk = static_cast<uint32_t>(archetype.chunks.size() - 1);
+    uint32_t row   = archetype.chunks[chunk].count++;
+
+    archetype.entities_of(chunk)[row] = entity;
+
+    Record& record   = m_records[entity.index];
+    record.archetype = archetype_index;
+    record.chunk     = chunk;
+    record.row       = row;
+    return {archetype_index, chunk, row};
+}
+
+void World::release(Location location, bool destroy_components) {
+    Archetype& archetype = *m_archetypes[location.archetype];
+
+    uint32_t last_chunk = static_cast<uint32_t>(archetype.chunks.size() - 1);
+    uint32_t last_row   = archetype.chunks[last_chunk].count - 1;
+    bool     is_last    = location.chunk == last_chunk && location.row == last_row;
+
+    for (std::size_t c = 0; c < archetype.components.size(); ++c) {
+        const ComponentInfo& info   = *archetype.components[c];
+        std::byte*           hole   = archetype.column(location.chunk, info.id) + location.row * info.size;
+        std::byte*           source = archetype.column(last_chunk, info.id) + last_row * info.size;
+
+        if (destroy_components && !info.trivial) {
+            info.destroy(hole);
+        }
+        if (!is_last) {
+            move_component(info, hole, source);
+        }
+    }
+
+    if (!is_last) {
+        Entity moved = archetype.entities_of(last_chunk)[last_row];
+        archetype.entities_of(location.chunk)[location.row] = moved;
+
+        m_records[moved.index].chunk = location.chunk;
+        m_records[moved.index].row   = location.row;
+    }
+
+    if (--archetype.chunks[last_chunk].count == 0) {
+        archetype.chunks.pop_back();
+    }
+}
+
+void World::destroy(Entity entity) {
+    Record& entry = const_cast<Record&>(record(entity));
+    release(entry.location(), true);
+
+    entry.archetype = NO_ARCHETYPE;
+    ++entry.generation;
+    m_free_records.push_back(entity.index);
+    --m_alive;
+}
+
+World::Location World::migrate(Entity entity, const ComponentInfo* added, std::size_t removed) {
+    Location from = record(entity).location();
+    uint32_t target_index;
+    {
+        Archetype&  source = *m_archetypes[from.archetype];
+        ComponentId edge   = added != nullptr ? added->id : static_cast<ComponentId>(removed);
+        auto&       edges  = added != nullptr ? source.with : source.without;
+
+        auto it = edges.find(edge);
+        if (it != edges.end()) {
+            target_index = it->second;
+        } else {
+            std::vector<const ComponentInfo*> components;
+            for (const ComponentInfo* info : source.components) {
+                if (info->id != removed) {
+                    components.push_back(info);
+                }
+            }
+            if (added != nullptr) {
+                components.push_back(added);
+            }
+            target_index = archetype_for(components);
+
+            // `archetype_for` may have grown `m_archetypes`, but archetypes themselves never move.
+            edges.emplace(edge, target_index);
+        }
+    }
+
+    Location   to     = allocate(target_index, entity);
+    Archetype& source = *m_archetypes[from.archetype];
+    Archetype& target = *m_archetypes[to.archetype];
+
+    for (const ComponentInfo* info : source.components) {
+        std::byte* component = source.column(from.chunk, info->id) + from.row * info->size;
+        if (target.mask.test(info->id)) {
+            move_component(*info, target.column(to.chunk, info->id) + to.row * info->size, component);
+        } else {
+            info->destroy(component);
+        }
+    }
+
+    // Every component of the old row was moved out or destroyed, and `allocate` already pointed the record at
+    // the new row, which `release` must not undo when it fills the hole with another entity.
+    release(from, false);
+    return to;
+}
+
+}  // namespace nbody
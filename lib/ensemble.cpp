@@ -0,0 +1,407 @@
+#include "ensemble.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "parallel.hpp"
+#include "trace.hpp"
+
+namespace nbody {
+
+namespace {
+    // Pairs a task should at least evaluate, so that systems of a few bodies are stepped many to a task.
+    constexpr std::size_t PAIR_GRAIN = 64 * 1024;
+
+    // Column order of `PackedGroup::columns`.
+    enum PackedColumn : std::size_t { X, Y, Z, MASS, AX, AY, AZ, PACKED_COLUMN_COUNT };
+
+    void kick(Bodies& bodies, std::size_t begin, std::size_t end, float dt) {
+        for (std::size_t i = begin; i < end; ++i) {
+            bodies.vx[i] += bodies.ax[i] * dt;
+            bodies.vy[i] += bodies.ay[i] * dt;
+            bodies.vz[i] += bodies.az[i] * dt;
+        }
+    }
+
+    void drift(Bodies& bodies, std::size_t begin, std::size_t end, float dt) {
+        for (std::size_t i = begin; i < end; ++i) {
+            bodies.x[i] += bodies.vx[i] * dt;
+            bodies.y[i] += bodies.vy[i] * dt;
+            bodies.z[i] += bodies.vz[i] * dt;
+        }
+    }
+}  // namespace
+
+std::string_view ensemble_status_name(EnsembleStatus status) noexcept {
+    switch (status) {
+        case EnsembleStatus::RUNNING:
+            return "running";
+        case EnsembleStatus::FINISHED:
+            return "finished";
+        case EnsembleStatus::ESCAPE:
+            return "escape";
+        case EnsembleStatus::ENCOUNTER:
+            return "encounter";
+    }
+    return "unknown";
+}
+
+Ensemble::Ensemble(const EnsembleConfig& config)
+    : m_config(config),
+      m_kernel(select_direct_sum_kernel(config.isa, Precision::FP32)),
+      m_packed_kernel(select_packed_systems_kernel(config.isa)) {}
+
+std::size_t Ensemble::add_system(const Bodies& bodies, const EnsembleSystemConfig& config) {
+    if (bodies.empty()) {
+        throw std::invalid_argument("Ensemble::add_system => a system needs at least one body.");
+    }
+
+    EnsembleSystem system{};
+    system.offset = m_bodies.size();
+    system.count  = bodies.size();
+    system.config = config;
+
+    for (std::size_t i = 0; i < bodies.size(); ++i) {
+        m_bodies.push_back(bodies.x[i], bodies.y[i], bodies.z[i], bodies.vx[i], bodies.vy[i], bodies.vz[i],
+                           bodies.mass[i]);
+    }
+
+    m_systems.push_back(system);
+    m_closest.emplace_back();
+    m_running.push_back(static_cast<uint32_t>(m_systems.size() - 1));
+    m_groups_dirty = true;
+    return m_systems.size() - 1;
+}
+
+bool Ensemble::needs_closest(const EnsembleSystem& system) const noexcept {
+    return system.config.encounter_distance > 0.0f || m_config.accuracy > 0.0f;
+}
+
+void Ensemble::compute_accelerations(std::size_t index) {
+    const EnsembleSystem& system = m_systems[index];
+
+    std::size_t begin = system.offset;
+    std::size_t end   = system.offset + system.count;
+    float       eps2  = m_config.softening * m_config.softening;
+
+    if (needs_closest(system)) {
+        // The scalar packed kernel with a single lane works on the columns in place, and evaluates each pair once
+        // for the forces and the closest pair alike.
+        ClosestPair&  closest = m_closest[index];
+        uint32_t      count   = static_cast<uint32_t>(system.count);
+        PackedSystems systems{m_bodies.x.data() + begin,
+                              m_bodies.y.data() + begin,
+                              m_bodies.z.data() + begin,
+                              m_bodies.mass.data() + begin,
+                              m_bodies.ax.data() + begin,
+                              m_bodies.ay.data() + begin,
+                              m_bodies.az.data() + begin,
+                              &count,
+                              1,
+                              system.count,
+                              &closest.distance2,
+                              &closest.pull};
+        packed_systems_scalar(systems, eps2);
+    } else {
+        std::fill(m_bodies.ax.begin() + begin, m_bodies.ax.begin() + end, 0.0f);
+        std::fill(m_bodies.ay.begin() + begin, m_bodies.ay.begin() + end, 0.0f);
+        std::fill(m_bodies.az.begin() + begin, m_bodies.az.begin() + end, 0.0f);
+
+        DirectSumTargets targets{m_bodies.x.data() + begin,  m_bodies.y.data() + begin,  m_bodies.z.data() + begin,
+                                 m_bodies.ax.data() + begin, m_bodies.ay.data() + begin, m_bodies.az.data() + begin,
+                                 system.count};
+        DirectSumSources sources{m_bodies.x.data() + begin, m_bodies.y.data() + begin, m_bodies.z.data() + begin,
+                                 m_bodies.mass.data() + begin, system.count};
+        m_kernel(targets, sources, eps2);
+    }
+
+    float g_const = m_config.gravitational_constant;
+    for (std::size_t i = begin; i < end; ++i) {
+        m_bodies.ax[i] *= g_const;
+        m_bodies.ay[i] *= g_const;
+        m_bodies.az[i] *= g_const;
+    }
+}
+
+void Ensemble::compute_accelerations(PackedGroup& group) {
+    std::size_t size = group.body_count * PACKED_LANES;
+    float*      x    = group.columns.data() + X * size;
+    float*      y    = group.columns.data() + Y * size;
+    float*      z    = group.columns.data() + Z * size;
+    float*      ax   = group.columns.data() + AX * size;
+    float*      ay   = group.columns.data() + AY * size;
+    float*      az   = group.columns.data() + AZ * size;
+
+    for (std::size_t lane = 0; lane < group.lanes; ++lane) {
+        const EnsembleSystem& system = m_systems[group.systems[lane]];
+        for (std::size_t i = 0; i < system.count; ++i) {
+            x[i * PACKED_LANES + lane] = m_bodies.x[system.offset + i];
+            y[i * PACKED_LANES + lane] = m_bodies.y[system.offset + i];
+            z[i * PACKED_LANES + lane] = m_bodies.z[system.offset + i];
+        }
+    }
+
+    PackedSystems systems{x,
+                          y,
+                          z,
+                          group.columns.data() + MASS * size,
+                          ax,
+                          ay,
+                          az,
+                          group.counts.data(),
+                          PACKED_LANES,
+                          group.body_count,
+                          group.min_distance2.data(),
+                          group.max_pull.data()};
+    m_packed_kernel(systems, m_config.softening * m_config.softening);
+
+    // Stopped systems keep the accelerations of their last step.
+    float g_const = m_config.gravitational_constant;
+    for (std::size_t lane = 0; lane < group.lanes; ++lane) {
+        const EnsembleSystem& system = m_systems[group.systems[lane]];
+        if (system.status != EnsembleStatus::RUNNING) {
+            continue;
+        }
+        for (std::size_t i = 0; i < system.count; ++i) {
+            m_bodies.ax[system.offset + i] = g_const * ax[i * PACKED_LANES + lane];
+            m_bodies.ay[system.offset + i] = g_const * ay[i * PACKED_LANES + lane];
+            m_bodies.az[system.offset + i] = g_const * az[i * PACKED_LANES + lane];
+        }
+        m_closest[group.systems[lane]] = {group.min_distance2[lane], group.max_pull[lane]};
+    }
+}
+
+double Ensemble::check_system(std::size_t index) {
+    EnsembleSystem&             system = m_systems[index];
+    const EnsembleSystemConfig& config = system.config;
+    const Bodies&               bodies = m_bodies;
+
+    std::size_t begin = system.offset;
+    std::size_t end   = system.offset + system.count;
+
+    if (system.time >= config.end_time) {
+        system.status = EnsembleStatus::FINISHED;
+        return 0.0;
+    }
+
+    if (config.escape_radius > 0.0f) {
+        double mass     = 0.0;
+        double center_x = 0.0;
+        double center_y = 0.0;
+        double center_z = 0.0;
+        for (std::size_t i = begin; i < end; ++i) {
+            mass += bodies.mass[i];
+            center_x += static_cast<double>(bodies.mass[i]) * bodies.x[i];
+            center_y += static_cast<double>(bodies.mass[i]) * bodies.y[i];
+            center_z += static_cast<double>(bodies.mass[i]) * bodies.z[i];
+        }
+        if (mass > 0.0) {
+            center_x /= mass;
+            center_y /= mass;
+            center_z /= mass;
+        }
+
+        double limit = static_cast<double>(config.escape_radius) * config.escape_radius;
+        for (std::size_t i = begin; i < end; ++i) {
+            double dx = bodies.x[i] - center_x;
+            double dy = bodies.y[i] - center_y;
+            double dz = bodies.z[i] - center_z;
+            if (dx * dx + dy * dy + dz * dz > limit) {
+                system.status = EnsembleStatus::ESCAPE;
+                return 0.0;
+            }
+        }
+    }
+
+    double timestep = std::min<double>(config.max_timestep, config.end_time - system.time);
+
+    // The force pass on the current positions found the closest pairs, the shortest free fall time is
+    // `1 / sqrt(G max (m + m') / r^3)`.
+    if (needs_closest(system)) {
+        const ClosestPair& closest  = m_closest[index];
+        float              distance = config.encounter_distance;
+        if (closest.distance2 < distance * distance) {
+            system.status = EnsembleStatus::ENCOUNTER;
+            return 0.0;
+        }
+        if (m_config.accuracy > 0.0f) {
+            // The kernels leave out pairs on top of each other without softening, which take no time to fall.
+            if (closest.distance2 + m_config.softening * m_config.softening == 0.0f) {
+                timestep = 0.0;
+            } else if (closest.pull > 0.0f) {
+                double pull = static_cast<double>(m_config.gravitational_constant) * closest.pull;
+                timestep    = std::min<double>(timestep, m_config.accuracy / std::sqrt(pull));
+            }
+        }
+    }
+
+    // Only pairs on top of each other get here, as above.
+    if (!(timestep > 0.0)) {
+        system.status = EnsembleStatus::ENCOUNTER;
+        return 0.0;
+    }
+    return timestep;
+}
+
+void Ensemble::step_system(std::size_t index) {
+    EnsembleSystem& system = m_systems[index];
+    if (system.steps == 0) {
+        compute_accelerations(index);
+    }
+
+    double timestep = check_system(index);
+    if (system.status != EnsembleStatus::RUNNING) {
+        return;
+    }
+
+    std::size_t begin = system.offset;
+    std::size_t end   = system.offset + system.count;
+    float       dt    = static_cast<float>(timestep);
+
+    kick(m_bodies, begin, end, 0.5f * dt);
+    drift(m_bodies, begin, end, dt);
+    compute_accelerations(index);
+    kick(m_bodies, begin, end, 0.5f * dt);
+
+    system.time += timestep;
+    ++system.steps;
+}
+
+void Ensemble::step_group(PackedGroup& group) {
+    bool fresh = false;
+    for (std::size_t lane = 0; lane < group.lanes; ++lane) {
+        fresh = fresh || m_systems[group.systems[lane]].steps == 0;
+    }
+    if (fresh) {
+        compute_accelerations(group);
+    }
+
+    // Zero for the lanes whose system stopped.
+    std::array<double, PACKED_LANES> timesteps{};
+    bool                             moved = false;
+    for (std::size_t lane = 0; lane < group.lanes; ++lane) {
+        const EnsembleSystem& system   = m_systems[group.systems[lane]];
+        double                timestep = check_system(group.systems[lane]);
+        if (system.status != EnsembleStatus::RUNNING) {
+            continue;
+        }
+        float dt = static_cast<float>(timestep);
+        kick(m_bodies, system.offset, system.offset + system.count, 0.5f * dt);
+        drift(m_bodies, system.offset, system.offset + system.count, dt);
+        timesteps[lane] = timestep;
+        moved           = true;
+    }
+    if (!moved) {
+        return;
+    }
+
+    compute_accelerations(group);
+    for (std::size_t lane = 0; lane < group.lanes; ++lane) {
+        EnsembleSystem& system = m_systems[group.systems[lane]];
+        if (timesteps[lane] > 0.0) {
+            kick(m_bodies, system.offset, system.offset + system.count, 0.5f * static_cast<float>(timesteps[lane]));
+            system.time += timesteps[lane];
+            ++system.steps;
+        }
+    }
+}
+
+void Ensemble::build_groups() {
+    m_groups.clear();
+    m_unpacked.clear();
+    m_unpacked_bodies = 0;
+
+    std::vector<uint32_t> packed;
+    for (uint32_t index : m_running) {
+        if (m_systems[index].count <= m_config.max_packed_bodies) {
+            packed.push_back(index);
+        } else {
+            m_unpacked.push_back(index);
+        }
+    }
+
+    // Neighbours in size share a group, so that few lanes idle past the end of their system.
+    std::stable_sort(packed.begin(), packed.end(),
+                     [&](uint32_t a, uint32_t b) { return m_systems[a].count < m_systems[b].count; });
+
+    for (std::size_t first = 0; first < packed.size(); first += PACKED_LANES) {
+        std::size_t lanes = std::min(PACKED_LANES, packed.size() - first);
+
+        // A group of a few systems would mostly evaluate empty lanes, they are faster one by one.
+        if (lanes < PACKED_LANES / 4) {
+            m_unpacked.insert(m_unpacked.end(), packed.begin() + first, packed.end());
+            break;
+        }
+
+        PackedGroup& group = m_groups.emplace_back();
+        group.lanes        = lanes;
+        group.body_count   = m_systems[packed[first + lanes - 1]].count;
+        group.columns.assign(PACKED_COLUMN_COUNT * group.body_count * PACKED_LANES, 0.0f);
+
+        float* mass = group.columns.data() + MASS * group.body_count * PACKED_LANES;
+        for (std::size_t lane = 0; lane < lanes; ++lane) {
+            const EnsembleSystem& system = m_systems[packed[first + lane]];
+            group.systems[lane]          = packed[first + lane];
+            group.counts[lane]           = static_cast<uint32_t>(system.count);
+            for (std::size_t i = 0; i < system.count; ++i) {
+                mass[i * PACKED_LANES + lane] = m_bodies.mass[system.offset + i];
+            }
+        }
+    }
+
+    for (uint32_t index : m_unpacked) {
+        m_unpacked_bodies += m_systems[index].count;
+    }
+    m_groups_dirty = false;
+}
+
+std::size_t Ensemble::step() {
+    NBODY_TRACE_ZONE("ensemble.step");
+
+    if (m_running.empty()) {
+        return 0;
+    }
+    if (m_groups_dirty) {
+        build_groups();
+    }
+
+    if (!m_groups.empty()) {
+        std::size_t bodies = 0;
+        for (const PackedGroup& group : m_groups) {
+            bodies += group.body_count;
+        }
+        std::size_t mean_count = (bodies + m_groups.size() - 1) / m_groups.size();
+        std::size_t grain      = std::max<std::size_t>(1, PAIR_GRAIN / (PACKED_LANES * mean_count * mean_count));
+        parallel_for(m_groups.size(), grain, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t k = begin; k < end; ++k) {
+                step_group(m_groups[k]);
+            }
+        });
+    }
+
+    if (!m_unpacked.empty()) {
+        std::size_t mean_count = (m_unpacked_bodies + m_unpacked.size() - 1) / m_unpacked.size();
+        std::size_t grain      = std::max<std::size_t>(1, PAIR_GRAIN / (mean_count * mean_count));
+        parallel_for(m_unpacked.size(), grain, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t k = begin; k < end; ++k) {
+                step_system(m_unpacked[k]);
+            }
+        });
+    }
+
+    std::size_t running = m_running.size();
+    std::erase_if(m_running, [&](uint32_t index) { return m_systems[index].status != EnsembleStatus::RUNNING; });
+    m_groups_dirty = m_running.size() != running;
+    return m_running.size();
+}
+
+std::size_t Ensemble::run(uint64_t max_steps) {
+    for (uint64_t step_index = 0; step_index < max_steps && !m_running.empty(); ++step_index) {
+        step();
+    }
+    return m_running.size();
+}
+
+}  // namespace nbody
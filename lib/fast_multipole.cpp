@@ -0,0 +1,546 @@
+#include "fast_multipole.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include "parallel.hpp"
+#include "trace.hpp"
+
+namespace nbody {
+
+namespace {
+    constexpr std::size_t NODE_GRAIN = 64;
+    constexpr std::size_t LEAF_GRAIN = 16;
+
+    constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+    double binomial(uint32_t n, uint32_t k) {
+        double result = 1.0;
+        for (uint32_t i = 1; i <= k; ++i) {
+            result = result * static_cast<double>(n - k + i) / static_cast<double>(i);
+        }
+        return result;
+    }
+
+    // Product of the binomials of every axis.
+    double binomial(const std::array<uint32_t, 3>& n, const std::array<uint32_t, 3>& k) {
+        return binomial(n[0], k[0]) * binomial(n[1], k[1]) * binomial(n[2], k[2]);
+    }
+
+    uint32_t degree(const std::array<uint32_t, 3>& n) { return n[0] + n[1] + n[2]; }
+
+    // `target[t] += sum coefficient * source[s] * factor[f]` over `terms`, which are sorted by their target so
+    // that each sum stays in a register.
+    void apply_terms(std::span<const FastMultipoleTerm> terms, const double* source, const double* factor,
+                     double* target) {
+        std::size_t i = 0;
+        while (i < terms.size()) {
+            uint32_t t   = terms[i].target;
+            double   sum = 0.0;
+            for (; i < terms.size() && terms[i].target == t; ++i) {
+                sum += terms[i].coefficient * source[terms[i].source] * factor[terms[i].factor];
+            }
+            target[t] += sum;
+        }
+    }
+
+    // Four independent partial sums, so the loop vectorizes without reassociation by the compiler.
+    double dot(const double* a, const double* b, std::size_t count) {
+        std::array<double, 4> sums = {0.0, 0.0, 0.0, 0.0};
+
+        std::size_t j = 0;
+        for (; j + 4 <= count; j += 4) {
+            for (std::size_t lane = 0; lane < 4; ++lane) {
+                sums[lane] += a[j + lane] * b[j + lane];
+            }
+        }
+        for (; j < count; ++j) {
+            sums[0] += a[j] * b[j];
+        }
+        return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    }
+
+    // Distance from a node's expansion center to the farthest corner of its bounds.
+    float node_radius(const OctreeNode& node) {
+        float dx = std::max(node.com_x - node.min_x, node.max_x - node.com_x);
+        float dy = std::max(node.com_y - node.min_y, node.max_y - node.com_y);
+        float dz = std::max(node.com_z - node.min_z, node.max_z - node.com_z);
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+}  // namespace
+
+FastMultipole::FastMultipole(const FastMultipoleConfig& config)
+    : m_config(config), m_kernel(select_direct_sum_kernel(config.isa, config.precision)) {
+    if (m_config.expansion_order > MAX_EXPANSION_ORDER) {
+        throw std::invalid_argument("FastMultipole::FastMultipole => expansion order " +
+                                    std::to_string(m_config.expansion_order) + " is above the maximum of " +
+                                    std::to_string(MAX_EXPANSION_ORDER));
+    }
+    // The force is the gradient of the potential, order 0 would leave nothing of it.
+    m_config.expansion_order = std::max<uint32_t>(1, m_config.expansion_order);
+
+    build_tables();
+}
+
+void FastMultipole::build_tables() {
+    uint32_t order = m_config.expansion_order;
+    uint32_t side  = order + 1;
+
+    auto index_of = [&](uint32_t x, uint32_t y, uint32_t z) { return m_index_of[(x * side + y) * side + z]; };
+
+    // Multi-indices in degree order, so every lower degree coefficient precedes the ones built from it.
+    m_index_of.assign(side * side * side, NO_INDEX);
+    for (uint32_t d = 0; d <= order; ++d) {
+        for (uint32_t x = d + 1; x-- > 0;) {
+            for (uint32_t y = d - x + 1; y-- > 0;) {
+                uint32_t z                             = d - x - y;
+                m_index_of[(x * side + y) * side + z] = static_cast<uint32_t>(m_indices.size());
+                m_indices.push_back({x, y, z});
+            }
+        }
+    }
+    m_coefficient_count = m_indices.size();
+
+    for (uint32_t t = 0; t < m_coefficient_count; ++t) {
+        const auto& n = m_indices[t];
+
+        // Filled in once the zero row index is known.
+        Recurrence recurrence{};
+        for (uint32_t axis = 0; axis < 3; ++axis) {
+            auto once  = n;
+            auto twice = n;
+            once[axis] -= std::min<uint32_t>(n[axis], 1);
+            twice[axis] -= std::min<uint32_t>(n[axis], 2);
+            recurrence.once[axis]  = n[axis] >= 1 ? index_of(once[0], once[1], once[2]) : NO_INDEX;
+            recurrence.twice[axis] = n[axis] >= 2 ? index_of(twice[0], twice[1], twice[2]) : NO_INDEX;
+        }
+        if (t > 0) {
+            double d                 = static_cast<double>(degree(n));
+            recurrence.first_scale  = -(2.0 * d - 1.0) / d;
+            recurrence.second_scale = -(d - 1.0) / d;
+        }
+        m_recurrence.push_back(recurrence);
+
+        for (uint32_t s = 0; s < m_coefficient_count; ++s) {
+            const auto& k = m_indices[s];
+
+            // Multipole shift: M'_n = sum_{j <= n} C(n, j) M_j d^(n - j)
+            if (k[0] <= n[0] && k[1] <= n[1] && k[2] <= n[2]) {
+                uint32_t f = index_of(n[0] - k[0], n[1] - k[1], n[2] - k[2]);
+                m_multipole_shift_terms.push_back({t, s, f, binomial(n, k)});
+            }
+
+            // Local shift: L'_n = sum_{k >= n} C(k, n) L_k d^(k - n)
+            if (k[0] >= n[0] && k[1] >= n[1] && k[2] >= n[2]) {
+                uint32_t f = index_of(k[0] - n[0], k[1] - n[1], k[2] - n[2]);
+                m_local_shift_terms.push_back({t, s, f, binomial(k, n)});
+            }
+
+            // Multipole to local: L_n = sum_k (-1)^|k| C(n + k, k) M_k T_(n + k)
+            if (degree(n) + degree(k) <= order) {
+                uint32_t f    = index_of(n[0] + k[0], n[1] + k[1], n[2] + k[2]);
+                double   sign = degree(k) % 2 == 0 ? 1.0 : -1.0;
+                m_multipole_to_local_terms.push_back({t, s, f, sign * binomial({n[0] + k[0], n[1] + k[1],
+                                                                                 n[2] + k[2]}, k)});
+            }
+        }
+
+        // Gradient along `axis`: d/dh_axis sum_n L_n h^n = sum_n (n_axis + 1) L_(n + e_axis) h^n. The target is
+        // the monomial `h^n` the term multiplies.
+        if (degree(n) < order) {
+            for (uint32_t axis = 0; axis < 3; ++axis) {
+                auto raised = n;
+                raised[axis] += 1;
+                m_gradient_terms[axis].push_back({t, index_of(raised[0], raised[1], raised[2]), 0,
+                                                  static_cast<double>(raised[axis])});
+            }
+        }
+    }
+
+    auto zero_row = static_cast<uint32_t>(m_coefficient_count);
+    for (auto& recurrence : m_recurrence) {
+        for (uint32_t axis = 0; axis < 3; ++axis) {
+            recurrence.once[axis]  = recurrence.once[axis] == NO_INDEX ? zero_row : recurrence.once[axis];
+            recurrence.twice[axis] = recurrence.twice[axis] == NO_INDEX ? zero_row : recurrence.twice[axis];
+        }
+    }
+}
+
+void FastMultipole::powers(double dx, double dy, double dz, double* result) const {
+    std::array<double, MAX_EXPANSION_ORDER + 1> px;
+    std::array<double, MAX_EXPANSION_ORDER + 1> py;
+    std::array<double, MAX_EXPANSION_ORDER + 1> pz;
+
+    px[0] = py[0] = pz[0] = 1.0;
+    for (uint32_t i = 1; i <= m_config.expansion_order; ++i) {
+        px[i] = px[i - 1] * dx;
+        py[i] = py[i - 1] * dy;
+        pz[i] = pz[i - 1] * dz;
+    }
+
+    for (std::size_t i = 0; i < m_coefficient_count; ++i) {
+        const auto& n = m_indices[i];
+        result[i]     = px[n[0]] * py[n[1]] * pz[n[2]];
+    }
+}
+
+void FastMultipole::derivatives(std::size_t count, const double* rx, const double* ry, const double* rz,
+                                double* result) const {
+    double* zeros      = result + m_coefficient_count * count;
+    double* inverse_r2 = zeros + count;
+    std::fill(zeros, zeros + count, 0.0);
+
+    for (std::size_t j = 0; j < count; ++j) {
+        inverse_r2[j] = 1.0 / (rx[j] * rx[j] + ry[j] * ry[j] + rz[j] * rz[j]);
+        result[j]     = std::sqrt(inverse_r2[j]);
+    }
+
+    // Every row only depends on rows of lower degree, and each row is one loop over the points that the
+    // compiler can vectorize.
+    for (std::size_t t = 1; t < m_coefficient_count; ++t) {
+        const Recurrence& recurrence = m_recurrence[t];
+
+        const double* x1 = result + recurrence.once[0] * count;
+        const double* y1 = result + recurrence.once[1] * count;
+        const double* z1 = result + recurrence.once[2] * count;
+        const double* x2 = result + recurrence.twice[0] * count;
+        const double* y2 = result + recurrence.twice[1] * count;
+        const double* z2 = result + recurrence.twice[2] * count;
+        double*       row = result + t * count;
+
+        for (std::size_t j = 0; j < count; ++j) {
+            double first  = rx[j] * x1[j] + ry[j] * y1[j] + rz[j] * z1[j];
+            double second = x2[j] + y2[j] + z2[j];
+            row[j] = (recurrence.first_scale * first + recurrence.second_scale * second) * inverse_r2[j];
+        }
+    }
+}
+
+void FastMultipole::compute_accelerations(Bodies& bodies) {
+    bodies.ax.resize(bodies.size());
+    bodies.ay.resize(bodies.size());
+    bodies.az.resize(bodies.size());
+
+    m_tree.build(bodies, m_config.leaf_size, m_config.precision != Precision::FP32);
+    if (m_tree.empty()) {
+        return;
+    }
+
+    m_arenas.for_each([](Arena& arena) { arena.reset(); });
+
+    std::size_t node_count = m_tree.nodes().size();
+    m_multipoles.assign(node_count * m_coefficient_count, 0.0);
+    m_locals.assign(node_count * m_coefficient_count, 0.0);
+    m_radii.resize(node_count);
+    m_candidates.resize(node_count);
+    m_far_lists.resize(node_count);
+    m_near_lists.resize(node_count);
+
+    upward_pass();
+    build_interaction_lists();
+    multipole_to_local();
+    downward_pass();
+    evaluate(bodies);
+}
+
+void FastMultipole::upward_pass() {
+    NBODY_TRACE_ZONE("fmm.upward_pass");
+
+    const auto& nodes   = m_tree.nodes();
+    const auto  offsets = m_tree.level_offsets();
+    const auto  xs      = m_tree.x();
+    const auto  ys      = m_tree.y();
+    const auto  zs      = m_tree.z();
+    const auto  masses  = m_tree.mass();
+
+    // Bottom up, children are final before their parents gather them.
+    for (std::size_t depth = offsets.size() - 1; depth-- > 0;) {
+        uint32_t level_begin = offsets[depth];
+
+        parallel_for(offsets[depth + 1] - level_begin, NODE_GRAIN, [&](std::size_t begin, std::size_t end) {
+            Arena&            arena = m_arenas.local();
+            ArenaScope        scope(arena);
+            std::span<double> monomials = arena.allocate_array<double>(m_coefficient_count);
+
+            for (std::size_t i = begin; i < end; ++i) {
+                uint32_t          index = level_begin + static_cast<uint32_t>(i);
+                const OctreeNode& node  = nodes[index];
+                double*           m     = multipole(index);
+
+                m_radii[index] = node_radius(node);
+
+                if (node.is_leaf()) {
+                    for (uint32_t b = node.body_begin; b < node.body_end; ++b) {
+                        powers(xs[b] - node.com_x, ys[b] - node.com_y, zs[b] - node.com_z, monomials.data());
+                        for (std::size_t t = 0; t < m_coefficient_count; ++t) {
+                            m[t] += masses[b] * monomials[t];
+                        }
+                    }
+                    continue;
+                }
+
+                for (uint32_t c = node.first_child; c < node.first_child + node.child_count; ++c) {
+                    const OctreeNode& child = nodes[c];
+                    const double*     mc    = multipole(c);
+
+                    powers(child.com_x - node.com_x, child.com_y - node.com_y, child.com_z - node.com_z,
+                           monomials.data());
+                    apply_terms(m_multipole_shift_terms, mc, monomials.data(), m);
+                }
+            }
+        });
+    }
+}
+
+void FastMultipole::build_interaction_lists() {
+    NBODY_TRACE_ZONE("fmm.interaction_lists");
+
+    const auto& nodes   = m_tree.nodes();
+    const auto  offsets = m_tree.level_offsets();
+    float       theta2  = m_config.theta * m_config.theta;
+
+    auto well_separated = [&](uint32_t a, uint32_t b) {
+        float dx = nodes[a].com_x - nodes[b].com_x;
+        float dy = nodes[a].com_y - nodes[b].com_y;
+        float dz = nodes[a].com_z - nodes[b].com_z;
+        float r  = m_radii[a] + m_radii[b];
+        return r * r < theta2 * (dx * dx + dy * dy + dz * dz);
+    };
+
+    std::span<uint32_t> root   = m_arenas.local().allocate_array<uint32_t>(1);
+    root[0]                    = Octree::ROOT;
+    m_candidates[Octree::ROOT] = root;
+
+    // Top down. A target node resolves the source nodes its parent handed down: well separated ones go to its
+    // far list, the rest are split until they are either separated or leaves. An inner target hands leaves and
+    // sources smaller than itself down to its children instead of splitting them.
+    for (std::size_t depth = 0; depth + 1 < offsets.size(); ++depth) {
+        uint32_t level_begin = offsets[depth];
+
+        parallel_for(offsets[depth + 1] - level_begin, NODE_GRAIN, [&](std::size_t begin, std::size_t end) {
+            Arena&                 arena       = m_arenas.local();
+            Scratch&               scratch     = m_scratch.local();
+            std::vector<uint32_t>& stack       = scratch.stack;
+            std::vector<uint32_t>& handed_down = scratch.handed_down;
+            std::vector<uint32_t>& far         = scratch.far;
+            std::vector<uint32_t>& near        = scratch.near;
+
+            for (std::size_t i = begin; i < end; ++i) {
+                uint32_t          a      = level_begin + static_cast<uint32_t>(i);
+                const OctreeNode& target = nodes[a];
+
+                stack.assign(m_candidates[a].begin(), m_candidates[a].end());
+                far.clear();
+                near.clear();
+                handed_down.clear();
+
+                while (!stack.empty()) {
+                    uint32_t          b      = stack.back();
+                    const OctreeNode& source = nodes[b];
+                    stack.pop_back();
+
+                    if (well_separated(a, b)) {
+                        far.push_back(b);
+                    } else if (target.is_leaf() && source.is_leaf()) {
+                        near.push_back(b);
+                    } else if (!target.is_leaf() && (source.is_leaf() || m_radii[b] <= m_radii[a])) {
+                        handed_down.push_back(b);
+                    } else {
+                        for (uint32_t c = source.first_child; c < source.first_child + source.child_count; ++c) {
+                            stack.push_back(c);
+                        }
+                    }
+                }
+
+                m_far_lists[a]  = arena.copy<uint32_t>(far);
+                m_near_lists[a] = arena.copy<uint32_t>(near);
+
+                // The children only read what is handed down, so they share one copy.
+                std::span<const uint32_t> shared = arena.copy<uint32_t>(handed_down);
+                for (uint32_t c = target.first_child; c < target.first_child + target.child_count; ++c) {
+                    m_candidates[c] = shared;
+                }
+            }
+        });
+    }
+}
+
+void FastMultipole::multipole_to_local() {
+    NBODY_TRACE_ZONE("fmm.multipole_to_local");
+
+    const auto& nodes = m_tree.nodes();
+
+    // All sources of a target are translated together. Their multipoles and derivatives are laid out as one row
+    // per coefficient, so every translation term becomes a dot product over the sources.
+    parallel_for(nodes.size(), NODE_GRAIN, [&](std::size_t begin, std::size_t end) {
+        Arena& arena = m_arenas.local();
+
+        for (std::size_t a = begin; a < end; ++a) {
+            const auto& far   = m_far_lists[a];
+            std::size_t count = far.size();
+            if (count == 0) {
+                continue;
+            }
+
+            ArenaScope        scope(arena);
+            std::span<double> rx         = arena.allocate_array<double>(count);
+            std::span<double> ry         = arena.allocate_array<double>(count);
+            std::span<double> rz         = arena.allocate_array<double>(count);
+            std::span<double> gathered   = arena.allocate_array<double>(m_coefficient_count * count);
+            std::span<double> derivative = arena.allocate_array<double>((m_coefficient_count + 2) * count);
+
+            for (std::size_t j = 0; j < count; ++j) {
+                uint32_t b = far[j];
+                rx[j]      = static_cast<double>(nodes[a].com_x) - nodes[b].com_x;
+                ry[j]      = static_cast<double>(nodes[a].com_y) - nodes[b].com_y;
+                rz[j]      = static_cast<double>(nodes[a].com_z) - nodes[b].com_z;
+
+                const double* m = multipole(b);
+                for (std::size_t k = 0; k < m_coefficient_count; ++k) {
+                    gathered[k * count + j] = m[k];
+                }
+            }
+
+            derivatives(count, rx.data(), ry.data(), rz.data(), derivative.data());
+
+            double* l = local(static_cast<uint32_t>(a));
+            for (const auto& term : m_multipole_to_local_terms) {
+                l[term.target] += term.coefficient * dot(gathered.data() + term.source * count,
+                                                         derivative.data() + term.factor * count, count);
+            }
+        }
+    });
+}
+
+void FastMultipole::downward_pass() {
+    NBODY_TRACE_ZONE("fmm.downward_pass");
+
+    const auto& nodes   = m_tree.nodes();
+    const auto  offsets = m_tree.level_offsets();
+
+    // Top down, a parent's local expansion is complete before it is shifted into its children.
+    for (std::size_t depth = 1; depth + 1 < offsets.size(); ++depth) {
+        uint32_t level_begin = offsets[depth];
+
+        parallel_for(offsets[depth + 1] - level_begin, NODE_GRAIN, [&](std::size_t begin, std::size_t end) {
+            Arena&            arena = m_arenas.local();
+            ArenaScope        scope(arena);
+            std::span<double> monomials = arena.allocate_array<double>(m_coefficient_count);
+
+            for (std::size_t i = begin; i < end; ++i) {
+                uint32_t          index  = level_begin + static_cast<uint32_t>(i);
+                const OctreeNode& node   = nodes[index];
+                const OctreeNode& parent = nodes[node.parent];
+                const double*     lp     = local(node.parent);
+                double*           l      = local(index);
+
+                powers(node.com_x - parent.com_x, node.com_y - parent.com_y, node.com_z - parent.com_z,
+                       monomials.data());
+                apply_terms(m_local_shift_terms, lp, monomials.data(), l);
+            }
+        });
+    }
+}
+
+void FastMultipole::evaluate(Bodies& bodies) {
+    NBODY_TRACE_ZONE("fmm.evaluate");
+
+    const auto& nodes   = m_tree.nodes();
+    const auto  order   = m_tree.order();
+    const auto  xs      = m_tree.x();
+    const auto  ys      = m_tree.y();
+    const auto  zs      = m_tree.z();
+    const auto  masses  = m_tree.mass();
+    const auto  xs_lo   = m_tree.x_lo();
+    const auto  ys_lo   = m_tree.y_lo();
+    const auto  zs_lo   = m_tree.z_lo();
+    bool        low     = !xs_lo.empty();
+    bool        rebase  = m_config.precision == Precision::RELATIVE;
+    float       eps2    = m_config.softening * m_config.softening;
+    float       g_const = m_config.gravitational_constant;
+
+    m_leaves.clear();
+    for (uint32_t index = 0; index < nodes.size(); ++index) {
+        if (nodes[index].is_leaf()) {
+            m_leaves.push_back(index);
+        }
+    }
+
+    parallel_for(m_leaves.size(), LEAF_GRAIN, [&](std::size_t begin, std::size_t end) {
+        Arena&            arena     = m_arenas.local();
+        ArenaScope        scope(arena);
+        std::span<double> monomials = arena.allocate_array<double>(m_coefficient_count);
+        InteractionList&  list      = m_scratch.local().near_field;
+
+        for (std::size_t leaf_index = begin; leaf_index < end; ++leaf_index) {
+            uint32_t          leaf  = m_leaves[leaf_index];
+            const OctreeNode& node  = nodes[leaf];
+            const double*     l     = local(leaf);
+            std::size_t       count = node.body_end - node.body_begin;
+
+            // Near field, the kernel's zero distance rule drops the self interactions.
+            list.clear();
+            for (uint32_t source : m_near_lists[leaf]) {
+                for (uint32_t b = nodes[source].body_begin; b < nodes[source].body_end; ++b) {
+                    if (low) {
+                        list.push_back(xs[b], ys[b], zs[b], masses[b], xs_lo[b], ys_lo[b], zs_lo[b]);
+                    } else {
+                        list.push_back(xs[b], ys[b], zs[b], masses[b]);
+                    }
+                }
+            }
+
+            ArenaScope       leaf_scope(arena);
+            std::span<float> ax = arena.allocate_array<float>(count);
+            std::span<float> ay = arena.allocate_array<float>(count);
+            std::span<float> az = arena.allocate_array<float>(count);
+            std::fill(ax.begin(), ax.end(), 0.0f);
+            std::fill(ay.begin(), ay.end(), 0.0f);
+            std::fill(az.begin(), az.end(), 0.0f);
+
+            DirectSumTargets targets{xs.data() + node.body_begin, ys.data() + node.body_begin,
+                                     zs.data() + node.body_begin, ax.data(), ay.data(), az.data(), count};
+            if (low) {
+                targets.x_lo = xs_lo.data() + node.body_begin;
+                targets.y_lo = ys_lo.data() + node.body_begin;
+                targets.z_lo = zs_lo.data() + node.body_begin;
+            }
+
+            // Offsets from the leaf's center of mass are small, so single precision resolves them finely.
+            if (rebase) {
+                std::span<float> tx = arena.allocate_array<float>(count);
+                std::span<float> ty = arena.allocate_array<float>(count);
+                std::span<float> tz = arena.allocate_array<float>(count);
+                rebase_coordinates(targets.x, targets.x_lo, node.com_x, count, tx.data());
+                rebase_coordinates(targets.y, targets.y_lo, node.com_y, count, ty.data());
+                rebase_coordinates(targets.z, targets.z_lo, node.com_z, count, tz.data());
+                targets = {tx.data(), ty.data(), tz.data(), ax.data(), ay.data(), az.data(), count};
+                list.rebase(node.com_x, node.com_y, node.com_z);
+            }
+            m_kernel(targets, list.sources(), eps2);
+
+            // Far field from the leaf's local expansion.
+            for (std::size_t i = 0; i < count; ++i) {
+                uint32_t b = node.body_begin + static_cast<uint32_t>(i);
+                powers(xs[b] - node.com_x, ys[b] - node.com_y, zs[b] - node.com_z, monomials.data());
+
+                std::array<double, 3> gradient = {0.0, 0.0, 0.0};
+                for (uint32_t axis = 0; axis < 3; ++axis) {
+                    for (const auto& term : m_gradient_terms[axis]) {
+                        gradient[axis] += term.coefficient * l[term.source] * monomials[term.target];
+                    }
+                }
+
+                uint32_t index   = order[b];
+                bodies.ax[index] = g_const * (ax[i] + static_cast<float>(gradient[0]));
+                bodies.ay[index] = g_const * (ay[i] + static_cast<float>(gradient[1]));
+                bodies.az[index] = g_const * (az[i] + static_cast<float>(gradient[2]));
+            }
+        }
+    });
+}
+
+}  // namespace nbody
@@ -0,0 +1,250 @@
+#include "gpu_lod.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include "shader_library.hpp"
+
+namespace nbody {
+
+namespace {
+
+constexpr const char* SHADER_PATH = "shaders/lod_cull.comp.spv";
+
+// Bindings of the set of shaders/lod_cull.comp.
+enum Binding : uint32_t {
+    NODES_BINDING,
+    INSTANCES_BINDING,
+    DRAW_BINDING,
+    BINDING_COUNT,
+};
+
+void pass_barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags source_stages,
+                  VkPipelineStageFlags destination_stages) {
+    VkMemoryBarrier barrier{};
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer, source_stages, destination_stages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+}  // namespace
+
+void GpuLod::create(GpuAllocator& allocator, VkPipelineCache cache, const GpuBarnesHut& tree, uint32_t frame_count,
+                    const GpuLodConfig& config, const std::vector<uint32_t>& queue_families) {
+    if (tree.body_count() == 0 || frame_count == 0 || config.max_instances == 0) {
+        throw std::runtime_error("GpuLod::create => needs a tree, a frame slot and room for an instance!");
+    }
+
+    m_allocator  = &allocator;
+    m_device     = allocator.device();
+    m_body_count = tree.body_count();
+    m_config     = config;
+    m_frames.resize(frame_count);
+
+    // One invocation per node at most, the rest loop over the nodes the dispatch does not cover.
+    uint32_t node_count = 2 * m_body_count - 1;
+    m_group_count       = std::min((node_count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+                                   allocator.limits().maxComputeWorkGroupCount[0]);
+
+    try {
+        create_buffers(queue_families);
+        create_descriptor_sets(tree);
+        create_pipeline(cache);
+    } catch (...) {
+        destroy();
+        throw;
+    }
+}
+
+void GpuLod::destroy() noexcept {
+    if (m_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipeline_layout, nullptr);
+    vkDestroyDescriptorPool(m_device, m_descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_set_layout, nullptr);
+    m_pipeline        = VK_NULL_HANDLE;
+    m_pipeline_layout = VK_NULL_HANDLE;
+    m_descriptor_pool = VK_NULL_HANDLE;
+    m_set_layout      = VK_NULL_HANDLE;
+
+    for (Frame& frame : m_frames) {
+        m_allocator->destroy_buffer(frame.instance_buffer, frame.instance_buffer_allocation);
+        m_allocator->destroy_buffer(frame.draw_buffer, frame.draw_buffer_allocation);
+    }
+    m_frames.clear();
+
+    m_allocator  = nullptr;
+    m_device     = VK_NULL_HANDLE;
+    m_body_count = 0;
+}
+
+void GpuLod::create_buffers(const std::vector<uint32_t>& queue_families) {
+    // Every body is drawn at most once, alone or in an impostor.
+    m_instance_buffer_size = std::min(m_body_count, m_config.max_instances) * INSTANCE_SIZE;
+
+    for (Frame& frame : m_frames) {
+        frame.instance_buffer =
+            m_allocator->create_buffer(m_instance_buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                       MemoryUsage::DEVICE_LOCAL, frame.instance_buffer_allocation, queue_families);
+        frame.draw_buffer = m_allocator->create_buffer(
+            sizeof(VkDrawIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            MemoryUsage::DEVICE_LOCAL, frame.draw_buffer_allocation, queue_families);
+    }
+}
+
+void GpuLod::create_descriptor_sets(const GpuBarnesHut& tree) {
+    std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings{};
+    for (uint32_t i = 0; i < BINDING_COUNT; ++i) {
+        bindings[i].binding         = i;
+        bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings    = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(m_device, &layout_info, nullptr, &m_set_layout) != VK_SUCCESS) {
+        throw std::runtime_error("GpuLod::create_descriptor_sets => failed to create descriptor set layout!");
+    }
+
+    uint32_t frame_count = static_cast<uint32_t>(m_frames.size());
+
+    VkDescriptorPoolSize pool_size{};
+    pool_size.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = BINDING_COUNT * frame_count;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes    = &pool_size;
+    pool_info.maxSets       = frame_count;
+
+    if (vkCreateDescriptorPool(m_device, &pool_info, nullptr, &m_descriptor_pool) != VK_SUCCESS) {
+        throw std::runtime_error("GpuLod::create_descriptor_sets => failed to create descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frame_count, m_set_layout);
+    std::vector<VkDescriptorSet>       sets(frame_count);
+
+    VkDescriptorSetAllocateInfo allocate_info{};
+    allocate_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.descriptorPool     = m_descriptor_pool;
+    allocate_info.descriptorSetCount = frame_count;
+    allocate_info.pSetLayouts        = layouts.data();
+
+    if (vkAllocateDescriptorSets(m_device, &allocate_info, sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("GpuLod::create_descriptor_sets => failed to allocate descriptor sets!");
+    }
+
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        Frame& frame = m_frames[i];
+        frame.set    = sets[i];
+
+        std::array<VkDescriptorBufferInfo, BINDING_COUNT> buffer_infos = {{
+            {tree.node_buffer(), 0, tree.node_buffer_size()},
+            {frame.instance_buffer, 0, m_instance_buffer_size},
+            {frame.draw_buffer, 0, sizeof(VkDrawIndirectCommand)},
+        }};
+
+        std::array<VkWriteDescriptorSet, BINDING_COUNT> writes{};
+        for (uint32_t binding = 0; binding < BINDING_COUNT; ++binding) {
+            writes[binding].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet          = frame.set;
+            writes[binding].dstBinding      = binding;
+            writes[binding].descriptorCount = 1;
+            writes[binding].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[binding].pBufferInfo     = &buffer_infos[binding];
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+void GpuLod::create_pipeline(VkPipelineCache cache) {
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset     = 0;
+    push_constant_range.size       = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount         = 1;
+    pipeline_layout_info.pSetLayouts            = &m_set_layout;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges    = &push_constant_range;
+
+    if (vkCreatePipelineLayout(m_device, &pipeline_layout_info, nullptr, &m_pipeline_layout) != VK_SUCCESS) {
+        throw std::runtime_error("GpuLod::create_pipeline => failed to create pipeline layout!");
+    }
+
+    std::vector<uint32_t>     storage;
+    std::span<const uint32_t> code = load_shader(SHADER_PATH, storage);
+
+    VkShaderModuleCreateInfo module_create_info{};
+    module_create_info.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_create_info.codeSize = code.size_bytes();
+    module_create_info.pCode    = code.data();
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(m_device, &module_create_info, nullptr, &shader_module) != VK_SUCCESS) {
+        throw std::runtime_error(std::string("GpuLod::create_pipeline => failed to create shader module ") +
+                                 SHADER_PATH);
+    }
+
+    VkComputePipelineCreateInfo pipeline_create_info{};
+    pipeline_create_info.sType              = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_create_info.stage.sType        = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_create_info.stage.stage        = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_create_info.stage.module       = shader_module;
+    pipeline_create_info.stage.pName        = "main";
+    pipeline_create_info.layout             = m_pipeline_layout;
+    pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_create_info.basePipelineIndex  = -1;
+
+    VkResult result = vkCreateComputePipelines(m_device, cache, 1, &pipeline_create_info, nullptr, &m_pipeline);
+    vkDestroyShaderModule(m_device, shader_module, nullptr);
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error(std::string("GpuLod::create_pipeline => failed to create pipeline for ") +
+                                 SHADER_PATH);
+    }
+}
+
+void GpuLod::record_cull(VkCommandBuffer command_buffer, uint32_t frame, const GpuLodView& view) const {
+    const Frame& resources = m_frames[frame];
+
+    // The step wrote the nodes, and clearing the count waits for nothing else: the previous use of the slot was
+    // done drawing before its fence signaled.
+    pass_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    VkDrawIndirectCommand draw{};
+    draw.vertexCount = 4;
+    vkCmdUpdateBuffer(command_buffer, resources.draw_buffer, 0, sizeof(draw), &draw);
+    pass_barrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    PushConstants push_constants{};
+    push_constants.view_projection = view.view_projection;
+    push_constants.sprite_size     = view.sprite_size;
+    push_constants.detail_scale    = view.focal_pixels / m_config.detail_pixels;
+    push_constants.body_count      = m_body_count;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline_layout, 0, 1, &resources.set,
+                            0, nullptr);
+    vkCmdPushConstants(command_buffer, m_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants),
+                       &push_constants);
+    vkCmdDispatch(command_buffer, m_group_count, 1, 1);
+}
+
+}  // namespace nbody
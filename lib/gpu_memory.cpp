@@ -0,0 +1,311 @@
+#include "gpu_memory.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+namespace nbody {
+
+namespace {
+
+VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+void GpuAllocator::create(VkDevice device, VkPhysicalDevice physical_device, VkDeviceSize block_size) {
+    m_device     = device;
+    m_block_size = block_size;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    m_limits = properties.limits;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &m_memory_properties);
+}
+
+void GpuAllocator::destroy() noexcept {
+    std::lock_guard lock(m_mutex);
+    for (Block& block : m_blocks) {
+        destroy_block(block);
+    }
+    m_blocks.clear();
+    m_device = VK_NULL_HANDLE;
+}
+
+uint32_t GpuAllocator::find_memory_type(uint32_t type_bits, MemoryUsage usage) const {
+    VkMemoryPropertyFlags required  = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    VkMemoryPropertyFlags preferred = 0;
+    if (usage == MemoryUsage::DEVICE_LOCAL) {
+        required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    } else if (usage == MemoryUsage::HOST_READBACK) {
+        preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    }
+
+    for (VkMemoryPropertyFlags properties : {required | preferred, required}) {
+        for (uint32_t i = 0; i < m_memory_properties.memoryTypeCount; ++i) {
+            if ((type_bits & (1u << i)) &&
+                (m_memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+    }
+
+    throw std::runtime_error("GpuAllocator::find_memory_type => failed to find a suitable memory type!");
+}
+
+GpuAllocation GpuAllocator::allocate(const VkMemoryRequirements& requirements, MemoryUsage usage) {
+    uint32_t     memory_type = find_memory_type(requirements.memoryTypeBits, usage);
+    VkDeviceSize alignment   = std::max<VkDeviceSize>(requirements.alignment, 1);
+
+    uint32_t     heap       = m_memory_properties.memoryTypes[memory_type].heapIndex;
+    VkDeviceSize block_size = std::min(m_block_size, m_memory_properties.memoryHeaps[heap].size / 8);
+
+    std::lock_guard lock(m_mutex);
+
+    uint32_t     index  = static_cast<uint32_t>(m_blocks.size());
+    VkDeviceSize offset = 0;
+    if (requirements.size > block_size / 2) {
+        index = create_block(memory_type, requirements.size, true);
+        suballocate(m_blocks[index], requirements.size, alignment, offset);
+    } else {
+        for (uint32_t i = 0; i < m_blocks.size() && index == m_blocks.size(); ++i) {
+            Block& block = m_blocks[i];
+            if (block.memory != VK_NULL_HANDLE && block.memory_type == memory_type && !block.dedicated &&
+                suballocate(block, requirements.size, alignment, offset)) {
+                index = i;
+            }
+        }
+        if (index == m_blocks.size()) {
+            index = create_block(memory_type, block_size, false);
+            suballocate(m_blocks[index], requirements.size, alignment, offset);
+        }
+    }
+
+    Block& block = m_blocks[index];
+    ++block.allocation_count;
+
+    GpuAllocation allocation{};
+    allocation.memory  = block.memory;
+    allocation.offset  = offset;
+    allocation.size    = requirements.size;
+    allocation.mapped  = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+    allocation.m_block = index;
+    return allocation;
+}
+
+void GpuAllocator::free(GpuAllocation& allocation) noexcept {
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::lock_guard lock(m_mutex);
+
+    Block&       block = m_blocks[allocation.m_block];
+    VkDeviceSize begin = allocation.offset;
+    VkDeviceSize end   = allocation.offset + allocation.size;
+
+    auto next = block.free_ranges.lower_bound(begin);
+    if (next != block.free_ranges.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == begin) {
+            begin = previous->first;
+            block.free_ranges.erase(previous);
+        }
+    }
+    if (next != block.free_ranges.end() && next->first == end) {
+        end += next->second;
+        block.free_ranges.erase(next);
+    }
+    block.free_ranges[begin] = end - begin;
+
+    if (--block.allocation_count == 0 && block.dedicated) {
+        destroy_block(block);
+    }
+    allocation = {};
+}
+
+VkBuffer GpuAllocator::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memory_usage,
+                                     GpuAllocation& allocation, const std::vector<uint32_t>& queue_families) {
+    VkBufferCreateInfo buffer_create_info{};
+    buffer_create_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.size        = size;
+    buffer_create_info.usage       = usage;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (queue_families.size() > 1) {
+        buffer_create_info.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+        buffer_create_info.queueFamilyIndexCount = static_cast<uint32_t>(queue_families.size());
+        buffer_create_info.pQueueFamilyIndices   = queue_families.data();
+    }
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    if (vkCreateBuffer(m_device, &buffer_create_info, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("GpuAllocator::create_buffer => failed to create buffer!");
+    }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(m_device, buffer, &memory_requirements);
+
+    try {
+        allocation = allocate(memory_requirements, memory_usage);
+    } catch (...) {
+        vkDestroyBuffer(m_device, buffer, nullptr);
+        throw;
+    }
+
+    vkBindBufferMemory(m_device, buffer, allocation.memory, allocation.offset);
+    return buffer;
+}
+
+void GpuAllocator::destroy_buffer(VkBuffer& buffer, GpuAllocation& allocation) noexcept {
+    // Also before `create`, when there is no device to pass.
+    if (buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(m_device, buffer, nullptr);
+        buffer = VK_NULL_HANDLE;
+    }
+    free(allocation);
+}
+
+void GpuAllocator::trim() noexcept {
+    std::lock_guard lock(m_mutex);
+    for (Block& block : m_blocks) {
+        if (block.memory != VK_NULL_HANDLE && block.allocation_count == 0) {
+            destroy_block(block);
+        }
+    }
+}
+
+GpuAllocatorStats GpuAllocator::stats() const noexcept {
+    std::lock_guard lock(m_mutex);
+
+    GpuAllocatorStats stats{};
+    for (const Block& block : m_blocks) {
+        if (block.memory == VK_NULL_HANDLE) {
+            continue;
+        }
+
+        VkDeviceSize free_bytes = 0;
+        for (const auto& [offset, size] : block.free_ranges) {
+            free_bytes += size;
+        }
+
+        ++stats.block_count;
+        stats.allocation_count += block.allocation_count;
+        stats.reserved_bytes += block.size;
+        stats.used_bytes += block.size - free_bytes;
+    }
+    return stats;
+}
+
+uint32_t GpuAllocator::create_block(uint32_t memory_type, VkDeviceSize size, bool dedicated) {
+    VkMemoryAllocateInfo allocate_info{};
+    allocate_info.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize  = size;
+    allocate_info.memoryTypeIndex = memory_type;
+
+    Block block{};
+    if (vkAllocateMemory(m_device, &allocate_info, nullptr, &block.memory) != VK_SUCCESS) {
+        throw std::runtime_error("GpuAllocator::allocate => failed to allocate device memory!");
+    }
+
+    if (m_memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(m_device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped) != VK_SUCCESS) {
+            vkFreeMemory(m_device, block.memory, nullptr);
+            throw std::runtime_error("GpuAllocator::allocate => failed to map device memory!");
+        }
+    }
+
+    block.size        = size;
+    block.memory_type = memory_type;
+    block.dedicated   = dedicated;
+    block.free_ranges = {{0, size}};
+
+    auto slot = std::find_if(m_blocks.begin(), m_blocks.end(),
+                             [](const Block& candidate) { return candidate.memory == VK_NULL_HANDLE; });
+    if (slot == m_blocks.end()) {
+        m_blocks.push_back(std::move(block));
+        return static_cast<uint32_t>(m_blocks.size() - 1);
+    }
+    *slot = std::move(block);
+    return static_cast<uint32_t>(slot - m_blocks.begin());
+}
+
+void GpuAllocator::destroy_block(Block& block) noexcept {
+    // Freeing unmaps the block as well.
+    vkFreeMemory(m_device, block.memory, nullptr);
+    block = Block{};
+}
+
+bool GpuAllocator::suballocate(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+    auto best = block.free_ranges.end();
+    for (auto range = block.free_ranges.begin(); range != block.free_ranges.end(); ++range) {
+        VkDeviceSize padding = align_up(range->first, alignment) - range->first;
+        if (range->second >= padding && range->second - padding >= size &&
+            (best == block.free_ranges.end() || range->second < best->second)) {
+            best = range;
+        }
+    }
+    if (best == block.free_ranges.end()) {
+        return false;
+    }
+
+    VkDeviceSize range_begin = best->first;
+    VkDeviceSize range_end   = best->first + best->second;
+    block.free_ranges.erase(best);
+
+    offset = align_up(range_begin, alignment);
+    if (offset > range_begin) {
+        block.free_ranges[range_begin] = offset - range_begin;
+    }
+    if (offset + size < range_end) {
+        block.free_ranges[offset + size] = range_end - (offset + size);
+    }
+    return true;
+}
+
+void GpuRing::create(GpuAllocator& allocator, VkDeviceSize frame_size, uint32_t frame_count,
+                     VkBufferUsageFlags usage) {
+    const VkPhysicalDeviceLimits& limits = allocator.limits();
+
+    m_alignment = 1;
+    if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+        m_alignment = std::max(m_alignment, limits.minUniformBufferOffsetAlignment);
+    }
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+        m_alignment = std::max(m_alignment, limits.minStorageBufferOffsetAlignment);
+    }
+
+    // Every region starts aligned.
+    m_frame_size = align_up(frame_size, m_alignment);
+    m_buffer     = allocator.create_buffer(m_frame_size * frame_count, usage, MemoryUsage::HOST_UPLOAD, m_allocation);
+    m_allocator  = &allocator;
+    begin_frame(0);
+}
+
+void GpuRing::destroy() noexcept {
+    if (m_allocator == nullptr) {
+        return;
+    }
+
+    m_allocator->destroy_buffer(m_buffer, m_allocation);
+    m_allocator = nullptr;
+}
+
+void GpuRing::begin_frame(uint32_t frame) noexcept {
+    m_begin = m_frame_size * frame;
+    m_head  = m_begin;
+}
+
+GpuRingAllocation GpuRing::allocate(VkDeviceSize size) {
+    VkDeviceSize offset = align_up(m_head, m_alignment);
+    if (offset + size > m_begin + m_frame_size) {
+        throw std::runtime_error("GpuRing::allocate => the region of the frame is full!");
+    }
+
+    m_head = offset + size;
+    return {offset, static_cast<char*>(m_allocation.mapped) + offset};
+}
+
+}  // namespace nbody
@@ -0,0 +1,312 @@
+#include "gpu_tree.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "shader_library.hpp"
+
+namespace nbody {
+
+namespace {
+
+// Same order as `GpuBarnesHut::Pass`.
+constexpr const char* SHADER_PATHS[] = {
+    "shaders/bvh_bounds.comp.spv",
+    "shaders/bvh_morton.comp.spv",
+    "shaders/bvh_radix_histogram.comp.spv",
+    "shaders/bvh_radix_scan.comp.spv",
+    "shaders/bvh_radix_scatter.comp.spv",
+    "shaders/bvh_build.comp.spv",
+    "shaders/bvh_moments.comp.spv",
+    "shaders/bvh_traverse.comp.spv",
+};
+
+// Four passes of `RADIX_BITS` in shaders/bvh_common.glsl sort the 30 bit keys and leave them in the first half.
+constexpr uint32_t RADIX_BITS  = 8;
+constexpr uint32_t SORT_PASSES = 4;
+constexpr uint32_t RADIX       = 1u << RADIX_BITS;
+
+// `Node` of shaders/bvh_common.glsl: three vec4 and four ints.
+constexpr VkDeviceSize NODE_SIZE = 3 * 16 + 4 * 4;
+
+// Orders everything the passes do to the buffers: shader reads and writes and the fills.
+void pass_barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags source_stages,
+                  VkPipelineStageFlags destination_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) {
+    VkMemoryBarrier barrier{};
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer, source_stages, destination_stages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+uint32_t group_count(uint32_t items, uint32_t group_size) noexcept { return (items + group_size - 1) / group_size; }
+
+}  // namespace
+
+bool GpuBarnesHut::supported(VkPhysicalDevice physical_device) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_1) {
+        return false;
+    }
+
+    VkPhysicalDeviceSubgroupProperties subgroup_properties{};
+    subgroup_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &subgroup_properties;
+    vkGetPhysicalDeviceProperties2(physical_device, &properties2);
+
+    return (subgroup_properties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+           (subgroup_properties.supportedOperations & VK_SUBGROUP_FEATURE_VOTE_BIT);
+}
+
+void GpuBarnesHut::create(GpuAllocator& allocator, VkPhysicalDevice physical_device, VkPipelineCache cache,
+                          VkDescriptorSetLayout body_set_layout, uint32_t body_count,
+                          const GpuBarnesHutConfig& config) {
+    if (!supported(physical_device)) {
+        throw std::runtime_error(
+            "GpuBarnesHut::create => the device has no subgroup vote operations in compute shaders!");
+    }
+    if (body_count == 0) {
+        throw std::runtime_error("GpuBarnesHut::create => needs at least one body!");
+    }
+
+    m_allocator  = &allocator;
+    m_device     = allocator.device();
+    m_body_count = body_count;
+
+    m_push_constants.body_count             = body_count;
+    m_push_constants.block_count            = group_count(body_count, SORT_BLOCK);
+    m_push_constants.shift                  = 0;
+    m_push_constants.theta_squared          = config.theta * config.theta;
+    m_push_constants.timestep               = config.timestep;
+    m_push_constants.softening_squared      = config.softening * config.softening;
+    m_push_constants.gravitational_constant = config.gravitational_constant;
+
+    try {
+        create_buffers();
+        create_descriptor_set();
+        create_pipelines(cache, body_set_layout);
+    } catch (...) {
+        destroy();
+        throw;
+    }
+}
+
+void GpuBarnesHut::destroy() noexcept {
+    if (m_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    for (VkPipeline& pipeline : m_pipelines) {
+        vkDestroyPipeline(m_device, pipeline, nullptr);
+        pipeline = VK_NULL_HANDLE;
+    }
+    vkDestroyPipelineLayout(m_device, m_pipeline_layout, nullptr);
+    vkDestroyDescriptorPool(m_device, m_descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_tree_set_layout, nullptr);
+    m_pipeline_layout = VK_NULL_HANDLE;
+    m_descriptor_pool = VK_NULL_HANDLE;
+    m_tree_set_layout = VK_NULL_HANDLE;
+    m_tree_set        = VK_NULL_HANDLE;
+
+    for (std::size_t i = 0; i < BUFFER_COUNT; ++i) {
+        m_allocator->destroy_buffer(m_buffers[i], m_buffer_allocations[i]);
+    }
+
+    m_allocator  = nullptr;
+    m_device     = VK_NULL_HANDLE;
+    m_body_count = 0;
+}
+
+void GpuBarnesHut::create_buffers() {
+    VkDeviceSize bodies = m_body_count;
+
+    m_buffer_sizes[BOUNDS_BUFFER]     = 6 * sizeof(uint32_t);
+    m_buffer_sizes[KEYS_BUFFER]       = 2 * bodies * sizeof(uint32_t);
+    m_buffer_sizes[VALUES_BUFFER]     = 2 * bodies * sizeof(uint32_t);
+    m_buffer_sizes[HISTOGRAMS_BUFFER] = VkDeviceSize{RADIX} * m_push_constants.block_count * sizeof(uint32_t);
+    m_buffer_sizes[NODES_BUFFER]      = (2 * bodies - 1) * NODE_SIZE;
+    // A single body has no internal nodes, the buffer still needs a size.
+    m_buffer_sizes[VISITS_BUFFER] = std::max<VkDeviceSize>(bodies - 1, 1) * sizeof(uint32_t);
+
+    for (std::size_t i = 0; i < BUFFER_COUNT; ++i) {
+        m_buffers[i] = m_allocator->create_buffer(m_buffer_sizes[i],
+                                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                  MemoryUsage::DEVICE_LOCAL, m_buffer_allocations[i]);
+    }
+}
+
+void GpuBarnesHut::create_descriptor_set() {
+    std::array<VkDescriptorSetLayoutBinding, BUFFER_COUNT> bindings{};
+    for (uint32_t i = 0; i < BUFFER_COUNT; ++i) {
+        bindings[i].binding         = i;
+        bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings    = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(m_device, &layout_info, nullptr, &m_tree_set_layout) != VK_SUCCESS) {
+        throw std::runtime_error("GpuBarnesHut::create_descriptor_set => failed to create descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize pool_size{};
+    pool_size.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = BUFFER_COUNT;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes    = &pool_size;
+    pool_info.maxSets       = 1;
+
+    if (vkCreateDescriptorPool(m_device, &pool_info, nullptr, &m_descriptor_pool) != VK_SUCCESS) {
+        throw std::runtime_error("GpuBarnesHut::create_descriptor_set => failed to create descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocate_info{};
+    allocate_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.descriptorPool     = m_descriptor_pool;
+    allocate_info.descriptorSetCount = 1;
+    allocate_info.pSetLayouts        = &m_tree_set_layout;
+
+    if (vkAllocateDescriptorSets(m_device, &allocate_info, &m_tree_set) != VK_SUCCESS) {
+        throw std::runtime_error("GpuBarnesHut::create_descriptor_set => failed to allocate descriptor set!");
+    }
+
+    std::array<VkDescriptorBufferInfo, BUFFER_COUNT> buffer_infos{};
+    std::array<VkWriteDescriptorSet, BUFFER_COUNT>   writes{};
+    for (uint32_t i = 0; i < BUFFER_COUNT; ++i) {
+        buffer_infos[i] = {m_buffers[i], 0, m_buffer_sizes[i]};
+
+        writes[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet          = m_tree_set;
+        writes[i].dstBinding      = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo     = &buffer_infos[i];
+    }
+    vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+// One layout for all passes, so the sets bound once stay bound across the pipeline switches of a step.
+void GpuBarnesHut::create_pipelines(VkPipelineCache cache, VkDescriptorSetLayout body_set_layout) {
+    VkDescriptorSetLayout set_layouts[] = {body_set_layout, m_tree_set_layout};
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset     = 0;
+    push_constant_range.size       = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount         = 2;
+    pipeline_layout_info.pSetLayouts            = set_layouts;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges    = &push_constant_range;
+
+    if (vkCreatePipelineLayout(m_device, &pipeline_layout_info, nullptr, &m_pipeline_layout) != VK_SUCCESS) {
+        throw std::runtime_error("GpuBarnesHut::create_pipelines => failed to create pipeline layout!");
+    }
+
+    for (uint32_t pass = 0; pass < PASS_COUNT; ++pass) {
+        std::vector<uint32_t>     storage;
+        std::span<const uint32_t> code = load_shader(SHADER_PATHS[pass], storage);
+
+        VkShaderModuleCreateInfo module_create_info{};
+        module_create_info.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        module_create_info.codeSize = code.size_bytes();
+        module_create_info.pCode    = code.data();
+
+        VkShaderModule shader_module;
+        if (vkCreateShaderModule(m_device, &module_create_info, nullptr, &shader_module) != VK_SUCCESS) {
+            throw std::runtime_error(std::string("GpuBarnesHut::create_pipelines => failed to create shader module ") +
+                                     SHADER_PATHS[pass]);
+        }
+
+        VkComputePipelineCreateInfo pipeline_create_info{};
+        pipeline_create_info.sType              = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_create_info.stage.sType        = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipeline_create_info.stage.stage        = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipeline_create_info.stage.module       = shader_module;
+        pipeline_create_info.stage.pName        = "main";
+        pipeline_create_info.layout             = m_pipeline_layout;
+        pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+        pipeline_create_info.basePipelineIndex  = -1;
+
+        VkResult result =
+            vkCreateComputePipelines(m_device, cache, 1, &pipeline_create_info, nullptr, &m_pipelines[pass]);
+        vkDestroyShaderModule(m_device, shader_module, nullptr);
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error(std::string("GpuBarnesHut::create_pipelines => failed to create pipeline for ") +
+                                     SHADER_PATHS[pass]);
+        }
+    }
+}
+
+void GpuBarnesHut::record_dispatch(VkCommandBuffer command_buffer, Pass pass, uint32_t groups, uint32_t shift) const {
+    PushConstants push_constants = m_push_constants;
+    push_constants.shift         = shift;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines[pass]);
+    vkCmdPushConstants(command_buffer, m_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants),
+                       &push_constants);
+    vkCmdDispatch(command_buffer, groups, 1, 1);
+}
+
+void GpuBarnesHut::record_step(VkCommandBuffer command_buffer, VkDescriptorSet body_set) const {
+    uint32_t body_groups  = group_count(m_body_count, WORKGROUP_SIZE);
+    uint32_t block_groups = m_push_constants.block_count;
+
+    // The previous step, or an upload, wrote the state this one reads, and its passes may still use the tree
+    // buffers the fills clear.
+    pass_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    // Identities of `atomicMin` and `atomicMax` on ordered floats, and no children done.
+    vkCmdFillBuffer(command_buffer, m_buffers[BOUNDS_BUFFER], 0, 3 * sizeof(uint32_t), 0xFFFF'FFFFu);
+    vkCmdFillBuffer(command_buffer, m_buffers[BOUNDS_BUFFER], 3 * sizeof(uint32_t), 3 * sizeof(uint32_t), 0);
+    vkCmdFillBuffer(command_buffer, m_buffers[VISITS_BUFFER], 0, VK_WHOLE_SIZE, 0);
+    pass_barrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    VkDescriptorSet sets[] = {body_set, m_tree_set};
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline_layout, 0, 2, sets, 0,
+                            nullptr);
+
+    record_dispatch(command_buffer, BOUNDS, body_groups, 0);
+    pass_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    record_dispatch(command_buffer, MORTON, body_groups, 0);
+    pass_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    for (uint32_t pass = 0; pass < SORT_PASSES; ++pass) {
+        uint32_t shift = pass * RADIX_BITS;
+        record_dispatch(command_buffer, RADIX_HISTOGRAM, block_groups, shift);
+        pass_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        record_dispatch(command_buffer, RADIX_SCAN, 1, shift);
+        pass_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        record_dispatch(command_buffer, RADIX_SCATTER, block_groups, shift);
+        pass_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+
+    if (m_body_count > 1) {
+        record_dispatch(command_buffer, BUILD, group_count(m_body_count - 1, WORKGROUP_SIZE), 0);
+        pass_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+    record_dispatch(command_buffer, MOMENTS, body_groups, 0);
+    pass_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    record_dispatch(command_buffer, TRAVERSE, body_groups, 0);
+}
+
+}  // namespace nbody
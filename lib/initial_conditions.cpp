@@ -0,0 +1,225 @@
+#include "initial_conditions.hpp"
+
+#include <cmath>
+#include <numbers>
+#include <random>
+
+namespace nbody {
+
+namespace {
+    using Generator = std::mt19937_64;
+
+    // Direction uniform over the unit sphere, scaled to `length`.
+    void isotropic(Generator& generator, double length, double& x, double& y, double& z) {
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+        double cos_theta = 2.0 * unit(generator) - 1.0;
+        double sin_theta = std::sqrt(1.0 - cos_theta * cos_theta);
+        double phi       = 2.0 * std::numbers::pi * unit(generator);
+
+        x = length * sin_theta * std::cos(phi);
+        y = length * sin_theta * std::sin(phi);
+        z = length * cos_theta;
+    }
+
+    // Aarseth, Henon and Wielen (1974): radii from the inverted cumulative mass, speeds by rejection from the
+    // distribution function, in units with scale radius 1 that are then rescaled to the standard ones.
+    void plummer(Generator& generator, Bodies& bodies) {
+        constexpr double MAX_RADIUS     = 10.0;
+        const double     length_scale   = 3.0 * std::numbers::pi / 16.0;
+        const double     velocity_scale = 1.0 / std::sqrt(length_scale);
+
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+        for (std::size_t i = 0; i < bodies.size(); ++i) {
+            double radius;
+            do {
+                radius = 1.0 / std::sqrt(std::pow(unit(generator), -2.0 / 3.0) - 1.0);
+            } while (!(radius <= MAX_RADIUS));
+
+            // `g(q) = q^2 (1 - q^2)^(7/2)` peaks below 0.1.
+            double q;
+            do {
+                q = unit(generator);
+            } while (0.1 * unit(generator) > q * q * std::pow(1.0 - q * q, 3.5));
+            double escape = std::sqrt(2.0) * std::pow(1.0 + radius * radius, -0.25);
+
+            double x, y, z, vx, vy, vz;
+            isotropic(generator, radius * length_scale, x, y, z);
+            isotropic(generator, q * escape * velocity_scale, vx, vy, vz);
+
+            bodies.x[i]  = static_cast<float>(x);
+            bodies.y[i]  = static_cast<float>(y);
+            bodies.z[i]  = static_cast<float>(z);
+            bodies.vx[i] = static_cast<float>(vx);
+            bodies.vy[i] = static_cast<float>(vy);
+            bodies.vz[i] = static_cast<float>(vz);
+        }
+    }
+
+    void cold_collapse(Generator& generator, Bodies& bodies) {
+        std::uniform_real_distribution<double> side(-1.0, 1.0);
+
+        for (std::size_t i = 0; i < bodies.size(); ++i) {
+            double x, y, z;
+            do {
+                x = side(generator);
+                y = side(generator);
+                z = side(generator);
+            } while (x * x + y * y + z * z > 1.0);
+
+            bodies.x[i] = static_cast<float>(x);
+            bodies.y[i] = static_cast<float>(y);
+            bodies.z[i] = static_cast<float>(z);
+        }
+    }
+
+    void uniform_cube(Generator& generator, Bodies& bodies) {
+        std::uniform_real_distribution<double> side(-1.0, 1.0);
+
+        for (std::size_t i = 0; i < bodies.size(); ++i) {
+            bodies.x[i] = static_cast<float>(side(generator));
+            bodies.y[i] = static_cast<float>(side(generator));
+            bodies.z[i] = static_cast<float>(side(generator));
+        }
+    }
+
+    // Bodies `[begin, end)` as a thin disk of unit radius and mass `disk_mass` on circular orbits, tilted by
+    // `inclination` about the x axis and moved to `center` with `velocity`.
+    void disk(Generator& generator, Bodies& bodies, std::size_t begin, std::size_t end, double disk_mass,
+              double inclination, const double (&center)[3], const double (&velocity)[3]) {
+        // Keeps the innermost orbits from diverging like the softening of the solvers does.
+        constexpr double CORE = 0.05;
+
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::normal_distribution<double>       thickness(0.0, 0.01);
+
+        double cos_i = std::cos(inclination);
+        double sin_i = std::sin(inclination);
+
+        for (std::size_t i = begin; i < end; ++i) {
+            double radius = std::sqrt(unit(generator));
+            double angle  = 2.0 * std::numbers::pi * unit(generator);
+
+            // A uniform disk encloses `disk_mass * radius^2` inside `radius`.
+            double speed = std::sqrt(disk_mass * radius * radius / (radius + CORE));
+
+            double x  = radius * std::cos(angle);
+            double y  = radius * std::sin(angle);
+            double z  = thickness(generator);
+            double vx = -speed * std::sin(angle);
+            double vy = speed * std::cos(angle);
+
+            bodies.x[i]  = static_cast<float>(center[0] + x);
+            bodies.y[i]  = static_cast<float>(center[1] + cos_i * y - sin_i * z);
+            bodies.z[i]  = static_cast<float>(center[2] + sin_i * y + cos_i * z);
+            bodies.vx[i] = static_cast<float>(velocity[0] + vx);
+            bodies.vy[i] = static_cast<float>(velocity[1] + cos_i * vy);
+            bodies.vz[i] = static_cast<float>(velocity[2] + sin_i * vy);
+        }
+    }
+
+    void disk_merger(Generator& generator, Bodies& bodies) {
+        std::size_t half = bodies.size() / 2;
+        double      mass = static_cast<double>(half) / static_cast<double>(bodies.size());
+
+        // Offset by 6 along x and 2 along y, approaching along x at the parabolic speed of the pair.
+        const double offset[3] = {3.0, 1.0, 0.0};
+        double       distance  = 2.0 * std::sqrt(offset[0] * offset[0] + offset[1] * offset[1]);
+        double       speed     = 0.5 * std::sqrt(2.0 / distance);
+
+        disk(generator, bodies, 0, half, mass, 0.0, {-offset[0], -offset[1], 0.0}, {speed, 0.0, 0.0});
+        disk(generator, bodies, half, bodies.size(), 1.0 - mass, std::numbers::pi / 3.0, {offset[0], offset[1], 0.0},
+             {-speed, 0.0, 0.0});
+    }
+
+    void to_center_of_mass_frame(Bodies& bodies) {
+        double center[6] = {};
+        double mass      = 0.0;
+        for (std::size_t i = 0; i < bodies.size(); ++i) {
+            center[0] += bodies.mass[i] * static_cast<double>(bodies.x[i]);
+            center[1] += bodies.mass[i] * static_cast<double>(bodies.y[i]);
+            center[2] += bodies.mass[i] * static_cast<double>(bodies.z[i]);
+            center[3] += bodies.mass[i] * static_cast<double>(bodies.vx[i]);
+            center[4] += bodies.mass[i] * static_cast<double>(bodies.vy[i]);
+            center[5] += bodies.mass[i] * static_cast<double>(bodies.vz[i]);
+            mass += bodies.mass[i];
+        }
+        if (!(mass > 0.0)) {
+            return;
+        }
+
+        for (std::size_t i = 0; i < bodies.size(); ++i) {
+            bodies.x[i]  = static_cast<float>(bodies.x[i] - center[0] / mass);
+            bodies.y[i]  = static_cast<float>(bodies.y[i] - center[1] / mass);
+            bodies.z[i]  = static_cast<float>(bodies.z[i] - center[2] / mass);
+            bodies.vx[i] = static_cast<float>(bodies.vx[i] - center[3] / mass);
+            bodies.vy[i] = static_cast<float>(bodies.vy[i] - center[4] / mass);
+            bodies.vz[i] = static_cast<float>(bodies.vz[i] - center[5] / mass);
+        }
+    }
+}  // namespace
+
+Bodies generate_initial_conditions(InitialConditions kind, std::size_t count, uint64_t seed) {
+    Bodies bodies;
+    bodies.resize(count);
+    if (count == 0) {
+        return bodies;
+    }
+
+    float mass = 1.0f / static_cast<float>(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        bodies.mass[i] = mass;
+    }
+
+    Generator generator(seed);
+    switch (kind) {
+        case InitialConditions::PLUMMER:
+            plummer(generator, bodies);
+            break;
+        case InitialConditions::COLD_COLLAPSE:
+            cold_collapse(generator, bodies);
+            break;
+        case InitialConditions::DISK:
+            disk(generator, bodies, 0, bodies.size(), 1.0, 0.0, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0});
+            break;
+        case InitialConditions::DISK_MERGER:
+            disk_merger(generator, bodies);
+            break;
+        case InitialConditions::UNIFORM_CUBE:
+            uniform_cube(generator, bodies);
+            break;
+    }
+
+    to_center_of_mass_frame(bodies);
+    return bodies;
+}
+
+std::string_view initial_conditions_name(InitialConditions kind) noexcept {
+    switch (kind) {
+        case InitialConditions::PLUMMER:
+            return "plummer";
+        case InitialConditions::COLD_COLLAPSE:
+            return "cold-collapse";
+        case InitialConditions::DISK:
+            return "disk";
+        case InitialConditions::DISK_MERGER:
+            return "disk-merger";
+        case InitialConditions::UNIFORM_CUBE:
+            return "uniform-cube";
+    }
+    return "unknown";
+}
+
+std::optional<InitialConditions> parse_initial_conditions(std::string_view name) noexcept {
+    for (InitialConditions kind : {InitialConditions::PLUMMER, InitialConditions::COLD_COLLAPSE,
+                                   InitialConditions::DISK, InitialConditions::DISK_MERGER,
+                                   InitialConditions::UNIFORM_CUBE}) {
+        if (initial_conditions_name(kind) == name) {
+            return kind;
+        }
+    }
+    return std::nullopt;
+}
+
+}  // namespace nbody
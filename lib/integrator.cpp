@@ -0,0 +1,197 @@
+#include "integrator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <stdexcept>
+
+#include "parallel.hpp"
+#include "trace.hpp"
+
+namespace nbody {
+
+namespace {
+    constexpr std::size_t BODY_GRAIN = 16 * 1024;
+}  // namespace
+
+void kick(Bodies& bodies, float timestep) {
+    NBODY_TRACE_ZONE("integrator.kick");
+
+    parallel_for(bodies.size(), BODY_GRAIN, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            bodies.vx[i] += bodies.ax[i] * timestep;
+            bodies.vy[i] += bodies.ay[i] * timestep;
+            bodies.vz[i] += bodies.az[i] * timestep;
+        }
+    });
+}
+
+void drift(Bodies& bodies, float timestep, Precision precision) {
+    NBODY_TRACE_ZONE("integrator.drift");
+
+    if (precision == Precision::FP32) {
+        parallel_for(bodies.size(), BODY_GRAIN, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                bodies.x[i] += bodies.vx[i] * timestep;
+                bodies.y[i] += bodies.vy[i] * timestep;
+                bodies.z[i] += bodies.vz[i] * timestep;
+            }
+        });
+        return;
+    }
+
+    bodies.resize_low_parts();
+
+    if (precision == Precision::FP64) {
+        // A double holds the pair and the step exactly enough, the result is split back into a pair.
+        auto update = [timestep](float& hi, float& lo, float velocity) {
+            double position = static_cast<double>(hi) + lo + static_cast<double>(velocity) * timestep;
+            hi              = static_cast<float>(position);
+            lo              = static_cast<float>(position - hi);
+        };
+        parallel_for(bodies.size(), BODY_GRAIN, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                update(bodies.x[i], bodies.x_lo[i], bodies.vx[i]);
+                update(bodies.y[i], bodies.y_lo[i], bodies.vy[i]);
+                update(bodies.z[i], bodies.z_lo[i], bodies.vz[i]);
+            }
+        });
+        return;
+    }
+
+    // Knuth's two-sum: `hi + step` is split into its rounded sum and the exact rounding error, which becomes
+    // the new low part. The old low part rides along with the step.
+    auto update = [timestep](float& hi, float& lo, float velocity) {
+        float step         = velocity * timestep + lo;
+        float sum          = hi + step;
+        float virtual_step = sum - hi;
+        lo                 = (hi - (sum - virtual_step)) + (step - virtual_step);
+        hi                 = sum;
+    };
+    parallel_for(bodies.size(), BODY_GRAIN, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            update(bodies.x[i], bodies.x_lo[i], bodies.vx[i]);
+            update(bodies.y[i], bodies.y_lo[i], bodies.vy[i]);
+            update(bodies.z[i], bodies.z_lo[i], bodies.vz[i]);
+        }
+    });
+}
+
+BlockTimestepIntegrator::BlockTimestepIntegrator(const BlockTimestepConfig& config) : m_config(config) {
+    if (config.max_level > MAX_LEVEL) {
+        throw std::invalid_argument("BlockTimestepIntegrator::BlockTimestepIntegrator => max_level above MAX_LEVEL.");
+    }
+}
+
+uint32_t BlockTimestepIntegrator::level_for(float ax, float ay, float az) const noexcept {
+    float acceleration = std::sqrt(ax * ax + ay * ay + az * az);
+    if (!(acceleration > 0.0f)) {
+        return 0;
+    }
+
+    float wanted = std::sqrt(2.0f * m_config.accuracy * m_config.softening / acceleration);
+    float ratio  = m_config.max_timestep / wanted;
+    if (!(ratio > 1.0f)) {
+        return 0;
+    }
+    return static_cast<uint32_t>(std::min(std::ceil(std::log2(ratio)), static_cast<float>(m_config.max_level)));
+}
+
+uint32_t BlockTimestepIntegrator::deepest_level() const noexcept {
+    for (uint32_t level = m_config.max_level; level > 0; --level) {
+        if (m_level_counts[level] > 0) {
+            return level;
+        }
+    }
+    return 0;
+}
+
+void BlockTimestepIntegrator::start(Bodies& bodies, Solver& solver) {
+    solver.compute_accelerations(bodies);
+    m_force_evaluations += bodies.size();
+
+    m_levels.resize(bodies.size());
+    m_level_counts.fill(0);
+    for (std::size_t i = 0; i < bodies.size(); ++i) {
+        m_levels[i] = static_cast<uint8_t>(level_for(bodies.ax[i], bodies.ay[i], bodies.az[i]));
+        ++m_level_counts[m_levels[i]];
+    }
+    m_started = true;
+}
+
+void BlockTimestepIntegrator::half_kick_active(Bodies& bodies) {
+    float half_step = 0.5f * m_config.max_timestep;
+    parallel_for(m_active.size(), BODY_GRAIN, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t k = begin; k < end; ++k) {
+            uint32_t i  = m_active[k];
+            float    dt = std::ldexp(half_step, -static_cast<int>(m_levels[i]));
+            bodies.vx[i] += bodies.ax[i] * dt;
+            bodies.vy[i] += bodies.ay[i] * dt;
+            bodies.vz[i] += bodies.az[i] * dt;
+        }
+    });
+}
+
+void BlockTimestepIntegrator::step(Bodies& bodies, Solver& solver) {
+    NBODY_TRACE_ZONE("block_timesteps.step");
+
+    m_force_evaluations = 0;
+    m_substeps          = 0;
+
+    if (!m_started || m_levels.size() != bodies.size()) {
+        start(bodies, solver);
+    }
+
+    // Time is counted in steps of the deepest possible level, so level `l` ends its steps at the multiples of
+    // `ticks >> l`.
+    const uint64_t ticks     = uint64_t{1} << m_config.max_level;
+    const float    tick_size = m_config.max_timestep / static_cast<float>(ticks);
+
+    // Every level begins a step now.
+    m_active.resize(bodies.size());
+    std::iota(m_active.begin(), m_active.end(), 0u);
+    half_kick_active(bodies);
+
+    uint64_t time = 0;
+    while (time < ticks) {
+        // `time` is a multiple of the step of every occupied level, the deepest of them ends its step first.
+        uint64_t substep = ticks >> deepest_level();
+        drift(bodies, static_cast<float>(substep) * tick_size, m_config.precision);
+        time += substep;
+        ++m_substeps;
+
+        m_active.clear();
+        for (uint32_t i = 0; i < m_levels.size(); ++i) {
+            if (time % (ticks >> m_levels[i]) == 0) {
+                m_active.push_back(i);
+            }
+        }
+
+        solver.compute_active_accelerations(bodies, m_active);
+        m_force_evaluations += m_active.size();
+
+        half_kick_active(bodies);
+
+        for (uint32_t i : m_active) {
+            uint32_t level  = m_levels[i];
+            uint32_t wanted = level_for(bodies.ax[i], bodies.ay[i], bodies.az[i]);
+
+            // A longer step has to start at one of its own multiples to stay in sync with its level.
+            while (wanted < level && time % (ticks >> wanted) != 0) {
+                ++wanted;
+            }
+
+            --m_level_counts[level];
+            ++m_level_counts[wanted];
+            m_levels[i] = static_cast<uint8_t>(wanted);
+        }
+
+        // At the end every body is synchronized and waits for the opening kick of the next call.
+        if (time < ticks) {
+            half_kick_active(bodies);
+        }
+    }
+}
+
+}  // namespace nbody
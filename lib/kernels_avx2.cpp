@@ -0,0 +1,294 @@
+#include "kernels.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <limits>
+
+// Compiled with per-function target attributes instead of -mavx2 for the whole file, so that nothing in this
+// translation unit leaks AVX2 code into functions that the scalar path may call on older CPUs.
+#define NBODY_TARGET_AVX2 __attribute__((target("avx2,fma")))
+
+namespace nbody {
+
+namespace {
+    NBODY_TARGET_AVX2 inline float horizontal_sum(__m256 value) {
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1));
+        sum        = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum        = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+        return _mm_cvtss_f32(sum);
+    }
+
+    NBODY_TARGET_AVX2 inline double horizontal_sum(__m256d value) {
+        __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(value), _mm256_extractf128_pd(value, 1));
+        sum         = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+        return _mm_cvtsd_f64(sum);
+    }
+
+    // Masked loads zero the lanes past the end, zero mass makes them contribute nothing.
+    template <bool MASKED>
+    NBODY_TARGET_AVX2 inline __m256 load(const float* p, __m256i mask) {
+        return MASKED ? _mm256_maskload_ps(p, mask) : _mm256_loadu_ps(p);
+    }
+
+    template <bool MASKED>
+    NBODY_TARGET_AVX2 inline __m128 load(const float* p, __m128i mask) {
+        return MASKED ? _mm_maskload_ps(p, mask) : _mm_loadu_ps(p);
+    }
+
+    // A target broadcast to every lane, with the low parts of its position under `COMPENSATED`.
+    class Target {
+       public:
+        __m256 x, y, z;
+        __m256 x_lo, y_lo, z_lo;
+    };
+
+    // Running sums of one target over all lanes. Under `COMPENSATED` the `c` members hold the Kahan
+    // compensations of the lanes, and the sum of a lane is `a - c`.
+    class Sums {
+       public:
+        __m256 ax, ay, az;
+        __m256 cx, cy, cz;
+    };
+
+    NBODY_TARGET_AVX2 inline void compensated_add(__m256 f, __m256 d, __m256& sum, __m256& compensation) {
+        __m256 corrected = _mm256_fmsub_ps(f, d, compensation);
+        __m256 next      = _mm256_add_ps(sum, corrected);
+        compensation     = _mm256_sub_ps(_mm256_sub_ps(next, sum), corrected);
+        sum              = next;
+    }
+
+    // Accumulates the eight sources from `j` on into the target's running sums.
+    template <Precision P, bool MASKED>
+    NBODY_TARGET_AVX2 inline void interact(const DirectSumSources& sources, std::size_t j, __m256i mask,
+                                           const Target& target, __m256 softening_squared, Sums& sums) {
+        const __m256 half       = _mm256_set1_ps(0.5f);
+        const __m256 three_half = _mm256_set1_ps(1.5f);
+
+        __m256 dx = _mm256_sub_ps(load<MASKED>(sources.x + j, mask), target.x);
+        __m256 dy = _mm256_sub_ps(load<MASKED>(sources.y + j, mask), target.y);
+        __m256 dz = _mm256_sub_ps(load<MASKED>(sources.z + j, mask), target.z);
+        if constexpr (P == Precision::COMPENSATED) {
+            // The high parts of nearby positions share their exponent, so their difference is exact and adding
+            // the difference of the low parts recovers the separation to about twice single precision.
+            dx = _mm256_add_ps(dx, _mm256_sub_ps(load<MASKED>(sources.x_lo + j, mask), target.x_lo));
+            dy = _mm256_add_ps(dy, _mm256_sub_ps(load<MASKED>(sources.y_lo + j, mask), target.y_lo));
+            dz = _mm256_add_ps(dz, _mm256_sub_ps(load<MASKED>(sources.z_lo + j, mask), target.z_lo));
+        }
+        __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, softening_squared)));
+
+        // 12 bit estimate refined by one Newton-Raphson step to about 23 bits.
+        __m256 inv = _mm256_rsqrt_ps(r2);
+        inv        = _mm256_mul_ps(inv, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(inv, inv), three_half));
+        inv        = _mm256_and_ps(inv, _mm256_cmp_ps(r2, _mm256_setzero_ps(), _CMP_GT_OQ));
+
+        __m256 f = _mm256_mul_ps(load<MASKED>(sources.mass + j, mask), _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+        if constexpr (P == Precision::COMPENSATED) {
+            compensated_add(f, dx, sums.ax, sums.cx);
+            compensated_add(f, dy, sums.ay, sums.cy);
+            compensated_add(f, dz, sums.az, sums.cz);
+        } else {
+            sums.ax = _mm256_fmadd_ps(f, dx, sums.ax);
+            sums.ay = _mm256_fmadd_ps(f, dy, sums.ay);
+            sums.az = _mm256_fmadd_ps(f, dz, sums.az);
+        }
+    }
+
+    // `FP32` and `COMPENSATED`, eight sources per step.
+    template <Precision P>
+    NBODY_TARGET_AVX2 void direct_sum_single(const DirectSumTargets& targets, const DirectSumSources& sources,
+                                             float softening_squared) {
+        constexpr std::size_t LANES = 8;
+
+        const __m256 eps2 = _mm256_set1_ps(softening_squared);
+        const __m256 zero = _mm256_setzero_ps();
+
+        std::size_t full = sources.count - sources.count % LANES;
+
+        __m256i tail_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(sources.count - full)),
+                                               _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+        for (std::size_t i = 0; i < targets.count; ++i) {
+            Target target{_mm256_set1_ps(targets.x[i]), _mm256_set1_ps(targets.y[i]), _mm256_set1_ps(targets.z[i]),
+                          zero, zero, zero};
+            if constexpr (P == Precision::COMPENSATED) {
+                target.x_lo = _mm256_set1_ps(targets.x_lo[i]);
+                target.y_lo = _mm256_set1_ps(targets.y_lo[i]);
+                target.z_lo = _mm256_set1_ps(targets.z_lo[i]);
+            }
+            Sums sums{zero, zero, zero, zero, zero, zero};
+
+            for (std::size_t j = 0; j < full; j += LANES) {
+                interact<P, false>(sources, j, tail_mask, target, eps2, sums);
+            }
+
+            if (full < sources.count) {
+                interact<P, true>(sources, full, tail_mask, target, eps2, sums);
+            }
+
+            if constexpr (P == Precision::COMPENSATED) {
+                sums.ax = _mm256_sub_ps(sums.ax, sums.cx);
+                sums.ay = _mm256_sub_ps(sums.ay, sums.cy);
+                sums.az = _mm256_sub_ps(sums.az, sums.cz);
+            }
+            targets.ax[i] += horizontal_sum(sums.ax);
+            targets.ay[i] += horizontal_sum(sums.ay);
+            targets.az[i] += horizontal_sum(sums.az);
+        }
+    }
+
+    template <bool MASKED>
+    NBODY_TARGET_AVX2 inline __m256d widen(const float* hi, const float* lo, std::size_t j, __m128i mask) {
+        return _mm256_add_pd(_mm256_cvtps_pd(load<MASKED>(hi + j, mask)), _mm256_cvtps_pd(load<MASKED>(lo + j, mask)));
+    }
+
+    // Accumulates the four sources from `j` on, widened from their single precision pairs, in double precision.
+    template <bool MASKED>
+    NBODY_TARGET_AVX2 inline void interact_fp64(const DirectSumSources& sources, std::size_t j, __m128i mask,
+                                                __m256d px, __m256d py, __m256d pz, __m256d softening_squared,
+                                                __m256d& ax, __m256d& ay, __m256d& az) {
+        __m256d dx = _mm256_sub_pd(widen<MASKED>(sources.x, sources.x_lo, j, mask), px);
+        __m256d dy = _mm256_sub_pd(widen<MASKED>(sources.y, sources.y_lo, j, mask), py);
+        __m256d dz = _mm256_sub_pd(widen<MASKED>(sources.z, sources.z_lo, j, mask), pz);
+        __m256d r2 =
+            _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_fmadd_pd(dz, dz, softening_squared)));
+
+        // Exact square root and division, double precision has no fast reciprocal square root on AVX2.
+        __m256d inv = _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_sqrt_pd(r2));
+        inv         = _mm256_and_pd(inv, _mm256_cmp_pd(r2, _mm256_setzero_pd(), _CMP_GT_OQ));
+
+        __m256d sm = _mm256_cvtps_pd(load<MASKED>(sources.mass + j, mask));
+        __m256d f  = _mm256_mul_pd(sm, _mm256_mul_pd(inv, _mm256_mul_pd(inv, inv)));
+        ax         = _mm256_fmadd_pd(f, dx, ax);
+        ay         = _mm256_fmadd_pd(f, dy, ay);
+        az         = _mm256_fmadd_pd(f, dz, az);
+    }
+
+    // `FP64`, four sources per step.
+    NBODY_TARGET_AVX2 void direct_sum_fp64(const DirectSumTargets& targets, const DirectSumSources& sources,
+                                           float softening_squared) {
+        constexpr std::size_t LANES = 4;
+
+        const __m256d eps2 = _mm256_set1_pd(softening_squared);
+
+        std::size_t full = sources.count - sources.count % LANES;
+
+        __m128i tail_mask =
+            _mm_cmpgt_epi32(_mm_set1_epi32(static_cast<int>(sources.count - full)), _mm_setr_epi32(0, 1, 2, 3));
+
+        for (std::size_t i = 0; i < targets.count; ++i) {
+            __m256d px = _mm256_set1_pd(static_cast<double>(targets.x[i]) + targets.x_lo[i]);
+            __m256d py = _mm256_set1_pd(static_cast<double>(targets.y[i]) + targets.y_lo[i]);
+            __m256d pz = _mm256_set1_pd(static_cast<double>(targets.z[i]) + targets.z_lo[i]);
+            __m256d ax = _mm256_setzero_pd();
+            __m256d ay = _mm256_setzero_pd();
+            __m256d az = _mm256_setzero_pd();
+
+            for (std::size_t j = 0; j < full; j += LANES) {
+                interact_fp64<false>(sources, j, tail_mask, px, py, pz, eps2, ax, ay, az);
+            }
+
+            if (full < sources.count) {
+                interact_fp64<true>(sources, full, tail_mask, px, py, pz, eps2, ax, ay, az);
+            }
+
+            targets.ax[i] += static_cast<float>(horizontal_sum(ax));
+            targets.ay[i] += static_cast<float>(horizontal_sum(ay));
+            targets.az[i] += static_cast<float>(horizontal_sum(az));
+        }
+    }
+}  // namespace
+
+template <Precision P>
+NBODY_TARGET_AVX2 void direct_sum_avx2(const DirectSumTargets& targets, const DirectSumSources& sources,
+                                       float softening_squared) {
+    if constexpr (P == Precision::FP64) {
+        direct_sum_fp64(targets, sources, softening_squared);
+    } else {
+        direct_sum_single<P>(targets, sources, softening_squared);
+    }
+}
+
+template void direct_sum_avx2<Precision::FP32>(const DirectSumTargets&, const DirectSumSources&, float);
+template void direct_sum_avx2<Precision::COMPENSATED>(const DirectSumTargets&, const DirectSumSources&, float);
+template void direct_sum_avx2<Precision::FP64>(const DirectSumTargets&, const DirectSumSources&, float);
+
+NBODY_TARGET_AVX2 void packed_systems_avx2(const PackedSystems& systems, float softening_squared) {
+    constexpr std::size_t LANES = 8;
+
+    const __m256 half       = _mm256_set1_ps(0.5f);
+    const __m256 three_half = _mm256_set1_ps(1.5f);
+    const __m256 eps2       = _mm256_set1_ps(softening_squared);
+    const __m256 zero       = _mm256_setzero_ps();
+    const __m256 infinity   = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+
+    std::size_t stride = systems.lanes;
+    std::size_t size   = systems.body_count * stride;
+    std::fill(systems.ax, systems.ax + size, 0.0f);
+    std::fill(systems.ay, systems.ay + size, 0.0f);
+    std::fill(systems.az, systems.az + size, 0.0f);
+
+    // Every eight lanes are eight independent systems, stepped through their pairs together.
+    for (std::size_t lane = 0; lane < stride; lane += LANES) {
+        __m256 counts =
+            _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(systems.counts + lane)));
+        __m256 min_distance2 = infinity;
+        __m256 max_pull      = zero;
+
+        for (std::size_t i = 0; i < systems.body_count; ++i) {
+            std::size_t a  = i * stride + lane;
+            __m256      xa = _mm256_loadu_ps(systems.x + a);
+            __m256      ya = _mm256_loadu_ps(systems.y + a);
+            __m256      za = _mm256_loadu_ps(systems.z + a);
+            __m256      ma = _mm256_loadu_ps(systems.mass + a);
+            __m256      ax = zero;
+            __m256      ay = zero;
+            __m256      az = zero;
+
+            for (std::size_t j = i + 1; j < systems.body_count; ++j) {
+                std::size_t b     = j * stride + lane;
+                __m256      valid = _mm256_cmp_ps(_mm256_set1_ps(static_cast<float>(j)), counts, _CMP_LT_OQ);
+
+                __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(systems.x + b), xa);
+                __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(systems.y + b), ya);
+                __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(systems.z + b), za);
+                __m256 d2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+                __m256 r2 = _mm256_add_ps(d2, eps2);
+
+                min_distance2 = _mm256_min_ps(min_distance2, _mm256_blendv_ps(infinity, d2, valid));
+
+                // As in `interact`, and lanes whose system has no body `j` get zero.
+                __m256 inv  = _mm256_rsqrt_ps(r2);
+                __m256 step = _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(inv, inv), three_half);
+                __m256 used = _mm256_and_ps(valid, _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+                inv         = _mm256_and_ps(_mm256_mul_ps(inv, step), used);
+                __m256 inv3 = _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv));
+
+                __m256 mb = _mm256_loadu_ps(systems.mass + b);
+                __m256 fa = _mm256_mul_ps(mb, inv3);
+                __m256 fb = _mm256_mul_ps(ma, inv3);
+                ax        = _mm256_fmadd_ps(fa, dx, ax);
+                ay        = _mm256_fmadd_ps(fa, dy, ay);
+                az        = _mm256_fmadd_ps(fa, dz, az);
+                _mm256_storeu_ps(systems.ax + b, _mm256_fnmadd_ps(fb, dx, _mm256_loadu_ps(systems.ax + b)));
+                _mm256_storeu_ps(systems.ay + b, _mm256_fnmadd_ps(fb, dy, _mm256_loadu_ps(systems.ay + b)));
+                _mm256_storeu_ps(systems.az + b, _mm256_fnmadd_ps(fb, dz, _mm256_loadu_ps(systems.az + b)));
+
+                max_pull = _mm256_max_ps(max_pull, _mm256_mul_ps(_mm256_add_ps(ma, mb), inv3));
+            }
+
+            _mm256_storeu_ps(systems.ax + a, _mm256_add_ps(_mm256_loadu_ps(systems.ax + a), ax));
+            _mm256_storeu_ps(systems.ay + a, _mm256_add_ps(_mm256_loadu_ps(systems.ay + a), ay));
+            _mm256_storeu_ps(systems.az + a, _mm256_add_ps(_mm256_loadu_ps(systems.az + a), az));
+        }
+
+        _mm256_storeu_ps(systems.min_distance2 + lane, min_distance2);
+        _mm256_storeu_ps(systems.max_pull + lane, max_pull);
+    }
+}
+
+}  // namespace nbody
+
+#endif
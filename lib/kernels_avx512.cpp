@@ -0,0 +1,272 @@
+#include "kernels.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <limits>
+
+// See kernels_avx2.cpp for why this uses target attributes.
+#define NBODY_TARGET_AVX512 __attribute__((target("avx512f")))
+
+namespace nbody {
+
+namespace {
+    // Masked loads zero the lanes past the end, zero mass makes them contribute nothing.
+    NBODY_TARGET_AVX512 inline __m512 load(const float* p, __mmask16 mask) { return _mm512_maskz_loadu_ps(mask, p); }
+
+    // The first eight lanes of a masked load widened to double precision.
+    NBODY_TARGET_AVX512 inline __m512d load_wide(const float* p, __mmask16 mask) {
+        return _mm512_cvtps_pd(_mm512_castps512_ps256(_mm512_maskz_loadu_ps(mask, p)));
+    }
+
+    // Double precision sum of eight single precision pairs.
+    NBODY_TARGET_AVX512 inline __m512d widen(const float* hi, const float* lo, __mmask16 mask) {
+        return _mm512_add_pd(load_wide(hi, mask), load_wide(lo, mask));
+    }
+
+    // A target broadcast to every lane, with the low parts of its position under `COMPENSATED`.
+    class Target {
+       public:
+        __m512 x, y, z;
+        __m512 x_lo, y_lo, z_lo;
+    };
+
+    // Running sums of one target over all lanes. Under `COMPENSATED` the `c` members hold the Kahan
+    // compensations of the lanes, and the sum of a lane is `a - c`.
+    class Sums {
+       public:
+        __m512 ax, ay, az;
+        __m512 cx, cy, cz;
+    };
+
+    NBODY_TARGET_AVX512 inline void compensated_add(__m512 f, __m512 d, __m512& sum, __m512& compensation) {
+        __m512 corrected = _mm512_fmsub_ps(f, d, compensation);
+        __m512 next      = _mm512_add_ps(sum, corrected);
+        compensation     = _mm512_sub_ps(_mm512_sub_ps(next, sum), corrected);
+        sum              = next;
+    }
+
+    // Accumulates the sixteen sources from `j` on into the target's running sums. Full steps pass a mask of
+    // all ones, which compiles to plain loads.
+    template <Precision P>
+    NBODY_TARGET_AVX512 inline void interact(const DirectSumSources& sources, std::size_t j, __mmask16 mask,
+                                             const Target& target, __m512 softening_squared, Sums& sums) {
+        const __m512 half       = _mm512_set1_ps(0.5f);
+        const __m512 three_half = _mm512_set1_ps(1.5f);
+
+        __m512 dx = _mm512_sub_ps(load(sources.x + j, mask), target.x);
+        __m512 dy = _mm512_sub_ps(load(sources.y + j, mask), target.y);
+        __m512 dz = _mm512_sub_ps(load(sources.z + j, mask), target.z);
+        if constexpr (P == Precision::COMPENSATED) {
+            // Exact difference of the high parts plus the difference of the low parts, see kernels_scalar.cpp.
+            dx = _mm512_add_ps(dx, _mm512_sub_ps(load(sources.x_lo + j, mask), target.x_lo));
+            dy = _mm512_add_ps(dy, _mm512_sub_ps(load(sources.y_lo + j, mask), target.y_lo));
+            dz = _mm512_add_ps(dz, _mm512_sub_ps(load(sources.z_lo + j, mask), target.z_lo));
+        }
+        __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_fmadd_ps(dz, dz, softening_squared)));
+
+        // 14 bit estimate refined by one Newton-Raphson step to full single precision.
+        __mmask16 nonzero = _mm512_cmp_ps_mask(r2, _mm512_setzero_ps(), _CMP_GT_OQ);
+        __m512    inv     = _mm512_maskz_rsqrt14_ps(nonzero, r2);
+        inv = _mm512_mul_ps(inv, _mm512_fnmadd_ps(_mm512_mul_ps(half, r2), _mm512_mul_ps(inv, inv), three_half));
+
+        __m512 f = _mm512_mul_ps(load(sources.mass + j, mask), _mm512_mul_ps(inv, _mm512_mul_ps(inv, inv)));
+        if constexpr (P == Precision::COMPENSATED) {
+            compensated_add(f, dx, sums.ax, sums.cx);
+            compensated_add(f, dy, sums.ay, sums.cy);
+            compensated_add(f, dz, sums.az, sums.cz);
+        } else {
+            sums.ax = _mm512_fmadd_ps(f, dx, sums.ax);
+            sums.ay = _mm512_fmadd_ps(f, dy, sums.ay);
+            sums.az = _mm512_fmadd_ps(f, dz, sums.az);
+        }
+    }
+
+    // `FP32` and `COMPENSATED`, sixteen sources per step.
+    template <Precision P>
+    NBODY_TARGET_AVX512 void direct_sum_single(const DirectSumTargets& targets, const DirectSumSources& sources,
+                                               float softening_squared) {
+        constexpr std::size_t LANES = 16;
+
+        const __m512 eps2 = _mm512_set1_ps(softening_squared);
+        const __m512 zero = _mm512_setzero_ps();
+
+        std::size_t full = sources.count - sources.count % LANES;
+
+        __mmask16 tail_mask = static_cast<__mmask16>((1u << (sources.count - full)) - 1u);
+
+        for (std::size_t i = 0; i < targets.count; ++i) {
+            Target target{_mm512_set1_ps(targets.x[i]), _mm512_set1_ps(targets.y[i]), _mm512_set1_ps(targets.z[i]),
+                          zero, zero, zero};
+            if constexpr (P == Precision::COMPENSATED) {
+                target.x_lo = _mm512_set1_ps(targets.x_lo[i]);
+                target.y_lo = _mm512_set1_ps(targets.y_lo[i]);
+                target.z_lo = _mm512_set1_ps(targets.z_lo[i]);
+            }
+            Sums sums{zero, zero, zero, zero, zero, zero};
+
+            for (std::size_t j = 0; j < full; j += LANES) {
+                interact<P>(sources, j, 0xFFFF, target, eps2, sums);
+            }
+
+            if (full < sources.count) {
+                interact<P>(sources, full, tail_mask, target, eps2, sums);
+            }
+
+            if constexpr (P == Precision::COMPENSATED) {
+                sums.ax = _mm512_sub_ps(sums.ax, sums.cx);
+                sums.ay = _mm512_sub_ps(sums.ay, sums.cy);
+                sums.az = _mm512_sub_ps(sums.az, sums.cz);
+            }
+            targets.ax[i] += _mm512_reduce_add_ps(sums.ax);
+            targets.ay[i] += _mm512_reduce_add_ps(sums.ay);
+            targets.az[i] += _mm512_reduce_add_ps(sums.az);
+        }
+    }
+
+    // Accumulates the eight sources from `j` on, widened from their single precision pairs, in double precision.
+    NBODY_TARGET_AVX512 inline void interact_fp64(const DirectSumSources& sources, std::size_t j, __mmask16 mask,
+                                                  __m512d px, __m512d py, __m512d pz, __m512d softening_squared,
+                                                  __m512d& ax, __m512d& ay, __m512d& az) {
+        __m512d dx = _mm512_sub_pd(widen(sources.x + j, sources.x_lo + j, mask), px);
+        __m512d dy = _mm512_sub_pd(widen(sources.y + j, sources.y_lo + j, mask), py);
+        __m512d dz = _mm512_sub_pd(widen(sources.z + j, sources.z_lo + j, mask), pz);
+        __m512d r2 =
+            _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_fmadd_pd(dz, dz, softening_squared)));
+
+        // Exact square root and division, the 14 bit estimate is far from double precision.
+        __mmask8 nonzero = _mm512_cmp_pd_mask(r2, _mm512_setzero_pd(), _CMP_GT_OQ);
+        __m512d  inv     = _mm512_maskz_div_pd(nonzero, _mm512_set1_pd(1.0), _mm512_sqrt_pd(r2));
+
+        __m512d f = _mm512_mul_pd(load_wide(sources.mass + j, mask), _mm512_mul_pd(inv, _mm512_mul_pd(inv, inv)));
+        ax        = _mm512_fmadd_pd(f, dx, ax);
+        ay        = _mm512_fmadd_pd(f, dy, ay);
+        az        = _mm512_fmadd_pd(f, dz, az);
+    }
+
+    // `FP64`, eight sources per step.
+    NBODY_TARGET_AVX512 void direct_sum_fp64(const DirectSumTargets& targets, const DirectSumSources& sources,
+                                             float softening_squared) {
+        constexpr std::size_t LANES = 8;
+
+        const __m512d eps2 = _mm512_set1_pd(softening_squared);
+
+        std::size_t full = sources.count - sources.count % LANES;
+
+        __mmask16 tail_mask = static_cast<__mmask16>((1u << (sources.count - full)) - 1u);
+
+        for (std::size_t i = 0; i < targets.count; ++i) {
+            __m512d px = _mm512_set1_pd(static_cast<double>(targets.x[i]) + targets.x_lo[i]);
+            __m512d py = _mm512_set1_pd(static_cast<double>(targets.y[i]) + targets.y_lo[i]);
+            __m512d pz = _mm512_set1_pd(static_cast<double>(targets.z[i]) + targets.z_lo[i]);
+            __m512d ax = _mm512_setzero_pd();
+            __m512d ay = _mm512_setzero_pd();
+            __m512d az = _mm512_setzero_pd();
+
+            for (std::size_t j = 0; j < full; j += LANES) {
+                interact_fp64(sources, j, 0x00FF, px, py, pz, eps2, ax, ay, az);
+            }
+
+            if (full < sources.count) {
+                interact_fp64(sources, full, tail_mask, px, py, pz, eps2, ax, ay, az);
+            }
+
+            targets.ax[i] += static_cast<float>(_mm512_reduce_add_pd(ax));
+            targets.ay[i] += static_cast<float>(_mm512_reduce_add_pd(ay));
+            targets.az[i] += static_cast<float>(_mm512_reduce_add_pd(az));
+        }
+    }
+}  // namespace
+
+template <Precision P>
+NBODY_TARGET_AVX512 void direct_sum_avx512(const DirectSumTargets& targets, const DirectSumSources& sources,
+                                           float softening_squared) {
+    if constexpr (P == Precision::FP64) {
+        direct_sum_fp64(targets, sources, softening_squared);
+    } else {
+        direct_sum_single<P>(targets, sources, softening_squared);
+    }
+}
+
+template void direct_sum_avx512<Precision::FP32>(const DirectSumTargets&, const DirectSumSources&, float);
+template void direct_sum_avx512<Precision::COMPENSATED>(const DirectSumTargets&, const DirectSumSources&, float);
+template void direct_sum_avx512<Precision::FP64>(const DirectSumTargets&, const DirectSumSources&, float);
+
+// See kernels_avx2.cpp, sixteen systems at a time.
+NBODY_TARGET_AVX512 void packed_systems_avx512(const PackedSystems& systems, float softening_squared) {
+    constexpr std::size_t LANES = 16;
+
+    const __m512 half       = _mm512_set1_ps(0.5f);
+    const __m512 three_half = _mm512_set1_ps(1.5f);
+    const __m512 eps2       = _mm512_set1_ps(softening_squared);
+    const __m512 zero       = _mm512_setzero_ps();
+    const __m512 infinity   = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+
+    std::size_t stride = systems.lanes;
+    std::size_t size   = systems.body_count * stride;
+    std::fill(systems.ax, systems.ax + size, 0.0f);
+    std::fill(systems.ay, systems.ay + size, 0.0f);
+    std::fill(systems.az, systems.az + size, 0.0f);
+
+    for (std::size_t lane = 0; lane < stride; lane += LANES) {
+        __m512i counts        = _mm512_loadu_si512(systems.counts + lane);
+        __m512  min_distance2 = infinity;
+        __m512  max_pull      = zero;
+
+        for (std::size_t i = 0; i < systems.body_count; ++i) {
+            std::size_t a  = i * stride + lane;
+            __m512      xa = _mm512_loadu_ps(systems.x + a);
+            __m512      ya = _mm512_loadu_ps(systems.y + a);
+            __m512      za = _mm512_loadu_ps(systems.z + a);
+            __m512      ma = _mm512_loadu_ps(systems.mass + a);
+            __m512      ax = zero;
+            __m512      ay = zero;
+            __m512      az = zero;
+
+            for (std::size_t j = i + 1; j < systems.body_count; ++j) {
+                std::size_t b     = j * stride + lane;
+                __mmask16   valid = _mm512_cmpgt_epi32_mask(counts, _mm512_set1_epi32(static_cast<int>(j)));
+
+                __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(systems.x + b), xa);
+                __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(systems.y + b), ya);
+                __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(systems.z + b), za);
+                __m512 d2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+                __m512 r2 = _mm512_add_ps(d2, eps2);
+
+                min_distance2 = _mm512_mask_min_ps(min_distance2, valid, min_distance2, d2);
+
+                // As in `interact`, and lanes whose system has no body `j` get zero.
+                __mmask16 used = valid & _mm512_cmp_ps_mask(r2, zero, _CMP_GT_OQ);
+                __m512    inv  = _mm512_maskz_rsqrt14_ps(used, r2);
+                __m512    step = _mm512_fnmadd_ps(_mm512_mul_ps(half, r2), _mm512_mul_ps(inv, inv), three_half);
+                inv            = _mm512_mul_ps(inv, step);
+                __m512    inv3 = _mm512_mul_ps(inv, _mm512_mul_ps(inv, inv));
+
+                __m512 mb = _mm512_loadu_ps(systems.mass + b);
+                __m512 fa = _mm512_mul_ps(mb, inv3);
+                __m512 fb = _mm512_mul_ps(ma, inv3);
+                ax        = _mm512_fmadd_ps(fa, dx, ax);
+                ay        = _mm512_fmadd_ps(fa, dy, ay);
+                az        = _mm512_fmadd_ps(fa, dz, az);
+                _mm512_storeu_ps(systems.ax + b, _mm512_fnmadd_ps(fb, dx, _mm512_loadu_ps(systems.ax + b)));
+                _mm512_storeu_ps(systems.ay + b, _mm512_fnmadd_ps(fb, dy, _mm512_loadu_ps(systems.ay + b)));
+                _mm512_storeu_ps(systems.az + b, _mm512_fnmadd_ps(fb, dz, _mm512_loadu_ps(systems.az + b)));
+
+                max_pull = _mm512_max_ps(max_pull, _mm512_mul_ps(_mm512_add_ps(ma, mb), inv3));
+            }
+
+            _mm512_storeu_ps(systems.ax + a, _mm512_add_ps(_mm512_loadu_ps(systems.ax + a), ax));
+            _mm512_storeu_ps(systems.ay + a, _mm512_add_ps(_mm512_loadu_ps(systems.ay + a), ay));
+            _mm512_storeu_ps(systems.az + a, _mm512_add_ps(_mm512_loadu_ps(systems.az + a), az));
+        }
+
+        _mm512_storeu_ps(systems.min_distance2 + lane, min_distance2);
+        _mm512_storeu_ps(systems.max_pull + lane, max_pull);
+    }
+}
+
+}  // namespace nbody
+
+#endif
@@ -0,0 +1,278 @@
+#include "kernels.hpp"
+
+#if defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace nbody {
+
+namespace {
+    // A target broadcast to every lane, with the low parts of its position under `COMPENSATED`.
+    class Target {
+       public:
+        float32x4_t x, y, z;
+        float32x4_t x_lo, y_lo, z_lo;
+    };
+
+    // Running sums of one target over all lanes. Under `COMPENSATED` the `c` members hold the Kahan
+    // compensations of the lanes, and the sum of a lane is `a - c`.
+    class Sums {
+       public:
+        float32x4_t ax, ay, az;
+        float32x4_t cx, cy, cz;
+    };
+
+    inline void compensated_add(float32x4_t f, float32x4_t d, float32x4_t& sum, float32x4_t& compensation) {
+        float32x4_t corrected = vsubq_f32(vmulq_f32(f, d), compensation);
+        float32x4_t next      = vaddq_f32(sum, corrected);
+        compensation          = vsubq_f32(vsubq_f32(next, sum), corrected);
+        sum                   = next;
+    }
+
+    // Accumulates the four sources from `j` on into the target's running sums.
+    template <Precision P>
+    inline void interact(const DirectSumSources& sources, std::size_t j, const Target& target,
+                         float32x4_t softening_squared, Sums& sums) {
+        float32x4_t dx = vsubq_f32(vld1q_f32(sources.x + j), target.x);
+        float32x4_t dy = vsubq_f32(vld1q_f32(sources.y + j), target.y);
+        float32x4_t dz = vsubq_f32(vld1q_f32(sources.z + j), target.z);
+        if constexpr (P == Precision::COMPENSATED) {
+            // Exact difference of the high parts plus the difference of the low parts, see kernels_scalar.cpp.
+            dx = vaddq_f32(dx, vsubq_f32(vld1q_f32(sources.x_lo + j), target.x_lo));
+            dy = vaddq_f32(dy, vsubq_f32(vld1q_f32(sources.y_lo + j), target.y_lo));
+            dz = vaddq_f32(dz, vsubq_f32(vld1q_f32(sources.z_lo + j), target.z_lo));
+        }
+        float32x4_t r2 = vfmaq_f32(vfmaq_f32(vfmaq_f32(softening_squared, dz, dz), dy, dy), dx, dx);
+
+        // 8 bit estimate refined by two Newton-Raphson steps.
+        float32x4_t inv = vrsqrteq_f32(r2);
+        inv             = vmulq_f32(inv, vrsqrtsq_f32(vmulq_f32(r2, inv), inv));
+        inv             = vmulq_f32(inv, vrsqrtsq_f32(vmulq_f32(r2, inv), inv));
+        inv = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(inv), vcgtq_f32(r2, vdupq_n_f32(0.0f))));
+
+        float32x4_t f = vmulq_f32(vld1q_f32(sources.mass + j), vmulq_f32(inv, vmulq_f32(inv, inv)));
+        if constexpr (P == Precision::COMPENSATED) {
+            compensated_add(f, dx, sums.ax, sums.cx);
+            compensated_add(f, dy, sums.ay, sums.cy);
+            compensated_add(f, dz, sums.az, sums.cz);
+        } else {
+            sums.ax = vfmaq_f32(sums.ax, f, dx);
+            sums.ay = vfmaq_f32(sums.ay, f, dy);
+            sums.az = vfmaq_f32(sums.az, f, dz);
+        }
+    }
+
+    // `FP32` and `COMPENSATED`, four sources per step.
+    template <Precision P>
+    void direct_sum_single(const DirectSumTargets& targets, const DirectSumSources& sources, float softening_squared) {
+        constexpr std::size_t LANES       = 4;
+        constexpr bool        COMPENSATED = P == Precision::COMPENSATED;
+
+        const float32x4_t eps2 = vdupq_n_f32(softening_squared);
+        const float32x4_t zero = vdupq_n_f32(0.0f);
+
+        std::size_t full = sources.count - sources.count % LANES;
+
+        for (std::size_t i = 0; i < targets.count; ++i) {
+            float  lx = COMPENSATED ? targets.x_lo[i] : 0.0f;
+            float  ly = COMPENSATED ? targets.y_lo[i] : 0.0f;
+            float  lz = COMPENSATED ? targets.z_lo[i] : 0.0f;
+            Target target{vdupq_n_f32(targets.x[i]), vdupq_n_f32(targets.y[i]), vdupq_n_f32(targets.z[i]),
+                          vdupq_n_f32(lx),           vdupq_n_f32(ly),           vdupq_n_f32(lz)};
+            Sums   sums{zero, zero, zero, zero, zero, zero};
+
+            for (std::size_t j = 0; j < full; j += LANES) {
+                interact<P>(sources, j, target, eps2, sums);
+            }
+
+            float sum_x = vaddvq_f32(vsubq_f32(sums.ax, sums.cx));
+            float sum_y = vaddvq_f32(vsubq_f32(sums.ay, sums.cy));
+            float sum_z = vaddvq_f32(vsubq_f32(sums.az, sums.cz));
+
+            // NEON has no masked loads, the remaining sources go through the scalar path.
+            for (std::size_t j = full; j < sources.count; ++j) {
+                float dx = sources.x[j] - targets.x[i];
+                float dy = sources.y[j] - targets.y[i];
+                float dz = sources.z[j] - targets.z[i];
+                if constexpr (COMPENSATED) {
+                    dx += sources.x_lo[j] - lx;
+                    dy += sources.y_lo[j] - ly;
+                    dz += sources.z_lo[j] - lz;
+                }
+                float r2 = dx * dx + dy * dy + dz * dz + softening_squared;
+
+                if (r2 > 0.0f) {
+                    float inv = 1.0f / std::sqrt(r2);
+                    float f   = sources.mass[j] * inv * inv * inv;
+                    sum_x += f * dx;
+                    sum_y += f * dy;
+                    sum_z += f * dz;
+                }
+            }
+
+            targets.ax[i] += sum_x;
+            targets.ay[i] += sum_y;
+            targets.az[i] += sum_z;
+        }
+    }
+
+    inline float64x2_t load_wide(const float* hi, const float* lo, std::size_t j) {
+        return vaddq_f64(vcvt_f64_f32(vld1_f32(hi + j)), vcvt_f64_f32(vld1_f32(lo + j)));
+    }
+
+    // `FP64`, two sources per step widened from their single precision pairs.
+    void direct_sum_fp64(const DirectSumTargets& targets, const DirectSumSources& sources, float softening_squared) {
+        constexpr std::size_t LANES = 2;
+
+        const float64x2_t eps2 = vdupq_n_f64(softening_squared);
+        const float64x2_t zero = vdupq_n_f64(0.0);
+
+        std::size_t full = sources.count - sources.count % LANES;
+
+        for (std::size_t i = 0; i < targets.count; ++i) {
+            double      tx = static_cast<double>(targets.x[i]) + targets.x_lo[i];
+            double      ty = static_cast<double>(targets.y[i]) + targets.y_lo[i];
+            double      tz = static_cast<double>(targets.z[i]) + targets.z_lo[i];
+            float64x2_t px = vdupq_n_f64(tx);
+            float64x2_t py = vdupq_n_f64(ty);
+            float64x2_t pz = vdupq_n_f64(tz);
+            float64x2_t ax = zero;
+            float64x2_t ay = zero;
+            float64x2_t az = zero;
+
+            for (std::size_t j = 0; j < full; j += LANES) {
+                float64x2_t dx = vsubq_f64(load_wide(sources.x, sources.x_lo, j), px);
+                float64x2_t dy = vsubq_f64(load_wide(sources.y, sources.y_lo, j), py);
+                float64x2_t dz = vsubq_f64(load_wide(sources.z, sources.z_lo, j), pz);
+                float64x2_t r2 = vfmaq_f64(vfmaq_f64(vfmaq_f64(eps2, dz, dz), dy, dy), dx, dx);
+
+                // Exact square root and division, the reciprocal estimate is far from double precision.
+                float64x2_t inv = vdivq_f64(vdupq_n_f64(1.0), vsqrtq_f64(r2));
+                inv = vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(inv), vcgtq_f64(r2, zero)));
+
+                float64x2_t sm = vcvt_f64_f32(vld1_f32(sources.mass + j));
+                float64x2_t f  = vmulq_f64(sm, vmulq_f64(inv, vmulq_f64(inv, inv)));
+                ax             = vfmaq_f64(ax, f, dx);
+                ay             = vfmaq_f64(ay, f, dy);
+                az             = vfmaq_f64(az, f, dz);
+            }
+
+            double sum_x = vaddvq_f64(ax);
+            double sum_y = vaddvq_f64(ay);
+            double sum_z = vaddvq_f64(az);
+
+            for (std::size_t j = full; j < sources.count; ++j) {
+                double dx = (static_cast<double>(sources.x[j]) + sources.x_lo[j]) - tx;
+                double dy = (static_cast<double>(sources.y[j]) + sources.y_lo[j]) - ty;
+                double dz = (static_cast<double>(sources.z[j]) + sources.z_lo[j]) - tz;
+                double r2 = dx * dx + dy * dy + dz * dz + softening_squared;
+
+                if (r2 > 0.0) {
+                    double inv = 1.0 / std::sqrt(r2);
+                    double f   = sources.mass[j] * inv * inv * inv;
+                    sum_x += f * dx;
+                    sum_y += f * dy;
+                    sum_z += f * dz;
+                }
+            }
+
+            targets.ax[i] += static_cast<float>(sum_x);
+            targets.ay[i] += static_cast<float>(sum_y);
+            targets.az[i] += static_cast<float>(sum_z);
+        }
+    }
+}  // namespace
+
+template <Precision P>
+void direct_sum_neon(const DirectSumTargets& targets, const DirectSumSources& sources, float softening_squared) {
+    if constexpr (P == Precision::FP64) {
+        direct_sum_fp64(targets, sources, softening_squared);
+    } else {
+        direct_sum_single<P>(targets, sources, softening_squared);
+    }
+}
+
+template void direct_sum_neon<Precision::FP32>(const DirectSumTargets&, const DirectSumSources&, float);
+template void direct_sum_neon<Precision::COMPENSATED>(const DirectSumTargets&, const DirectSumSources&, float);
+template void direct_sum_neon<Precision::FP64>(const DirectSumTargets&, const DirectSumSources&, float);
+
+// See kernels_avx2.cpp, four systems at a time.
+void packed_systems_neon(const PackedSystems& systems, float softening_squared) {
+    constexpr std::size_t LANES = 4;
+
+    const float32x4_t eps2     = vdupq_n_f32(softening_squared);
+    const float32x4_t zero     = vdupq_n_f32(0.0f);
+    const float32x4_t infinity = vdupq_n_f32(std::numeric_limits<float>::infinity());
+
+    std::size_t stride = systems.lanes;
+    std::size_t size   = systems.body_count * stride;
+    std::fill(systems.ax, systems.ax + size, 0.0f);
+    std::fill(systems.ay, systems.ay + size, 0.0f);
+    std::fill(systems.az, systems.az + size, 0.0f);
+
+    for (std::size_t lane = 0; lane < stride; lane += LANES) {
+        uint32x4_t  counts        = vld1q_u32(systems.counts + lane);
+        float32x4_t min_distance2 = infinity;
+        float32x4_t max_pull      = zero;
+
+        for (std::size_t i = 0; i < systems.body_count; ++i) {
+            std::size_t a  = i * stride + lane;
+            float32x4_t xa = vld1q_f32(systems.x + a);
+            float32x4_t ya = vld1q_f32(systems.y + a);
+            float32x4_t za = vld1q_f32(systems.z + a);
+            float32x4_t ma = vld1q_f32(systems.mass + a);
+            float32x4_t ax = zero;
+            float32x4_t ay = zero;
+            float32x4_t az = zero;
+
+            for (std::size_t j = i + 1; j < systems.body_count; ++j) {
+                std::size_t b     = j * stride + lane;
+                uint32x4_t  valid = vcgtq_u32(counts, vdupq_n_u32(static_cast<uint32_t>(j)));
+
+                float32x4_t dx = vsubq_f32(vld1q_f32(systems.x + b), xa);
+                float32x4_t dy = vsubq_f32(vld1q_f32(systems.y + b), ya);
+                float32x4_t dz = vsubq_f32(vld1q_f32(systems.z + b), za);
+                float32x4_t d2 = vfmaq_f32(vfmaq_f32(vmulq_f32(dz, dz), dy, dy), dx, dx);
+                float32x4_t r2 = vaddq_f32(d2, eps2);
+
+                min_distance2 = vminq_f32(min_distance2, vbslq_f32(valid, d2, infinity));
+
+                // As in `interact`, and lanes whose system has no body `j` get zero.
+                float32x4_t inv = vrsqrteq_f32(r2);
+                inv             = vmulq_f32(inv, vrsqrtsq_f32(vmulq_f32(r2, inv), inv));
+                inv             = vmulq_f32(inv, vrsqrtsq_f32(vmulq_f32(r2, inv), inv));
+                uint32x4_t used = vandq_u32(valid, vcgtq_f32(r2, zero));
+                inv             = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(inv), used));
+
+                float32x4_t inv3 = vmulq_f32(inv, vmulq_f32(inv, inv));
+
+                float32x4_t mb = vld1q_f32(systems.mass + b);
+                float32x4_t fa = vmulq_f32(mb, inv3);
+                float32x4_t fb = vmulq_f32(ma, inv3);
+                ax             = vfmaq_f32(ax, fa, dx);
+                ay             = vfmaq_f32(ay, fa, dy);
+                az             = vfmaq_f32(az, fa, dz);
+                vst1q_f32(systems.ax + b, vfmsq_f32(vld1q_f32(systems.ax + b), fb, dx));
+                vst1q_f32(systems.ay + b, vfmsq_f32(vld1q_f32(systems.ay + b), fb, dy));
+                vst1q_f32(systems.az + b, vfmsq_f32(vld1q_f32(systems.az + b), fb, dz));
+
+                max_pull = vmaxq_f32(max_pull, vmulq_f32(vaddq_f32(ma, mb), inv3));
+            }
+
+            vst1q_f32(systems.ax + a, vaddq_f32(vld1q_f32(systems.ax + a), ax));
+            vst1q_f32(systems.ay + a, vaddq_f32(vld1q_f32(systems.ay + a), ay));
+            vst1q_f32(systems.az + a, vaddq_f32(vld1q_f32(systems.az + a), az));
+        }
+
+        vst1q_f32(systems.min_distance2 + lane, min_distance2);
+        vst1q_f32(systems.max_pull + lane, max_pull);
+    }
+}
+
+}  // namespace nbody
+
+#endif
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "kernels.hpp"
+
+namespace nbody {
+
+namespace {
+    // Kahan summation: `compensation` holds the low order bits the last addition lost, negated.
+    class CompensatedSum {
+       public:
+        float sum          = 0.0f;
+        float compensation = 0.0f;
+
+        void add(float value) noexcept {
+            float corrected = value - compensation;
+            float next      = sum + corrected;
+            compensation    = (next - sum) - corrected;
+            sum             = next;
+        }
+    };
+
+    void direct_sum_fp32(const DirectSumTargets& targets, const DirectSumSources& sources, float softening_squared) {
+        for (std::size_t i = 0; i < targets.count; ++i) {
+            float px = targets.x[i];
+            float py = targets.y[i];
+            float pz = targets.z[i];
+            float ax = 0.0f;
+            float ay = 0.0f;
+            float az = 0.0f;
+
+            for (std::size_t j = 0; j < sources.count; ++j) {
+                float dx = sources.x[j] - px;
+                float dy = sources.y[j] - py;
+                float dz = sources.z[j] - pz;
+                float r2 = dx * dx + dy * dy + dz * dz + softening_squared;
+
+                if (r2 > 0.0f) {
+                    float inv = 1.0f / std::sqrt(r2);
+                    float f   = sources.mass[j] * inv * inv * inv;
+                    ax += f * dx;
+                    ay += f * dy;
+                    az += f * dz;
+                }
+            }
+
+            targets.ax[i] += ax;
+            targets.ay[i] += ay;
+            targets.az[i] += az;
+        }
+    }
+
+    void direct_sum_fp64(const DirectSumTargets& targets, const DirectSumSources& sources, float softening_squared) {
+        double eps2 = softening_squared;
+
+        for (std::size_t i = 0; i < targets.count; ++i) {
+            double px = static_cast<double>(targets.x[i]) + targets.x_lo[i];
+            double py = static_cast<double>(targets.y[i]) + targets.y_lo[i];
+            double pz = static_cast<double>(targets.z[i]) + targets.z_lo[i];
+            double ax = 0.0;
+            double ay = 0.0;
+            double az = 0.0;
+
+            for (std::size_t j = 0; j < sources.count; ++j) {
+                double dx = (static_cast<double>(sources.x[j]) + sources.x_lo[j]) - px;
+                double dy = (static_cast<double>(sources.y[j]) + sources.y_lo[j]) - py;
+                double dz = (static_cast<double>(sources.z[j]) + sources.z_lo[j]) - pz;
+                double r2 = dx * dx + dy * dy + dz * dz + eps2;
+
+                if (r2 > 0.0) {
+                    double inv = 1.0 / std::sqrt(r2);
+                    double f   = sources.mass[j] * inv * inv * inv;
+                    ax += f * dx;
+                    ay += f * dy;
+                    az += f * dz;
+                }
+            }
+
+            targets.ax[i] += static_cast<float>(ax);
+            targets.ay[i] += static_cast<float>(ay);
+            targets.az[i] += static_cast<float>(az);
+        }
+    }
+
+    // The high parts of nearby positions share their exponent, so their difference is exact and adding the
+    // difference of the low parts recovers the separation to about twice single precision.
+    void direct_sum_compensated(const DirectSumTargets& targets, const DirectSumSources& sources,
+                                float softening_squared) {
+        for (std::size_t i = 0; i < targets.count; ++i) {
+            float          px = targets.x[i];
+            float          py = targets.y[i];
+            float          pz = targets.z[i];
+            float          lx = targets.x_lo[i];
+            float          ly = targets.y_lo[i];
+            float          lz = targets.z_lo[i];
+            CompensatedSum ax;
+            CompensatedSum ay;
+            CompensatedSum az;
+
+            for (std::size_t j = 0; j < sources.count; ++j) {
+                float dx = (sources.x[j] - px) + (sources.x_lo[j] - lx);
+                float dy = (sources.y[j] - py) + (sources.y_lo[j] - ly);
+                float dz = (sources.z[j] - pz) + (sources.z_lo[j] - lz);
+                float r2 = dx * dx + dy * dy + dz * dz + softening_squared;
+
+                if (r2 > 0.0f) {
+                    float inv = 1.0f / std::sqrt(r2);
+                    float f   = sources.mass[j] * inv * inv * inv;
+                    ax.add(f * dx);
+                    ay.add(f * dy);
+                    az.add(f * dz);
+                }
+            }
+
+            targets.ax[i] += ax.sum - ax.compensation;
+            targets.ay[i] += ay.sum - ay.compensation;
+            targets.az[i] += az.sum - az.compensation;
+        }
+    }
+}  // namespace
+
+template <Precision P>
+void direct_sum_scalar(const DirectSumTargets& targets, const DirectSumSources& sources, float softening_squared) {
+    if constexpr (P == Precision::FP64) {
+        direct_sum_fp64(targets, sources, softening_squared);
+    } else if constexpr (P == Precision::COMPENSATED) {
+        direct_sum_compensated(targets, sources, softening_squared);
+    } else {
+        direct_sum_fp32(targets, sources, softening_squared);
+    }
+}
+
+template void direct_sum_scalar<Precision::FP32>(const DirectSumTargets&, const DirectSumSources&, float);
+template void direct_sum_scalar<Precision::COMPENSATED>(const DirectSumTargets&, const DirectSumSources&, float);
+template void direct_sum_scalar<Precision::FP64>(const DirectSumTargets&, const DirectSumSources&, float);
+
+void packed_systems_scalar(const PackedSystems& systems, float softening_squared) {
+    std::size_t lanes = systems.lanes;
+    std::size_t size  = systems.body_count * lanes;
+
+    std::fill(systems.ax, systems.ax + size, 0.0f);
+    std::fill(systems.ay, systems.ay + size, 0.0f);
+    std::fill(systems.az, systems.az + size, 0.0f);
+    std::fill(systems.min_distance2, systems.min_distance2 + lanes, std::numeric_limits<float>::infinity());
+    std::fill(systems.max_pull, systems.max_pull + lanes, 0.0f);
+
+    for (std::size_t i = 0; i < systems.body_count; ++i) {
+        for (std::size_t j = i + 1; j < systems.body_count; ++j) {
+            for (std::size_t lane = 0; lane < lanes; ++lane) {
+                if (j >= systems.counts[lane]) {
+                    continue;
+                }
+                std::size_t a = i * lanes + lane;
+                std::size_t b = j * lanes + lane;
+
+                float dx = systems.x[b] - systems.x[a];
+                float dy = systems.y[b] - systems.y[a];
+                float dz = systems.z[b] - systems.z[a];
+                float d2 = dx * dx + dy * dy + dz * dz;
+                float r2 = d2 + softening_squared;
+
+                systems.min_distance2[lane] = std::min(systems.min_distance2[lane], d2);
+                if (r2 > 0.0f) {
+                    float inv  = 1.0f / std::sqrt(r2);
+                    float inv3 = inv * inv * inv;
+                    float ma   = systems.mass[a];
+                    float mb   = systems.mass[b];
+                    float fa   = mb * inv3;
+                    float fb   = ma * inv3;
+                    systems.ax[a] += fa * dx;
+                    systems.ay[a] += fa * dy;
+                    systems.az[a] += fa * dz;
+                    systems.ax[b] -= fb * dx;
+                    systems.ay[b] -= fb * dy;
+                    systems.az[b] -= fb * dz;
+                    systems.max_pull[lane] = std::max(systems.max_pull[lane], (ma + mb) * inv3);
+                }
+            }
+        }
+    }
+}
+
+}  // namespace nbody
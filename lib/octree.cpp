@@ -0,0 +1,343 @@
+#include "octree.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+
+#include "morton.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+namespace nbody {
+
+namespace {
+    constexpr std::size_t BODY_GRAIN = 4096;
+    constexpr std::size_t NODE_GRAIN = 256;
+
+    class Bounds {
+       public:
+        float min_x = std::numeric_limits<float>::max();
+        float min_y = std::numeric_limits<float>::max();
+        float min_z = std::numeric_limits<float>::max();
+        float max_x = std::numeric_limits<float>::lowest();
+        float max_y = std::numeric_limits<float>::lowest();
+        float max_z = std::numeric_limits<float>::lowest();
+    };
+}  // namespace
+
+void Octree::build(const Bodies& bodies, uint32_t leaf_size, bool low_parts) {
+    NBODY_TRACE_ZONE("octree.build");
+
+    m_nodes.clear();
+    m_level_offsets.clear();
+
+    if (bodies.empty()) {
+        m_keys.clear();
+        m_order.clear();
+        m_x.clear();
+        m_y.clear();
+        m_z.clear();
+        m_mass.clear();
+        m_x_lo.clear();
+        m_y_lo.clear();
+        m_z_lo.clear();
+        m_extent       = 0.0;
+        m_built_extent = 0.0;
+        return;
+    }
+
+    compute_morton_keys(bodies);
+    gather_bodies(bodies, low_parts);
+    build_levels(std::max<uint32_t>(1, leaf_size));
+    compute_moments();
+
+    m_extent       = summed_extent();
+    m_built_extent = m_extent;
+}
+
+void Octree::refit(const Bodies& bodies) {
+    NBODY_TRACE_ZONE("octree.refit");
+
+    if (bodies.size() != m_order.size()) {
+        throw std::runtime_error("Octree::refit => the body count changed since the last build!");
+    }
+    if (bodies.empty()) {
+        return;
+    }
+
+    gather_bodies(bodies, !m_x_lo.empty());
+    compute_moments();
+    m_extent = summed_extent();
+}
+
+void Octree::compute_morton_keys(const Bodies& bodies) {
+    std::size_t count       = bodies.size();
+    std::size_t block_count = (count + BODY_GRAIN - 1) / BODY_GRAIN;
+
+    // Per block bounds first, so the reduction needs no synchronization.
+    std::vector<Bounds> block_bounds(block_count);
+    parallel_for(block_count, 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t block = begin; block < end; ++block) {
+            Bounds&     bounds = block_bounds[block];
+            std::size_t last   = std::min(count, (block + 1) * BODY_GRAIN);
+
+            for (std::size_t i = block * BODY_GRAIN; i < last; ++i) {
+                bounds.min_x = std::min(bounds.min_x, bodies.x[i]);
+                bounds.min_y = std::min(bounds.min_y, bodies.y[i]);
+                bounds.min_z = std::min(bounds.min_z, bodies.z[i]);
+                bounds.max_x = std::max(bounds.max_x, bodies.x[i]);
+                bounds.max_y = std::max(bounds.max_y, bodies.y[i]);
+                bounds.max_z = std::max(bounds.max_z, bodies.z[i]);
+            }
+        }
+    });
+
+    Bounds bounds;
+    for (const auto& block : block_bounds) {
+        bounds.min_x = std::min(bounds.min_x, block.min_x);
+        bounds.min_y = std::min(bounds.min_y, block.min_y);
+        bounds.min_z = std::min(bounds.min_z, block.min_z);
+        bounds.max_x = std::max(bounds.max_x, block.max_x);
+        bounds.max_y = std::max(bounds.max_y, block.max_y);
+        bounds.max_z = std::max(bounds.max_z, block.max_z);
+    }
+
+    // Quantize against a cube so that cells stay cubic at every depth.
+    float extent = std::max({bounds.max_x - bounds.min_x, bounds.max_y - bounds.min_y, bounds.max_z - bounds.min_z});
+    float scale  = extent > 0.0f ? static_cast<float>(MORTON_AXIS_MAX) / extent : 0.0f;
+
+    auto quantize = [scale](float value, float origin) {
+        float cell = std::floor((value - origin) * scale);
+        return static_cast<uint32_t>(std::clamp(cell, 0.0f, static_cast<float>(MORTON_AXIS_MAX)));
+    };
+
+    m_keys.resize(count);
+    parallel_for(count, BODY_GRAIN, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            m_keys[i].code  = morton_encode(quantize(bodies.x[i], bounds.min_x), quantize(bodies.y[i], bounds.min_y),
+                                            quantize(bodies.z[i], bounds.min_z));
+            m_keys[i].index = static_cast<uint32_t>(i);
+        }
+    });
+
+    // Ties broken by index keep the order, and therefore the tree, deterministic.
+    parallel_sort(m_keys.begin(), m_keys.end(), [](const MortonKey& a, const MortonKey& b) {
+        return a.code < b.code || (a.code == b.code && a.index < b.index);
+    });
+
+    m_order.resize(count);
+    parallel_for(count, BODY_GRAIN, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            m_order[i] = m_keys[i].index;
+        }
+    });
+}
+
+void Octree::gather_bodies(const Bodies& bodies, bool low_parts) {
+    std::size_t count = m_order.size();
+
+    m_x.resize(count);
+    m_y.resize(count);
+    m_z.resize(count);
+    m_mass.resize(count);
+
+    m_x_lo.resize(low_parts ? count : 0);
+    m_y_lo.resize(low_parts ? count : 0);
+    m_z_lo.resize(low_parts ? count : 0);
+
+    parallel_for(count, BODY_GRAIN, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            uint32_t index = m_order[i];
+            m_x[i]         = bodies.x[index];
+            m_y[i]         = bodies.y[index];
+            m_z[i]         = bodies.z[index];
+            m_mass[i]      = bodies.mass[index];
+        }
+        if (low_parts) {
+            for (std::size_t i = begin; i < end; ++i) {
+                uint32_t index = m_order[i];
+                m_x_lo[i]      = index < bodies.x_lo.size() ? bodies.x_lo[index] : 0.0f;
+                m_y_lo[i]      = index < bodies.y_lo.size() ? bodies.y_lo[index] : 0.0f;
+                m_z_lo[i]      = index < bodies.z_lo.size() ? bodies.z_lo[index] : 0.0f;
+            }
+        }
+    });
+}
+
+void Octree::build_levels(uint32_t leaf_size) {
+    OctreeNode root{};
+    root.first_child = NO_NODE;
+    root.child_count = 0;
+    root.body_begin  = 0;
+    root.body_end    = static_cast<uint32_t>(m_keys.size());
+    root.parent      = NO_NODE;
+    root.depth       = 0;
+
+    m_nodes.push_back(root);
+    m_level_offsets = {0, 1};
+
+    // Returns the end of the octant run that starts at `begin`. Codes in a node share every octant above
+    // `depth`, so the octant at `depth` is non-decreasing over the node's range.
+    auto octant_run_end = [this](uint32_t begin, uint32_t end, uint32_t depth) {
+        uint32_t octant = morton_octant(m_keys[begin].code, depth);
+        auto     in_run = [=](const MortonKey& key) { return morton_octant(key.code, depth) <= octant; };
+        auto     it     = std::partition_point(m_keys.begin() + begin, m_keys.begin() + end, in_run);
+        return static_cast<uint32_t>(it - m_keys.begin());
+    };
+
+    auto should_split = [leaf_size](const OctreeNode& node) {
+        return node.body_end - node.body_begin > leaf_size && node.depth < MORTON_BITS_PER_AXIS;
+    };
+
+    // Kept over builds, like the node array, so rebuilding every step reuses their memory.
+    std::vector<uint32_t>& child_counts = m_child_counts;
+
+    for (uint32_t depth = 0;; ++depth) {
+        uint32_t level_begin = m_level_offsets[depth];
+        uint32_t level_end   = m_level_offsets[depth + 1];
+        uint32_t level_size  = level_end - level_begin;
+
+        if (level_size == 0) {
+            m_level_offsets.pop_back();
+            break;
+        }
+
+        // Pass 1: count the non-empty octants of every node of the level.
+        child_counts.assign(level_size, 0);
+        parallel_for(level_size, NODE_GRAIN, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                const OctreeNode& node = m_nodes[level_begin + i];
+                if (!should_split(node)) {
+                    continue;
+                }
+
+                uint32_t count = 0;
+                for (uint32_t run = node.body_begin; run < node.body_end;) {
+                    run = octant_run_end(run, node.body_end, depth);
+                    ++count;
+                }
+                child_counts[i] = count;
+            }
+        });
+
+        // Exclusive scan gives every node the position of its first child in the next level.
+        uint32_t next_level_size = 0;
+        for (uint32_t i = 0; i < level_size; ++i) {
+            OctreeNode& node = m_nodes[level_begin + i];
+            node.child_count = child_counts[i];
+            node.first_child = child_counts[i] > 0 ? level_end + next_level_size : NO_NODE;
+            next_level_size += child_counts[i];
+        }
+
+        m_nodes.resize(level_end + next_level_size);
+        m_level_offsets.push_back(level_end + next_level_size);
+
+        // Pass 2: write the children.
+        parallel_for(level_size, NODE_GRAIN, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                uint32_t          node_index = level_begin + static_cast<uint32_t>(i);
+                const OctreeNode& node       = m_nodes[node_index];
+
+                uint32_t child_index = node.first_child;
+                for (uint32_t run = node.body_begin; node.child_count > 0 && run < node.body_end;) {
+                    uint32_t run_end = octant_run_end(run, node.body_end, depth);
+
+                    OctreeNode& child = m_nodes[child_index++];
+                    child             = OctreeNode{};
+                    child.first_child = NO_NODE;
+                    child.child_count = 0;
+                    child.body_begin  = run;
+                    child.body_end    = run_end;
+                    child.parent      = node_index;
+                    child.depth       = depth + 1;
+
+                    run = run_end;
+                }
+            }
+        });
+    }
+}
+
+void Octree::compute_moments() {
+    // Bottom up, one level at a time: all children of a level are final before their parents read them.
+    for (std::size_t depth = m_level_offsets.size() - 1; depth-- > 0;) {
+        uint32_t level_begin = m_level_offsets[depth];
+        uint32_t level_end   = m_level_offsets[depth + 1];
+
+        parallel_for(level_end - level_begin, NODE_GRAIN, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                OctreeNode& node = m_nodes[level_begin + i];
+
+                Bounds bounds;
+                float  mass = 0.0f;
+                float  mx   = 0.0f;
+                float  my   = 0.0f;
+                float  mz   = 0.0f;
+
+                if (node.is_leaf()) {
+                    for (uint32_t b = node.body_begin; b < node.body_end; ++b) {
+                        mass += m_mass[b];
+                        mx += m_mass[b] * m_x[b];
+                        my += m_mass[b] * m_y[b];
+                        mz += m_mass[b] * m_z[b];
+
+                        bounds.min_x = std::min(bounds.min_x, m_x[b]);
+                        bounds.min_y = std::min(bounds.min_y, m_y[b]);
+                        bounds.min_z = std::min(bounds.min_z, m_z[b]);
+                        bounds.max_x = std::max(bounds.max_x, m_x[b]);
+                        bounds.max_y = std::max(bounds.max_y, m_y[b]);
+                        bounds.max_z = std::max(bounds.max_z, m_z[b]);
+                    }
+                } else {
+                    for (uint32_t c = node.first_child; c < node.first_child + node.child_count; ++c) {
+                        const OctreeNode& child = m_nodes[c];
+
+                        mass += child.mass;
+                        mx += child.mass * child.com_x;
+                        my += child.mass * child.com_y;
+                        mz += child.mass * child.com_z;
+
+                        bounds.min_x = std::min(bounds.min_x, child.min_x);
+                        bounds.min_y = std::min(bounds.min_y, child.min_y);
+                        bounds.min_z = std::min(bounds.min_z, child.min_z);
+                        bounds.max_x = std::max(bounds.max_x, child.max_x);
+                        bounds.max_y = std::max(bounds.max_y, child.max_y);
+                        bounds.max_z = std::max(bounds.max_z, child.max_z);
+                    }
+                }
+
+                node.mass  = mass;
+                node.min_x = bounds.min_x;
+                node.min_y = bounds.min_y;
+                node.min_z = bounds.min_z;
+                node.max_x = bounds.max_x;
+                node.max_y = bounds.max_y;
+                node.max_z = bounds.max_z;
+
+                // Massless nodes (tracers only) fall back to the center of their bounds.
+                if (mass > 0.0f) {
+                    node.com_x = mx / mass;
+                    node.com_y = my / mass;
+                    node.com_z = mz / mass;
+                } else {
+                    node.com_x = 0.5f * (bounds.min_x + bounds.max_x);
+                    node.com_y = 0.5f * (bounds.min_y + bounds.max_y);
+                    node.com_z = 0.5f * (bounds.min_z + bounds.max_z);
+                }
+            }
+        });
+    }
+}
+
+// Longest sides rather than volumes, so that flat and empty cells still count.
+double Octree::summed_extent() const {
+    double extent = 0.0;
+    for (const OctreeNode& node : m_nodes) {
+        extent += std::max({node.max_x - node.min_x, node.max_y - node.min_y, node.max_z - node.min_z});
+    }
+    return extent;
+}
+
+}  // namespace nbody
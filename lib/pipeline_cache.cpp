@@ -0,0 +1,263 @@
+#include "pipeline_cache.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace nbody {
+
+namespace {
+
+// FNV-1a
+uint64_t checksum(const uint8_t* data, std::size_t size) noexcept {
+    uint64_t hash = 0xcbf2'9ce4'8422'2325ull;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 0x0000'0100'0000'01b3ull;
+    }
+    return hash;
+}
+
+std::vector<uint8_t> read_cache_file(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        return {};
+    }
+
+    std::vector<uint8_t> contents(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(contents.data()), static_cast<std::streamsize>(contents.size()));
+    if (!file) {
+        return {};
+    }
+    return contents;
+}
+
+// Writes `header` and `data` to a temporary file next to `path` and renames it over the old file.
+bool write_cache_file(const std::filesystem::path& path, const void* header, std::size_t header_size,
+                      const void* data, std::size_t size) {
+    std::error_code error;
+    if (path.has_parent_path()) {
+        std::filesystem::create_directories(path.parent_path(), error);
+        if (error) {
+            return false;
+        }
+    }
+
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(static_cast<const char*>(header), static_cast<std::streamsize>(header_size));
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        file.close();
+        if (!file) {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+// The device UUID needs Vulkan 1.1, on a 1.0 device it stays zero and the other IDs have to do.
+std::array<uint8_t, VK_UUID_SIZE> device_uuid(VkPhysicalDevice physical_device,
+                                              const VkPhysicalDeviceProperties& properties) {
+    std::array<uint8_t, VK_UUID_SIZE> uuid{};
+    if (properties.apiVersion >= VK_API_VERSION_1_1) {
+        VkPhysicalDeviceIDProperties id_properties{};
+        id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &id_properties;
+        vkGetPhysicalDeviceProperties2(physical_device, &properties2);
+
+        std::memcpy(uuid.data(), id_properties.deviceUUID, VK_UUID_SIZE);
+    }
+    return uuid;
+}
+
+}  // namespace
+
+std::filesystem::path default_cache_path(const char* file_name) {
+    std::filesystem::path directory;
+    if (const char* cache_home = std::getenv("XDG_CACHE_HOME"); cache_home != nullptr && *cache_home != '\0') {
+        directory = cache_home;
+    } else if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+        directory = std::filesystem::path(home) / ".cache";
+    } else {
+        return file_name;
+    }
+    return directory / "jennifers-body" / file_name;
+}
+
+void PipelineCache::create(VkDevice device, VkPhysicalDevice physical_device, std::filesystem::path path) {
+    if (m_cache != VK_NULL_HANDLE) {
+        throw std::runtime_error("PipelineCache::create => cache was already created.");
+    }
+
+    m_device = device;
+    m_path   = std::move(path);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    m_identity                = Header{};
+    m_identity.magic          = MAGIC;
+    m_identity.version        = VERSION;
+    m_identity.vendor_id      = properties.vendorID;
+    m_identity.device_id      = properties.deviceID;
+    m_identity.driver_version = properties.driverVersion;
+    std::memcpy(m_identity.pipeline_cache_uuid.data(), properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    // Without a device UUID the pipeline cache UUID, which the driver changes whenever its cache format does,
+    // identifies the data on its own.
+    m_identity.device_uuid = device_uuid(physical_device, properties);
+
+    std::vector<uint8_t> contents = read_cache_file(m_path);
+    const uint8_t*       data     = nullptr;
+    std::size_t          size     = 0;
+
+    if (contents.size() >= sizeof(Header)) {
+        Header header;
+        std::memcpy(&header, contents.data(), sizeof(Header));
+
+        const uint8_t* payload      = contents.data() + sizeof(Header);
+        std::size_t    payload_size = contents.size() - sizeof(Header);
+
+        bool same_device = header.magic == m_identity.magic && header.version == m_identity.version &&
+                           header.vendor_id == m_identity.vendor_id && header.device_id == m_identity.device_id &&
+                           header.driver_version == m_identity.driver_version &&
+                           header.device_uuid == m_identity.device_uuid &&
+                           header.pipeline_cache_uuid == m_identity.pipeline_cache_uuid;
+
+        if (same_device && header.data_size == payload_size && header.checksum == checksum(payload, payload_size)) {
+            data = payload;
+            size = payload_size;
+        }
+    }
+
+    VkPipelineCacheCreateInfo create_info{};
+    create_info.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    create_info.initialDataSize = size;
+    create_info.pInitialData    = data;
+
+    VkResult result = vkCreatePipelineCache(m_device, &create_info, nullptr, &m_cache);
+    if (result != VK_SUCCESS && data != nullptr) {
+        // The driver may still turn down data that passed our checks, and an empty cache is always fine.
+        create_info.initialDataSize = 0;
+        create_info.pInitialData    = nullptr;
+        data                        = nullptr;
+        result                      = vkCreatePipelineCache(m_device, &create_info, nullptr, &m_cache);
+    }
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("PipelineCache::create => failed to create pipeline cache!");
+    }
+
+    m_loaded_from_disk = data != nullptr;
+}
+
+bool PipelineCache::save() const {
+    if (m_cache == VK_NULL_HANDLE) {
+        return false;
+    }
+
+    std::size_t size = 0;
+    if (vkGetPipelineCacheData(m_device, m_cache, &size, nullptr) != VK_SUCCESS) {
+        return false;
+    }
+
+    // Pipelines created between the two calls can grow the data, which the second call reports as
+    // `VK_INCOMPLETE`. Writing that prefix would be valid, but a complete snapshot is worth one more try.
+    std::vector<uint8_t> data(size);
+    VkResult             result = vkGetPipelineCacheData(m_device, m_cache, &size, data.data());
+    if (result == VK_INCOMPLETE) {
+        vkGetPipelineCacheData(m_device, m_cache, &size, nullptr);
+        data.resize(size);
+        result = vkGetPipelineCacheData(m_device, m_cache, &size, data.data());
+    }
+    if (result != VK_SUCCESS) {
+        return false;
+    }
+    data.resize(size);
+
+    Header header    = m_identity;
+    header.data_size = size;
+    header.checksum  = checksum(data.data(), size);
+
+    return write_cache_file(m_path, &header, sizeof(Header), data.data(), size);
+}
+
+void PipelineCache::destroy() noexcept {
+    if (m_cache != VK_NULL_HANDLE) {
+        vkDestroyPipelineCache(m_device, m_cache, nullptr);
+        m_cache = VK_NULL_HANDLE;
+    }
+}
+
+std::optional<VkPhysicalDevice> DeviceProbeCache::load(std::span<const VkPhysicalDevice> devices, uint32_t key,
+                                                       std::vector<uint32_t>& values) const {
+    std::vector<uint8_t> contents = read_cache_file(m_path);
+    if (contents.size() < sizeof(Header)) {
+        return std::nullopt;
+    }
+
+    Header header;
+    std::memcpy(&header, contents.data(), sizeof(Header));
+
+    const uint8_t* payload      = contents.data() + sizeof(Header);
+    std::size_t    payload_size = contents.size() - sizeof(Header);
+    if (header.magic != MAGIC || header.version != VERSION || header.key != key ||
+        header.value_count != payload_size / sizeof(uint32_t) || payload_size % sizeof(uint32_t) != 0 ||
+        header.checksum != checksum(payload, payload_size)) {
+        return std::nullopt;
+    }
+
+    // Only the properties of every device, which cost nothing next to the queries of a probe.
+    for (VkPhysicalDevice device : devices) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+
+        if (properties.vendorID == header.vendor_id && properties.deviceID == header.device_id &&
+            properties.driverVersion == header.driver_version &&
+            device_uuid(device, properties) == header.device_uuid) {
+            values.resize(header.value_count);
+            if (payload_size > 0) {
+                std::memcpy(values.data(), payload, payload_size);
+            }
+            return device;
+        }
+    }
+    return std::nullopt;
+}
+
+bool DeviceProbeCache::save(VkPhysicalDevice device, uint32_t key, std::span<const uint32_t> values) const {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+
+    Header header{};
+    header.magic          = MAGIC;
+    header.version        = VERSION;
+    header.key            = key;
+    header.vendor_id      = properties.vendorID;
+    header.device_id      = properties.deviceID;
+    header.driver_version = properties.driverVersion;
+    header.device_uuid    = device_uuid(device, properties);
+    header.value_count    = values.size();
+    header.checksum       = checksum(reinterpret_cast<const uint8_t*>(values.data()), values.size_bytes());
+
+    return write_cache_file(m_path, &header, sizeof(Header), values.data(), values.size_bytes());
+}
+
+}  // namespace nbody
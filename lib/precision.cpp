@@ -0,0 +1,40 @@
+#include "precision.hpp"
+
+namespace nbody {
+
+std::string_view precision_name(Precision precision) noexcept {
+    switch (precision) {
+        case Precision::FP32:
+            return "fp32";
+        case Precision::COMPENSATED:
+            return "compensated";
+        case Precision::FP64:
+            return "fp64";
+        case Precision::RELATIVE:
+            return "relative";
+    }
+    return "unknown";
+}
+
+std::optional<Precision> parse_precision(std::string_view name) noexcept {
+    for (Precision precision : {Precision::FP32, Precision::COMPENSATED, Precision::FP64, Precision::RELATIVE}) {
+        if (precision_name(precision) == name) {
+            return precision;
+        }
+    }
+    return std::nullopt;
+}
+
+void rebase_coordinates(const float* hi, const float* lo, double origin, std::size_t count, float* out) noexcept {
+    if (lo == nullptr) {
+        for (std::size_t i = 0; i < count; ++i) {
+            out[i] = static_cast<float>(static_cast<double>(hi[i]) - origin);
+        }
+        return;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<float>((static_cast<double>(hi[i]) + static_cast<double>(lo[i])) - origin);
+    }
+}
+
+}  // namespace nbody
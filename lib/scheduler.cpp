@@ -0,0 +1,298 @@
+#include "scheduler.hpp"
+
+#include <bit>
+#include <string>
+#include <utility>
+
+#include "trace.hpp"
+
+namespace nbody {
+
+namespace {
+    // Rounds of failed searches a worker yields through before it goes to sleep.
+    constexpr int SPIN_COUNT = 64;
+
+    thread_local const Scheduler* t_scheduler = nullptr;
+    thread_local std::size_t      t_worker    = SIZE_MAX;
+
+    // xorshift64, only used to pick steal victims.
+    thread_local uint64_t t_random_state = 0x9e3779b97f4a7c15ull;
+
+    uint64_t next_random() noexcept {
+        t_random_state ^= t_random_state << 13;
+        t_random_state ^= t_random_state >> 7;
+        t_random_state ^= t_random_state << 17;
+        return t_random_state;
+    }
+}  // namespace
+
+/* ---- WorkStealingDeque ---- */
+
+WorkStealingDeque::WorkStealingDeque(std::size_t capacity) {
+    m_rings.push_back(std::make_unique<Ring>(static_cast<int64_t>(std::bit_ceil(std::max<std::size_t>(2, capacity)))));
+    m_ring.store(m_rings.back().get(), std::memory_order_relaxed);
+}
+
+WorkStealingDeque::~WorkStealingDeque() {
+    while (Task* task = pop()) {
+        delete task;
+    }
+}
+
+void WorkStealingDeque::push(Task* task) {
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    int64_t top    = m_top.load(std::memory_order_acquire);
+    Ring*   ring   = m_ring.load(std::memory_order_relaxed);
+
+    if (bottom - top > ring->capacity() - 1) {
+        ring = grow(ring, top, bottom);
+    }
+
+    ring->put(bottom, task);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+}
+
+Task* WorkStealingDeque::pop() {
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    Ring*   ring   = m_ring.load(std::memory_order_relaxed);
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Task* task = ring->get(bottom);
+    if (top == bottom) {
+        // Last task, race the thieves for it.
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            task = nullptr;
+        }
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+Task* WorkStealingDeque::steal() {
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+    if (top >= bottom) {
+        return nullptr;
+    }
+
+    Ring* ring = m_ring.load(std::memory_order_acquire);
+    Task* task = ring->get(top);
+    if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return task;
+}
+
+WorkStealingDeque::Ring* WorkStealingDeque::grow(Ring* ring, int64_t top, int64_t bottom) {
+    auto bigger = std::make_unique<Ring>(2 * ring->capacity());
+    for (int64_t i = top; i < bottom; ++i) {
+        bigger->put(i, ring->get(i));
+    }
+
+    Ring* result = bigger.get();
+    m_rings.push_back(std::move(bigger));
+    m_ring.store(result, std::memory_order_release);
+    return result;
+}
+
+/* ---- Scheduler ---- */
+
+Scheduler::Scheduler(std::size_t worker_count) {
+    worker_count = std::max<std::size_t>(1, worker_count);
+
+    // Every deque has to exist before the first worker starts stealing from them.
+    for (std::size_t i = 0; i < worker_count; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    m_active_workers.store(worker_count, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < worker_count; ++i) {
+        m_workers[i]->thread = std::thread([this, i] { worker_loop(i); });
+    }
+}
+
+Scheduler::~Scheduler() {
+    m_stopping.store(true, std::memory_order_seq_cst);
+    {
+        std::lock_guard lock(m_sleep_mutex);
+    }
+    m_wake.notify_all();
+    m_unpark.notify_all();
+
+    for (auto& worker : m_workers) {
+        worker->thread.join();
+    }
+
+    for (Task* task : m_injected) {
+        delete task;
+    }
+}
+
+Scheduler& Scheduler::global() {
+    static Scheduler scheduler(hardware_thread_count() - 1);
+    return scheduler;
+}
+
+void Scheduler::set_active_worker_count(std::size_t count) {
+    {
+        std::lock_guard lock(m_sleep_mutex);
+        m_active_workers.store(std::min(count, m_workers.size()), std::memory_order_seq_cst);
+    }
+    m_unpark.notify_all();
+}
+
+void Scheduler::spawn(TaskGroup& group, std::function<void()> function) {
+    group.m_pending.fetch_add(1, std::memory_order_relaxed);
+    Task* task = new Task{std::move(function), &group};
+
+    std::size_t worker = current_worker();
+    if (worker != NO_WORKER) {
+        m_workers[worker]->deque.push(task);
+    } else {
+        std::lock_guard lock(m_injection_mutex);
+        m_injected.push_back(task);
+        m_injected_count.fetch_add(1, std::memory_order_release);
+    }
+
+    notify_task_queued();
+}
+
+void Scheduler::wait(TaskGroup& group) {
+    std::size_t worker = current_worker();
+
+    while (!group.done()) {
+        if (Task* task = find_task(worker)) {
+            run(task);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    if (group.m_failed.load(std::memory_order_acquire)) {
+        group.m_failed.store(false, std::memory_order_relaxed);
+        std::rethrow_exception(std::exchange(group.m_exception, nullptr));
+    }
+}
+
+std::size_t Scheduler::current_worker() const noexcept { return t_scheduler == this ? t_worker : NO_WORKER; }
+
+Task* Scheduler::find_task(std::size_t worker) {
+    Task* task = nullptr;
+
+    if (worker != NO_WORKER) {
+        task = m_workers[worker]->deque.pop();
+    }
+
+    if (!task && m_injected_count.load(std::memory_order_acquire) > 0) {
+        std::lock_guard lock(m_injection_mutex);
+        if (!m_injected.empty()) {
+            task = m_injected.front();
+            m_injected.pop_front();
+            m_injected_count.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (!task) {
+        task = steal_task(worker);
+    }
+
+    if (task) {
+        m_queued.fetch_sub(1, std::memory_order_seq_cst);
+    }
+    return task;
+}
+
+Task* Scheduler::steal_task(std::size_t worker) {
+    std::size_t count = m_workers.size();
+    std::size_t first = static_cast<std::size_t>(next_random() % count);
+
+    for (std::size_t i = 0; i < count; ++i) {
+        std::size_t victim = (first + i) % count;
+        if (victim == worker) {
+            continue;
+        }
+        if (Task* task = m_workers[victim]->deque.steal()) {
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+void Scheduler::run(Task* task) {
+    TaskGroup* group = task->group;
+
+    try {
+        task->function();
+    } catch (...) {
+        if (!group->m_failed.exchange(true, std::memory_order_acq_rel)) {
+            group->m_exception = std::current_exception();
+        }
+    }
+
+    delete task;
+
+    // Last touch of the group, the waiter may destroy it as soon as the count reaches zero.
+    group->m_pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void Scheduler::worker_loop(std::size_t worker) {
+    t_scheduler    = this;
+    t_worker       = worker;
+    t_random_state = 0x9e3779b97f4a7c15ull * (worker + 1);
+    Tracer::global().set_thread_name("worker " + std::to_string(worker));
+
+    while (!m_stopping.load(std::memory_order_acquire)) {
+        if (worker >= m_active_workers.load(std::memory_order_acquire)) {
+            std::unique_lock lock(m_sleep_mutex);
+            m_unpark.wait(lock, [this, worker] {
+                return m_stopping.load(std::memory_order_seq_cst) ||
+                       worker < m_active_workers.load(std::memory_order_seq_cst);
+            });
+            continue;
+        }
+
+        if (Task* task = find_task(worker)) {
+            run(task);
+            continue;
+        }
+
+        bool queued = false;
+        for (int spin = 0; spin < SPIN_COUNT && !queued; ++spin) {
+            std::this_thread::yield();
+            queued = m_queued.load(std::memory_order_relaxed) > 0;
+        }
+        if (queued) {
+            continue;
+        }
+
+        std::unique_lock lock(m_sleep_mutex);
+        m_sleeping.fetch_add(1, std::memory_order_seq_cst);
+        m_wake.wait(lock, [this] {
+            return m_stopping.load(std::memory_order_seq_cst) || m_queued.load(std::memory_order_seq_cst) > 0;
+        });
+        m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void Scheduler::notify_task_queued() {
+    m_queued.fetch_add(1, std::memory_order_seq_cst);
+
+    // Taking the lock orders this against a worker between checking `m_queued` and starting to wait.
+    if (m_sleeping.load(std::memory_order_seq_cst) > 0) {
+        {
+            std::lock_guard lock(m_sleep_mutex);
+        }
+        m_wake.notify_one();
+    }
+}
+
+}  // namespace nbody
@@ -0,0 +1,38 @@
+#include "shader_library.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace nbody {
+
+std::span<const uint32_t> load_shader(std::string_view path, std::vector<uint32_t>& storage) {
+    std::span<const EmbeddedShader> shaders = embedded_shaders();
+
+    auto embedded = std::find_if(shaders.begin(), shaders.end(),
+                                 [&](const EmbeddedShader& shader) { return shader.path == path; });
+    if (embedded != shaders.end()) {
+        return embedded->code;
+    }
+
+    std::ifstream file(std::string(path), std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("load_shader => failed to open " + std::string(path));
+    }
+
+    auto size = static_cast<std::size_t>(file.tellg());
+    if (size % sizeof(uint32_t) != 0) {
+        throw std::runtime_error("load_shader => " + std::string(path) + " is not SPIR-V.");
+    }
+
+    storage.resize(size / sizeof(uint32_t));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(storage.data()), static_cast<std::streamsize>(size));
+    if (!file) {
+        throw std::runtime_error("load_shader => failed to read " + std::string(path));
+    }
+    return storage;
+}
+
+}  // namespace nbody
@@ -0,0 +1,132 @@
+#include "simd.hpp"
+
+#include "kernels.hpp"
+
+namespace nbody {
+
+bool is_isa_supported(Isa isa) noexcept {
+    switch (isa) {
+        case Isa::SCALAR:
+            return true;
+#if defined(__aarch64__)
+        case Isa::NEON:
+            return true;
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+        case Isa::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case Isa::AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+Isa detect_isa() noexcept {
+    for (Isa isa : {Isa::AVX512, Isa::AVX2, Isa::NEON}) {
+        if (is_isa_supported(isa)) {
+            return isa;
+        }
+    }
+    return Isa::SCALAR;
+}
+
+std::string_view isa_name(Isa isa) noexcept {
+    switch (isa) {
+        case Isa::SCALAR:
+            return "scalar";
+        case Isa::NEON:
+            return "neon";
+        case Isa::AVX2:
+            return "avx2";
+        case Isa::AVX512:
+            return "avx512";
+    }
+    return "unknown";
+}
+
+std::optional<Isa> parse_isa(std::string_view name) noexcept {
+    for (Isa isa : {Isa::SCALAR, Isa::NEON, Isa::AVX2, Isa::AVX512}) {
+        if (isa_name(isa) == name) {
+            return isa;
+        }
+    }
+    if (name == "auto") {
+        return detect_isa();
+    }
+    return std::nullopt;
+}
+
+namespace {
+    template <Precision P>
+    DirectSumKernel select_kernel(Isa isa) noexcept {
+        // Fall back towards narrower instruction sets until one is usable.
+        switch (isa) {
+            case Isa::AVX512:
+#if defined(__x86_64__) || defined(_M_X64)
+                if (is_isa_supported(Isa::AVX512)) {
+                    return direct_sum_avx512<P>;
+                }
+#endif
+                [[fallthrough]];
+            case Isa::AVX2:
+#if defined(__x86_64__) || defined(_M_X64)
+                if (is_isa_supported(Isa::AVX2)) {
+                    return direct_sum_avx2<P>;
+                }
+#endif
+                [[fallthrough]];
+            case Isa::NEON:
+#if defined(__aarch64__)
+                return direct_sum_neon<P>;
+#endif
+                [[fallthrough]];
+            case Isa::SCALAR:
+                break;
+        }
+        return direct_sum_scalar<P>;
+    }
+}  // namespace
+
+DirectSumKernel select_direct_sum_kernel(Isa isa, Precision precision) noexcept {
+    switch (precision) {
+        case Precision::COMPENSATED:
+            return select_kernel<Precision::COMPENSATED>(isa);
+        case Precision::FP64:
+            return select_kernel<Precision::FP64>(isa);
+        case Precision::FP32:
+        case Precision::RELATIVE:
+            break;
+    }
+    return select_kernel<Precision::FP32>(isa);
+}
+
+PackedSystemsKernel select_packed_systems_kernel(Isa isa) noexcept {
+    switch (isa) {
+        case Isa::AVX512:
+#if defined(__x86_64__) || defined(_M_X64)
+            if (is_isa_supported(Isa::AVX512)) {
+                return packed_systems_avx512;
+            }
+#endif
+            [[fallthrough]];
+        case Isa::AVX2:
+#if defined(__x86_64__) || defined(_M_X64)
+            if (is_isa_supported(Isa::AVX2)) {
+                return packed_systems_avx2;
+            }
+#endif
+            [[fallthrough]];
+        case Isa::NEON:
+#if defined(__aarch64__)
+            return packed_systems_neon;
+#endif
+            [[fallthrough]];
+        case Isa::SCALAR:
+            break;
+    }
+    return packed_systems_scalar;
+}
+
+}  // namespace nbody
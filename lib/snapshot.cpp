@@ -0,0 +1,537 @@
+#include "snapshot.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "parallel.hpp"
+
+namespace nbody {
+
+static_assert(std::endian::native == std::endian::little, "Snapshot files store little endian values in place");
+
+namespace {
+    constexpr uint64_t    MAGIC        = 0x0100'5041'4e53'424aull;  // "JBSNAP\0\1"
+    constexpr uint32_t    VERSION      = 1;
+    constexpr std::size_t ALIGNMENT    = SIMD_ALIGNMENT;
+    constexpr std::size_t COPY_GRAIN   = 64 * 1024;
+    constexpr std::size_t MAX_LITERALS = 128;
+    constexpr std::size_t MIN_RUN      = 3;
+    constexpr std::size_t MAX_RUN      = MIN_RUN + 127;
+
+    class FrameHeader {
+       public:
+        uint64_t magic;
+        uint32_t version;
+        uint32_t column_count;
+        uint64_t body_count;
+        uint64_t step;
+        double   time;
+        uint64_t frame_size;
+        uint64_t reserved[2];
+    };
+
+    static_assert(sizeof(FrameHeader) == 64, "FrameHeader should fill exactly one cache line");
+    static_assert(sizeof(SnapshotColumnRecord) == 24, "SnapshotColumnRecord is stored as is");
+
+    constexpr std::size_t align_up(std::size_t size) noexcept { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+    // Columns start right after the header and the column records.
+    constexpr std::size_t columns_offset(std::size_t column_count) noexcept {
+        return align_up(sizeof(FrameHeader) + sizeof(SnapshotColumnRecord) * column_count);
+    }
+
+    constexpr std::size_t MIN_COLUMNS_OFFSET = columns_offset(SNAPSHOT_COLUMN_COUNT_NO_LOW);
+    constexpr std::size_t MAX_COLUMNS_OFFSET = columns_offset(SNAPSHOT_COLUMN_COUNT);
+
+    aligned_vector<float>& column_of(Bodies& bodies, SnapshotColumn column) noexcept {
+        switch (column) {
+            case SnapshotColumn::X:    return bodies.x;
+            case SnapshotColumn::Y:    return bodies.y;
+            case SnapshotColumn::Z:    return bodies.z;
+            case SnapshotColumn::VX:   return bodies.vx;
+            case SnapshotColumn::VY:   return bodies.vy;
+            case SnapshotColumn::VZ:   return bodies.vz;
+            case SnapshotColumn::MASS: return bodies.mass;
+            case SnapshotColumn::X_LO: return bodies.x_lo;
+            case SnapshotColumn::Y_LO: return bodies.y_lo;
+            case SnapshotColumn::Z_LO: return bodies.z_lo;
+        }
+        return bodies.mass;
+    }
+
+    const aligned_vector<float>& column_of(const Bodies& bodies, SnapshotColumn column) noexcept {
+        return column_of(const_cast<Bodies&>(bodies), column);
+    }
+
+    // Plane `p` of the shuffled bytes holds byte `p` of every value, so the sign and exponent bytes of all
+    // values end up next to each other, where they form long runs.
+    void shuffle(const float* values, std::size_t count, uint8_t* planes) noexcept {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(values);
+        for (std::size_t plane = 0; plane < sizeof(float); ++plane) {
+            for (std::size_t i = 0; i < count; ++i) {
+                planes[plane * count + i] = bytes[i * sizeof(float) + plane];
+            }
+        }
+    }
+
+    void unshuffle(const uint8_t* planes, std::size_t count, float* values) noexcept {
+        auto* bytes = reinterpret_cast<uint8_t*>(values);
+        for (std::size_t plane = 0; plane < sizeof(float); ++plane) {
+            for (std::size_t i = 0; i < count; ++i) {
+                bytes[i * sizeof(float) + plane] = planes[plane * count + i];
+            }
+        }
+    }
+
+    // Control byte `c < 0x80` is followed by `c + 1` literal bytes, `c >= 0x80` by one byte repeated
+    // `(c & 0x7f) + MIN_RUN` times.
+    void encode_rle(const uint8_t* bytes, std::size_t size, std::vector<uint8_t>& result) {
+        result.clear();
+        std::size_t k = 0;
+        while (k < size) {
+            std::size_t run = 1;
+            while (k + run < size && run < MAX_RUN && bytes[k + run] == bytes[k]) {
+                ++run;
+            }
+
+            if (run >= MIN_RUN) {
+                result.push_back(static_cast<uint8_t>(0x80 | (run - MIN_RUN)));
+                result.push_back(bytes[k]);
+                k += run;
+                continue;
+            }
+
+            // Literals up to the next run worth encoding.
+            std::size_t begin = k;
+            while (k < size && k - begin < MAX_LITERALS &&
+                   !(k + 2 < size && bytes[k] == bytes[k + 1] && bytes[k] == bytes[k + 2])) {
+                ++k;
+            }
+            result.push_back(static_cast<uint8_t>(k - begin - 1));
+            result.insert(result.end(), bytes + begin, bytes + k);
+        }
+    }
+
+    // Returns false unless `encoded` expands to exactly `size` bytes.
+    bool decode_rle(const uint8_t* encoded, std::size_t encoded_size, uint8_t* bytes, std::size_t size) noexcept {
+        std::size_t k        = 0;
+        std::size_t position = 0;
+        while (position < encoded_size) {
+            uint8_t control = encoded[position++];
+            if (control & 0x80) {
+                std::size_t run = (control & 0x7f) + MIN_RUN;
+                if (position >= encoded_size || k + run > size) {
+                    return false;
+                }
+                std::memset(bytes + k, encoded[position++], run);
+                k += run;
+            } else {
+                std::size_t literals = control + 1u;
+                if (position + literals > encoded_size || k + literals > size) {
+                    return false;
+                }
+                std::memcpy(bytes + k, encoded + position, literals);
+                position += literals;
+                k += literals;
+            }
+        }
+        return k == size;
+    }
+
+    void write_all(int file, const void* data, std::size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        while (size > 0) {
+            ssize_t written = ::write(file, bytes, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("SnapshotWriter::write_frame => ") + std::strerror(errno));
+            }
+            bytes += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+
+    // Size of the complete frames at the start of a file, anything after them is a torn frame.
+    std::size_t complete_frames_size(int file) {
+        struct stat status;
+        if (::fstat(file, &status) != 0) {
+            return 0;
+        }
+
+        std::size_t file_size = static_cast<std::size_t>(status.st_size);
+        std::size_t offset    = 0;
+        FrameHeader header;
+        while (offset + sizeof(FrameHeader) <= file_size &&
+               ::pread(file, &header, sizeof(FrameHeader), static_cast<off_t>(offset)) ==
+                   static_cast<ssize_t>(sizeof(FrameHeader)) &&
+               header.magic == MAGIC && header.frame_size >= MIN_COLUMNS_OFFSET &&
+               offset + header.frame_size <= file_size) {
+            offset += header.frame_size;
+        }
+        return offset;
+    }
+}  // namespace
+
+/* ---- SnapshotWriter ---- */
+
+SnapshotWriter::SnapshotWriter(const std::filesystem::path& path, const SnapshotWriterConfig& config)
+    : m_config(config) {
+    m_config.max_pending = std::max<std::size_t>(1, m_config.max_pending);
+
+    // Appending reads the existing frame headers to find where the last complete frame ends.
+    int flags = O_CREAT | O_CLOEXEC | (m_config.append ? O_RDWR : O_WRONLY | O_TRUNC);
+    m_file    = ::open(path.c_str(), flags, 0644);
+    if (m_file < 0) {
+        throw std::runtime_error("SnapshotWriter::SnapshotWriter => failed to open " + path.string() + ": " +
+                                 std::strerror(errno));
+    }
+
+    if (m_config.append) {
+        std::size_t end = complete_frames_size(m_file);
+        if (::ftruncate(m_file, static_cast<off_t>(end)) != 0 || ::lseek(m_file, 0, SEEK_END) < 0) {
+            ::close(m_file);
+            throw std::runtime_error("SnapshotWriter::SnapshotWriter => failed to append to " + path.string());
+        }
+    }
+
+    m_thread = std::thread([this] { writer_loop(); });
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void SnapshotWriter::write(const Bodies& bodies, uint64_t step, double time) {
+    std::unique_ptr<Pending> pending;
+    {
+        std::unique_lock lock(m_mutex);
+        m_changed.wait(lock, [&] { return m_queue.size() < m_config.max_pending || m_error || m_stopping; });
+        rethrow_error();
+        if (m_stopping) {
+            throw std::runtime_error("SnapshotWriter::write => writer is closed.");
+        }
+        if (!m_free.empty()) {
+            pending = std::move(m_free.back());
+            m_free.pop_back();
+        }
+    }
+    if (!pending) {
+        pending = std::make_unique<Pending>();
+    }
+
+    pending->step       = step;
+    pending->time       = time;
+    pending->body_count = bodies.size();
+    for (auto& column : pending->columns) {
+        column.resize(bodies.size());
+    }
+
+    // Low parts missing after the other columns grew count as zero. The writer thread drops them when all are.
+    parallel_for(bodies.size(), COPY_GRAIN, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t c = 0; c < SNAPSHOT_COLUMN_COUNT; ++c) {
+            const auto& source = column_of(bodies, static_cast<SnapshotColumn>(c));
+            std::size_t copied = std::clamp(source.size(), begin, end);
+            std::copy(source.begin() + begin, source.begin() + copied, pending->columns[c].begin() + begin);
+            std::fill(pending->columns[c].begin() + copied, pending->columns[c].begin() + end, 0.0f);
+        }
+    });
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_queue.push_back(std::move(pending));
+    }
+    m_changed.notify_all();
+}
+
+void SnapshotWriter::flush() {
+    std::unique_lock lock(m_mutex);
+    m_changed.wait(lock, [&] { return m_queue.empty() && !m_writing; });
+    rethrow_error();
+}
+
+void SnapshotWriter::close() {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_changed.notify_all();
+        m_thread.join();
+    }
+
+    if (m_file >= 0) {
+        ::close(m_file);
+        m_file = -1;
+    }
+
+    std::lock_guard lock(m_mutex);
+    rethrow_error();
+}
+
+void SnapshotWriter::rethrow_error() {
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+void SnapshotWriter::writer_loop() {
+    for (;;) {
+        std::unique_ptr<Pending> pending;
+        bool                     failed;
+        {
+            std::unique_lock lock(m_mutex);
+            m_changed.wait(lock, [&] { return !m_queue.empty() || m_stopping; });
+            if (m_queue.empty()) {
+                return;
+            }
+            pending = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_writing = true;
+            failed    = m_error != nullptr;
+        }
+
+        // After the first failure the file ends mid frame, so later frames are dropped instead of written
+        // where no reader would find them.
+        std::exception_ptr error;
+        if (!failed) {
+            try {
+                write_frame(*pending);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            if (error && !m_error) {
+                m_error = error;
+            }
+            m_writing = false;
+            m_free.push_back(std::move(pending));
+        }
+        m_changed.notify_all();
+    }
+}
+
+void SnapshotWriter::write_frame(const Pending& pending) {
+    std::array<SnapshotColumnRecord, SNAPSHOT_COLUMN_COUNT> records{};
+    std::array<std::size_t, SNAPSHOT_COLUMN_COUNT>          encoded_offsets{};
+
+    // Single precision runs have no low parts, which keeps their frames at the size they always had.
+    std::size_t column_count = SNAPSHOT_COLUMN_COUNT_NO_LOW;
+    for (std::size_t c = SNAPSHOT_COLUMN_COUNT_NO_LOW; c < SNAPSHOT_COLUMN_COUNT; ++c) {
+        const auto& column = pending.columns[c];
+        if (std::any_of(column.begin(), column.end(), [](float value) { return value != 0.0f; })) {
+            column_count = SNAPSHOT_COLUMN_COUNT;
+        }
+    }
+
+    // Encoded columns go into one buffer first, their sizes decide the offsets in the header.
+    m_encoded.clear();
+    std::size_t offset = columns_offset(column_count);
+    for (std::size_t c = 0; c < column_count; ++c) {
+        ColumnEncoding encoding = m_config.encodings[c];
+        std::size_t    size     = pending.body_count * sizeof(float);
+
+        if (encoding == ColumnEncoding::SHUFFLED_RLE && pending.body_count > 0) {
+            m_shuffled.resize(size);
+            shuffle(pending.columns[c].data(), pending.body_count, m_shuffled.data());
+            encode_rle(m_shuffled.data(), size, m_run_lengths);
+
+            // Noise does not compress, such a column is better off staying readable in place.
+            if (m_run_lengths.size() < size) {
+                encoded_offsets[c] = m_encoded.size();
+                m_encoded.insert(m_encoded.end(), m_run_lengths.begin(), m_run_lengths.end());
+                size = m_run_lengths.size();
+            } else {
+                encoding = ColumnEncoding::RAW;
+            }
+        } else {
+            encoding = ColumnEncoding::RAW;
+        }
+
+        records[c].column      = static_cast<uint32_t>(c);
+        records[c].encoding    = static_cast<uint32_t>(encoding);
+        records[c].offset      = offset;
+        records[c].stored_size = size;
+        offset                 = align_up(offset + size);
+    }
+
+    FrameHeader header{};
+    header.magic        = MAGIC;
+    header.version      = VERSION;
+    header.column_count = static_cast<uint32_t>(column_count);
+    header.body_count   = pending.body_count;
+    header.step         = pending.step;
+    header.time         = pending.time;
+    header.frame_size   = offset;
+
+    std::array<uint8_t, MAX_COLUMNS_OFFSET> prefix{};
+    std::memcpy(prefix.data(), &header, sizeof(header));
+    std::memcpy(prefix.data() + sizeof(header), records.data(), sizeof(SnapshotColumnRecord) * column_count);
+    write_all(m_file, prefix.data(), columns_offset(column_count));
+
+    static constexpr std::array<uint8_t, ALIGNMENT> padding{};
+    for (std::size_t c = 0; c < column_count; ++c) {
+        const uint8_t* data = records[c].encoding == static_cast<uint32_t>(ColumnEncoding::RAW)
+                                  ? reinterpret_cast<const uint8_t*>(pending.columns[c].data())
+                                  : m_encoded.data() + encoded_offsets[c];
+        write_all(m_file, data, records[c].stored_size);
+        write_all(m_file, padding.data(), align_up(records[c].stored_size) - records[c].stored_size);
+    }
+}
+
+/* ---- SnapshotFile ---- */
+
+SnapshotFile::SnapshotFile(const std::filesystem::path& path) {
+    int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        throw std::runtime_error("SnapshotFile::SnapshotFile => failed to open " + path.string() + ": " +
+                                 std::strerror(errno));
+    }
+
+    struct stat status;
+    if (::fstat(file, &status) != 0) {
+        ::close(file);
+        throw std::runtime_error("SnapshotFile::SnapshotFile => failed to stat " + path.string());
+    }
+
+    m_size = static_cast<std::size_t>(status.st_size);
+    if (m_size > 0) {
+        void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, file, 0);
+        if (data == MAP_FAILED) {
+            ::close(file);
+            throw std::runtime_error("SnapshotFile::SnapshotFile => failed to map " + path.string());
+        }
+        m_data = static_cast<const uint8_t*>(data);
+    }
+
+    // The mapping keeps the file alive on its own.
+    ::close(file);
+
+    try {
+        build_index();
+    } catch (...) {
+        if (m_data != nullptr) {
+            ::munmap(const_cast<uint8_t*>(m_data), m_size);
+        }
+        throw;
+    }
+}
+
+SnapshotFile::~SnapshotFile() {
+    if (m_data != nullptr) {
+        ::munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+}
+
+void SnapshotFile::build_index() {
+    std::size_t offset = 0;
+    while (offset + MIN_COLUMNS_OFFSET <= m_size) {
+        FrameHeader header;
+        std::memcpy(&header, m_data + offset, sizeof(header));
+
+        if (header.magic != MAGIC || header.version != VERSION) {
+            if (offset == 0) {
+                throw std::runtime_error("SnapshotFile::build_index => not a snapshot file.");
+            }
+            break;
+        }
+        if ((header.column_count != SNAPSHOT_COLUMN_COUNT && header.column_count != SNAPSHOT_COLUMN_COUNT_NO_LOW) ||
+            header.frame_size < columns_offset(header.column_count) || header.frame_size > m_size - offset) {
+            break;
+        }
+
+        SnapshotFrame frame{};
+        frame.step         = header.step;
+        frame.time         = header.time;
+        frame.body_count   = header.body_count;
+        frame.offset       = offset;
+        frame.column_count = header.column_count;
+        std::memcpy(frame.columns.data(), m_data + offset + sizeof(header),
+                    sizeof(SnapshotColumnRecord) * frame.column_count);
+
+        bool valid = true;
+        for (std::size_t c = 0; c < frame.column_count; ++c) {
+            const SnapshotColumnRecord& record = frame.columns[c];
+            valid = valid && record.column == c && record.offset % ALIGNMENT == 0 &&
+                    record.offset <= header.frame_size && record.stored_size <= header.frame_size - record.offset;
+            if (record.encoding == static_cast<uint32_t>(ColumnEncoding::RAW)) {
+                valid = valid && record.stored_size == header.body_count * sizeof(float);
+            } else {
+                valid = valid && record.encoding == static_cast<uint32_t>(ColumnEncoding::SHUFFLED_RLE);
+            }
+        }
+        if (!valid) {
+            break;
+        }
+
+        m_frames.push_back(frame);
+        offset += header.frame_size;
+    }
+}
+
+std::size_t SnapshotFile::find(double time) const noexcept {
+    auto it = std::lower_bound(m_frames.begin(), m_frames.end(), time,
+                               [](const SnapshotFrame& frame, double value) { return frame.time < value; });
+    return static_cast<std::size_t>(it - m_frames.begin());
+}
+
+std::span<const float> SnapshotFile::column(std::size_t index, SnapshotColumn column) const {
+    const SnapshotFrame& frame = m_frames.at(index);
+    if (!frame.has(column)) {
+        throw std::runtime_error("SnapshotFile::column => frame has no such column.");
+    }
+    const SnapshotColumnRecord& record = frame.columns[static_cast<std::size_t>(column)];
+    if (record.encoding != static_cast<uint32_t>(ColumnEncoding::RAW)) {
+        throw std::runtime_error("SnapshotFile::column => column is encoded, use load instead.");
+    }
+    return {reinterpret_cast<const float*>(m_data + frame.offset + record.offset), frame.body_count};
+}
+
+void SnapshotFile::load(std::size_t index, Bodies& bodies) const {
+    const SnapshotFrame& frame = m_frames.at(index);
+
+    bodies.resize(frame.body_count);
+    std::fill(bodies.ax.begin(), bodies.ax.end(), 0.0f);
+    std::fill(bodies.ay.begin(), bodies.ay.end(), 0.0f);
+    std::fill(bodies.az.begin(), bodies.az.end(), 0.0f);
+    if (!frame.has(SnapshotColumn::X_LO)) {
+        std::fill(bodies.x_lo.begin(), bodies.x_lo.end(), 0.0f);
+        std::fill(bodies.y_lo.begin(), bodies.y_lo.end(), 0.0f);
+        std::fill(bodies.z_lo.begin(), bodies.z_lo.end(), 0.0f);
+    }
+
+    for (std::size_t c = 0; c < frame.column_count; ++c) {
+        const SnapshotColumnRecord& record = frame.columns[c];
+        const uint8_t*              data   = m_data + frame.offset + record.offset;
+        auto&                       target = column_of(bodies, static_cast<SnapshotColumn>(c));
+
+        if (record.encoding == static_cast<uint32_t>(ColumnEncoding::RAW)) {
+            std::memcpy(target.data(), data, record.stored_size);
+        } else if (frame.body_count > 0) {
+            std::vector<uint8_t> planes(frame.body_count * sizeof(float));
+            if (!decode_rle(data, record.stored_size, planes.data(), planes.size())) {
+                throw std::runtime_error("SnapshotFile::load => corrupt encoded column.");
+            }
+            unshuffle(planes.data(), frame.body_count, target.data());
+        }
+    }
+}
+
+}  // namespace nbody
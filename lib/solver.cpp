@@ -0,0 +1,66 @@
+#include "solver.hpp"
+
+#include "barnes_hut.hpp"
+#include "direct_sum.hpp"
+#include "fast_multipole.hpp"
+
+namespace nbody {
+
+std::unique_ptr<Solver> make_solver(const SolverConfig& config) {
+    switch (config.kind) {
+        case SolverKind::DIRECT_SUM: {
+            DirectSumConfig direct_sum_config{};
+            direct_sum_config.softening              = config.softening;
+            direct_sum_config.gravitational_constant = config.gravitational_constant;
+            direct_sum_config.isa                    = config.isa;
+            direct_sum_config.precision              = config.precision;
+            return std::make_unique<DirectSum>(direct_sum_config);
+        }
+        case SolverKind::BARNES_HUT: {
+            BarnesHutConfig barnes_hut_config{};
+            barnes_hut_config.theta                  = config.theta;
+            barnes_hut_config.softening              = config.softening;
+            barnes_hut_config.gravitational_constant = config.gravitational_constant;
+            barnes_hut_config.leaf_size              = config.leaf_size;
+            barnes_hut_config.isa                    = config.isa;
+            barnes_hut_config.precision              = config.precision;
+            barnes_hut_config.rebuild_threshold      = config.rebuild_threshold;
+            return std::make_unique<BarnesHut>(barnes_hut_config);
+        }
+        case SolverKind::FAST_MULTIPOLE: {
+            FastMultipoleConfig fast_multipole_config{};
+            fast_multipole_config.theta                  = config.theta;
+            fast_multipole_config.expansion_order        = config.expansion_order;
+            fast_multipole_config.softening              = config.softening;
+            fast_multipole_config.gravitational_constant = config.gravitational_constant;
+            fast_multipole_config.leaf_size              = config.leaf_size;
+            fast_multipole_config.isa                    = config.isa;
+            fast_multipole_config.precision              = config.precision;
+            return std::make_unique<FastMultipole>(fast_multipole_config);
+        }
+    }
+    return nullptr;
+}
+
+std::string_view solver_kind_name(SolverKind kind) noexcept {
+    switch (kind) {
+        case SolverKind::DIRECT_SUM:
+            return "direct";
+        case SolverKind::BARNES_HUT:
+            return "barnes-hut";
+        case SolverKind::FAST_MULTIPOLE:
+            return "fmm";
+    }
+    return "unknown";
+}
+
+std::optional<SolverKind> parse_solver_kind(std::string_view name) noexcept {
+    for (SolverKind kind : {SolverKind::DIRECT_SUM, SolverKind::BARNES_HUT, SolverKind::FAST_MULTIPOLE}) {
+        if (solver_kind_name(kind) == name) {
+            return kind;
+        }
+    }
+    return std::nullopt;
+}
+
+}  // namespace nbody
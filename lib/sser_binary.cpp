@@ -0,0 +1,354 @@
+#include "sser_binary.hpp"
+
+#include <bit>
+
+namespace serr {
+
+static_assert(std::endian::native == std::endian::little, "Scalars are copied as little endian bytes");
+
+namespace {
+    constexpr std::size_t MAX_VARINT_SIZE = 10;
+
+    constexpr uint64_t zigzag(int64_t value) noexcept {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    constexpr int64_t unzigzag(uint64_t value) noexcept {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    constexpr bool is_scalar(Unit unit) noexcept {
+        return unit == Unit::UINT || unit == Unit::INT || unit == Unit::FLOAT || unit == Unit::DOUBLE ||
+               unit == Unit::BOOL;
+    }
+
+    constexpr bool is_unit(uint8_t byte) noexcept { return byte <= static_cast<uint8_t>(Unit::ARRAY); }
+}  // namespace
+
+/* ---- Writer ---- */
+
+Writer::Writer(std::span<std::byte> buffer) noexcept : m_data(buffer.data()), m_capacity(buffer.size()) {}
+
+Writer::Writer(std::vector<std::byte>& buffer) noexcept
+    : m_data(buffer.data()),
+      m_capacity(buffer.size()),
+      m_size(buffer.size()),
+      m_base(buffer.size()),
+      m_growable(&buffer) {}
+
+void Writer::reset() noexcept {
+    m_size = m_base;
+    m_atoms.clear();
+    m_external.clear();
+    m_external_size = 0;
+    if (m_growable != nullptr) {
+        m_growable->resize(m_base);
+    }
+}
+
+void Writer::reserve(std::size_t count) {
+    if (m_growable == nullptr || m_size + count <= m_capacity) {
+        return;
+    }
+
+    // The vector keeps its size equal to the bytes written, its capacity grows geometrically by itself.
+    m_growable->resize(std::max(m_size + count, m_growable->size()));
+    m_data     = m_growable->data();
+    m_capacity = m_growable->size();
+}
+
+void Writer::put(const void* bytes, std::size_t count) {
+    reserve(count);
+    if (m_size + count <= m_capacity) {
+        std::memcpy(m_data + m_size, bytes, count);
+    }
+    m_size += count;
+}
+
+void Writer::put_byte(uint8_t byte) {
+    reserve(1);
+    if (m_size < m_capacity) {
+        m_data[m_size] = static_cast<std::byte>(byte);
+    }
+    ++m_size;
+}
+
+void Writer::put_varint(uint64_t value) {
+    uint8_t     bytes[MAX_VARINT_SIZE];
+    std::size_t count = 0;
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        bytes[count++] = byte | (value != 0 ? 0x80 : 0x00);
+    } while (value != 0);
+    put(bytes, count);
+}
+
+void Writer::put_atom(std::string_view name) {
+    auto it = m_atoms.find(name);
+    if (it != m_atoms.end()) {
+        put_varint(uint64_t{it->second} << 1);
+        return;
+    }
+
+    uint32_t id = static_cast<uint32_t>(m_atoms.size());
+    m_atoms.emplace(std::string(name), id);
+    put_varint(uint64_t{id} << 1 | 1);
+    put_varint(name.size());
+    put(name.data(), name.size());
+}
+
+void Writer::write_uint(uint64_t value) {
+    put_byte(static_cast<uint8_t>(Unit::UINT));
+    put_varint(value);
+}
+
+void Writer::write_int(int64_t value) {
+    put_byte(static_cast<uint8_t>(Unit::INT));
+    put_varint(zigzag(value));
+}
+
+void Writer::write_float(float value) {
+    put_byte(static_cast<uint8_t>(Unit::FLOAT));
+    put(&value, sizeof(value));
+}
+
+void Writer::write_double(double value) {
+    put_byte(static_cast<uint8_t>(Unit::DOUBLE));
+    put(&value, sizeof(value));
+}
+
+void Writer::write_bool(bool value) {
+    put_byte(static_cast<uint8_t>(Unit::BOOL));
+    put_byte(value ? 1 : 0);
+}
+
+void Writer::write_string(std::string_view value) {
+    put_byte(static_cast<uint8_t>(Unit::STRING));
+    put_varint(value.size());
+    put(value.data(), value.size());
+}
+
+void Writer::write_atom(std::string_view name) {
+    put_byte(static_cast<uint8_t>(Unit::ATOM));
+    put_atom(name);
+}
+
+void Writer::begin_table(std::size_t count) {
+    put_byte(static_cast<uint8_t>(Unit::TABLE));
+    put_varint(count);
+}
+
+void Writer::write_key(std::string_view name) { put_atom(name); }
+
+void Writer::begin_array(std::size_t count) {
+    put_byte(static_cast<uint8_t>(Unit::ARRAY));
+    put_byte(MIXED);
+    put_byte(0);
+    put_varint(count);
+}
+
+void Writer::write_array_bytes(Unit unit, std::size_t width, std::size_t count, const void* elements,
+                               bool external) {
+    put_byte(static_cast<uint8_t>(Unit::ARRAY));
+    put_byte(static_cast<uint8_t>(unit));
+    put_byte(static_cast<uint8_t>(width));
+    put_varint(count);
+
+    static constexpr std::byte padding[8]{};
+    std::size_t                offset = stream_size();
+    put(padding, (width - offset % width) % width);
+    if (!external) {
+        put(elements, count * width);
+        return;
+    }
+
+    m_external.push_back({m_size, static_cast<const std::byte*>(elements), count * width});
+    m_external_size += count * width;
+}
+
+/* ---- Reader ---- */
+
+uint8_t Reader::take_byte() {
+    if (m_position >= m_size) {
+        throw std::runtime_error("Reader::take_byte => unexpected end of buffer.");
+    }
+    return static_cast<uint8_t>(m_data[m_position++]);
+}
+
+const std::byte* Reader::take(std::size_t count) {
+    if (count > m_size - m_position) {
+        throw std::runtime_error("Reader::take => unexpected end of buffer.");
+    }
+    const std::byte* bytes = m_data + m_position;
+    m_position += count;
+    return bytes;
+}
+
+uint64_t Reader::take_varint() {
+    uint64_t value = 0;
+    for (std::size_t i = 0; i < MAX_VARINT_SIZE; ++i) {
+        uint8_t byte = take_byte();
+        value |= uint64_t{byte & 0x7fu} << (7 * i);
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Reader::take_varint => varint is too long.");
+}
+
+std::string_view Reader::take_atom() {
+    uint64_t tag = take_varint();
+    uint64_t id  = tag >> 1;
+
+    if ((tag & 1) == 0) {
+        if (id >= m_atoms.size()) {
+            throw std::runtime_error("Reader::take_atom => reference to an undefined atom.");
+        }
+        return m_atoms[id];
+    }
+
+    if (id != m_atoms.size()) {
+        throw std::runtime_error("Reader::take_atom => atoms defined out of order.");
+    }
+    std::size_t      length = take_varint();
+    const std::byte* name   = take(length);
+    m_atoms.emplace_back(reinterpret_cast<const char*>(name), length);
+    return m_atoms.back();
+}
+
+Unit Reader::peek() const {
+    if (m_position >= m_size) {
+        throw std::runtime_error("Reader::peek => unexpected end of buffer.");
+    }
+    uint8_t byte = static_cast<uint8_t>(m_data[m_position]);
+    if (!is_unit(byte)) {
+        throw std::runtime_error("Reader::peek => unknown unit.");
+    }
+    return static_cast<Unit>(byte);
+}
+
+void Reader::expect(Unit unit, const char* where) {
+    if (peek() != unit) {
+        throw std::runtime_error(std::string("Reader::") + where + " => value has another unit.");
+    }
+    ++m_position;
+}
+
+uint64_t Reader::read_uint() {
+    expect(Unit::UINT, "read_uint");
+    return take_varint();
+}
+
+int64_t Reader::read_int() {
+    expect(Unit::INT, "read_int");
+    return unzigzag(take_varint());
+}
+
+float Reader::read_float() {
+    expect(Unit::FLOAT, "read_float");
+    float value;
+    std::memcpy(&value, take(sizeof(value)), sizeof(value));
+    return value;
+}
+
+double Reader::read_double() {
+    expect(Unit::DOUBLE, "read_double");
+    double value;
+    std::memcpy(&value, take(sizeof(value)), sizeof(value));
+    return value;
+}
+
+bool Reader::read_bool() {
+    expect(Unit::BOOL, "read_bool");
+    return take_byte() != 0;
+}
+
+std::string_view Reader::read_string() {
+    expect(Unit::STRING, "read_string");
+    std::size_t length = take_varint();
+    return {reinterpret_cast<const char*>(take(length)), length};
+}
+
+std::string_view Reader::read_atom() {
+    expect(Unit::ATOM, "read_atom");
+    return take_atom();
+}
+
+std::size_t Reader::begin_table() {
+    expect(Unit::TABLE, "begin_table");
+    return take_varint();
+}
+
+std::string_view Reader::read_key() { return take_atom(); }
+
+ArrayHeader Reader::begin_array() {
+    expect(Unit::ARRAY, "begin_array");
+
+    uint8_t element_unit  = take_byte();
+    uint8_t element_width = take_byte();
+    if (element_unit != MIXED) {
+        bool known_width = element_width == 1 || element_width == 2 || element_width == 4 || element_width == 8;
+        if (!is_unit(element_unit) || !is_scalar(static_cast<Unit>(element_unit)) || !known_width) {
+            throw std::runtime_error("Reader::begin_array => malformed array header.");
+        }
+    }
+    return {static_cast<Unit>(element_unit), element_width, take_varint()};
+}
+
+bool Reader::is_mixed(const ArrayHeader& header) const noexcept {
+    return static_cast<uint8_t>(header.element_unit) == MIXED;
+}
+
+const std::byte* Reader::array_elements(const ArrayHeader& header, Unit unit, std::size_t width) {
+    if (header.element_unit != unit || header.element_width != width) {
+        throw std::runtime_error("Reader::array_elements => elements have another type.");
+    }
+    take((width - m_position % width) % width);
+    if (header.count > (m_size - m_position) / width) {
+        throw std::runtime_error("Reader::array_elements => unexpected end of buffer.");
+    }
+
+    const std::byte* elements = take(header.count * width);
+    if (unit == Unit::BOOL) {
+        for (std::size_t i = 0; i < header.count; ++i) {
+            if (static_cast<uint8_t>(elements[i]) > 1) {
+                throw std::runtime_error("Reader::array_elements => malformed bool.");
+            }
+        }
+    }
+    return elements;
+}
+
+void Reader::skip() {
+    switch (peek()) {
+        case Unit::UINT:   read_uint(); break;
+        case Unit::INT:    read_int(); break;
+        case Unit::FLOAT:  read_float(); break;
+        case Unit::DOUBLE: read_double(); break;
+        case Unit::BOOL:   read_bool(); break;
+        case Unit::STRING: read_string(); break;
+        case Unit::ATOM:   read_atom(); break;
+        case Unit::TABLE: {
+            std::size_t count = begin_table();
+            for (std::size_t i = 0; i < count; ++i) {
+                take_atom();
+                skip();
+            }
+            break;
+        }
+        case Unit::ARRAY: {
+            ArrayHeader header = begin_array();
+            if (is_mixed(header)) {
+                for (std::size_t i = 0; i < header.count; ++i) {
+                    skip();
+                }
+            } else {
+                array_elements(header, header.element_unit, header.element_width);
+            }
+            break;
+        }
+    }
+}
+
+}  // namespace serr
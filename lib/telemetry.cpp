@@ -0,0 +1,443 @@
+#include "telemetry.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "diagnostics.hpp"
+#include "parallel.hpp"
+#include "serialization.hpp"
+
+namespace nbody {
+
+namespace {
+    constexpr std::size_t COPY_GRAIN = 64 * 1024;
+
+    // How long a viewer that connects without new frames waits to be accepted.
+    constexpr auto ACCEPT_INTERVAL = std::chrono::milliseconds(50);
+
+    constexpr std::size_t KEYFRAME_FIELDS = 14;
+    constexpr std::size_t DELTA_FIELDS    = 12;
+
+    constexpr std::string_view AXES[] = {"x", "y", "z"};
+
+    // Nearest grid position of `value`, saturated to the range of `int32_t`. A non finite position sits at the
+    // origin.
+    int32_t grid(double value, double origin, double quantum) noexcept {
+        double q = std::round((value - origin) / quantum);
+        if (!std::isfinite(q)) {
+            return std::isnan(q) ? 0 : (q > 0.0 ? INT32_MAX : INT32_MIN);
+        }
+        return static_cast<int32_t>(std::clamp(q, static_cast<double>(INT32_MIN), static_cast<double>(INT32_MAX)));
+    }
+
+    const aligned_vector<float>& axis_of(const Bodies& bodies, std::size_t axis) noexcept {
+        return axis == 0 ? bodies.x : axis == 1 ? bodies.y : bodies.z;
+    }
+}  // namespace
+
+/* ---- TelemetryServer ---- */
+
+TelemetryServer::TelemetryServer(const TelemetryConfig& config) : m_config(config) {
+    m_config.keyframe_interval = std::max(m_config.keyframe_interval, 1u);
+    m_config.position_bits     = std::clamp(m_config.position_bits, 1u, 30u);
+
+    m_listener = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listener < 0) {
+        throw std::runtime_error(std::string("TelemetryServer::TelemetryServer => failed to create socket: ") +
+                                 std::strerror(errno));
+    }
+
+    int reuse = 1;
+    ::setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port        = htons(m_config.port);
+
+    socklen_t length = sizeof(address);
+    if (::bind(m_listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(m_listener, static_cast<int>(m_config.max_clients)) != 0 ||
+        ::getsockname(m_listener, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        int error = errno;
+        ::close(m_listener);
+        throw std::runtime_error("TelemetryServer::TelemetryServer => failed to listen on port " +
+                                 std::to_string(m_config.port) + ": " + std::strerror(error));
+    }
+    m_port = ntohs(address.sin_port);
+
+    m_thread = std::thread([this] { server_loop(); });
+}
+
+TelemetryServer::~TelemetryServer() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_changed.notify_all();
+    m_thread.join();
+
+    for (const Client& client : m_clients) {
+        ::close(client.socket);
+    }
+    ::close(m_listener);
+}
+
+bool TelemetryServer::publish(const Bodies& bodies, const TelemetryStats& stats) {
+    if (m_client_count.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_has_pending) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    // Only this thread sets `m_has_pending`, so the server thread leaves `m_pending` alone until it does.
+    Bodies& copy = m_pending.bodies;
+    for (auto* column : {&copy.x, &copy.y, &copy.z, &copy.vx, &copy.vy, &copy.vz, &copy.mass}) {
+        column->resize(bodies.size());
+    }
+    parallel_for(bodies.size(), COPY_GRAIN, [&](std::size_t begin, std::size_t end) {
+        std::copy(bodies.x.begin() + begin, bodies.x.begin() + end, copy.x.begin() + begin);
+        std::copy(bodies.y.begin() + begin, bodies.y.begin() + end, copy.y.begin() + begin);
+        std::copy(bodies.z.begin() + begin, bodies.z.begin() + end, copy.z.begin() + begin);
+        std::copy(bodies.vx.begin() + begin, bodies.vx.begin() + end, copy.vx.begin() + begin);
+        std::copy(bodies.vy.begin() + begin, bodies.vy.begin() + end, copy.vy.begin() + begin);
+        std::copy(bodies.vz.begin() + begin, bodies.vz.begin() + end, copy.vz.begin() + begin);
+        std::copy(bodies.mass.begin() + begin, bodies.mass.begin() + end, copy.mass.begin() + begin);
+    });
+    m_pending.stats = stats;
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_has_pending = true;
+    }
+    m_changed.notify_all();
+    return true;
+}
+
+void TelemetryServer::server_loop() {
+    for (;;) {
+        bool has_frame = false;
+        {
+            std::unique_lock lock(m_mutex);
+            m_changed.wait_for(lock, ACCEPT_INTERVAL, [&] { return m_has_pending || m_stopping; });
+            if (m_stopping) {
+                return;
+            }
+            if (m_has_pending) {
+                std::swap(m_frame, m_pending);
+                m_has_pending = false;
+                has_frame     = true;
+            }
+        }
+
+        accept_clients();
+        if (!has_frame || m_clients.empty()) {
+            continue;
+        }
+
+        bool keyframe = m_keyframe_due || m_since_keyframe + 1 >= m_config.keyframe_interval ||
+                        m_frame.bodies.size() != m_q[0].size();
+        quantize(m_frame.bodies, keyframe);
+        encode(m_frame, keyframe);
+        m_keyframe_due   = false;
+        m_since_keyframe = keyframe ? 0 : m_since_keyframe + 1;
+
+        std::erase_if(m_clients, [&](Client& client) {
+            if (!keyframe && !client.synced) {
+                return false;
+            }
+            if (send_message(client.socket)) {
+                client.synced = true;
+                return false;
+            }
+            ::close(client.socket);
+            return true;
+        });
+        m_client_count.store(m_clients.size(), std::memory_order_relaxed);
+    }
+}
+
+void TelemetryServer::accept_clients() {
+    for (;;) {
+        int socket = ::accept4(m_listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (socket < 0) {
+            break;
+        }
+        if (m_clients.size() >= m_config.max_clients) {
+            ::close(socket);
+            continue;
+        }
+
+        timeval timeout{};
+        timeout.tv_sec  = static_cast<time_t>(m_config.send_timeout);
+        timeout.tv_usec = static_cast<suseconds_t>((m_config.send_timeout - std::floor(m_config.send_timeout)) * 1e6);
+        ::setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        // Messages are sent whole, waiting for more data to fill a segment only delays them.
+        int no_delay = 1;
+        ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        m_clients.push_back({socket, false});
+        m_keyframe_due = true;
+    }
+    m_client_count.store(m_clients.size(), std::memory_order_relaxed);
+}
+
+void TelemetryServer::quantize(const Bodies& bodies, bool keyframe) {
+    std::size_t count = bodies.size();
+
+    if (keyframe) {
+        double extent = 0.0;
+        for (std::size_t axis = 0; axis < 3; ++axis) {
+            const aligned_vector<float>& values = axis_of(bodies, axis);
+
+            double lower = 0.0;
+            double upper = 0.0;
+            if (count > 0) {
+                auto [min, max] = std::minmax_element(values.begin(), values.end());
+                lower           = *min;
+                upper           = *max;
+            }
+            m_origin[axis] = lower;
+            if (std::isfinite(upper - lower)) {
+                extent = std::max(extent, upper - lower);
+            }
+        }
+        m_quantum = extent > 0.0 ? std::ldexp(extent, -static_cast<int>(m_config.position_bits)) : 1.0;
+    }
+
+    for (std::size_t axis = 0; axis < 3; ++axis) {
+        const aligned_vector<float>& values = axis_of(bodies, axis);
+        aligned_vector<int32_t>&     q      = m_q[axis];
+        aligned_vector<int16_t>&     delta  = m_delta[axis];
+
+        if (keyframe) {
+            q.resize(count);
+            for (std::size_t i = 0; i < count; ++i) {
+                q[i] = grid(values[i], m_origin[axis], m_quantum);
+            }
+            continue;
+        }
+
+        delta.resize(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            int64_t change = int64_t{grid(values[i], m_origin[axis], m_quantum)} - q[i];
+            delta[i]       = static_cast<int16_t>(std::clamp<int64_t>(change, INT16_MIN, INT16_MAX));
+            q[i] += delta[i];
+        }
+    }
+}
+
+void TelemetryServer::encode(const Frame& frame, bool keyframe) {
+    const Bodies&         bodies  = frame.bodies;
+    std::array<double, 3> p       = momentum(bodies);
+    uint64_t              dropped = m_dropped.load(std::memory_order_relaxed);
+
+    // The byte count goes first, the stream after it.
+    m_message.assign(sizeof(uint32_t), std::byte{0});
+    serr::Writer writer(m_message);
+
+    writer.begin_table(keyframe ? KEYFRAME_FIELDS + (m_config.solver ? 1 : 0) : DELTA_FIELDS);
+    writer.write_key("kind");
+    writer.write_atom(keyframe ? "keyframe" : "delta");
+    writer.write_key("step");
+    writer.write_uint(frame.stats.step);
+    writer.write_key("time");
+    writer.write_double(frame.stats.time);
+    writer.write_key("step_seconds");
+    writer.write_double(frame.stats.step_seconds);
+    writer.write_key("kinetic_energy");
+    writer.write_double(kinetic_energy(bodies));
+    writer.write_key("potential_energy");
+    writer.write_double(frame.stats.potential_energy);
+    writer.write_key("momentum");
+    writer.write_array(std::span<const double>(p));
+    writer.write_key("dropped");
+    writer.write_uint(dropped);
+    writer.write_key("body_count");
+    writer.write_uint(bodies.size());
+
+    if (keyframe) {
+        writer.write_key("origin");
+        writer.write_array(std::span<const double>(m_origin));
+        writer.write_key("quantum");
+        writer.write_double(m_quantum);
+        if (m_config.solver) {
+            writer.write_key("solver");
+            serr::encode(writer, *m_config.solver);
+        }
+    }
+
+    for (std::size_t axis = 0; axis < 3; ++axis) {
+        writer.write_key(AXES[axis]);
+        if (keyframe) {
+            writer.write_external_array(std::span<const int32_t>(m_q[axis]));
+        } else {
+            writer.write_external_array(std::span<const int16_t>(m_delta[axis]));
+        }
+    }
+
+    uint32_t size = static_cast<uint32_t>(writer.stream_size());
+    std::memcpy(m_message.data(), &size, sizeof(size));
+    m_external.assign(writer.external().begin(), writer.external().end());
+}
+
+bool TelemetryServer::send_message(int socket) const {
+    std::vector<iovec> pieces;
+    std::size_t        position = 0;
+    for (const serr::ExternalArray& array : m_external) {
+        pieces.push_back({const_cast<std::byte*>(m_message.data()) + position, array.offset - position});
+        pieces.push_back({const_cast<std::byte*>(array.data), array.size});
+        position = array.offset;
+    }
+    pieces.push_back({const_cast<std::byte*>(m_message.data()) + position, m_message.size() - position});
+
+    // A short send leaves the rest of the pieces, starting inside the one where it stopped.
+    std::size_t first = 0;
+    while (first < pieces.size()) {
+        msghdr header{};
+        header.msg_iov    = pieces.data() + first;
+        header.msg_iovlen = pieces.size() - first;
+
+        ssize_t sent = ::sendmsg(socket, &header, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        auto remaining = static_cast<std::size_t>(sent);
+        while (first < pieces.size() && remaining >= pieces[first].iov_len) {
+            remaining -= pieces[first].iov_len;
+            ++first;
+        }
+        if (first < pieces.size()) {
+            pieces[first].iov_base = static_cast<char*>(pieces[first].iov_base) + remaining;
+            pieces[first].iov_len -= remaining;
+        }
+    }
+    return true;
+}
+
+/* ---- TelemetryDecoder ---- */
+
+bool TelemetryDecoder::decode(std::span<const std::byte> message) {
+    serr::Reader reader(message);
+
+    TelemetryFrame frame{};
+    uint64_t       body_count = 0;
+    bool           has_axes   = false;
+
+    std::array<double, 3> origin  = m_origin;
+    double                quantum = m_quantum;
+
+    std::size_t count = reader.begin_table();
+    for (std::size_t i = 0; i < count; ++i) {
+        std::string_view key = reader.read_key();
+        if (key == "kind") {
+            frame.keyframe = reader.read_atom() == "keyframe";
+        } else if (key == "step") {
+            frame.stats.step = reader.read_uint();
+        } else if (key == "time") {
+            frame.stats.time = reader.read_double();
+        } else if (key == "step_seconds") {
+            frame.stats.step_seconds = reader.read_double();
+        } else if (key == "kinetic_energy") {
+            frame.kinetic_energy = reader.read_double();
+        } else if (key == "potential_energy") {
+            frame.stats.potential_energy = reader.read_double();
+        } else if (key == "momentum") {
+            reader.read_array(reader.begin_array(), std::span<double>(frame.momentum));
+        } else if (key == "dropped") {
+            frame.dropped = reader.read_uint();
+        } else if (key == "body_count") {
+            body_count = reader.read_uint();
+        } else if (key == "origin") {
+            reader.read_array(reader.begin_array(), std::span<double>(origin));
+        } else if (key == "quantum") {
+            quantum = reader.read_double();
+        } else if (key == "solver") {
+            // Fields the viewer does not know are skipped, missing ones keep their defaults.
+            SolverConfig solver{};
+            serr::decode(reader, solver);
+            frame.solver = solver;
+        } else if (key == "x" || key == "y" || key == "z") {
+            std::size_t       axis   = static_cast<std::size_t>(key[0] - 'x');
+            serr::ArrayHeader header = reader.begin_array();
+            if (header.element_width == sizeof(int32_t)) {
+                m_q[axis].resize(header.count);
+                reader.read_array(header, std::span<int32_t>(m_q[axis]));
+            } else {
+                m_delta[axis].resize(header.count);
+                reader.read_array(header, std::span<int16_t>(m_delta[axis]));
+            }
+            has_axes = true;
+        } else {
+            reader.skip();
+        }
+    }
+
+    if (!has_axes) {
+        throw std::runtime_error("TelemetryDecoder::decode => message has no positions.");
+    }
+    if (!frame.keyframe && !m_synced) {
+        return false;
+    }
+
+    if (frame.keyframe) {
+        for (const std::vector<int32_t>& q : m_q) {
+            if (q.size() != body_count) {
+                throw std::runtime_error("TelemetryDecoder::decode => keyframe has another body count.");
+            }
+        }
+        m_origin  = origin;
+        m_quantum = quantum;
+        m_synced  = true;
+    } else {
+        for (std::size_t axis = 0; axis < 3; ++axis) {
+            if (m_delta[axis].size() != body_count || m_q[axis].size() != body_count) {
+                throw std::runtime_error("TelemetryDecoder::decode => delta has another body count.");
+            }
+            for (std::size_t i = 0; i < body_count; ++i) {
+                m_q[axis][i] += m_delta[axis][i];
+            }
+        }
+    }
+
+    std::array<aligned_vector<float>*, 3> positions = {&m_x, &m_y, &m_z};
+    for (std::size_t axis = 0; axis < 3; ++axis) {
+        positions[axis]->resize(body_count);
+        for (std::size_t i = 0; i < body_count; ++i) {
+            (*positions[axis])[i] = static_cast<float>(m_origin[axis] + m_q[axis][i] * m_quantum);
+        }
+    }
+
+    if (!frame.solver) {
+        frame.solver = m_frame.solver;
+    }
+    m_frame = frame;
+    return true;
+}
+
+}  // namespace nbody
@@ -0,0 +1,183 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace nbody {
+
+namespace {
+    thread_local TraceRing*  t_ring = nullptr;
+    thread_local std::string t_name = "thread";
+
+    void write_escaped(std::ostream& out, std::string_view text) {
+        out << '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out << '\\';
+            }
+            out << c;
+        }
+        out << '"';
+    }
+
+    // Chrome traces count in microseconds.
+    void write_microseconds(std::ostream& out, uint64_t ns) { out << ns / 1000 << '.' << std::setw(3) << ns % 1000; }
+}  // namespace
+
+uint64_t trace_now() noexcept {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+TraceRing::TraceRing(std::size_t capacity, uint32_t id, std::string name)
+    : m_events(std::bit_ceil(std::max<std::size_t>(capacity, 1))),
+      m_mask(m_events.size() - 1),
+      m_id(id),
+      m_name(std::move(name)) {}
+
+std::vector<TraceEvent> TraceRing::copy() const {
+    uint64_t head  = m_head.load(std::memory_order_acquire);
+    uint64_t first = head > m_events.size() ? head - m_events.size() : 0;
+
+    std::vector<TraceEvent> events;
+    events.reserve(head - first);
+    for (uint64_t i = first; i < head; ++i) {
+        events.push_back(m_events[i & m_mask]);
+    }
+
+    // Events the writer wrapped around to while they were copied may be torn.
+    uint64_t after       = m_head.load(std::memory_order_acquire);
+    uint64_t overwritten = after > m_events.size() ? after - m_events.size() : 0;
+    if (overwritten > first) {
+        events.erase(events.begin(), events.begin() + static_cast<std::ptrdiff_t>(std::min(overwritten, head) - first));
+    }
+    return events;
+}
+
+Tracer& Tracer::global() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::record(const char* name, uint64_t begin, uint64_t end) noexcept {
+    try {
+        local_ring().push(name, begin, end);
+    } catch (const std::bad_alloc&) {
+    }
+}
+
+void Tracer::set_thread_name(std::string name) {
+    t_name = std::move(name);
+    if (t_ring != nullptr) {
+        std::lock_guard lock(m_mutex);
+        t_ring->m_name = t_name;
+    }
+}
+
+TraceRing& Tracer::track(std::string_view name) {
+    {
+        std::lock_guard lock(m_mutex);
+        for (const auto& ring : m_rings) {
+            if (ring->m_name == name) {
+                return *ring;
+            }
+        }
+    }
+    return add_ring(std::string(name));
+}
+
+TraceRing& Tracer::local_ring() {
+    if (t_ring == nullptr) {
+        t_ring = &add_ring(t_name);
+    }
+    return *t_ring;
+}
+
+TraceRing& Tracer::add_ring(std::string name) {
+    std::lock_guard lock(m_mutex);
+    uint32_t        id = static_cast<uint32_t>(m_rings.size());
+    m_rings.push_back(std::make_unique<TraceRing>(RING_CAPACITY, id, std::move(name)));
+    return *m_rings.back();
+}
+
+std::vector<TraceSummary> Tracer::summarize(uint64_t begin, uint64_t end) const {
+    std::vector<TraceRing*> rings;
+    {
+        std::lock_guard lock(m_mutex);
+        for (const auto& ring : m_rings) {
+            rings.push_back(ring.get());
+        }
+    }
+
+    std::vector<TraceSummary>               summaries;
+    std::map<std::string_view, std::size_t> index;
+    for (const TraceRing* ring : rings) {
+        for (const TraceEvent& event : ring->copy()) {
+            if (event.end < begin || event.end >= end) {
+                continue;
+            }
+            auto [it, inserted] = index.try_emplace(event.name, summaries.size());
+            if (inserted) {
+                summaries.push_back({event.name});
+            }
+            summaries[it->second].count += 1;
+            summaries[it->second].total_ns += event.end - event.begin;
+        }
+    }
+    return summaries;
+}
+
+void Tracer::write_chrome_trace(const std::filesystem::path& path) const {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Tracer::write_chrome_trace => failed to open " + path.string());
+    }
+    file << std::setfill('0');
+
+    std::lock_guard lock(m_mutex);
+
+    // Timestamps relative to the first event keep the numbers short.
+    std::vector<std::vector<TraceEvent>> events;
+    uint64_t                             origin = UINT64_MAX;
+    for (const auto& ring : m_rings) {
+        events.push_back(ring->copy());
+        for (const TraceEvent& event : events.back()) {
+            origin = std::min(origin, event.begin);
+        }
+    }
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (std::size_t i = 0; i < m_rings.size(); ++i) {
+        file << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+             << m_rings[i]->id() << ",\"args\":{\"name\":";
+        write_escaped(file, m_rings[i]->m_name);
+        file << "}}";
+        first = false;
+
+        for (const TraceEvent& event : events[i]) {
+            file << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << m_rings[i]->id() << ",\"name\":";
+            write_escaped(file, event.name);
+            file << ",\"ts\":";
+            write_microseconds(file, event.begin - origin);
+            file << ",\"dur\":";
+            write_microseconds(file, event.end - event.begin);
+            file << "}";
+        }
+    }
+    file << "\n]}\n";
+
+    if (!file) {
+        throw std::runtime_error("Tracer::write_chrome_trace => failed to write " + path.string());
+    }
+}
+
+}  // namespace nbody
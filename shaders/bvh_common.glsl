@@ -0,0 +1,78 @@
+// Shared by the bvh_*.comp passes of `nbody::GpuBarnesHut`, in the order lib/gpu_tree.cpp dispatches them:
+// bounds, Morton codes, four radix sort passes of histogram, scan and scatter, hierarchy, moments and traversal.
+
+// Must match `GpuBarnesHut::WORKGROUP_SIZE` and `GpuBarnesHut::SORT_BLOCK` in include/gpu_tree.hpp.
+#define WORKGROUP_SIZE   256
+#define ITEMS_PER_THREAD 8
+#define SORT_BLOCK       (WORKGROUP_SIZE * ITEMS_PER_THREAD)
+
+// Eight bits per sort pass. The histogram and scatter passes keep one counter per digit and invocation.
+#define RADIX_BITS 8
+#define RADIX      256
+
+#define NONE (-1)
+
+layout(local_size_x = WORKGROUP_SIZE) in;
+
+// One block for all passes, each reads what it needs.
+layout(push_constant) uniform Parameters {
+    uint  body_count;
+    uint  block_count;  // Sort blocks of `SORT_BLOCK` keys
+    uint  shift;        // Lowest key bit of the digit the current sort pass orders by
+    float theta_squared;
+    float timestep;
+    float softening_squared;
+    float gravitational_constant;
+} params;
+
+// The body state, laid out as for shaders/nbody.comp. Positions carry the mass in `w`.
+layout(std430, set = 0, binding = 0) readonly buffer PositionsIn { vec4 positions_in[]; };
+layout(std430, set = 0, binding = 1) readonly buffer VelocitiesIn { vec4 velocities_in[]; };
+layout(std430, set = 0, binding = 2) writeonly buffer PositionsOut { vec4 positions_out[]; };
+layout(std430, set = 0, binding = 3) writeonly buffer VelocitiesOut { vec4 velocities_out[]; };
+
+// Internal nodes are `[0, body_count - 1)` with the root at 0, the leaf of the `k`th body in Morton order is
+// `body_count - 1 + k`. With a single body the leaf is the root.
+struct Node {
+    vec4 center;  // Center of mass, total mass in `w`
+    vec4 lower;   // Lower corner of the bounds, longest side in `w`
+    vec4 upper;
+    int  left;    // `NONE` for leaves
+    int  right;
+    int  parent;  // `NONE` for the root
+    int  escape;  // Next node in depth first order once the subtree is done, `NONE` after the last one
+};
+
+// Minimum then maximum corner of all positions, as `ordered` bits so that atomics on uints order them like floats.
+layout(std430, set = 1, binding = 0) buffer Bounds { uint bounds[6]; };
+// Two halves of `body_count` entries that the sort passes alternate between. After the four passes the Morton
+// codes and the body index each belongs to are sorted in the first half.
+layout(std430, set = 1, binding = 1) buffer Keys { uint keys[]; };
+layout(std430, set = 1, binding = 2) buffer Values { uint values[]; };
+// Count of each digit in each block, digit major, turned into the offset it scatters to by the scan.
+layout(std430, set = 1, binding = 3) buffer Histograms { uint histograms[]; };
+layout(std430, set = 1, binding = 4) coherent buffer Nodes { Node nodes[]; };
+// Children that finished their moments, per internal node. Cleared before every step.
+layout(std430, set = 1, binding = 5) coherent buffer Visits { uint visits[]; };
+
+uint ordered(float value) {
+    uint bits = floatBitsToUint(value);
+    return (bits & 0x80000000u) != 0u ? ~bits : bits | 0x80000000u;
+}
+
+float from_ordered(uint bits) {
+    return uintBitsToFloat((bits & 0x80000000u) != 0u ? bits & 0x7fffffffu : ~bits);
+}
+
+int leaf_node(uint k) {
+    return int(params.body_count) - 1 + int(k);
+}
+
+// The first half of the keys and values is read by even sort passes and written by odd ones.
+uint sort_source() {
+    return (params.shift / RADIX_BITS) % 2u == 0u ? 0u : params.body_count;
+}
+
+uint sort_destination() {
+    return params.body_count - sort_source();
+}
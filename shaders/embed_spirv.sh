@@ -0,0 +1,42 @@
+#!/bin/sh
+# Usage: embed_spirv.sh OUTPUT MODULE.spv...
+#
+# Writes a C++ source defining `nbody::embedded_shaders` with every module as an array of words, named by the path
+# it was given as. `od` prints the words in the byte order of the build machine, the order `vkCreateShaderModule`
+# expects them in.
+set -eu
+
+output=$1
+shift
+
+{
+    printf '// Generated by shaders/embed_spirv.sh, do not edit.\n'
+    printf '#include "shader_library.hpp"\n\n'
+    printf 'namespace nbody {\n\nnamespace {\n\n'
+    index=0
+    for module in "$@"; do
+        printf '// %s\n' "$module"
+        printf 'constexpr uint32_t MODULE_%d[] = {\n' "$index"
+        od -An -v -tx4 "$module" | sed -e 's/\([0-9a-f]\{8\}\)/0x\1u,/g' -e 's/^ */    /'
+        printf '};\n\n'
+        index=$((index + 1))
+    done
+    printf '}  // namespace\n\n'
+    printf 'std::span<const EmbeddedShader> embedded_shaders() noexcept {\n'
+    if [ $# -eq 0 ]; then
+        # C++ has no arrays of length zero.
+        printf '    return {};\n'
+    else
+        printf '    static constexpr EmbeddedShader SHADERS[] = {\n'
+        index=0
+        for module in "$@"; do
+            printf '        {"%s", MODULE_%d},\n' "$module" "$index"
+            index=$((index + 1))
+        done
+        printf '    };\n'
+        printf '    return SHADERS;\n'
+    fi
+    printf '}\n\n'
+    printf '}  // namespace nbody\n'
+} > "$output.tmp"
+mv "$output.tmp" "$output"
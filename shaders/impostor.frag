@@ -0,0 +1,16 @@
+#version 450
+
+layout(location = 0) out vec4 color;
+
+layout(location = 0) in vec2 sprite_coordinate;
+layout(location = 1) flat in float intensity;
+
+// Like shaders/shader.frag with the peak intensity from shaders/impostor.vert.
+void main() {
+    float distance_squared = dot(sprite_coordinate, sprite_coordinate);
+    if (distance_squared > 1.0) {
+        discard;
+    }
+
+    color = vec4(intensity * (1.0 - distance_squared) * vec3(1.0, 0.85, 0.6), 1.0);
+}
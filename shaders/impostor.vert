@@ -0,0 +1,57 @@
+#version 450
+
+// Draws what shaders/lod_cull.comp picked: single bodies like shaders/shader.vert, and impostors for the nodes
+// that stand for many.
+
+// Must match `Instance` in shaders/lod_cull.comp.
+struct Instance {
+    vec4  center;
+    float radius;
+    float bodies;
+};
+
+// Only the first `instances.length()` of the indirect draw's instances were written.
+layout(std430, set = 0, binding = 0) readonly buffer Instances { Instance instances[]; };
+
+// Rewritten by the host for every frame in flight.
+layout(std140, set = 1, binding = 0) uniform Camera {
+    mat4 view_projection;
+    vec2 sprite_size;
+    vec2 projection_scale;
+} camera;
+
+layout(location = 0) out vec2 sprite_coordinate;
+layout(location = 1) flat out float intensity;
+
+// Corners of a triangle strip quad, one quad per instance.
+const vec2 corners[4] = vec2[](
+        vec2(-1.0, -1.0),
+        vec2(1.0, -1.0),
+        vec2(-1.0, 1.0),
+        vec2(1.0, 1.0)
+    );
+
+void main() {
+    vec2 corner = corners[gl_VertexIndex];
+    if (gl_InstanceIndex >= instances.length()) {
+        // All four corners on one point, which rasterizes nothing.
+        gl_Position       = vec4(0.0, 0.0, 0.0, 1.0);
+        sprite_coordinate = corner;
+        intensity         = 0.0;
+        return;
+    }
+
+    Instance instance = instances[gl_InstanceIndex];
+    vec4     center   = camera.view_projection * vec4(instance.center.xyz, 1.0);
+
+    // A sprite keeps its constant size on screen, and grows to cover the node once that projects larger. Clip
+    // space offsets of a length in space do not depend on `w`.
+    vec2 sprite = camera.sprite_size * center.w;
+    vec2 extent = max(sprite, instance.radius * camera.projection_scale);
+
+    gl_Position       = center + vec4(corner * extent, 0.0, 0.0);
+    sprite_coordinate = corner;
+
+    // The light of the bodies spread over the larger sprite, as much in total as their single sprites give.
+    intensity = 0.35 * instance.bodies * (sprite.x * sprite.y) / (extent.x * extent.y);
+}
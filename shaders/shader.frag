@@ -2,8 +2,15 @@
 
 layout(location = 0) out vec4 color;
 
-layout(location = 0) in vec3 fragColor;
+layout(location = 0) in vec2 sprite_coordinate;
 
 void main() {
-    color = vec4(fragColor, 1.0);
+    float distance_squared = dot(sprite_coordinate, sprite_coordinate);
+    if (distance_squared > 1.0) {
+        discard;
+    }
+
+    // Blended additively, keep single bodies faint so that only dense regions saturate.
+    float intensity = 0.35 * (1.0 - distance_squared);
+    color           = vec4(intensity * vec3(1.0, 0.85, 0.6), 1.0);
 }
@@ -1,20 +1,30 @@
 #version 450
 
-layout(location = 0) out vec3 fragColor;
+// Written by shaders/nbody.comp, positions carry the mass in `w`.
+layout(std430, set = 0, binding = 0) readonly buffer Positions { vec4 positions[]; };
 
-vec2 positions[3] = vec2[](
-        vec2(-0.5f, -0.5f),
-        vec2(0.5f, -0.5f),
-        vec2(0.0f, 0.5f)
-    );
+// Rewritten by the host for every frame in flight.
+layout(std140, set = 1, binding = 0) uniform Camera {
+    mat4 view_projection;
+    vec2 sprite_size;
+    vec2 projection_scale;  // Only used by shaders/impostor.vert
+} camera;
+
+layout(location = 0) out vec2 sprite_coordinate;
 
-vec3 colors[3] = vec3[](
-        vec3(1.0, 0.0, 0.0),
-        vec3(0.0, 1.0, 0.0),
-        vec3(0.0, 0.0, 1.0)
+// Corners of a triangle strip quad, one quad per instance.
+const vec2 corners[4] = vec2[](
+        vec2(-1.0, -1.0),
+        vec2(1.0, -1.0),
+        vec2(-1.0, 1.0),
+        vec2(1.0, 1.0)
     );
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    vec2 corner = corners[gl_VertexIndex];
+    vec4 center = camera.view_projection * vec4(positions[gl_InstanceIndex].xyz, 1.0);
+
+    // Offset in clip space scaled by `w` so that sprites keep a constant size on screen.
+    gl_Position       = center + vec4(corner * camera.sprite_size * center.w, 0.0, 0.0);
+    sprite_coordinate = corner;
 }
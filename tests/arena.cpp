@@ -0,0 +1,100 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "arena.hpp"
+#include "scheduler.hpp"
+
+TEST_CASE("Arena aligns, spills into new blocks and merges them on reset") {
+    nbody::Arena arena(1024);
+    CHECK(arena.capacity() == 0);
+
+    void* byte = arena.allocate(1, 1);
+    void* line = arena.allocate(100, nbody::SIMD_ALIGNMENT);
+    CHECK(reinterpret_cast<uintptr_t>(line) % nbody::SIMD_ALIGNMENT == 0);
+    CHECK(static_cast<std::byte*>(line) >= static_cast<std::byte*>(byte) + 1);
+    CHECK(arena.used() == nbody::SIMD_ALIGNMENT + 100);
+
+    // Larger than a block, so it gets one of its own.
+    std::span<float> large = arena.allocate_array<float>(1000);
+    large[999]             = 1.0f;
+    CHECK(arena.capacity() == 1024 + 4000);
+
+    std::array<int, 4> values = {1, 2, 3, 4};
+    std::span<int>     copied = arena.copy(std::span<const int>(values));
+    CHECK(copied.size() == 4);
+    CHECK(copied[3] == 4);
+
+    std::size_t capacity = arena.capacity();
+    arena.reset();
+    CHECK(arena.used() == 0);
+    CHECK(arena.capacity() == capacity);
+
+    // The merged block now holds a whole cycle without growing.
+    arena.allocate(1024 + 2000);
+    arena.allocate(1000);
+    CHECK(arena.capacity() == capacity);
+}
+
+TEST_CASE("ArenaScope hands back what the scope allocated") {
+    nbody::Arena arena(256);
+    arena.allocate(16);
+    std::size_t before = arena.used();
+
+    for (int iteration = 0; iteration < 100; ++iteration) {
+        nbody::ArenaScope scope(arena);
+        arena.allocate(200);
+        arena.allocate(200);
+    }
+    CHECK(arena.used() == before);
+    // Every iteration reused the blocks of the first.
+    CHECK(arena.capacity() == 2 * 256);
+}
+
+TEST_CASE("Pool recycles blocks and constructs in place") {
+    nbody::Pool<std::string> pool(4);
+
+    std::vector<std::string*> strings;
+    for (int i = 0; i < 10; ++i) {
+        strings.push_back(pool.create(std::to_string(i)));
+    }
+    CHECK(std::set<std::string*>(strings.begin(), strings.end()).size() == 10);
+    CHECK(*strings[7] == "7");
+
+    std::string* freed = strings[3];
+    pool.destroy(freed);
+    std::string* reused = pool.create("again");
+    CHECK(reused == freed);
+    CHECK(*reused == "again");
+
+    strings[3] = reused;
+    for (std::string* string : strings) {
+        pool.destroy(string);
+    }
+}
+
+TEST_CASE("WorkerLocal gives every thread state of its own") {
+    nbody::Scheduler             scheduler(3);
+    nbody::WorkerLocal<uint64_t> sums(scheduler);
+    std::atomic<std::size_t>     items{0};
+
+    scheduler.parallel_for(0, 100000, 100, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            sums.local() += i;
+        }
+        items.fetch_add(end - begin, std::memory_order_relaxed);
+    });
+    CHECK(items.load() == 100000);
+
+    uint64_t total = 0;
+    sums.for_each([&](uint64_t& sum) { total += sum; });
+    CHECK(total == uint64_t{100000} * 99999 / 2);
+}
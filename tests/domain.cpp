@@ -0,0 +1,155 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "bodies.hpp"
+#include "domain.hpp"
+#include "initial_conditions.hpp"
+#include "octree.hpp"
+
+namespace {
+    constexpr std::size_t DOMAIN_COUNT = 8;
+
+    // Samples of four ranks that each hold a quarter of a Plummer sphere, measured at very different costs.
+    std::vector<nbody::DomainSample> skewed_samples(const nbody::Bodies& bodies) {
+        nbody::DomainBounds   global = nbody::DomainBounds::of(bodies);
+        std::vector<uint64_t> keys(bodies.size());
+        nbody::compute_domain_keys(bodies, global, keys);
+
+        std::vector<nbody::DomainSample> samples;
+        std::size_t                      quarter = keys.size() / 4;
+        for (std::size_t rank = 0; rank < 4; ++rank) {
+            std::vector<uint64_t> local(keys.begin() + rank * quarter, keys.begin() + (rank + 1) * quarter);
+            std::sort(local.begin(), local.end());
+
+            double work = static_cast<double>((rank + 1) * (rank + 1));
+            for (const nbody::DomainSample& sample : nbody::sample_domain(local, work, 256)) {
+                samples.push_back(sample);
+            }
+        }
+        return samples;
+    }
+
+    // `sum_j m_j (r_j - r) / (|r_j - r|^2 + eps^2)^(3/2)` over `x, y, z, mass` quadruples, in double precision.
+    std::array<double, 3> pull(const std::vector<float>& sources, float x, float y, float z, double eps2) {
+        std::array<double, 3> a{};
+        for (std::size_t k = 0; k < sources.size(); k += 4) {
+            double dx  = static_cast<double>(sources[k]) - x;
+            double dy  = static_cast<double>(sources[k + 1]) - y;
+            double dz  = static_cast<double>(sources[k + 2]) - z;
+            double r2  = dx * dx + dy * dy + dz * dz + eps2;
+            double inv = sources[k + 3] / (r2 * std::sqrt(r2));
+            a[0] += dx * inv;
+            a[1] += dy * inv;
+            a[2] += dz * inv;
+        }
+        return a;
+    }
+
+    std::vector<float> quadruples(const nbody::Bodies& bodies) {
+        std::vector<float> sources;
+        for (std::size_t i = 0; i < bodies.size(); ++i) {
+            sources.insert(sources.end(), {bodies.x[i], bodies.y[i], bodies.z[i], bodies.mass[i]});
+        }
+        return sources;
+    }
+
+    std::vector<std::array<float, 4>> sorted(const std::vector<float>& sources) {
+        std::vector<std::array<float, 4>> entries;
+        for (std::size_t k = 0; k < sources.size(); k += 4) {
+            entries.push_back({sources[k], sources[k + 1], sources[k + 2], sources[k + 3]});
+        }
+        std::sort(entries.begin(), entries.end());
+        return entries;
+    }
+}  // namespace
+
+TEST_CASE("Splitters cut skewed work into equal shares") {
+    nbody::Bodies bodies = nbody::generate_initial_conditions(nbody::InitialConditions::PLUMMER, 20000, 16);
+
+    std::vector<nbody::DomainSample> samples   = skewed_samples(bodies);
+    std::vector<uint64_t>            splitters = nbody::choose_splitters(samples, DOMAIN_COUNT);
+
+    REQUIRE(splitters.size() == DOMAIN_COUNT + 1);
+    CHECK(splitters.front() == 0);
+    CHECK(splitters.back() == UINT64_MAX);
+    CHECK(std::is_sorted(splitters.begin(), splitters.end()));
+
+    std::vector<double> shares(DOMAIN_COUNT, 0.0);
+    double              total    = 0.0;
+    double              heaviest = 0.0;
+    bool                in_range = true;
+    for (const nbody::DomainSample& sample : samples) {
+        std::size_t domain = nbody::domain_of(splitters, sample.key);
+        in_range           = in_range && splitters[domain] <= sample.key && sample.key < splitters[domain + 1];
+        shares[domain] += sample.work;
+        total += sample.work;
+        heaviest = std::max(heaviest, sample.work);
+    }
+    CHECK(in_range);
+
+    for (double share : shares) {
+        CHECK(std::abs(share - total / DOMAIN_COUNT) <= heaviest);
+    }
+}
+
+TEST_CASE("Every key maps into the range of its domain") {
+    std::vector<uint64_t> splitters = {0, 100, 100, 250, 1000, UINT64_MAX};
+
+    CHECK(nbody::domain_of(splitters, 0) == 0);
+    CHECK(nbody::domain_of(splitters, 99) == 0);
+    CHECK(nbody::domain_of(splitters, 100) == 2);
+    CHECK(nbody::domain_of(splitters, 999) == 3);
+    CHECK(nbody::domain_of(splitters, 1000) == 4);
+    CHECK(nbody::domain_of(splitters, UINT64_MAX - 1) == 4);
+
+    std::mt19937_64 random(3);
+    bool            in_range = true;
+    for (int round = 0; round < 10000; ++round) {
+        uint64_t    key    = random() % 1200;
+        std::size_t domain = nbody::domain_of(splitters, key);
+        in_range           = in_range && splitters[domain] <= key && key < splitters[domain + 1];
+    }
+    CHECK(in_range);
+}
+
+TEST_CASE("Essential sources stand in for the tree") {
+    nbody::Bodies bodies = nbody::generate_initial_conditions(nbody::InitialConditions::PLUMMER, 4096, 17);
+    nbody::Octree tree;
+    tree.build(bodies, 16);
+
+    // A domain far off along the diagonal, and points inside it.
+    nbody::DomainBounds target;
+    target.min_x = target.min_y = target.min_z = 20.0f;
+    target.max_x = target.max_y = target.max_z = 22.0f;
+
+    SUBCASE("no opening angle sends every body") {
+        std::vector<float> sources;
+        nbody::append_essential_sources(tree, target, 0.0f, sources);
+        CHECK(sorted(sources) == sorted(quadruples(bodies)));
+    }
+
+    SUBCASE("far nodes pull as the bodies do") {
+        std::vector<float> sources;
+        nbody::append_essential_sources(tree, target, 0.5f, sources);
+        CHECK(sources.size() < 4 * bodies.size() / 10);
+
+        std::vector<float> exact_sources = quadruples(bodies);
+        double             worst         = 0.0;
+        for (float corner : {20.0f, 21.0f, 22.0f}) {
+            std::array<double, 3> approximate = pull(sources, corner, 21.0f, 22.0f - (corner - 20.0f), 1.0e-4);
+            std::array<double, 3> exact       = pull(exact_sources, corner, 21.0f, 22.0f - (corner - 20.0f), 1.0e-4);
+            double                error       = std::hypot(approximate[0] - exact[0], approximate[1] - exact[1],
+                                                           approximate[2] - exact[2]);
+            worst = std::max(worst, error / std::hypot(exact[0], exact[1], exact[2]));
+        }
+        CHECK(worst < 1.0e-3);
+    }
+}
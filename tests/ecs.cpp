@@ -0,0 +1,175 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <iterator>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ecs.hpp"
+
+namespace {
+    class Position {
+       public:
+        float x, y, z;
+    };
+
+    class Velocity {
+       public:
+        float x, y, z;
+    };
+
+    class Tag {
+       public:
+        uint32_t value;
+    };
+
+    // Not trivially copyable, counts the instances alive so that leaked or doubly destroyed components show.
+    class Name {
+       public:
+        static inline int live = 0;
+
+        std::unique_ptr<uint32_t> value;
+
+        explicit Name(uint32_t v) : value(std::make_unique<uint32_t>(v)) { ++live; }
+        Name(Name&& other) noexcept : value(std::move(other.value)) { ++live; }
+        Name& operator=(Name&& other) noexcept {
+            value = std::move(other.value);
+            return *this;
+        }
+        ~Name() { --live; }
+    };
+
+    // What the world should hold for an entity.
+    class Expected {
+       public:
+        uint32_t position;
+        bool     has_velocity = false;
+        bool     has_name     = false;
+    };
+}  // namespace
+
+TEST_CASE("Components survive migrations between archetypes") {
+    nbody::World world;
+
+    nbody::Entity entity = world.create(Position{1.0f, 2.0f, 3.0f});
+    CHECK(world.has<Position>(entity));
+    CHECK(!world.has<Velocity>(entity));
+
+    world.add(entity, Velocity{4.0f, 5.0f, 6.0f});
+    world.add(entity, Name{7});
+    CHECK(world.get<Position>(entity).z == 3.0f);
+    CHECK(world.get<Velocity>(entity).x == 4.0f);
+    CHECK(*world.get<Name>(entity).value == 7);
+
+    world.add(entity, Velocity{8.0f, 0.0f, 0.0f});
+    CHECK(world.get<Velocity>(entity).x == 8.0f);
+
+    world.remove<Position>(entity);
+    CHECK(!world.has<Position>(entity));
+    CHECK(*world.get<Name>(entity).value == 7);
+    CHECK_THROWS_AS(world.get<Position>(entity), std::runtime_error);
+
+    world.destroy(entity);
+    CHECK(!world.alive(entity));
+    CHECK(Name::live == 0);
+    CHECK_THROWS_AS(world.destroy(entity), std::runtime_error);
+    CHECK_THROWS_AS(world.create(Tag{1}, Tag{2}), std::invalid_argument);
+}
+
+TEST_CASE("Churning entities keeps every query and handle consistent") {
+    std::unordered_map<uint32_t, std::pair<nbody::Entity, Expected>> expected;
+    std::vector<nbody::Entity>                                        dead;
+    std::mt19937                                                      random(11);
+    uint32_t                                                          next = 0;
+
+    {
+        nbody::World world;
+        for (int round = 0; round < 20000; ++round) {
+            uint32_t action = random() % 8;
+            if (expected.empty() || action < 3) {
+                // Enough entities per archetype to spread over several chunks
+                nbody::Entity entity = world.create(Position{static_cast<float>(next), 0.0f, 0.0f});
+                expected[next]       = {entity, Expected{next}};
+                ++next;
+                continue;
+            }
+
+            auto it = expected.begin();
+            std::advance(it, random() % expected.size());
+            auto& [entity, state] = it->second;
+            if (action == 3) {
+                world.destroy(entity);
+                dead.push_back(entity);
+                expected.erase(it);
+            } else if (action == 4) {
+                world.add(entity, Velocity{static_cast<float>(state.position), 0.0f, 0.0f});
+                state.has_velocity = true;
+            } else if (action == 5) {
+                world.remove<Velocity>(entity);
+                state.has_velocity = false;
+            } else if (action == 6) {
+                world.add(entity, Name{state.position});
+                state.has_name = true;
+            } else {
+                world.remove<Name>(entity);
+                state.has_name = false;
+            }
+        }
+
+        REQUIRE(world.size() == expected.size());
+        CHECK(world.archetype_count() == 4);
+
+        for (const auto& [position, value] : expected) {
+            const auto& [entity, state] = value;
+            REQUIRE(world.alive(entity));
+            CHECK(world.get<Position>(entity).x == static_cast<float>(position));
+            CHECK(world.has<Velocity>(entity) == state.has_velocity);
+            CHECK(world.has<Name>(entity) == state.has_name);
+            if (state.has_name) {
+                CHECK(*world.get<Name>(entity).value == position);
+            }
+        }
+        // Slots are reused, but never by the same generation.
+        for (nbody::Entity entity : dead) {
+            CHECK(!world.alive(entity));
+        }
+
+        std::size_t visited = 0;
+        bool        matches = true;
+        world.each<Position, Velocity>([&](nbody::Entity entity, Position& position, Velocity& velocity) {
+            auto it = expected.find(static_cast<uint32_t>(position.x));
+            matches = matches && it != expected.end() && it->second.first == entity &&
+                      it->second.second.has_velocity && velocity.x == position.x;
+            ++visited;
+        });
+        CHECK(matches);
+
+        std::size_t with_velocity = 0;
+        for (const auto& [position, value] : expected) {
+            with_velocity += value.second.has_velocity ? 1 : 0;
+        }
+        CHECK(visited == with_velocity);
+
+        std::atomic<std::size_t> parallel_visited{0};
+        world.parallel_each_chunk<Position>([&](std::span<const nbody::Entity> entities, std::span<Position>) {
+            parallel_visited.fetch_add(entities.size(), std::memory_order_relaxed);
+        });
+        CHECK(parallel_visited.load() == expected.size());
+
+        std::size_t names = 0;
+        for (const auto& [position, value] : expected) {
+            names += value.second.has_name ? 1 : 0;
+        }
+        CHECK(Name::live == static_cast<int>(names));
+    }
+    // The world's destructor destroys the components still alive.
+    CHECK(Name::live == 0);
+}
@@ -0,0 +1,242 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "bodies.hpp"
+#include "ensemble.hpp"
+#include "kernels.hpp"
+#include "simd.hpp"
+
+namespace {
+    constexpr nbody::Isa ISAS[] = {nbody::Isa::SCALAR, nbody::Isa::NEON, nbody::Isa::AVX2, nbody::Isa::AVX512};
+
+    // Bodies of comparable mass in a unit cube, drifting slowly.
+    nbody::Bodies random_system(std::size_t count, std::mt19937_64& generator) {
+        std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> velocity(-0.1f, 0.1f);
+        std::uniform_real_distribution<float> mass(0.5f, 1.5f);
+
+        nbody::Bodies bodies;
+        for (std::size_t i = 0; i < count; ++i) {
+            bodies.push_back(position(generator), position(generator), position(generator), velocity(generator),
+                             velocity(generator), velocity(generator), mass(generator) / static_cast<float>(count));
+        }
+        return bodies;
+    }
+
+    double relative_error(double value, double exact) { return std::abs(value - exact) / std::abs(exact); }
+}  // namespace
+
+TEST_CASE("Packed kernels match the direct sum of every system") {
+    constexpr float EPS2 = 1.0e-4f;
+
+    std::mt19937_64            generator(28);
+    std::vector<nbody::Bodies> systems;
+    std::vector<uint32_t>      counts(nbody::PACKED_LANES, 0);
+
+    // Lane 3 stays empty, lane 5 holds a single body.
+    std::size_t body_count = 0;
+    for (std::size_t lane = 0; lane < nbody::PACKED_LANES; ++lane) {
+        std::size_t count = lane == 3 ? 0 : lane == 5 ? 1 : 2 + (lane * 7) % 19;
+        systems.push_back(random_system(count, generator));
+        counts[lane] = static_cast<uint32_t>(count);
+        body_count   = std::max(body_count, count);
+    }
+
+    // Everything past the count of a lane holds garbage, finite as the kernels require.
+    std::size_t                  size = body_count * nbody::PACKED_LANES;
+    nbody::aligned_vector<float> x(size, 7.0f), y(size, 7.0f), z(size, 7.0f), mass(size, 7.0f);
+    for (std::size_t lane = 0; lane < nbody::PACKED_LANES; ++lane) {
+        for (std::size_t i = 0; i < counts[lane]; ++i) {
+            x[i * nbody::PACKED_LANES + lane]    = systems[lane].x[i];
+            y[i * nbody::PACKED_LANES + lane]    = systems[lane].y[i];
+            z[i * nbody::PACKED_LANES + lane]    = systems[lane].z[i];
+            mass[i * nbody::PACKED_LANES + lane] = systems[lane].mass[i];
+        }
+    }
+
+    for (nbody::Isa isa : ISAS) {
+        if (!nbody::is_isa_supported(isa)) {
+            continue;
+        }
+        CAPTURE(nbody::isa_name(isa));
+
+        nbody::aligned_vector<float> ax(size, 1.0f), ay(size, 1.0f), az(size, 1.0f);
+        std::vector<float>           min_distance2(nbody::PACKED_LANES), max_pull(nbody::PACKED_LANES);
+        nbody::PackedSystems         packed{x.data(),
+                                    y.data(),
+                                    z.data(),
+                                    mass.data(),
+                                    ax.data(),
+                                    ay.data(),
+                                    az.data(),
+                                    counts.data(),
+                                    nbody::PACKED_LANES,
+                                    body_count,
+                                    min_distance2.data(),
+                                    max_pull.data()};
+        nbody::select_packed_systems_kernel(isa)(packed, EPS2);
+
+        double worst_acceleration = 0.0;
+        double worst_distance     = 0.0;
+        double worst_pull         = 0.0;
+        for (std::size_t lane = 0; lane < nbody::PACKED_LANES; ++lane) {
+            nbody::Bodies& system = systems[lane];
+            std::size_t    count  = counts[lane];
+            if (count == 0) {
+                continue;
+            }
+
+            std::fill(system.ax.begin(), system.ax.end(), 0.0f);
+            std::fill(system.ay.begin(), system.ay.end(), 0.0f);
+            std::fill(system.az.begin(), system.az.end(), 0.0f);
+            nbody::DirectSumTargets targets{system.x.data(),  system.y.data(),  system.z.data(), system.ax.data(),
+                                            system.ay.data(), system.az.data(), count};
+            nbody::DirectSumSources sources{system.x.data(), system.y.data(), system.z.data(), system.mass.data(),
+                                            count};
+            nbody::direct_sum_scalar<nbody::Precision::FP32>(targets, sources, EPS2);
+
+            double exact_distance2 = std::numeric_limits<double>::infinity();
+            double exact_pull      = 0.0;
+            for (std::size_t i = 0; i < count; ++i) {
+                std::size_t k  = i * nbody::PACKED_LANES + lane;
+                double      ex = std::hypot(system.ax[i], system.ay[i], system.az[i]);
+                double      dx = ax[k] - system.ax[i];
+                double      dy = ay[k] - system.ay[i];
+                double      dz = az[k] - system.az[i];
+                worst_acceleration = std::max(worst_acceleration, std::sqrt(dx * dx + dy * dy + dz * dz) / ex);
+
+                for (std::size_t j = i + 1; j < count; ++j) {
+                    double rx = system.x[j] - system.x[i];
+                    double ry = system.y[j] - system.y[i];
+                    double rz = system.z[j] - system.z[i];
+                    double d2 = rx * rx + ry * ry + rz * rz;
+                    double r2 = d2 + EPS2;
+                    exact_distance2 = std::min(exact_distance2, d2);
+                    exact_pull      = std::max(exact_pull, (system.mass[i] + system.mass[j]) / (r2 * std::sqrt(r2)));
+                }
+            }
+
+            if (count == 1) {
+                CHECK(std::isinf(min_distance2[lane]));
+                CHECK(max_pull[lane] == 0.0f);
+                CHECK(ax[lane] == 0.0f);
+            } else {
+                worst_distance = std::max(worst_distance, relative_error(min_distance2[lane], exact_distance2));
+                worst_pull     = std::max(worst_pull, relative_error(max_pull[lane], exact_pull));
+            }
+        }
+
+        CHECK(worst_acceleration < 1.0e-5);
+        CHECK(worst_distance < 1.0e-5);
+        CHECK(worst_pull < 1.0e-5);
+    }
+}
+
+TEST_CASE("Packed and unpacked ensembles step alike") {
+    constexpr std::size_t SYSTEM_COUNT = 45;
+
+    nbody::EnsembleSystemConfig system_config{};
+    system_config.end_time           = 0.5;
+    system_config.max_timestep       = 1.0e-2f;
+    system_config.encounter_distance = 0.02f;
+
+    nbody::EnsembleConfig packed_config{};
+    packed_config.softening = 0.01f;
+    packed_config.accuracy  = 0.01f;
+    nbody::EnsembleConfig unpacked_config = packed_config;
+    unpacked_config.max_packed_bodies     = 0;
+
+    // Sizes from 2 to 10 and one past the packing limit, so that both paths run within one ensemble too.
+    nbody::Ensemble packed(packed_config);
+    nbody::Ensemble unpacked(unpacked_config);
+    std::mt19937_64 generator(5);
+    for (std::size_t s = 0; s < SYSTEM_COUNT; ++s) {
+        std::size_t   count  = s == 0 ? packed_config.max_packed_bodies + 1 : 2 + s % 9;
+        nbody::Bodies bodies = random_system(count, generator);
+        packed.add_system(bodies, system_config);
+        unpacked.add_system(bodies, system_config);
+    }
+
+    // A handful of steps, before the orbits of neighbours in rounding drift apart.
+    for (int step = 0; step < 10; ++step) {
+        CHECK(packed.step() == unpacked.step());
+    }
+
+    double worst = 0.0;
+    for (std::size_t s = 0; s < SYSTEM_COUNT; ++s) {
+        const nbody::EnsembleSystem& a = packed.system(s);
+        const nbody::EnsembleSystem& b = unpacked.system(s);
+        CHECK(a.status == b.status);
+        CHECK(a.steps == b.steps);
+        CHECK(a.time == doctest::Approx(b.time).epsilon(1.0e-4));
+    }
+    for (std::size_t i = 0; i < packed.bodies().size(); ++i) {
+        worst = std::max<double>(worst, std::abs(packed.bodies().x[i] - unpacked.bodies().x[i]));
+        worst = std::max<double>(worst, std::abs(packed.bodies().vx[i] - unpacked.bodies().vx[i]));
+    }
+    CHECK(worst < 1.0e-4);
+
+    // Either path runs every system to whichever condition stops it first.
+    CHECK(packed.run() == 0);
+    CHECK(unpacked.run() == 0);
+}
+
+TEST_CASE("Close pairs stop a system or shorten its steps") {
+    nbody::Bodies pair;
+    pair.push_back(-0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f);
+    pair.push_back(0.5f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.5f);
+
+    nbody::Bodies on_top;
+    on_top.push_back(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f);
+    on_top.push_back(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f);
+
+    for (std::size_t max_packed_bodies : {std::size_t{0}, std::size_t{128}}) {
+        CAPTURE(max_packed_bodies);
+
+        nbody::EnsembleConfig config{};
+        config.max_packed_bodies = max_packed_bodies;
+
+        nbody::EnsembleSystemConfig approach{};
+        approach.end_time           = 10.0;
+        approach.encounter_distance = 0.1f;
+
+        nbody::EnsembleSystemConfig long_steps{};
+        long_steps.max_timestep = 1.0f;
+
+        nbody::EnsembleConfig adaptive = config;
+        adaptive.accuracy              = 0.1f;
+
+        // Enough copies of each for a packed group of their own.
+        nbody::Ensemble encounters(config);
+        nbody::Ensemble adaptive_steps(adaptive);
+        nbody::Ensemble coincident(adaptive);
+        for (std::size_t s = 0; s < nbody::PACKED_LANES; ++s) {
+            encounters.add_system(pair, approach);
+            adaptive_steps.add_system(pair, long_steps);
+            coincident.add_system(on_top);
+        }
+
+        encounters.run();
+        adaptive_steps.step();
+        coincident.step();
+        for (std::size_t s = 0; s < nbody::PACKED_LANES; ++s) {
+            const nbody::EnsembleSystem& system = encounters.system(s);
+            CHECK(system.status == nbody::EnsembleStatus::ENCOUNTER);
+            // Falling together, they close the gap before the 0.45 their speeds alone would take.
+            CHECK(system.time > 0.3);
+            CHECK(system.time < 0.45);
+
+            // The free fall time of the pair at unit distance is `sqrt(1 / G (m + m')) = 1`.
+            CHECK(adaptive_steps.system(s).time == doctest::Approx(0.1).epsilon(1.0e-4));
+            CHECK(coincident.system(s).status == nbody::EnsembleStatus::ENCOUNTER);
+        }
+    }
+}
@@ -0,0 +1,271 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "gpu_memory.hpp"
+
+// The allocator's driver calls against memory on the host, so that suballocation runs without a GPU. Defined in
+// the test binary, they take precedence over the ones of the Vulkan loader it links.
+
+namespace {
+    constexpr VkDeviceSize HEAP_SIZE       = VkDeviceSize{256} << 20;
+    constexpr VkDeviceSize BLOCK_SIZE      = VkDeviceSize{1} << 20;
+    constexpr VkDeviceSize STORAGE_ALIGN   = 64;
+    constexpr VkDeviceSize BUFFER_ALIGN    = 256;
+    constexpr uint32_t     DEVICE_TYPE     = 0;
+    constexpr uint32_t     HOST_TYPE       = 1;
+    constexpr uint32_t     ALL_MEMORY_BITS = 0b11;
+
+    class FakeMemory {
+       public:
+        std::vector<std::byte> bytes;
+        uint32_t               type;
+    };
+
+    class FakeBuffer {
+       public:
+        VkDeviceSize size;
+    };
+
+    int live_memory  = 0;
+    int live_buffers = 0;
+
+    // Any non-null handle, dispatchable handles are only passed through.
+    VkDevice device() noexcept { return reinterpret_cast<VkDevice>(&live_memory); }
+
+    VkPhysicalDevice physical_device() noexcept { return reinterpret_cast<VkPhysicalDevice>(&live_buffers); }
+
+    VkMemoryRequirements requirements(VkDeviceSize size, VkDeviceSize alignment,
+                                      uint32_t type_bits = ALL_MEMORY_BITS) noexcept {
+        return {size, alignment, type_bits};
+    }
+}  // namespace
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice, VkPhysicalDeviceProperties* properties) {
+    *properties                                        = {};
+    properties->limits.minStorageBufferOffsetAlignment = STORAGE_ALIGN;
+    properties->limits.minUniformBufferOffsetAlignment = BUFFER_ALIGN;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice,
+                                                               VkPhysicalDeviceMemoryProperties* properties) {
+    VkMemoryPropertyFlags host = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    *properties                          = {};
+    properties->memoryTypeCount          = 2;
+    properties->memoryTypes[DEVICE_TYPE] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0};
+    properties->memoryTypes[HOST_TYPE]   = {host, 1};
+    properties->memoryHeapCount          = 2;
+    properties->memoryHeaps[0]           = {HEAP_SIZE, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+    properties->memoryHeaps[1]           = {HEAP_SIZE, 0};
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo* info,
+                                                const VkAllocationCallbacks*, VkDeviceMemory* memory) {
+    auto* fake = new FakeMemory{std::vector<std::byte>(info->allocationSize), info->memoryTypeIndex};
+    *memory    = reinterpret_cast<VkDeviceMemory>(fake);
+    ++live_memory;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*) {
+    if (memory != VK_NULL_HANDLE) {
+        delete reinterpret_cast<FakeMemory*>(memory);
+        --live_memory;
+    }
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize,
+                                           VkMemoryMapFlags, void** data) {
+    auto* fake = reinterpret_cast<FakeMemory*>(memory);
+    if (fake->type != HOST_TYPE) {
+        return VK_ERROR_MEMORY_MAP_FAILED;
+    }
+    *data = fake->bytes.data() + offset;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice, const VkBufferCreateInfo* info, const VkAllocationCallbacks*,
+                                              VkBuffer* buffer) {
+    *buffer = reinterpret_cast<VkBuffer>(new FakeBuffer{info->size});
+    ++live_buffers;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements(VkDevice, VkBuffer buffer,
+                                                         VkMemoryRequirements* memory_requirements) {
+    *memory_requirements = requirements(reinterpret_cast<FakeBuffer*>(buffer)->size, BUFFER_ALIGN);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice, VkBuffer, VkDeviceMemory, VkDeviceSize) {
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice, VkBuffer buffer, const VkAllocationCallbacks*) {
+    if (buffer != VK_NULL_HANDLE) {
+        delete reinterpret_cast<FakeBuffer*>(buffer);
+        --live_buffers;
+    }
+}
+
+TEST_CASE("Randomized allocations never overlap and coalesce back into whole blocks") {
+    nbody::GpuAllocator allocator;
+    allocator.create(device(), physical_device(), BLOCK_SIZE);
+
+    class Live {
+       public:
+        nbody::GpuAllocation allocation;
+        uint8_t              pattern;
+    };
+
+    std::mt19937_64   random(25);
+    std::vector<Live> live;
+    bool              aligned   = true;
+    bool              in_block  = true;
+    bool              disjoint  = true;
+    bool              untouched = true;
+
+    // Offset to end of every live allocation, per block.
+    std::map<VkDeviceMemory, std::map<VkDeviceSize, VkDeviceSize>> ranges;
+
+    for (int round = 0; round < 20000; ++round) {
+        if (live.empty() || random() % 5 < 3) {
+            // Mostly small buffers, some past half a block that get blocks of their own.
+            bool               dedicated = random() % 50 == 0;
+            VkDeviceSize       size      = dedicated ? BLOCK_SIZE / 2 + 1 + random() % BLOCK_SIZE
+                                                     : 1 + random() % 20000;
+            VkDeviceSize       alignment = VkDeviceSize{1} << (random() % 13);
+            nbody::MemoryUsage usage     = random() % 2 ? nbody::MemoryUsage::HOST_UPLOAD
+                                                        : nbody::MemoryUsage::DEVICE_LOCAL;
+
+            Live entry{allocator.allocate(requirements(size, alignment), usage), static_cast<uint8_t>(round)};
+            const nbody::GpuAllocation& allocation = entry.allocation;
+
+            aligned  = aligned && allocation.offset % alignment == 0;
+            in_block = in_block && allocation.offset + allocation.size <=
+                                       reinterpret_cast<FakeMemory*>(allocation.memory)->bytes.size();
+
+            auto& block = ranges[allocation.memory];
+            auto  next  = block.lower_bound(allocation.offset);
+            disjoint    = disjoint && (next == block.end() || next->first >= allocation.offset + allocation.size);
+            if (next != block.begin()) {
+                disjoint = disjoint && std::prev(next)->second <= allocation.offset;
+            }
+            block[allocation.offset] = allocation.offset + allocation.size;
+
+            // Host visible memory is mapped where the allocation lives, and filled to catch overlaps later.
+            if (usage == nbody::MemoryUsage::HOST_UPLOAD) {
+                auto* fake = reinterpret_cast<FakeMemory*>(allocation.memory);
+                in_block   = in_block && allocation.mapped == fake->bytes.data() + allocation.offset;
+                std::memset(allocation.mapped, entry.pattern, allocation.size);
+            } else {
+                in_block = in_block && allocation.mapped == nullptr;
+            }
+            live.push_back(entry);
+        } else {
+            std::size_t index = random() % live.size();
+            Live        entry = live[index];
+            live[index]       = live.back();
+            live.pop_back();
+
+            nbody::GpuAllocation& allocation = entry.allocation;
+            if (allocation.mapped != nullptr) {
+                const auto* bytes = static_cast<const uint8_t*>(allocation.mapped);
+                for (VkDeviceSize i = 0; i < allocation.size; ++i) {
+                    untouched = untouched && bytes[i] == entry.pattern;
+                }
+            }
+            ranges[allocation.memory].erase(allocation.offset);
+            allocator.free(allocation);
+            CHECK(allocation.memory == VK_NULL_HANDLE);
+        }
+    }
+
+    CHECK(aligned);
+    CHECK(in_block);
+    CHECK(disjoint);
+    CHECK(untouched);
+    CHECK(allocator.stats().allocation_count == live.size());
+
+    for (Live& entry : live) {
+        allocator.free(entry.allocation);
+    }
+    nbody::GpuAllocatorStats stats = allocator.stats();
+    CHECK(stats.allocation_count == 0);
+    CHECK(stats.used_bytes == 0);
+    CHECK(stats.block_count > 0);
+
+    // Every block merged back into one free range, so each holds two buffers of half a block again. Filling
+    // them takes a new block only after as many halves as there are blocks twice.
+    std::size_t                       blocks = stats.block_count;
+    std::size_t                       limit  = blocks;
+    std::size_t                       fitted = 0;
+    std::vector<nbody::GpuAllocation> halves;
+    for (nbody::MemoryUsage usage : {nbody::MemoryUsage::HOST_UPLOAD, nbody::MemoryUsage::DEVICE_LOCAL}) {
+        for (;;) {
+            halves.push_back(allocator.allocate(requirements(BLOCK_SIZE / 2, 1), usage));
+            if (allocator.stats().block_count > limit) {
+                ++limit;
+                break;
+            }
+            ++fitted;
+        }
+    }
+    CHECK(fitted == 2 * blocks);
+    for (nbody::GpuAllocation& half : halves) {
+        allocator.free(half);
+    }
+
+    allocator.trim();
+    CHECK(allocator.stats().block_count == 0);
+    CHECK(live_memory == 0);
+    allocator.destroy();
+}
+
+TEST_CASE("Buffers and the ring share the allocator's blocks") {
+    nbody::GpuAllocator allocator;
+    allocator.create(device(), physical_device(), BLOCK_SIZE);
+
+    nbody::GpuAllocation first_allocation;
+    nbody::GpuAllocation second_allocation;
+    VkBuffer             first  = allocator.create_buffer(1000, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                          nbody::MemoryUsage::DEVICE_LOCAL, first_allocation);
+    VkBuffer             second = allocator.create_buffer(1000, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                          nbody::MemoryUsage::DEVICE_LOCAL, second_allocation);
+    CHECK(first_allocation.memory == second_allocation.memory);
+    CHECK(second_allocation.offset % BUFFER_ALIGN == 0);
+    CHECK(live_memory == 1);
+
+    nbody::GpuRing ring;
+    ring.create(allocator, 1000, 2, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+    CHECK(live_memory == 2);
+
+    ring.begin_frame(1);
+    nbody::GpuRingAllocation a = ring.allocate(10);
+    nbody::GpuRingAllocation b = ring.allocate(10);
+    CHECK(a.offset == 1024);
+    CHECK(b.offset == 1024 + BUFFER_ALIGN);
+    CHECK(static_cast<char*>(b.mapped) - static_cast<char*>(a.mapped) == static_cast<std::ptrdiff_t>(BUFFER_ALIGN));
+    CHECK_THROWS_AS(ring.allocate(1000), std::runtime_error);
+
+    // A frame slot starts over once it comes around again.
+    ring.begin_frame(1);
+    CHECK(ring.allocate(10).offset == 1024);
+
+    ring.destroy();
+    allocator.destroy_buffer(first, first_allocation);
+    allocator.destroy_buffer(second, second_allocation);
+    CHECK(first == VK_NULL_HANDLE);
+    CHECK(live_buffers == 0);
+
+    allocator.destroy();
+    CHECK(live_memory == 0);
+}
@@ -0,0 +1,130 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+#include "bodies.hpp"
+#include "diagnostics.hpp"
+#include "initial_conditions.hpp"
+#include "integrator.hpp"
+#include "solver.hpp"
+
+namespace {
+    constexpr float SOFTENING = 1.0e-3f;
+
+    nbody::SolverConfig direct_sum() {
+        nbody::SolverConfig config{};
+        config.kind      = nbody::SolverKind::DIRECT_SUM;
+        config.softening = SOFTENING;
+        return config;
+    }
+
+    nbody::BlockTimestepConfig block_config() {
+        nbody::BlockTimestepConfig config{};
+        config.max_timestep = 1.0e-2f;
+        config.softening    = SOFTENING;
+        return config;
+    }
+
+    // A Plummer sphere with a tight equal mass binary on a circular orbit of the softened potential, out where
+    // the cluster pulls little.
+    nbody::Bodies cluster_with_binary(std::size_t count) {
+        nbody::Bodies bodies = nbody::generate_initial_conditions(nbody::InitialConditions::PLUMMER, count, 9);
+
+        constexpr float MASS       = 0.01f;
+        constexpr float SEPARATION = 2.0e-3f;
+        float           r2         = SEPARATION * SEPARATION;
+        float           speed      = std::sqrt(2.0f * MASS * r2 / std::pow(r2 + SOFTENING * SOFTENING, 1.5f));
+
+        bodies.push_back(3.0f - 0.5f * SEPARATION, 0.0f, 0.0f, 0.0f, -0.5f * speed, 0.0f, MASS);
+        bodies.push_back(3.0f + 0.5f * SEPARATION, 0.0f, 0.0f, 0.0f, 0.5f * speed, 0.0f, MASS);
+        return bodies;
+    }
+
+    double total_energy(const nbody::Bodies& bodies) {
+        return nbody::kinetic_energy(bodies) + nbody::potential_energy(bodies, 1.0f, SOFTENING);
+    }
+}  // namespace
+
+TEST_CASE("A single level is plain kick-drift-kick leapfrog") {
+    nbody::Bodies initial = nbody::generate_initial_conditions(nbody::InitialConditions::PLUMMER, 512, 4);
+
+    nbody::BlockTimestepConfig config = block_config();
+    config.max_level                  = 0;
+
+    nbody::Bodies                  blocks = initial;
+    nbody::BlockTimestepIntegrator integrator(config);
+    std::unique_ptr<nbody::Solver> block_solver = nbody::make_solver(direct_sum());
+    nbody::Bodies                  plain        = initial;
+    std::unique_ptr<nbody::Solver> plain_solver = nbody::make_solver(direct_sum());
+    plain_solver->compute_accelerations(plain);
+
+    for (int step = 0; step < 20; ++step) {
+        integrator.step(blocks, *block_solver);
+        CHECK(integrator.substeps() == 1);
+
+        nbody::kick(plain, 0.5f * config.max_timestep);
+        nbody::drift(plain, config.max_timestep);
+        plain_solver->compute_accelerations(plain);
+        nbody::kick(plain, 0.5f * config.max_timestep);
+    }
+
+    bool identical = true;
+    for (std::size_t i = 0; i < initial.size(); ++i) {
+        identical = identical && blocks.x[i] == plain.x[i] && blocks.y[i] == plain.y[i] && blocks.z[i] == plain.z[i];
+        identical = identical && blocks.vx[i] == plain.vx[i] && blocks.vy[i] == plain.vy[i] &&
+                    blocks.vz[i] == plain.vz[i];
+    }
+    CHECK(identical);
+}
+
+TEST_CASE("A tight binary steps on deeper levels than its cluster") {
+    nbody::Bodies                  bodies = cluster_with_binary(512);
+    nbody::BlockTimestepIntegrator integrator(block_config());
+    std::unique_ptr<nbody::Solver> solver = nbody::make_solver(direct_sum());
+
+    // The first call computes every acceleration up front, the second one only steps.
+    integrator.step(bodies, *solver);
+    integrator.step(bodies, *solver);
+
+    std::size_t binary  = bodies.size() - 2;
+    uint32_t    deepest = 0;
+    for (std::size_t i = 0; i < binary; ++i) {
+        deepest = std::max<uint32_t>(deepest, integrator.levels()[i]);
+    }
+    CHECK(integrator.levels()[binary] >= deepest + 2);
+    CHECK(integrator.levels()[binary + 1] >= deepest + 2);
+
+    // Nearly every substep moves only the binary.
+    CHECK(integrator.substeps() >= 8);
+    CHECK(integrator.force_evaluations() * 4 < bodies.size() * integrator.substeps());
+}
+
+TEST_CASE("Block timesteps conserve energy") {
+    nbody::Bodies                  bodies = cluster_with_binary(256);
+    nbody::BlockTimestepIntegrator integrator(block_config());
+    std::unique_ptr<nbody::Solver> solver = nbody::make_solver(direct_sum());
+
+    double initial = total_energy(bodies);
+    double worst   = 0.0;
+    for (int step = 0; step < 100; ++step) {
+        integrator.step(bodies, *solver);
+        worst = std::max(worst, std::abs((total_energy(bodies) - initial) / initial));
+    }
+    CHECK(worst < 1.0e-3);
+}
+
+TEST_CASE("Levels past MAX_LEVEL are rejected") {
+    nbody::BlockTimestepConfig config{};
+    config.max_level = nbody::BlockTimestepIntegrator::MAX_LEVEL + 1;
+    CHECK_THROWS_AS(nbody::BlockTimestepIntegrator{config}, std::invalid_argument);
+
+    config.max_level = nbody::BlockTimestepIntegrator::MAX_LEVEL;
+    nbody::BlockTimestepIntegrator deepest(config);
+    CHECK(deepest.config().max_level == nbody::BlockTimestepIntegrator::MAX_LEVEL);
+}
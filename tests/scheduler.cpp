@@ -0,0 +1,147 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "scheduler.hpp"
+
+TEST_CASE("WorkStealingDeque pops newest first and steals oldest first") {
+    std::vector<nbody::Task> tasks(3);
+    nbody::WorkStealingDeque deque(2);
+
+    for (nbody::Task& task : tasks) {
+        deque.push(&task);
+    }
+
+    CHECK(deque.steal() == &tasks[0]);
+    CHECK(deque.pop() == &tasks[2]);
+    CHECK(deque.pop() == &tasks[1]);
+    CHECK(deque.pop() == nullptr);
+    CHECK(deque.steal() == nullptr);
+}
+
+TEST_CASE("WorkStealingDeque hands every task out exactly once under contention") {
+    constexpr std::size_t TASK_COUNT  = 200'000;
+    constexpr std::size_t THIEF_COUNT = 3;
+
+    std::vector<nbody::Task>      tasks(TASK_COUNT);
+    std::vector<std::atomic<int>> taken(TASK_COUNT);
+    std::atomic<std::size_t>      taken_count{0};
+    nbody::WorkStealingDeque      deque(16);
+
+    auto take = [&](nbody::Task* task) {
+        taken[static_cast<std::size_t>(task - tasks.data())].fetch_add(1, std::memory_order_relaxed);
+        taken_count.fetch_add(1, std::memory_order_relaxed);
+    };
+
+    std::vector<std::thread> thieves;
+    for (std::size_t i = 0; i < THIEF_COUNT; ++i) {
+        thieves.emplace_back([&] {
+            while (taken_count.load(std::memory_order_relaxed) < TASK_COUNT) {
+                if (nbody::Task* task = deque.steal()) {
+                    take(task);
+                }
+            }
+        });
+    }
+
+    // The owner pops one of every few tasks it pushes, racing the thieves for the last one.
+    for (std::size_t i = 0; i < TASK_COUNT; ++i) {
+        deque.push(&tasks[i]);
+        if (i % 3 == 0) {
+            if (nbody::Task* task = deque.pop()) {
+                take(task);
+            }
+        }
+    }
+    while (nbody::Task* task = deque.pop()) {
+        take(task);
+    }
+
+    for (std::thread& thief : thieves) {
+        thief.join();
+    }
+
+    std::size_t wrong = 0;
+    for (const std::atomic<int>& count : taken) {
+        wrong += count.load() != 1;
+    }
+    CHECK(wrong == 0);
+    CHECK(taken_count.load() == TASK_COUNT);
+}
+
+TEST_CASE("Scheduler::parallel_for covers the range once") {
+    nbody::Scheduler scheduler(3);
+
+    std::vector<std::atomic<int>> visits(100'003);
+    scheduler.parallel_for(0, visits.size(), 64, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            visits[i].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    std::size_t wrong = 0;
+    for (const std::atomic<int>& count : visits) {
+        wrong += count.load() != 1;
+    }
+    CHECK(wrong == 0);
+}
+
+TEST_CASE("Scheduler runs nested groups and rethrows from wait") {
+    nbody::Scheduler scheduler(2);
+
+    SUBCASE("nested") {
+        std::atomic<uint64_t> sum{0};
+        nbody::TaskGroup      outer;
+        for (uint64_t i = 0; i < 64; ++i) {
+            scheduler.spawn(outer, [&, i] {
+                nbody::TaskGroup inner;
+                for (uint64_t j = 0; j < 64; ++j) {
+                    scheduler.spawn(inner, [&, i, j] { sum.fetch_add(i * 64 + j, std::memory_order_relaxed); });
+                }
+                scheduler.wait(inner);
+            });
+        }
+        scheduler.wait(outer);
+
+        CHECK(outer.done());
+        CHECK(sum.load() == 4096 * 4095 / 2);
+    }
+
+    SUBCASE("exception") {
+        std::atomic<int> finished{0};
+        nbody::TaskGroup group;
+        for (int i = 0; i < 16; ++i) {
+            scheduler.spawn(group, [&, i] {
+                if (i == 7) {
+                    throw std::runtime_error("task failed");
+                }
+                finished.fetch_add(1);
+            });
+        }
+
+        CHECK_THROWS_AS(scheduler.wait(group), std::runtime_error);
+        CHECK(group.done());
+        CHECK(finished.load() == 15);
+    }
+}
+
+TEST_CASE("Scheduler finishes groups with parked workers") {
+    nbody::Scheduler scheduler(3);
+    scheduler.set_active_worker_count(0);
+
+    std::atomic<int> count{0};
+    nbody::TaskGroup group;
+    for (int i = 0; i < 100; ++i) {
+        scheduler.spawn(group, [&] { count.fetch_add(1); });
+    }
+    scheduler.wait(group);
+    CHECK(count.load() == 100);
+
+    scheduler.set_active_worker_count(scheduler.worker_count());
+}
@@ -0,0 +1,133 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "serialization.hpp"
+#include "telemetry.hpp"
+
+namespace {
+    nbody::SolverConfig sample_config() {
+        nbody::SolverConfig config{};
+        config.kind                   = nbody::SolverKind::FAST_MULTIPOLE;
+        config.softening              = 0.25f;
+        config.gravitational_constant = 4.0f;
+        config.isa                    = nbody::Isa::SCALAR;
+        config.precision              = nbody::Precision::COMPENSATED;
+        config.theta                  = 0.3f;
+        config.leaf_size              = 7;
+        config.rebuild_threshold      = 1.5f;
+        config.expansion_order        = 6;
+        return config;
+    }
+
+    void check_same_config(const nbody::SolverConfig& a, const nbody::SolverConfig& b) {
+        CHECK(a.kind == b.kind);
+        CHECK(a.softening == b.softening);
+        CHECK(a.gravitational_constant == b.gravitational_constant);
+        CHECK(a.isa == b.isa);
+        CHECK(a.precision == b.precision);
+        CHECK(a.theta == b.theta);
+        CHECK(a.leaf_size == b.leaf_size);
+        CHECK(a.rebuild_threshold == b.rebuild_threshold);
+        CHECK(a.expansion_order == b.expansion_order);
+    }
+
+    // Reads exactly `size` bytes, false when the server closed the connection first.
+    bool read_exactly(int socket, std::byte* data, std::size_t size) {
+        while (size > 0) {
+            ssize_t count = ::recv(socket, data, size, 0);
+            if (count <= 0) {
+                return false;
+            }
+            data += count;
+            size -= static_cast<std::size_t>(count);
+        }
+        return true;
+    }
+}  // namespace
+
+TEST_CASE("SolverConfig round trips every field") {
+    static_assert(serr::layout<nbody::SolverConfig>().size() == 9);
+
+    std::vector<std::byte> buffer;
+    serr::Writer           writer(buffer);
+    serr::encode(writer, sample_config());
+
+    nbody::SolverConfig decoded{};
+    serr::Reader        reader(buffer);
+    serr::decode(reader, decoded);
+    CHECK(reader.at_end());
+    check_same_config(decoded, sample_config());
+}
+
+TEST_CASE("Bodies round trip with the low parts of the positions") {
+    nbody::Bodies bodies;
+    for (int i = 0; i < 37; ++i) {
+        float f = static_cast<float>(i);
+        bodies.push_back(f, -f, 2.0f * f, 0.5f * f, 1.0f, -1.0f, 1.0f + f);
+        bodies.x_lo.back() = 1.0e-9f * f;
+        bodies.z_lo.back() = -1.0e-9f * f;
+    }
+
+    std::vector<std::byte> buffer;
+    serr::Writer           writer(buffer);
+    serr::encode(writer, bodies);
+
+    nbody::Bodies decoded;
+    serr::Reader  reader(buffer);
+    serr::decode(reader, decoded);
+    CHECK(decoded.x == bodies.x);
+    CHECK(decoded.vz == bodies.vz);
+    CHECK(decoded.mass == bodies.mass);
+    CHECK(decoded.x_lo == bodies.x_lo);
+    CHECK(decoded.y_lo == bodies.y_lo);
+    CHECK(decoded.z_lo == bodies.z_lo);
+}
+
+TEST_CASE("Telemetry keyframes carry the solver config") {
+    nbody::TelemetryConfig config{};
+    config.port   = 0;
+    config.solver = sample_config();
+    nbody::TelemetryServer server(config);
+
+    int viewer = ::socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(viewer >= 0);
+    sockaddr_in address{};
+    address.sin_family      = AF_INET;
+    address.sin_port        = htons(server.port());
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(::connect(viewer, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+
+    nbody::Bodies bodies;
+    for (int i = 0; i < 10; ++i) {
+        bodies.push_back(static_cast<float>(i), 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    // The server thread accepts the viewer on its own time, publishing is refused until then.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!server.publish(bodies, {}) && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    uint32_t size = 0;
+    REQUIRE(read_exactly(viewer, reinterpret_cast<std::byte*>(&size), sizeof(size)));
+    std::vector<std::byte> message(size);
+    REQUIRE(read_exactly(viewer, message.data(), message.size()));
+    ::close(viewer);
+
+    nbody::TelemetryDecoder decoder;
+    REQUIRE(decoder.decode(message));
+    CHECK(decoder.frame().keyframe);
+    REQUIRE(decoder.frame().solver.has_value());
+    check_same_config(*decoder.frame().solver, sample_config());
+}
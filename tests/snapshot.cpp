@@ -0,0 +1,187 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bodies.hpp"
+#include "snapshot.hpp"
+
+namespace {
+    // Removes its file on the way out, also when a check fails.
+    class TemporaryFile {
+       public:
+        explicit TemporaryFile(const char* name)
+            : path(std::filesystem::temp_directory_path() / (std::to_string(::getpid()) + "_" + name)) {}
+        ~TemporaryFile() { std::filesystem::remove(path); }
+
+        std::filesystem::path path;
+    };
+
+    nbody::Bodies random_bodies(std::size_t count, uint64_t seed) {
+        std::mt19937_64                       generator(seed);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        nbody::Bodies bodies;
+        for (std::size_t i = 0; i < count; ++i) {
+            bodies.push_back(unit(generator), unit(generator), unit(generator), unit(generator), unit(generator),
+                             unit(generator), 1.0f / static_cast<float>(count));
+        }
+        return bodies;
+    }
+
+    void check_same_state(const nbody::Bodies& loaded, const nbody::Bodies& written) {
+        REQUIRE(loaded.size() == written.size());
+        CHECK(loaded.x == written.x);
+        CHECK(loaded.y == written.y);
+        CHECK(loaded.z == written.z);
+        CHECK(loaded.vx == written.vx);
+        CHECK(loaded.vy == written.vy);
+        CHECK(loaded.vz == written.vz);
+        CHECK(loaded.mass == written.mass);
+    }
+}  // namespace
+
+TEST_CASE("Snapshots round trip through the writer and the mapping") {
+    TemporaryFile file("round_trip.snap");
+
+    // Masses run length encode, positions are noise and stay raw even when asked to encode.
+    nbody::SnapshotWriterConfig config{};
+    config.encodings[static_cast<std::size_t>(nbody::SnapshotColumn::MASS)] = nbody::ColumnEncoding::SHUFFLED_RLE;
+    config.encodings[static_cast<std::size_t>(nbody::SnapshotColumn::X)]    = nbody::ColumnEncoding::SHUFFLED_RLE;
+
+    std::vector<nbody::Bodies> frames = {random_bodies(1000, 1), random_bodies(1000, 2), random_bodies(37, 3)};
+    {
+        nbody::SnapshotWriter writer(file.path, config);
+        for (std::size_t i = 0; i < frames.size(); ++i) {
+            writer.write(frames[i], 10 * i, 0.5 * static_cast<double>(i));
+        }
+        writer.close();
+        CHECK_THROWS_AS(writer.write(frames[0], 0, 0.0), std::runtime_error);
+    }
+
+    nbody::SnapshotFile snapshot(file.path);
+    REQUIRE(snapshot.size() == frames.size());
+
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        const nbody::SnapshotFrame& frame = snapshot.frame(i);
+        CHECK(frame.step == 10 * i);
+        CHECK(frame.time == 0.5 * static_cast<double>(i));
+        CHECK(frame.body_count == frames[i].size());
+
+        nbody::Bodies loaded;
+        snapshot.load(i, loaded);
+        check_same_state(loaded, frames[i]);
+    }
+
+    const nbody::SnapshotFrame& first = snapshot.frame(0);
+    CHECK(first.columns[static_cast<std::size_t>(nbody::SnapshotColumn::MASS)].encoding ==
+          static_cast<uint32_t>(nbody::ColumnEncoding::SHUFFLED_RLE));
+    CHECK(first.columns[static_cast<std::size_t>(nbody::SnapshotColumn::X)].encoding ==
+          static_cast<uint32_t>(nbody::ColumnEncoding::RAW));
+
+    std::span<const float> y = snapshot.column(1, nbody::SnapshotColumn::Y);
+    CHECK(reinterpret_cast<uintptr_t>(y.data()) % nbody::SIMD_ALIGNMENT == 0);
+    CHECK(std::equal(y.begin(), y.end(), frames[1].y.begin(), frames[1].y.end()));
+    CHECK_THROWS_AS(snapshot.column(0, nbody::SnapshotColumn::MASS), std::runtime_error);
+
+    CHECK(snapshot.find(0.0) == 0);
+    CHECK(snapshot.find(0.25) == 1);
+    CHECK(snapshot.find(1.0) == 2);
+    CHECK(snapshot.find(2.0) == snapshot.size());
+}
+
+TEST_CASE("Appending drops a torn frame and continues after the complete ones") {
+    TemporaryFile file("append.snap");
+
+    nbody::Bodies first  = random_bodies(500, 4);
+    nbody::Bodies second = random_bodies(500, 5);
+    {
+        nbody::SnapshotWriter writer(file.path);
+        writer.write(first, 0, 0.0);
+        writer.write(second, 1, 1.0);
+    }
+
+    // A crash in the middle of the second frame.
+    std::filesystem::resize_file(file.path, std::filesystem::file_size(file.path) - 100);
+    CHECK(nbody::SnapshotFile(file.path).size() == 1);
+
+    nbody::Bodies third = random_bodies(200, 6);
+    {
+        nbody::SnapshotWriterConfig config{};
+        config.append = true;
+        nbody::SnapshotWriter writer(file.path, config);
+        writer.write(third, 2, 2.0);
+    }
+
+    nbody::SnapshotFile snapshot(file.path);
+    REQUIRE(snapshot.size() == 2);
+    CHECK(snapshot.frame(1).step == 2);
+
+    nbody::Bodies loaded;
+    snapshot.load(0, loaded);
+    check_same_state(loaded, first);
+    snapshot.load(1, loaded);
+    check_same_state(loaded, third);
+}
+
+TEST_CASE("Low parts are stored only when non-zero and never leak between loads") {
+    TemporaryFile file("low_parts.snap");
+
+    // Low parts of the first bodies only, the rest count as zero.
+    nbody::Bodies compensated = random_bodies(300, 7);
+    compensated.x_lo.assign(100, 1.0e-8f);
+    compensated.y_lo.assign(100, -2.0e-8f);
+    compensated.z_lo.assign(100, 3.0e-8f);
+    nbody::Bodies single = random_bodies(300, 8);
+
+    nbody::SnapshotWriterConfig config{};
+    config.encodings[static_cast<std::size_t>(nbody::SnapshotColumn::Y_LO)] = nbody::ColumnEncoding::SHUFFLED_RLE;
+    {
+        nbody::SnapshotWriter writer(file.path, config);
+        writer.write(compensated, 0, 0.0);
+        writer.write(single, 1, 1.0);
+    }
+
+    nbody::SnapshotFile snapshot(file.path);
+    REQUIRE(snapshot.size() == 2);
+    CHECK(snapshot.frame(0).column_count == nbody::SNAPSHOT_COLUMN_COUNT);
+    CHECK(snapshot.frame(1).column_count == nbody::SNAPSHOT_COLUMN_COUNT_NO_LOW);
+    CHECK(snapshot.frame(0).columns[static_cast<std::size_t>(nbody::SnapshotColumn::Y_LO)].encoding ==
+          static_cast<uint32_t>(nbody::ColumnEncoding::SHUFFLED_RLE));
+    CHECK(snapshot.column(0, nbody::SnapshotColumn::Z_LO)[99] == 3.0e-8f);
+    CHECK_THROWS_AS(snapshot.column(1, nbody::SnapshotColumn::X_LO), std::runtime_error);
+
+    compensated.resize_low_parts();
+    nbody::Bodies loaded;
+    snapshot.load(0, loaded);
+    check_same_state(loaded, compensated);
+    CHECK(loaded.x_lo == compensated.x_lo);
+    CHECK(loaded.y_lo == compensated.y_lo);
+    CHECK(loaded.z_lo == compensated.z_lo);
+
+    snapshot.load(1, loaded);
+    check_same_state(loaded, single);
+    CHECK(std::all_of(loaded.x_lo.begin(), loaded.x_lo.end(), [](float value) { return value == 0.0f; }));
+    CHECK(std::all_of(loaded.y_lo.begin(), loaded.y_lo.end(), [](float value) { return value == 0.0f; }));
+    CHECK(std::all_of(loaded.z_lo.begin(), loaded.z_lo.end(), [](float value) { return value == 0.0f; }));
+}
+
+TEST_CASE("Opening a file that is no snapshot throws") {
+    TemporaryFile file("garbage.snap");
+    {
+        std::ofstream stream(file.path, std::ios::binary);
+        stream << std::string(4096, 'x');
+    }
+    CHECK_THROWS_AS(nbody::SnapshotFile(file.path), std::runtime_error);
+}
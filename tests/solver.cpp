@@ -0,0 +1,186 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "barnes_hut.hpp"
+#include "bodies.hpp"
+#include "initial_conditions.hpp"
+#include "integrator.hpp"
+#include "octree.hpp"
+#include "solver.hpp"
+
+namespace {
+    constexpr std::size_t BODY_COUNT = 4096;
+
+    nbody::Bodies accelerations(const nbody::SolverConfig& config, const nbody::Bodies& initial) {
+        nbody::Bodies bodies = initial;
+        make_solver(config)->compute_accelerations(bodies);
+        return bodies;
+    }
+
+    // Root mean square of the error of every acceleration relative to its exact magnitude.
+    double rms_relative_error(const nbody::Bodies& approximate, const nbody::Bodies& exact) {
+        double sum = 0.0;
+        for (std::size_t i = 0; i < exact.size(); ++i) {
+            double dx        = approximate.ax[i] - exact.ax[i];
+            double dy        = approximate.ay[i] - exact.ay[i];
+            double dz        = approximate.az[i] - exact.az[i];
+            double magnitude = std::hypot(exact.ax[i], exact.ay[i], exact.az[i]);
+            sum += (dx * dx + dy * dy + dz * dz) / (magnitude * magnitude);
+        }
+        return std::sqrt(sum / static_cast<double>(exact.size()));
+    }
+
+    nbody::SolverConfig config_of(nbody::SolverKind kind) {
+        nbody::SolverConfig config{};
+        config.kind = kind;
+        return config;
+    }
+}  // namespace
+
+TEST_CASE("Tree codes approach the direct sum") {
+    nbody::Bodies initial = nbody::generate_initial_conditions(nbody::InitialConditions::PLUMMER, BODY_COUNT, 7);
+    nbody::Bodies exact   = accelerations(config_of(nbody::SolverKind::DIRECT_SUM), initial);
+
+    SUBCASE("Barnes-Hut") {
+        nbody::SolverConfig config = config_of(nbody::SolverKind::BARNES_HUT);
+
+        config.theta        = 0.0f;
+        double opened_error = rms_relative_error(accelerations(config, initial), exact);
+        config.theta        = 0.3f;
+        double fine_error   = rms_relative_error(accelerations(config, initial), exact);
+        config.theta        = 0.7f;
+        double coarse_error = rms_relative_error(accelerations(config, initial), exact);
+
+        // Opening every cell leaves only the rounding of another summation order.
+        CHECK(opened_error < 1.0e-6);
+        CHECK(fine_error < 2.0e-3);
+        CHECK(coarse_error < 1.0e-2);
+        CHECK(fine_error < coarse_error);
+    }
+
+    SUBCASE("fast multipole") {
+        nbody::SolverConfig config = config_of(nbody::SolverKind::FAST_MULTIPOLE);
+
+        config.expansion_order = 2;
+        double low_error       = rms_relative_error(accelerations(config, initial), exact);
+        config.expansion_order = 6;
+        double high_error      = rms_relative_error(accelerations(config, initial), exact);
+
+        CHECK(low_error < 3.0e-2);
+        CHECK(high_error < 2.0e-3);
+        CHECK(high_error < low_error);
+    }
+}
+
+TEST_CASE("Active accelerations match those of every body") {
+    nbody::Bodies initial = nbody::generate_initial_conditions(nbody::InitialConditions::UNIFORM_CUBE, 1024, 3);
+
+    std::vector<uint32_t> active;
+    for (uint32_t i = 0; i < initial.size(); i += 5) {
+        active.push_back(i);
+    }
+
+    for (nbody::SolverKind kind :
+         {nbody::SolverKind::DIRECT_SUM, nbody::SolverKind::BARNES_HUT, nbody::SolverKind::FAST_MULTIPOLE}) {
+        nbody::SolverConfig config = config_of(kind);
+        nbody::Bodies       all    = accelerations(config, initial);
+
+        nbody::Bodies subset = initial;
+        make_solver(config)->compute_active_accelerations(subset, active);
+
+        for (uint32_t i : active) {
+            CHECK(subset.ax[i] == doctest::Approx(all.ax[i]).epsilon(1.0e-4));
+            CHECK(subset.ay[i] == doctest::Approx(all.ay[i]).epsilon(1.0e-4));
+            CHECK(subset.az[i] == doctest::Approx(all.az[i]).epsilon(1.0e-4));
+        }
+    }
+}
+
+namespace {
+    // Leapfrog steps of a Barnes-Hut solver refitting its tree, long enough that it rebuilds a few times. Returns
+    // the extent growth after every step.
+    std::vector<double> drift_refitted(nbody::Bodies& bodies, nbody::BarnesHut& solver, int steps) {
+        constexpr float TIMESTEP = 2.0e-2f;
+
+        std::vector<double> growth;
+        solver.compute_accelerations(bodies);
+        for (int step = 0; step < steps; ++step) {
+            nbody::kick(bodies, 0.5f * TIMESTEP);
+            nbody::drift(bodies, TIMESTEP);
+            solver.compute_accelerations(bodies);
+            nbody::kick(bodies, 0.5f * TIMESTEP);
+            growth.push_back(solver.tree().extent_growth());
+        }
+        return growth;
+    }
+
+    nbody::BarnesHutConfig refitting_config() {
+        nbody::BarnesHutConfig config{};
+        config.rebuild_threshold = 1.05f;
+        return config;
+    }
+}  // namespace
+
+TEST_CASE("Refitted trees stay within the opening angle error of a fresh one") {
+    nbody::Bodies bodies = nbody::generate_initial_conditions(nbody::InitialConditions::PLUMMER, BODY_COUNT, 11);
+
+    // At the default 0.5 a fresh tree alone is about 3e-3 off the direct sum, which would hide the refit.
+    nbody::BarnesHutConfig config = refitting_config();
+    config.theta                  = 0.3f;
+    nbody::BarnesHut    solver(config);
+    std::vector<double> growth = drift_refitted(bodies, solver, 20);
+
+    // Growth past the threshold starts a rebuild, and the next step swaps it in and refits it.
+    bool swapped = false;
+    for (std::size_t step = 1; step < growth.size(); ++step) {
+        swapped = swapped || (growth[step - 1] > config.rebuild_threshold && growth[step] < config.rebuild_threshold);
+    }
+    CHECK(swapped);
+
+    nbody::BarnesHutConfig fresh_config = config;
+    fresh_config.rebuild_threshold      = 0.0f;
+    nbody::Bodies fresh                 = bodies;
+    nbody::BarnesHut(fresh_config).compute_accelerations(fresh);
+    nbody::Bodies exact = accelerations(config_of(nbody::SolverKind::DIRECT_SUM), bodies);
+
+    CHECK(rms_relative_error(bodies, fresh) < 1.2e-3);
+    CHECK(rms_relative_error(bodies, exact) < 1.1 * rms_relative_error(fresh, exact));
+}
+
+TEST_CASE("Refitting needs the body count of the last build") {
+    nbody::Bodies bodies = nbody::generate_initial_conditions(nbody::InitialConditions::UNIFORM_CUBE, 1000, 2);
+
+    nbody::Octree tree;
+    tree.build(bodies, 16);
+    tree.refit(bodies);
+    CHECK(tree.extent_growth() == doctest::Approx(1.0));
+
+    bodies.push_back(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+    CHECK_THROWS_AS(tree.refit(bodies), std::runtime_error);
+}
+
+TEST_CASE("Background rebuilds keep runs deterministic") {
+    nbody::Bodies initial = nbody::generate_initial_conditions(nbody::InitialConditions::PLUMMER, BODY_COUNT, 12);
+
+    nbody::Bodies    first = initial;
+    nbody::BarnesHut first_solver(refitting_config());
+    drift_refitted(first, first_solver, 12);
+
+    nbody::Bodies    second = initial;
+    nbody::BarnesHut second_solver(refitting_config());
+    drift_refitted(second, second_solver, 12);
+
+    bool identical = true;
+    for (std::size_t i = 0; i < initial.size(); ++i) {
+        identical = identical && first.ax[i] == second.ax[i] && first.ay[i] == second.ay[i] &&
+                    first.az[i] == second.az[i];
+    }
+    CHECK(identical);
+}
@@ -0,0 +1,182 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "sser_binary.hpp"
+
+TEST_CASE("Scalars, strings and atoms round trip") {
+    std::vector<std::byte> buffer;
+    serr::Writer           writer(buffer);
+
+    writer.write_uint(0);
+    writer.write_uint(std::numeric_limits<uint64_t>::max());
+    writer.write_int(-1);
+    writer.write_int(std::numeric_limits<int64_t>::min());
+    writer.write_int(std::numeric_limits<int64_t>::max());
+    writer.write_float(-0.5f);
+    writer.write_double(1.0e300);
+    writer.write_bool(true);
+    writer.write_string("");
+    writer.write_string("bodies");
+    writer.write_atom("keyframe");
+    writer.write_atom("delta");
+    writer.write_atom("keyframe");
+
+    serr::Reader reader(buffer);
+    CHECK(reader.read_uint() == 0);
+    CHECK(reader.read_uint() == std::numeric_limits<uint64_t>::max());
+    CHECK(reader.peek() == serr::Unit::INT);
+    CHECK(reader.read_int() == -1);
+    CHECK(reader.read_int() == std::numeric_limits<int64_t>::min());
+    CHECK(reader.read_int() == std::numeric_limits<int64_t>::max());
+    CHECK(reader.read_float() == -0.5f);
+    CHECK(reader.read_double() == 1.0e300);
+    CHECK(reader.read_bool());
+    CHECK(reader.read_string().empty());
+    CHECK(reader.read_string() == "bodies");
+    CHECK(reader.read_atom() == "keyframe");
+    CHECK(reader.read_atom() == "delta");
+    CHECK(reader.read_atom() == "keyframe");
+    CHECK(reader.at_end());
+}
+
+TEST_CASE("A repeated atom only sends its id") {
+    std::vector<std::byte> buffer;
+    serr::Writer           writer(buffer);
+
+    writer.write_atom("a_long_atom_name");
+    std::size_t first = writer.size();
+    writer.write_atom("a_long_atom_name");
+    CHECK(writer.size() - first == 2);
+
+    // A new stream defines every atom again.
+    writer.reset();
+    writer.write_atom("a_long_atom_name");
+    CHECK(writer.size() == first);
+}
+
+TEST_CASE("Tables and arrays nest, skip and view in place") {
+    std::vector<std::byte> buffer;
+    serr::Writer           writer(buffer);
+
+    std::array<double, 5>  doubles = {1.0, 2.0, 3.0, 4.0, 5.0};
+    std::array<int16_t, 3> shorts  = {-3, 0, 3};
+
+    writer.begin_table(4);
+    writer.write_key("name");
+    writer.write_string("plummer");
+    writer.write_key("mixed");
+    writer.begin_array(2);
+    writer.write_uint(7);
+    writer.write_atom("seven");
+    writer.write_key("doubles");
+    writer.write_array<double>(doubles);
+    writer.write_key("shorts");
+    writer.write_array<int16_t>(shorts);
+
+    serr::Reader reader(buffer);
+    REQUIRE(reader.begin_table() == 4);
+    CHECK(reader.read_key() == "name");
+    reader.skip();
+
+    CHECK(reader.read_key() == "mixed");
+    serr::ArrayHeader mixed = reader.begin_array();
+    REQUIRE(reader.is_mixed(mixed));
+    CHECK(mixed.count == 2);
+    CHECK(reader.read_uint() == 7);
+    CHECK(reader.read_atom() == "seven");
+
+    CHECK(reader.read_key() == "doubles");
+    serr::ArrayHeader doubles_header = reader.begin_array();
+    CHECK(doubles_header.element_unit == serr::Unit::DOUBLE);
+    std::span<const double> view = reader.view_array<double>(doubles_header);
+    CHECK(reinterpret_cast<std::uintptr_t>(view.data()) % alignof(double) == 0);
+    CHECK(std::equal(view.begin(), view.end(), doubles.begin(), doubles.end()));
+
+    CHECK(reader.read_key() == "shorts");
+    serr::ArrayHeader      shorts_header = reader.begin_array();
+    std::array<int16_t, 3> read_shorts{};
+    reader.read_array<int16_t>(shorts_header, read_shorts);
+    CHECK(read_shorts == shorts);
+    CHECK(reader.at_end());
+}
+
+TEST_CASE("External arrays read back as the stream write_array writes") {
+    std::vector<int32_t> values(1000);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<int32_t>(i * i) - 5000;
+    }
+
+    std::vector<std::byte> inline_buffer;
+    serr::Writer           inline_writer(inline_buffer);
+    inline_writer.begin_table(2);
+    inline_writer.write_key("x");
+    inline_writer.write_array<int32_t>(values);
+    inline_writer.write_key("after");
+    inline_writer.write_uint(3);
+
+    std::vector<std::byte> buffer;
+    serr::Writer           writer(buffer);
+    writer.begin_table(2);
+    writer.write_key("x");
+    writer.write_external_array<int32_t>(values);
+    writer.write_key("after");
+    writer.write_uint(3);
+
+    REQUIRE(writer.external().size() == 1);
+    CHECK(writer.stream_size() == inline_writer.size());
+
+    // What a gather write sends.
+    const serr::ExternalArray& external = writer.external()[0];
+    std::vector<std::byte>     gathered(buffer.begin(), buffer.begin() + external.offset);
+    gathered.insert(gathered.end(), external.data, external.data + external.size);
+    gathered.insert(gathered.end(), buffer.begin() + external.offset, buffer.end());
+    CHECK(gathered == inline_buffer);
+}
+
+TEST_CASE("A fixed buffer counts past its end") {
+    std::array<std::byte, 8> storage{};
+    serr::Writer             writer(storage);
+
+    writer.write_string("longer than eight bytes");
+    CHECK(writer.overflowed());
+    CHECK(writer.size() == 2 + 23);
+    CHECK(writer.data().size() == storage.size());
+}
+
+TEST_CASE("Malformed input and reads of the wrong unit throw") {
+    std::vector<std::byte> buffer;
+    serr::Writer           writer(buffer);
+    writer.write_string("truncated");
+    writer.write_uint(1);
+
+    SUBCASE("wrong unit") {
+        serr::Reader reader(buffer);
+        CHECK_THROWS_AS(reader.read_uint(), std::runtime_error);
+    }
+
+    SUBCASE("truncated") {
+        serr::Reader reader(std::span<const std::byte>(buffer).first(5));
+        CHECK_THROWS_AS(reader.read_string(), std::runtime_error);
+    }
+
+    SUBCASE("unknown atom id") {
+        std::vector<std::byte> atoms;
+        serr::Writer           atom_writer(atoms);
+        atom_writer.write_atom("first");
+        atom_writer.write_atom("first");
+
+        // Only the use, without the definition.
+        std::span<const std::byte> use = std::span<const std::byte>(atoms).last(2);
+        serr::Reader               reader(use);
+        CHECK_THROWS_AS(reader.read_atom(), std::runtime_error);
+    }
+}
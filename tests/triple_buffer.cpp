@@ -0,0 +1,104 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "triple_buffer.hpp"
+
+namespace {
+    // Every word derived from the sequence number, so that a value mixed from two publishes shows.
+    class Sample {
+       public:
+        uint64_t                 sequence = 0;
+        std::array<uint64_t, 15> words    = {};
+
+        void set(uint64_t value) noexcept {
+            sequence = value;
+            for (std::size_t i = 0; i < words.size(); ++i) {
+                words[i] = value * (i + 1);
+            }
+        }
+
+        bool consistent() const noexcept {
+            for (std::size_t i = 0; i < words.size(); ++i) {
+                if (words[i] != sequence * (i + 1)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+}  // namespace
+
+TEST_CASE("TripleBuffer hands over the latest value only") {
+    nbody::TripleBuffer<int> buffer;
+    buffer.fill(-1);
+    CHECK(!buffer.update());
+    CHECK(buffer.front() == -1);
+
+    buffer.back() = 1;
+    buffer.publish();
+    CHECK(buffer.update());
+    CHECK(buffer.front() == 1);
+    CHECK(!buffer.update());
+
+    // The second publish replaces the first before the consumer looked.
+    buffer.back() = 2;
+    buffer.publish();
+    buffer.back() = 3;
+    buffer.publish();
+    CHECK(buffer.update());
+    CHECK(buffer.front() == 3);
+    CHECK(!buffer.update());
+    CHECK(buffer.front() == 3);
+
+    // The producer never writes into the slot the consumer reads.
+    buffer.back() = 4;
+    CHECK(buffer.front() == 3);
+}
+
+TEST_CASE("TripleBuffer never tears or reorders values across threads") {
+    constexpr uint64_t PUBLISHES = 200000;
+
+    nbody::TripleBuffer<Sample> buffer;
+    buffer.fill(Sample{});
+
+    std::atomic<bool> done{false};
+    std::thread       producer([&] {
+        for (uint64_t sequence = 1; sequence <= PUBLISHES; ++sequence) {
+            buffer.back().set(sequence);
+            buffer.publish();
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    uint64_t last     = 0;
+    uint64_t updates  = 0;
+    bool     in_order = true;
+    bool     whole    = true;
+    for (;;) {
+        // Read before the update, so that nothing is left once the producer was seen done and nothing is fresh.
+        bool finished = done.load(std::memory_order_acquire);
+        if (buffer.update()) {
+            const Sample& sample = buffer.front();
+            whole                = whole && sample.consistent();
+            in_order             = in_order && sample.sequence > last;
+            last                 = sample.sequence;
+            ++updates;
+        } else if (finished) {
+            break;
+        }
+    }
+    producer.join();
+
+    CHECK(whole);
+    CHECK(in_order);
+    CHECK(updates > 0);
+    CHECK(updates <= PUBLISHES);
+    // Whatever was dropped on the way, the final value arrives.
+    CHECK(buffer.front().sequence == PUBLISHES);
+}